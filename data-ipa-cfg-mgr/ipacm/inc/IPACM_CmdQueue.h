@@ -40,7 +40,9 @@ IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define IPA_CONNTRACK_MESSAGE_H
 
 #include <pthread.h>
+#include <string.h>
 #include "IPACM_Defs.h"
+#include "IPACM_EvtPool.h"
 
 
 
@@ -60,6 +62,47 @@ typedef struct cmd_s
 	ipacm_cmd_q_data data;
 }cmd_t;
 
+/* ring slots, power of 2 */
+#define IPACM_CMD_QUEUE_SIZE 1024
+
+typedef struct cmd_slot_s
+{
+	uint32_t seq;
+	cmd_t evt;
+}cmd_slot_t;
+
+/* external events looked at together for coalescing */
+#define IPACM_CMD_STAGE_SIZE 64
+#define IPACM_EVT_KEY_LEN 72
+
+/* Coalescing key of an event. The first obj_len bytes name the object
+	 the event is about, the rest is what the event says about it */
+typedef struct
+{
+	uint8_t len;
+	uint8_t obj_len;
+	uint8_t data[IPACM_EVT_KEY_LEN];
+}ipacm_evt_key;
+
+static inline void ipacm_evt_key_add(ipacm_evt_key *key, const void *buf, uint8_t len)
+{
+	memcpy(&key->data[key->len], buf, len);
+	key->len += len;
+}
+
+/* fills the key, false when the event must not be coalesced */
+typedef bool (*ipacm_evt_key_fn)(const ipacm_cmd_q_data *data, ipacm_evt_key *key);
+/* releases the payload of a squashed event */
+typedef void (*ipacm_evt_drop_fn)(ipacm_cmd_q_data *data);
+
+typedef struct cmd_stage_s
+{
+	cmd_t evt;
+	bool keyed;
+	bool squashed;
+	ipacm_evt_key key;
+}cmd_stage_t;
+
 class Message
 {
 private:
@@ -74,35 +117,68 @@ public:
 		evt.callback_ptr = NULL;
 	}
 	~Message() { }
+	static void* operator new(size_t size) throw() { return IPACM_EvtPool::Alloc(size); }
+	static void operator delete(void *ptr) { IPACM_EvtPool::Free(ptr); }
 	void setnext(Message *item) { m_next = item; }
 	Message* getnext()       { return m_next; }
 };
 
+/* Bounded lock free ring, any thread posts and the Process() thread
+	 is the only consumer. A slot is ready to be filled when its seq
+	 equals the producer position and ready to be consumed when it is
+	 one past it. Events posted while the ring is full go to a locked
+	 list of Message, and so do the ones posted after them until that
+	 list is drained, to keep the order. Posting never blocks, the
+	 consumer posts events too */
 class MessageQueue
 {
 
 private:
+	cmd_slot_t ring[IPACM_CMD_QUEUE_SIZE];
+	uint32_t ring_tail;
+	uint32_t ring_head;
+
 	Message *Head;
 	Message *Tail;
-	Message* dequeue(void);
+	uint32_t overflow_cnt;
+
+	bool push(const cmd_t *evt);
+	bool pending(void);
+	static void wakeup(void);
+
 	static MessageQueue *inst_internal;
 	static MessageQueue *inst_external;
+	static int evt_fd;
+	static uint32_t consumer_waiting;
 
-	MessageQueue()
-	{
-		Head = NULL;
-		Tail = NULL;
-	}
+	static ipacm_evt_key_fn key_fn[IPACM_EVENT_MAX];
+	static ipacm_evt_drop_fn drop_fn[IPACM_EVENT_MAX];
+	static uint32_t squashed[IPACM_EVENT_MAX];
+
+	int Stage(cmd_stage_t *stage);
+	static void Coalesce(cmd_stage_t *stage, int num);
+
+	MessageQueue();
 
 public:
 
 	~MessageQueue() { }
-	void enqueue(Message *item);
+	void enqueue(const cmd_t *evt);
+	/* only called from the one consumer thread, false when empty */
+	bool dequeue(cmd_t *evt);
 
 	static void* Process(void *);
 	static MessageQueue* getInstanceInternal();
 	static MessageQueue* getInstanceExternal();
 
+	/* Events with a key function are coalesced: an external event is
+		 squashed when an earlier pending one has the same id and key,
+		 unless an event on the same object or one without a key came in
+		 between. drop releases the payload, IPACM_EvtPool::Free if NULL */
+	static void setCoalesce(ipa_cm_event_id event, ipacm_evt_key_fn key,
+													ipacm_evt_drop_fn drop);
+	static uint32_t getSquashed(ipa_cm_event_id event);
+
 };
 
 #endif  /* IPA_CONNTRACK_MESSAGE_H */
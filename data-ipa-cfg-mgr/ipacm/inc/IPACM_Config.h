@@ -109,6 +109,8 @@ public:
 
 	int ipa_nat_max_entries;
 
+	int ipa_nat_max_temp_entries;
+
 	bool ipacm_odu_router_mode;
 
 	bool ipacm_odu_enable;
@@ -219,6 +221,11 @@ public:
 		return ipa_nat_max_entries;
 	}
 
+	inline int GetNatMaxTempEntries(void)
+	{
+		return ipa_nat_max_temp_entries;
+	}
+
 	inline int GetNatIfacesCnt()
 	{
 		return ipa_nat_iface_entries;
@@ -36,6 +36,7 @@ IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <arpa/inet.h>
 #include <netinet/in.h>
 #include <errno.h>
+#include <time.h>
 
 #include "IPACM_ConntrackClient.h"
 #include "IPACM_CmdQueue.h"
@@ -56,9 +57,34 @@ extern "C"
 
 using namespace std;
 
-#define UDP_TIMEOUT_UPDATE 20
 #define BROADCAST_IPV4_ADDR 0xFFFFFFFF
 
+/* a batch of ipv4 conntrack messages is posted once it is full or
+	 this many microseconds after its first message */
+#define IPACM_CT_BATCH_USEC 2000
+
+/* receive buffer of the conntrack event sockets, an overrun costs a
+	 dump of the conntrack table */
+#define IPACM_CT_RCVBUF_SIZE (1024 * 1024)
+#define IPACM_CT_MAX_EPOLL_EVENTS 3
+
+/* addresses ignored by the conntrack socket filters */
+#define IPACM_CT_MAX_FILTER_ADDRS 64
+
+typedef struct
+{
+	ipacm_ct_evt_batch *batch;
+	struct timespec start;
+}ipacm_ct_batch_ctx;
+
+typedef struct
+{
+	uint32_t received;	/* events that passed the socket filters */
+	uint32_t accepted;	/* events handed to the listener */
+	uint32_t dropped;	/* events dropped before the listener */
+	uint32_t rebuilds;	/* socket filters compiled */
+}ipacm_ct_filter_stats;
+
 class IPACM_ConntrackClient
 {
 
@@ -69,9 +95,40 @@ private:
    struct nfct_handle *udp_hdl;
    struct nfct_filter *tcp_filter;
    struct nfct_filter *udp_filter;
-   static int IPA_Conntrack_Filters_Ignore_Local_Addrs(struct nfct_filter *filter);
-   static int IPA_Conntrack_Filters_Ignore_Bridge_Addrs(struct nfct_filter *filter);
-   static int IPA_Conntrack_Filters_Ignore_Local_Iface(struct nfct_filter *, ipacm_event_iface_up *);
+   struct nfct_handle *dump_hdl;
+   int resync_fd;
+   ipacm_ct_batch_ctx ct_batch;
+   uint32_t resync_cnt;
+
+   /* interest set compiled into the socket filters, the connections
+      of ignore_addrs and the ones to ignore_dst_addrs are dropped */
+   uint32_t ignore_addrs[IPACM_CT_MAX_FILTER_ADDRS];
+   int num_ignore_addrs;
+   uint32_t ignore_dst_addrs[IPACM_CT_MAX_FILTER_ADDRS];
+   int num_ignore_dst_addrs;
+   bool bridge_ignored;
+   pthread_mutex_t filter_lock;
+   ipacm_ct_filter_stats filter_stats;
+
+   static int AddFilterAddr(uint32_t *addrs, int *num, uint32_t addr);
+   static int IPA_Conntrack_Filters_Ignore_Local_Addrs(void);
+   static int IPA_Conntrack_Filters_Ignore_Bridge_Addrs(void);
+   static int IPA_Conntrack_Filters_Ignore_Local_Iface(ipacm_event_iface_up *);
+   static struct nfct_filter *BuildFilter(uint8_t l4proto);
+   static int AttachFilters(void);
+   static bool isAlgConnection(struct nf_conntrack *ct);
+   static bool CtEvtKey(const ipacm_cmd_q_data *data, ipacm_evt_key *key);
+   static void CtEvtDrop(ipacm_cmd_q_data *data);
+   static void FlushBatch(ipacm_ct_batch_ctx *ctx);
+   static int BatchTimeLeft(ipacm_ct_batch_ctx *ctx);
+   static int SetupEventSocket(struct nfct_handle *hdl);
+   static int TCPRegisterWithConnTrack(void);
+   static int UDPRegisterWithConnTrack(void);
+   static int CatchEvents(struct nfct_handle *hdl);
+   static int IPAConntrackDumpCB(enum nf_conntrack_msg_type type,
+                                 struct nf_conntrack *ct,
+                                 void *data);
+   static void Resync(void);
    IPACM_ConntrackClient();
 
 public:
@@ -79,18 +136,19 @@ public:
                                   struct nf_conntrack *ct,
                                   void *data);
 
-   static int IPA_Conntrack_UDP_Filter_Init(void);
-   static int IPA_Conntrack_TCP_Filter_Init(void);
-   static void* TCPRegisterWithConnTrack(void *);
-   static void* UDPRegisterWithConnTrack(void *);
+   static void* ConnTrackReader(void *);
+   static void RequestResync(void);
    static void* UDPConnTimeoutUpdate(void *);
 
-   static void UpdateUDPFilters(void *, bool);
-   static void UpdateTCPFilters(void *, bool);
+   static void UpdateFilters(ipacm_event_iface_up *);
+   static void GetFilterStats(ipacm_ct_filter_stats *);
    static void Read_TcpUdp_Timeout(char *in, int len);
 
    static IPACM_ConntrackClient* GetInstance();
 
+   /* coalesce repeated conntrack events of a connection */
+   static void EnableCoalescing(void);
+
 #ifdef IPACM_DEBUG
 #define iptodot(X,Y) \
 		 IPACMLOG(" %s(0x%x): %d.%d.%d.%d\n", X, Y, ((Y>>24) & 0xFF), ((Y>>16) & 0xFF), ((Y>>8) & 0xFF), (Y & 0xFF));
@@ -41,12 +41,12 @@ IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "IPACM_CmdQueue.h"
 #include "IPACM_Conntrack_NATApp.h"
+#include "IPACM_Conntrack_Classifier.h"
 #include "IPACM_Listener.h"
 #ifdef CT_OPT
 #include "IPACM_LanToLan.h"
 #endif
 
-#define MAX_IFACE_ADDRESS 50
 #define MAX_STA_CLNT_IFACES 10
 #define STA_CLNT_SUBNET_MASK 0xFFFFFF00
 
@@ -73,15 +73,23 @@ private:
 	int NatIfaceCnt;
 	int StaClntCnt;
 	NatIfaces *pNatIfaces;
-	uint32_t nat_iface_ipv4_addr[MAX_IFACE_ADDRESS];
-	uint32_t nonnat_iface_ipv4_addr[MAX_IFACE_ADDRESS];
 	uint32_t sta_clnt_ipv4_addr[MAX_STA_CLNT_IFACES];
+	/* nat, non nat, sta and private addresses */
+	AddrClassifier addr_cls;
 	IPACM_Config *pConfig;
+
+	/* nat updates of the conntrack batch being processed */
+	bool isBatching;
+	nat_batch_op nat_ops[IPACM_CT_BATCH_MAX];
+	int nat_op_cnt;
 #ifdef CT_OPT
 	IPACM_LanToLan *p_lan2lan;
 #endif
 
 	void ProcessCTMessage(void *);
+	void ProcessCTBatch(void *);
+	void UpdateNatEntry(const nat_table_entry *, bool);
+	void FlushNatOps(void);
 	void ProcessTCPorUDPMsg(struct nf_conntrack *,
 	enum nf_conntrack_msg_type, u_int8_t);
 	void TriggerWANUp(void *);
@@ -94,6 +102,8 @@ private:
 	void CheckSTAClient(const nat_table_entry *, bool *);
 	int CheckNatIface(ipacm_event_data_all *, bool *);
 	void HandleNonNatIPAddr(void *, bool);
+	void LoadPrivateSubnets(void);
+	void LoadSTASubnets(void);
 
 #ifdef CT_OPT
 	void ProcessCTV6Message(void *);
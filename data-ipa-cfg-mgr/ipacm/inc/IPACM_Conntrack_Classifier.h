@@ -0,0 +1,108 @@
+/*
+Copyright (c) 2016, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of The Linux Foundation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/*!
+	@file
+	IPACM_Conntrack_Classifier.h
+
+	@brief
+	This file implements the address classifier of the conntrack listener
+
+	@Author
+
+*/
+#ifndef IPACM_CONNTRACK_CLASSIFIER_H
+#define IPACM_CONNTRACK_CLASSIFIER_H
+
+#include <stdint.h>
+
+/* address classes, an address can be in several of them */
+#define IPACM_ADDR_IGNORE        0x00
+#define IPACM_ADDR_NAT           0x01	/* client of a nat iface */
+#define IPACM_ADDR_NONNAT        0x02	/* client of a non nat iface */
+#define IPACM_ADDR_STA           0x04	/* sta client */
+#define IPACM_ADDR_PRIVATE       0x08	/* in a private subnet */
+#define IPACM_ADDR_STA_SUBNET    0x10	/* in the subnet of a sta client */
+
+#define IPACM_ADDR_HASH_BITS 8
+#define IPACM_ADDR_HASH_SIZE (1 << IPACM_ADDR_HASH_BITS)
+#define IPACM_ADDR_MAX_SUBNETS 16
+
+typedef struct
+{
+	uint32_t addr;
+	uint8_t cls;
+}addr_class_entry;
+
+typedef struct
+{
+	uint32_t addr;
+	uint32_t mask;
+	uint8_t cls;	/* own classes */
+	uint8_t match;	/* own classes and the ones of covering subnets */
+}subnet_class_entry;
+
+/* Answers which classes an ip address belongs to. Exact addresses sit
+   in an open addressing hash (linear probing, at most half full),
+   subnets in a table ordered by prefix length where each subnet also
+   carries the classes of the subnets covering it, so the first match
+   is the answer. */
+class AddrClassifier
+{
+private:
+	addr_class_entry buckets[IPACM_ADDR_HASH_SIZE];
+	int count;
+
+	subnet_class_entry subnets[IPACM_ADDR_MAX_SUBNETS];
+	int num_subnets;
+
+	uint32_t Hash(uint32_t);
+	int FindBucket(uint32_t);
+	void Remove(int);
+	void UpdateSubnetMatch();
+
+public:
+	AddrClassifier();
+
+	int Add(uint32_t, uint8_t);
+	void Del(uint32_t, uint8_t);
+	bool isClass(uint32_t, uint8_t);
+
+	int AddSubnet(uint32_t, uint32_t, uint8_t);
+	void ClearSubnets(uint8_t);
+
+	uint8_t Classify(uint32_t);
+
+	/* classes of either end of a connection */
+	inline uint8_t Classify(uint32_t addr1, uint32_t addr2)
+	{
+		return Classify(addr1) | Classify(addr2);
+	}
+};
+
+#endif /* IPACM_CONNTRACK_CLASSIFIER_H */
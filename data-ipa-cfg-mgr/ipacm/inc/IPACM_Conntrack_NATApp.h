@@ -32,9 +32,13 @@ IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <string.h>  /* for stderror */
 #include <stdlib.h>
 #include <cstdio>  /* for perror */
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <pthread.h>
 
 #include "IPACM_Config.h"
 #include "IPACM_Xml.h"
+#include "IPACM_Conntrack_NATCache.h"
 
 extern "C"
 {
@@ -42,32 +46,151 @@ extern "C"
 #include <ipa_nat_drv.h>
 }
 
-#define MAX_TEMP_ENTRIES 25
+/* temp entries staged when MaxNatTempEntries is not configured */
+#define DEFAULT_TEMP_ENTRIES 100
+#define MAX_BULK_NAT_ENTRIES 32
+
+/* conntrack timeout updates sent with one sendto() */
+#define MAX_CT_UPDATE_ENTRIES 256
+#define CT_UPDATE_MSG_SIZE 256
+#define CT_UPDATE_BUF_SIZE (MAX_CT_UPDATE_ENTRIES * CT_UPDATE_MSG_SIZE)
+/* milliseconds to wait for the ack of a batch of updates */
+#define CT_UPDATE_ACK_TIMEOUT 1000
+
+/* timestamp sweep scheduler, the flows sit in a timer wheel by the
+	 time their conntrack entry expires and only the ones expiring
+	 within CT_SWEEP_MARGIN seconds get their timestamp checked */
+#define CT_WHEEL_SLOTS 64
+#define CT_WHEEL_TICK 5
+#define CT_SWEEP_MARGIN (2 * CT_WHEEL_TICK)
+#define CT_SWEEP_MAX_SLEEP 20
+#define CT_SWEEP_BULK_MIN 64
+
+/* admission control, when the nat cache or the nat table is full a
+	 new flow takes the place of the offloaded flow whose rule was hit
+	 longest ago, if that is at least CT_EVICT_MIN_IDLE seconds. Udp
+	 flows are evicted first and new udp flows only evict udp flows.
+	 The rule timestamps are read at most every CT_EVICT_REFRESH
+	 seconds to find out which flows were hit */
+#define CT_EVICT_MIN_IDLE 30
+#define CT_EVICT_REFRESH 1
+
+/* nat table resize, the table is recreated twice as big when ipa
+	 rejects a rule, when more than CT_RESIZE_LOAD percent of its base
+	 entries are in use or when a collision chain is longer than
+	 CT_RESIZE_MAX_CHAIN rules. The load and the chains are checked at
+	 most every CT_RESIZE_CHECK seconds. The table grows up to
+	 CT_RESIZE_MAX_GROWTH times the size MaxNatEntries gives it, and no
+	 more than the CT_RESIZE_MAX_ENTRIES ipa_nat takes, flows are
+	 evicted from then on */
+#define CT_RESIZE_LOAD 75
+#define CT_RESIZE_MAX_CHAIN 4
+#define CT_RESIZE_CHECK 10
+#define CT_RESIZE_MAX_GROWTH 4
+#define CT_RESIZE_MAX_ENTRIES 4096
+
+/* one bit per tcp or udp port */
+#define ALG_PORT_WORDS (65536 / 32)
 
 #define IPACM_TCP_FULL_FILE_NAME  "/proc/sys/net/ipv4/netfilter/ip_conntrack_tcp_timeout_established"
 #define IPACM_UDP_FULL_FILE_NAME   "/proc/sys/net/ipv4/netfilter/ip_conntrack_udp_timeout_stream"
+#define IPACM_UDP_UNREPLIED_FILE_NAME   "/proc/sys/net/ipv4/netfilter/ip_conntrack_udp_timeout"
 
-typedef struct _nat_table_entry
+/* seconds between two reads of the conntrack timeouts */
+#define CT_TIMEOUT_REFRESH 60
+
+#define CHK_TBL_HDL()  if(nat_table_hdl == 0){ return -1; }
+
+/* The flow is kept by value, the event thread may delete it and
+	 reuse its cache slot before the batch is sent */
+typedef struct
 {
-	uint32_t private_ip;
-	uint16_t private_port;
+	nat_table_entry rule;
+	int idx;
+	uint32_t new_ts;
+	uint32_t seq;
+	bool failed;
+}ct_update_entry;
+
+/* flows whose conntrack entry could not be updated, deleted by the
+	 event thread on IPA_HANDLE_CT_UPDATE_FAILED */
+typedef struct
+{
+	int num;
+	nat_table_entry rule[MAX_CT_UPDATE_ENTRIES];
+}nat_ct_failed_flows;
 
-	uint32_t target_ip;
-	uint16_t target_port;
+typedef struct
+{
+	uint32_t deadline;	/* conntrack expiry, monotonic seconds */
+	uint32_t rule_hdl;	/* 0 while not in the wheel */
+	uint32_t hw_ts;
+	bool ts_read;
+	int bucket;
+	nat_cache_link link;
+}ct_sched_entry;
+
+typedef struct
+{
+	int idx;
+	uint32_t added;	/* monotonic seconds the rule was added */
+}ct_pending_entry;
 
-	uint32_t public_ip;
-	uint16_t public_port;
+typedef struct
+{
+	uint32_t sweeps;
+	uint64_t sweep_usec;	/* time spent in the sweeps */
+	uint32_t checked;	/* flows whose timestamp was read */
+	uint32_t refreshed;	/* flows whose conntrack timeout was updated */
+}nat_sweep_stats;
 
-	u_int8_t  protocol;
-	uint32_t timestamp;
+typedef struct
+{
+	uint32_t hw_ts;	/* rule timestamp when last read */
+	uint32_t last_hit;	/* monotonic seconds the rule was last seen hit */
+}ct_hit_entry;
 
-	bool dst_nat;
-	bool enabled;
+/* flows idle long enough to be evicted, coldest first, taken from
+	 one timestamp snapshot */
+typedef struct
+{
+	int idx;
 	uint32_t rule_hdl;
+	uint32_t last_hit;
+}ct_evict_entry;
 
-}nat_table_entry;
+typedef struct
+{
+	ct_evict_entry *entry;
+	int num;
+	int pos;	/* next flow to evict */
+}ct_evict_list;
 
-#define CHK_TBL_HDL()  if(nat_table_hdl == 0){ return -1; }
+typedef struct
+{
+	uint32_t max_entries;
+	uint32_t cached;	/* flows in the nat cache */
+	uint32_t offloaded;	/* flows with a rule in the nat table */
+	uint32_t evicted_udp;
+	uint32_t evicted_tcp;
+	uint32_t rejected;	/* no flow idle enough to make room */
+	uint32_t resized;	/* times the nat table grew */
+	uint16_t table_entries;	/* current nat table size */
+	uint16_t expn_table_entries;
+}nat_admit_stats;
+
+typedef struct
+{
+	uint32_t staged;	/* flows waiting for their client address */
+	uint32_t flushed;	/* staged flows moved to the nat table */
+	uint32_t evicted;	/* staged flows dropped to make room */
+}nat_temp_stats;
+
+typedef struct
+{
+	nat_table_entry rule;
+	bool add;
+}nat_batch_op;
 
 class NatApp
 {
@@ -75,33 +198,133 @@ private:
 
 	static NatApp *pInstance;
 
+	NatCache nat_cache;
 	nat_table_entry *cache;
-	nat_table_entry temp[MAX_TEMP_ENTRIES];
+
+	/* flows staged until the address of their client resolves, the
+		 oldest one is evicted when all max_temp_entries are in use */
+	NatCache temp_cache;
+	nat_table_entry *temp;
+	nat_cache_link *temp_age;
+	int temp_oldest, temp_newest;
+	int max_temp_entries;
+	nat_temp_stats temp_stats;
+
 	uint32_t pub_ip_addr;
 	uint32_t pub_ip_addr_pre;
 	uint32_t nat_table_hdl;
 
 	int curCnt, max_entries;
 
-	ipacm_alg *pALGPorts;
-	uint16_t nALGPort;
+	/* timestamp sweep, rule timestamps read from the nat table
+		 and the cache entry of each rule handle */
+	ipa_nat_ipv4_timestamp *ts_snap;
+	int *hdl_idx;
+	int hdl_idx_len;
 
+	/* alg ports, bitmaps built from the config at init and on
+		 config change */
+	uint32_t alg_tcp_ports[ALG_PORT_WORDS];
+	uint32_t alg_udp_ports[ALG_PORT_WORDS];
+
+	/* conntrack timeouts, tcp established, udp stream and udp
+		 unreplied, read with pread() from proc files kept open */
 	uint32_t tcp_timeout;
 	uint32_t udp_timeout;
+	uint32_t udp_unreplied_timeout;
+	int tcp_timeout_fd;
+	int udp_timeout_fd;
+	int udp_unreplied_timeout_fd;
+	uint32_t timeout_read_time;
 
 	uint32_t PwrSaveIfs[IPA_MAX_NUM_WIFI_CLIENTS];
 
 	struct nf_conntrack *ct;
 	struct nfct_handle *ct_hdl;
 
+	/* pending conntrack timeout updates, one netlink message each */
+	char ct_update_buf[CT_UPDATE_BUF_SIZE];
+	int ct_update_len;
+	int ct_last_msg;
+	ct_update_entry ct_updates[MAX_CT_UPDATE_ENTRIES];
+	int ct_update_cnt;
+
+	/* timestamp sweep scheduler, only the sweep thread touches the
+		 wheel, the flows added from other threads wait in ct_pending */
+	ct_sched_entry *ct_sched;
+	int ct_wheel[CT_WHEEL_SLOTS];
+	uint32_t ct_wheel_tick;
+	int *ct_due;
+	ct_pending_entry *ct_pending;
+	ct_pending_entry *ct_drained;
+	int ct_pending_cnt;
+	bool ct_pending_overflow;
+	uint32_t ct_last_sweep;
+	/* monotonic seconds the sweep thread sleeps until, it is woken
+		 up when a new flow has to be checked before then */
+	uint32_t ct_sweep_wake;
+	pthread_cond_t ct_sweep_cond;
+	pthread_mutex_t ct_pending_lock;
+	nat_sweep_stats sweep_stats;
+
+	/* admission control, only the threads adding flows touch these */
+	ct_hit_entry *ct_hits;
+	uint32_t hits_read_time;
+	ipa_nat_ipv4_timestamp *hits_snap;
+	int *hits_hdl_idx;
+	int hits_hdl_idx_len;
+	ct_evict_list evict_udp, evict_tcp;
+	nat_admit_stats admit_stats;
+
+	/* nat table size, kept when the table is added again. The sweep
+		 thread holds ct_sweep_lock while it uses the rule handles, a
+		 resize changes all of them */
+	uint16_t tbl_entries, tbl_expn_entries;
+	uint16_t max_tbl_entries, max_tbl_expn_entries;
+	uint32_t resize_check_time;
+	ipa_nat_ipv4_rule *resize_rules;
+	uint32_t *resize_hdls;
+	int *resize_slots;
+	pthread_mutex_t ct_sweep_lock;
+	/* public ip of a table lost in a resize, the table is created
+		 again on the next flow added, at most every CT_RESIZE_CHECK
+		 seconds */
+	uint32_t lost_pub_ip;
+	uint32_t restore_time;
+
 	NatApp();
 	int Init();
 
-	void UpdateCTUdpTs(nat_table_entry *, uint32_t);
+	void UpdateCTUdpTs(int, uint32_t);
+	void FlushCTUpdates();
+	int RecvCTUpdateAcks();
+	void ScheduleTs(int);
+	void DrainPending(uint32_t);
+	void WheelInsert(int);
+	void WheelRemove(int);
+	uint32_t FlowTimeout(const nat_table_entry *, bool);
+	void ReadTimeout(int *, const char *, uint32_t *);
+	void ReadTimeStamps(int);
+	void CheckTimeStamps(int, uint32_t);
 	bool ChkForDup(const nat_table_entry *);
-	bool isAlgPort(uint8_t, uint16_t);
+	bool IsSameFlow(int, const nat_table_entry *);
 	void Reset();
 	bool isPwrSaveIf(uint32_t);
+	int ReserveEntry(const nat_table_entry *, int *);
+	int AddEntriesToHw(const int *, int, bool);
+	void MarkOffloaded(int);
+	void ReadHits(uint32_t);
+	int NextColdFlow(ct_evict_list *);
+	int EvictColdFlow(const nat_table_entry *);
+	int RetryRejected(const ipa_nat_ipv4_rule *, const nat_table_entry *, uint32_t *);
+	int GetOffloadedRules(void);
+	int ResizeTable(uint16_t, uint16_t);
+	int GrowTable(void);
+	int RestoreTable(void);
+	void CheckTableSize(void);
+	int DelEntriesFromHw(const int *, int);
+	void UnstageTempEntry(int);
+	int FlushTempEntry(int, bool, bool);
 
 public:
 	static NatApp* GetInstance();
@@ -112,8 +335,17 @@ public:
 
 	int AddEntry(const nat_table_entry *);
 	int DeleteEntry(const nat_table_entry *);
+	int UpdateEntries(const nat_batch_op *, int);
+	void DeleteFailedFlows(const nat_ct_failed_flows *);
+
+	int LoadAlgPorts(void);
+	bool isAlgPort(uint8_t, uint16_t);
 
-	void UpdateUDPTimeStamp();
+	int SweepTimeStamps();
+	void WaitSweep(int);
+	void GetSweepStats(nat_sweep_stats *);
+	void GetTempStats(nat_temp_stats *);
+	void GetAdmitStats(nat_admit_stats *);
 
 	int UpdatePwrSaveIf(uint32_t);
 	int ResetPwrSaveIf(uint32_t);
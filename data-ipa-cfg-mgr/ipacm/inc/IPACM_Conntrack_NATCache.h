@@ -0,0 +1,145 @@
+/*
+Copyright (c) 2016, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of The Linux Foundation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/*!
+	@file
+	IPACM_Conntrack_NATCache.h
+
+	@brief
+	This file implements the NAT rule cache with O(1) 5-tuple lookup
+
+	@Author
+
+*/
+#ifndef IPACM_CONNTRACK_NATCACHE_H
+#define IPACM_CONNTRACK_NATCACHE_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+typedef struct _nat_table_entry
+{
+	uint32_t private_ip;
+	uint16_t private_port;
+
+	uint32_t target_ip;
+	uint16_t target_port;
+
+	uint32_t public_ip;
+	uint16_t public_port;
+
+	u_int8_t  protocol;
+	uint32_t timestamp;
+
+	bool dst_nat;
+	bool enabled;
+	uint32_t rule_hdl;
+
+}nat_table_entry;
+
+#define NAT_CACHE_INVALID_IDX (-1)
+
+typedef struct _nat_cache_link
+{
+	int next;
+	int prev;
+}nat_cache_link;
+
+/* Storage for nat_table_entry backed by an open addressing hash
+   (linear probing, keyed on the connection 5-tuple) and a stack of
+   free slots, so that lookup, insert and remove do not walk the
+   whole array. Slot indices are stable until the entry is removed,
+   an unused slot has all its 5-tuple fields set to 0.
+
+   Every entry is also linked into a per-private-IP and a
+   per-target-IP list so that the flows of one client can be
+   visited without a full sweep. */
+class NatCache
+{
+private:
+	nat_table_entry *entries;
+	int max_entries;
+	int count;
+
+	int *buckets;
+	uint32_t bucket_mask;
+
+	int *free_slots;
+	int free_cnt;
+
+	/* client lists, hashed on the ip address */
+	int *priv_heads;
+	int *tgt_heads;
+	uint32_t ip_mask;
+	nat_cache_link *priv_links;
+	nat_cache_link *tgt_links;
+
+	uint32_t Hash(const nat_table_entry *);
+	uint32_t HashIp(uint32_t);
+	int FindBucket(const nat_table_entry *);
+	void Link(int *, nat_cache_link *, int);
+	void Unlink(int *, nat_cache_link *, int);
+	int SkipToIp(const nat_cache_link *, int, uint32_t, bool);
+
+public:
+	NatCache();
+	~NatCache();
+
+	int Init(int);
+	void Clear();
+
+	int Lookup(const nat_table_entry *);
+	int Insert(const nat_table_entry *);
+	void Remove(int);
+
+	static bool isSameTuple(const nat_table_entry *, const nat_table_entry *);
+
+	/* Iterate the entries of one client, fetch the next index
+		 before removing the current one */
+	int FirstByPrivateIp(uint32_t);
+	int NextByPrivateIp(int);
+	int FirstByTargetIp(uint32_t);
+	int NextByTargetIp(int);
+
+	inline nat_table_entry *GetEntries()
+	{
+		return entries;
+	}
+
+	inline int GetMaxEntries()
+	{
+		return max_entries;
+	}
+
+	inline int GetCount()
+	{
+		return count;
+	}
+};
+
+#endif /* IPACM_CONNTRACK_NATCACHE_H */
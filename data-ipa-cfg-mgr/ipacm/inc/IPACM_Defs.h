@@ -158,6 +158,7 @@ typedef enum
 	IPA_SW_ROUTING_DISABLE,                   /* NULL */
 	IPA_PROCESS_CT_MESSAGE,                   /* ipacm_ct_evt_data */
 	IPA_PROCESS_CT_MESSAGE_V6,                /* ipacm_ct_evt_data */
+	IPA_PROCESS_CT_BATCH,                     /* ipacm_ct_evt_batch */
 	IPA_LAN_TO_LAN_NEW_CONNECTION,            /* ipacm_event_connection */
 	IPA_LAN_TO_LAN_DEL_CONNECTION,            /* ipacm_event_connection */
 	IPA_WLAN_SWITCH_TO_SCC,                   /* No Data */
@@ -185,6 +186,7 @@ typedef enum
 	IPA_ETH_BRIDGE_CLIENT_DEL,                /* ipacm_event_eth_bridge*/
 	IPA_ETH_BRIDGE_WLAN_SCC_MCC_SWITCH,       /* ipacm_event_eth_bridge*/
 	IPA_LAN_DELETE_SELF,                      /* ipacm_event_data_fid */
+	IPA_HANDLE_CT_UPDATE_FAILED,              /* nat_ct_failed_flows */
 	IPACM_EVENT_MAX
 } ipa_cm_event_id;
 
@@ -224,6 +226,15 @@ typedef struct
 	enum nf_conntrack_msg_type type;
 }ipacm_ct_evt_data;
 
+/* ipv4 conntrack messages read together, see IPACM_CT_BATCH_USEC */
+#define IPACM_CT_BATCH_MAX 15
+
+typedef struct
+{
+	int num;
+	ipacm_ct_evt_data evt[IPACM_CT_BATCH_MAX];
+}ipacm_ct_evt_batch;
+
 typedef struct
 {
 	char iface_name[IPA_IFACE_NAME_LEN];
@@ -41,21 +41,11 @@ IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define IPACM_EvtDispatcher_H
 
 #include <stdio.h>
+#include <vector>
 #include <IPACM_CmdQueue.h>
 #include "IPACM_Defs.h"
 #include "IPACM_Listener.h"
 
-/* queue */
-typedef struct _cmd_evts
-{
-	ipa_cm_event_id event;
-	IPACM_Listener *obj;
-	//int ipa_interface_index;
-	_cmd_evts *next;
-}  cmd_evts;
-
-
-
 class IPACM_EvtDispatcher
 {
 public:
@@ -69,8 +59,20 @@ public:
 	static int PostEvt(ipacm_cmd_q_data *);
 	static void ProcessEvt(ipacm_cmd_q_data *);
 
+	/* coalesce repeated neighbor, address and route events */
+	static void EnableCoalescing(void);
+
 private:
-	static cmd_evts *head;
+	/* listeners of each event in registration order. A listener that
+		 deregisters while an event is dispatched is only cleared, the
+		 cleared entries are dropped once the dispatch is over */
+	static std::vector<IPACM_Listener *> listeners[IPACM_EVENT_MAX];
+	static bool dispatching;
+	static bool removed;
+
+	static void Compact(void);
+	static bool NeighKey(const ipacm_cmd_q_data *data, ipacm_evt_key *key);
+	static bool AddrKey(const ipacm_cmd_q_data *data, ipacm_evt_key *key);
 };
 
 #endif /* IPACM_EvtDispatcher_H */
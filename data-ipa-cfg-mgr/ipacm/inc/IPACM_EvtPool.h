@@ -0,0 +1,125 @@
+/*
+Copyright (c) 2016, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of The Linux Foundation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/*!
+	@file
+	IPACM_EvtPool.h
+
+	@brief
+	This file implements the pool allocator for event payloads
+
+	@Author
+
+*/
+#ifndef IPACM_EVTPOOL_H
+#define IPACM_EVTPOOL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+
+/* block sizes are 32, 64, 128 and 256 bytes, the last one for the
+   conntrack batches, bigger payloads use malloc */
+#define IPACM_EVT_POOL_CLASSES 4
+#define IPACM_EVT_POOL_MIN_BLOCK 32
+/* blocks per slab and most slabs per class */
+#define IPACM_EVT_POOL_SLAB_BLOCKS 64
+#define IPACM_EVT_POOL_MAX_SLABS 16
+/* blocks moved between a thread cache and the shared list at a time */
+#define IPACM_EVT_POOL_BATCH 16
+
+typedef struct
+{
+	uint32_t block_size;
+	uint32_t slabs;
+	uint32_t in_use;
+	uint32_t high_water;
+} ipacm_evt_class_stats;
+
+typedef struct
+{
+	ipacm_evt_class_stats cls[IPACM_EVT_POOL_CLASSES];
+	/* payloads that did not fit a class or found it full */
+	uint32_t fallback;
+} ipacm_evt_pool_stats;
+
+/* Fixed size event payloads and queue nodes come from slabs that are
+	 never given back. Each thread keeps a small cache of free blocks per
+	 class, so a producer only takes the pool lock once every
+	 IPACM_EVT_POOL_BATCH events, and the dispatcher thread, which frees
+	 them, hands them back in batches as well. Free() also takes
+	 pointers from malloc, which are recognized by not being in a slab */
+class IPACM_EvtPool
+{
+public:
+	static void* Alloc(size_t size);
+	static void Free(void *ptr);
+	static void GetStats(ipacm_evt_pool_stats *stats);
+
+private:
+	typedef struct
+	{
+		void *head[IPACM_EVT_POOL_CLASSES];
+		int cnt[IPACM_EVT_POOL_CLASSES];
+	} evt_cache;
+
+	typedef struct
+	{
+		uint32_t block_size;
+		char *slab[IPACM_EVT_POOL_MAX_SLABS];
+		uint32_t slabs;
+		/* shared free list, under lock */
+		void *head;
+		int cnt;
+		uint32_t in_use;
+		uint32_t high_water;
+	} evt_class;
+
+	static evt_class pool[IPACM_EVT_POOL_CLASSES];
+	static uint32_t fallback;
+	static pthread_mutex_t lock;
+	static pthread_key_t cache_key;
+	static pthread_once_t cache_once;
+
+	static int ClassOf(size_t size);
+	static int SlabClassOf(void *ptr);
+	static evt_cache* GetCache(void);
+	static void CreateKey(void);
+	static void ReleaseCache(void *arg);
+	static int Refill(evt_cache *cache, int cls);
+	static void Drain(evt_cache *cache, int cls, int num);
+};
+
+/* Typed front end for the fixed size structs of IPACM_Defs.h */
+template <typename T>
+static inline T* ipacm_evt_alloc(void)
+{
+	return (T *)IPACM_EvtPool::Alloc(sizeof(T));
+}
+
+#endif /* IPACM_EVTPOOL_H */
@@ -177,6 +177,7 @@ if (!(a)) {                                                 \
 
 #define IPACMNat_TAG                         "IPACMNAT"
 #define NAT_MaxEntries_TAG                   "MaxNatEntries"
+#define NAT_MaxTempEntries_TAG               "MaxNatTempEntries"
 
 #define IP_PassthroughFlag_TAG               "IPPassthroughFlag"
 #define IP_PassthroughMode_TAG               "IPPassthroughMode"
@@ -275,6 +276,7 @@ typedef struct  _IPACM_conf_t
 	ipacm_private_subnet_conf_t private_subnet_config;
 	ipacm_alg_conf_t alg_config;
 	int nat_max_entries;
+	int nat_max_temp_entries;
 	bool odu_enable;
 	bool router_mode_enable;
 	bool odu_embms_enable;
@@ -38,15 +38,49 @@ IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 */
 #include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/eventfd.h>
 #include "IPACM_CmdQueue.h"
 #include "IPACM_Log.h"
 #include "IPACM_Iface.h"
 
+/* guards the overflow lists */
 pthread_mutex_t mutex    = PTHREAD_MUTEX_INITIALIZER;
-pthread_cond_t  cond_var = PTHREAD_COND_INITIALIZER;
 
 MessageQueue* MessageQueue::inst_internal = NULL;
 MessageQueue* MessageQueue::inst_external = NULL;
+int MessageQueue::evt_fd = -1;
+uint32_t MessageQueue::consumer_waiting = 0;
+ipacm_evt_key_fn MessageQueue::key_fn[IPACM_EVENT_MAX];
+ipacm_evt_drop_fn MessageQueue::drop_fn[IPACM_EVENT_MAX];
+uint32_t MessageQueue::squashed[IPACM_EVENT_MAX];
+
+MessageQueue::MessageQueue()
+{
+	uint32_t cnt;
+
+	for(cnt = 0; cnt < IPACM_CMD_QUEUE_SIZE; cnt++)
+	{
+		ring[cnt].seq = cnt;
+	}
+	ring_tail = 0;
+	ring_head = 0;
+
+	Head = NULL;
+	Tail = NULL;
+	overflow_cnt = 0;
+
+	/* both queues wake up the one Process() thread */
+	if(evt_fd < 0)
+	{
+		evt_fd = eventfd(0, EFD_CLOEXEC);
+		if(evt_fd < 0)
+		{
+			PERROR("eventfd");
+		}
+	}
+}
 
 MessageQueue* MessageQueue::getInstanceInternal()
 {
@@ -78,50 +112,249 @@ MessageQueue* MessageQueue::getInstanceExternal()
 	return inst_external;
 }
 
-void MessageQueue::enqueue(Message *item)
+/* Claims the slot at the producer position, false if the ring is full */
+bool MessageQueue::push(const cmd_t *evt)
 {
-	if(!Head)
+	cmd_slot_t *slot;
+	uint32_t pos, seq;
+	int32_t diff;
+
+	pos = __atomic_load_n(&ring_tail, __ATOMIC_RELAXED);
+	while(1)
 	{
-		Tail = item;
-		Head = item;
+		slot = &ring[pos & (IPACM_CMD_QUEUE_SIZE - 1)];
+		seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+		diff = (int32_t)(seq - pos);
+
+		if(diff == 0)
+		{
+			/* pos is reloaded when another producer got there first */
+			if(__atomic_compare_exchange_n(&ring_tail, &pos, pos + 1, true,
+							__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+			{
+				break;
+			}
+		}
+		else if(diff < 0)
+		{
+			return false;
+		}
+		else
+		{
+			pos = __atomic_load_n(&ring_tail, __ATOMIC_RELAXED);
+		}
 	}
-	else
+
+	memcpy(&slot->evt, evt, sizeof(cmd_t));
+	__atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+
+	return true;
+}
+
+void MessageQueue::enqueue(const cmd_t *evt)
+{
+	Message *item = NULL;
+
+	if(__atomic_load_n(&overflow_cnt, __ATOMIC_ACQUIRE) != 0 || !push(evt))
 	{
-		if(Tail == NULL)
+		item = new Message();
+		if(item == NULL)
+		{
+			IPACMERR("unable to allocate message, event %d dropped\n", evt->data.event);
+			IPACM_EvtPool::Free(evt->data.evt_data);
+			return;
+		}
+		memcpy(&item->evt, evt, sizeof(cmd_t));
+
+		pthread_mutex_lock(&mutex);
+		if(!Head)
 		{
-			IPACMDBG("Tail is null\n");
-			Head->setnext(item);
+			Head = item;
 		}
 		else
 		{
 			Tail->setnext(item);
 		}
 		Tail = item;
+		__atomic_add_fetch(&overflow_cnt, 1, __ATOMIC_RELEASE);
+		pthread_mutex_unlock(&mutex);
+
+		IPACMDBG("Queue full, event %d in overflow list\n", evt->data.event);
+	}
+
+	wakeup();
+}
+
+/* Only called from the Process() thread */
+bool MessageQueue::dequeue(cmd_t *evt)
+{
+	cmd_slot_t *slot = &ring[ring_head & (IPACM_CMD_QUEUE_SIZE - 1)];
+	Message *item;
+
+	if(__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) == ring_head + 1)
+	{
+		memcpy(evt, &slot->evt, sizeof(cmd_t));
+		__atomic_store_n(&slot->seq, ring_head + IPACM_CMD_QUEUE_SIZE, __ATOMIC_RELEASE);
+		ring_head++;
+		return true;
+	}
+
+	/* a claimed slot that is not filled yet may hold an event posted
+		 before the ones in the list, the producer wakes us up for it */
+	if(__atomic_load_n(&overflow_cnt, __ATOMIC_ACQUIRE) == 0 ||
+		 __atomic_load_n(&ring_tail, __ATOMIC_ACQUIRE) != ring_head)
+	{
+		return false;
 	}
+
+	pthread_mutex_lock(&mutex);
+	item = Head;
+	Head = Head->getnext();
+	if(!Head)
+	{
+		Tail = NULL;
+	}
+	__atomic_sub_fetch(&overflow_cnt, 1, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&mutex);
+
+	memcpy(evt, &item->evt, sizeof(cmd_t));
+	delete item;
+
+	return true;
 }
 
+bool MessageQueue::pending(void)
+{
+	cmd_slot_t *slot = &ring[ring_head & (IPACM_CMD_QUEUE_SIZE - 1)];
+
+	return __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) == ring_head + 1 ||
+		(__atomic_load_n(&overflow_cnt, __ATOMIC_ACQUIRE) != 0 &&
+		 __atomic_load_n(&ring_tail, __ATOMIC_ACQUIRE) == ring_head);
+}
 
-Message* MessageQueue::dequeue(void)
+/* Producers only pay for the eventfd write when the consumer sleeps */
+void MessageQueue::wakeup(void)
 {
-	if(Head == NULL)
+	uint64_t val = 1;
+
+	/* the first producer to see the flag clears it, one write is
+		 enough to wake the consumer up */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if(__atomic_load_n(&consumer_waiting, __ATOMIC_SEQ_CST) != 0 &&
+		 __atomic_exchange_n(&consumer_waiting, 0, __ATOMIC_SEQ_CST) != 0 &&
+		 evt_fd >= 0)
 	{
-		return NULL;
+		if(write(evt_fd, &val, sizeof(val)) < 0)
+		{
+			PERROR("write");
+		}
 	}
-	else
+}
+
+void MessageQueue::setCoalesce(ipa_cm_event_id event, ipacm_evt_key_fn key,
+															 ipacm_evt_drop_fn drop)
+{
+	if(event >= IPA_EXTERNAL_EVENT_MAX)
 	{
-		Message *tmp = Head;
-		Head = Head->getnext();
+		IPACMERR("only external events are coalesced, not %d\n", event);
+		return;
+	}
+	drop_fn[event] = drop;
+	key_fn[event] = key;
+}
+
+uint32_t MessageQueue::getSquashed(ipa_cm_event_id event)
+{
+	if(event >= IPACM_EVENT_MAX)
+	{
+		return 0;
+	}
+	return __atomic_load_n(&squashed[event], __ATOMIC_RELAXED);
+}
+
+/* Compare the last staged event with the ones before it, newest first */
+void MessageQueue::Coalesce(cmd_stage_t *stage, int num)
+{
+	cmd_stage_t *cur = &stage[num], *prev;
+	int cnt;
+
+	for(cnt = num - 1; cnt >= 0; cnt--)
+	{
+		prev = &stage[cnt];
+		if(prev->squashed)
+		{
+			continue;
+		}
+		if(!prev->keyed)
+		{
+			return;
+		}
+		if(prev->key.obj_len != cur->key.obj_len ||
+			 memcmp(prev->key.data, cur->key.data, cur->key.obj_len) != 0)
+		{
+			continue;
+		}
 
-		return tmp;
+		/* same object, anything but a repeat has to be seen in order */
+		if(prev->evt.data.event == cur->evt.data.event &&
+			 prev->key.len == cur->key.len &&
+			 memcmp(prev->key.data, cur->key.data, cur->key.len) == 0)
+		{
+			if(drop_fn[cur->evt.data.event] != NULL)
+			{
+				drop_fn[cur->evt.data.event](&cur->evt.data);
+			}
+			else
+			{
+				IPACM_EvtPool::Free(cur->evt.data.evt_data);
+			}
+			cur->squashed = true;
+			__atomic_add_fetch(&squashed[cur->evt.data.event], 1, __ATOMIC_RELAXED);
+			IPACMDBG("Squashed event %d, %d so far\n", cur->evt.data.event,
+							 squashed[cur->evt.data.event]);
+		}
+		return;
 	}
 }
 
+/* Move the events pending in the queue to the stage, returns how many */
+int MessageQueue::Stage(cmd_stage_t *stage)
+{
+	cmd_stage_t *cur;
+	int num = 0;
+
+	while(num < IPACM_CMD_STAGE_SIZE && dequeue(&stage[num].evt))
+	{
+		cur = &stage[num];
+		cur->squashed = false;
+		cur->keyed = false;
+		cur->key.len = 0;
+		cur->key.obj_len = 0;
+		if(cur->evt.data.event < IPACM_EVENT_MAX &&
+			 key_fn[cur->evt.data.event] != NULL)
+		{
+			cur->keyed = key_fn[cur->evt.data.event](&cur->evt.data, &cur->key);
+		}
+
+		if(cur->keyed)
+		{
+			Coalesce(stage, num);
+		}
+		num++;
+	}
+
+	return num;
+}
 
 void* MessageQueue::Process(void *param)
 {
 	MessageQueue *MsgQueueInternal = NULL;
 	MessageQueue *MsgQueueExternal = NULL;
-	Message *item = NULL;
+	cmd_t evt;
+	cmd_stage_t stage[IPACM_CMD_STAGE_SIZE];
+	int stage_head = 0, stage_num = 0;
+	uint64_t val;
+	bool found;
 	IPACMDBG("MessageQueue::Process()\n");
 
 	MsgQueueInternal = MessageQueue::getInstanceInternal();
@@ -138,67 +371,65 @@ void* MessageQueue::Process(void *param)
 		return NULL;
 	}
 
+	if(evt_fd < 0)
+	{
+		IPACMERR("no eventfd to wait on\n");
+		return NULL;
+	}
+
 	while(1)
 	{
-		if(pthread_mutex_lock(&mutex) != 0)
+		found = MsgQueueInternal->dequeue(&evt);
+		if(found)
 		{
-			IPACMERR("unable to lock the mutex\n");
-			return NULL;
+			IPACMDBG("Get event %s from internal queue.\n",
+				IPACM_Iface::ipacmcfg->getEventName(evt.data.event));
 		}
-
-		item = MsgQueueInternal->dequeue();
-		if(item == NULL)
+		else
 		{
-			item = MsgQueueExternal->dequeue();
-			if(item)
+			/* external events go through the stage, internal ones are
+				 still looked for before each of them */
+			if(stage_head == stage_num)
+			{
+				stage_head = 0;
+				stage_num = MsgQueueExternal->Stage(stage);
+			}
+			while(stage_head < stage_num && stage[stage_head].squashed)
+			{
+				stage_head++;
+			}
+			if(stage_head < stage_num)
 			{
+				memcpy(&evt, &stage[stage_head++].evt, sizeof(cmd_t));
+				found = true;
 				IPACMDBG("Get event %s from external queue.\n",
-					IPACM_Iface::ipacmcfg->getEventName(item->evt.data.event));
+					IPACM_Iface::ipacmcfg->getEventName(evt.data.event));
 			}
 		}
-		else
-		{
-			IPACMDBG("Get event %s from internal queue.\n",
-				IPACM_Iface::ipacmcfg->getEventName(item->evt.data.event));
-		}
 
-		if(item == NULL)
+		if(!found)
 		{
-			IPACMDBG("Waiting for Message\n");
+			/* Announce the wait before looking again, a producer either
+				 sees the flag or its event is found below */
+			__atomic_store_n(&consumer_waiting, 1, __ATOMIC_SEQ_CST);
+			__atomic_thread_fence(__ATOMIC_SEQ_CST);
 
-			if(pthread_cond_wait(&cond_var, &mutex) != 0)
+			if(!MsgQueueInternal->pending() && !MsgQueueExternal->pending())
 			{
-				IPACMERR("unable to lock the mutex\n");
-
-				if(pthread_mutex_unlock(&mutex) != 0)
+				IPACMDBG("Waiting for Message\n");
+				if(read(evt_fd, &val, sizeof(val)) < 0 && errno != EINTR)
 				{
-					IPACMERR("unable to unlock the mutex\n");
+					IPACMERR("unable to wait for message\n");
 					return NULL;
 				}
-
-				return NULL;
-			}
-
-			if(pthread_mutex_unlock(&mutex) != 0)
-			{
-				IPACMERR("unable to unlock the mutex\n");
-				return NULL;
 			}
 
+			__atomic_store_n(&consumer_waiting, 0, __ATOMIC_SEQ_CST);
+			continue;
 		}
-		else
-		{
-			if(pthread_mutex_unlock(&mutex) != 0)
-			{
-				IPACMERR("unable to unlock the mutex\n");
-				return NULL;
-			}
 
-			IPACMDBG("Processing item %p event ID: %d\n",item,item->evt.data.event);
-			item->evt.callback_ptr(&item->evt.data);
-			delete item;
-			item = NULL;
-		}
+		IPACMDBG("Processing event ID: %d\n", evt.data.event);
+		evt.callback_ptr(&evt.data);
 
 	} /* Go forever until a termination indication is received */
 
@@ -80,6 +80,7 @@ const char *ipacm_event_name[] = {
 	__stringify(IPA_SW_ROUTING_DISABLE),                   /* NULL */
 	__stringify(IPA_PROCESS_CT_MESSAGE),                   /* ipacm_ct_evt_data */
 	__stringify(IPA_PROCESS_CT_MESSAGE_V6),                /* ipacm_ct_evt_data */
+	__stringify(IPA_PROCESS_CT_BATCH),                     /* ipacm_ct_evt_batch */
 	__stringify(IPA_LAN_TO_LAN_NEW_CONNECTION),            /* ipacm_event_connection */
 	__stringify(IPA_LAN_TO_LAN_DEL_CONNECTION),            /* ipacm_event_connection */
 	__stringify(IPA_WLAN_SWITCH_TO_SCC),                   /* No Data */
@@ -105,6 +106,7 @@ const char *ipacm_event_name[] = {
 	__stringify(IPA_ETH_BRIDGE_CLIENT_DEL),                /* ipacm_event_eth_bridge*/
 	__stringify(IPA_ETH_BRIDGE_WLAN_SCC_MCC_SWITCH),       /* ipacm_event_eth_bridge*/
 	__stringify(IPA_LAN_DELETE_SELF),                      /* ipacm_event_data_fid */
+	__stringify(IPA_HANDLE_CT_UPDATE_FAILED),              /* nat_ct_failed_flows */
 	__stringify(IPACM_EVENT_MAX),
 };
 
@@ -124,6 +126,7 @@ IPACM_Config::IPACM_Config()
 	ipa_num_private_subnet = 0;
 	ipa_num_alg_ports = 0;
 	ipa_nat_max_entries = 0;
+	ipa_nat_max_temp_entries = 0;
 	ipa_nat_iface_entries = 0;
 	ipa_sw_rt_enable = false;
 	ipa_bridge_enable = false;
@@ -280,6 +283,9 @@ int IPACM_Config::Init(void)
 	ipa_nat_max_entries = cfg->nat_max_entries;
 	IPACMDBG_H("Nat Maximum Entries %d\n", ipa_nat_max_entries);
 
+	ipa_nat_max_temp_entries = cfg->nat_max_temp_entries;
+	IPACMDBG_H("Nat Maximum Temp Entries %d\n", ipa_nat_max_temp_entries);
+
 	/* Find ODU is either router mode or bridge mode*/
 	ipacm_odu_enable = cfg->odu_enable;
 	ipacm_odu_router_mode = cfg->router_mode_enable;
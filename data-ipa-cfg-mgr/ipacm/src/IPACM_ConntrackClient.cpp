@@ -33,7 +33,14 @@ IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <errno.h>
 #include <arpa/inet.h>
 #include <netinet/in.h>
+#include <time.h>
 #include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <linux/netlink.h>
 #include <net/if.h>
 #include "IPACM_Iface.h"
 #include "IPACM_ConntrackListener.h"
@@ -42,6 +49,10 @@ IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #define LO_NAME "lo"
 
+#ifndef SOL_NETLINK
+#define SOL_NETLINK 270
+#endif
+
 extern IPACM_EvtDispatcher cm_dis;
 extern void ParseCTMessage(struct nf_conntrack *ct);
 
@@ -60,6 +71,20 @@ IPACM_ConntrackClient::IPACM_ConntrackClient()
 	udp_hdl = NULL;
 	tcp_filter = NULL;
 	udp_filter = NULL;
+	dump_hdl = NULL;
+	resync_fd = eventfd(0, EFD_NONBLOCK);
+	if(resync_fd < 0)
+	{
+		PERROR("eventfd\n");
+	}
+	memset(&ct_batch, 0, sizeof(ct_batch));
+	resync_cnt = 0;
+
+	num_ignore_addrs = 0;
+	num_ignore_dst_addrs = 0;
+	bridge_ignored = false;
+	memset(&filter_stats, 0, sizeof(filter_stats));
+	pthread_mutex_init(&filter_lock, NULL);
 }
 
 IPACM_ConntrackClient* IPACM_ConntrackClient::GetInstance()
@@ -67,24 +92,6 @@ IPACM_ConntrackClient* IPACM_ConntrackClient::GetInstance()
 	if(pInstance == NULL)
 	{
 		pInstance = new IPACM_ConntrackClient();
-
-		pInstance->udp_filter = nfct_filter_create();
-		if(pInstance->udp_filter == NULL)
-		{
-			IPACMERR("unable to create UDP filter\n");
-			delete pInstance;
-			return NULL;
-		}
-		IPACMDBG("Created UDP filter\n");
-
-		pInstance->tcp_filter = nfct_filter_create();
-		if(pInstance->tcp_filter == NULL)
-		{
-			IPACMERR("unable to create TCP filter\n");
-			delete pInstance;
-			return NULL;
-		}
-		IPACMDBG("Created TCP filter\n");
 	}
 
 	return pInstance;
@@ -99,6 +106,9 @@ int IPACM_ConntrackClient::IPAConntrackEventCB
 {
 	ipacm_cmd_q_data evt_data;
 	ipacm_ct_evt_data *ct_data;
+	ipacm_ct_batch_ctx *ctx = (ipacm_ct_batch_ctx *)data;
+	struct timespec now;
+	long usec;
 	uint8_t ip_type = 0;
 
 	IPACMDBG("Event callback called with msgtype: %d\n",type);
@@ -115,7 +125,48 @@ int IPACM_ConntrackClient::IPAConntrackEventCB
 
 #endif
 
-	ct_data = (ipacm_ct_evt_data *)malloc(sizeof(ipacm_ct_evt_data));
+	if(ctx != NULL)
+	{
+		pInstance->filter_stats.received++;
+		if(AF_INET == ip_type && isAlgConnection(ct))
+		{
+			IPACMDBG("Ignoring ALG connection\n");
+			pInstance->filter_stats.dropped++;
+			goto IGNORE;
+		}
+		pInstance->filter_stats.accepted++;
+	}
+
+	/* ipv4 messages are handed over in batches */
+	if(ctx != NULL && AF_INET == ip_type)
+	{
+		if(ctx->batch == NULL)
+		{
+			ctx->batch = ipacm_evt_alloc<ipacm_ct_evt_batch>();
+			if(ctx->batch == NULL)
+			{
+				IPACMERR("unable to allocate memory \n");
+				goto IGNORE;
+			}
+			ctx->batch->num = 0;
+			clock_gettime(CLOCK_MONOTONIC, &ctx->start);
+		}
+
+		ctx->batch->evt[ctx->batch->num].ct = ct;
+		ctx->batch->evt[ctx->batch->num].type = type;
+		ctx->batch->num++;
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		usec = (now.tv_sec - ctx->start.tv_sec) * 1000000 +
+			(now.tv_nsec - ctx->start.tv_nsec) / 1000;
+		if(ctx->batch->num == IPACM_CT_BATCH_MAX || usec >= IPACM_CT_BATCH_USEC)
+		{
+			FlushBatch(ctx);
+		}
+		return NFCT_CB_STOLEN;
+	}
+
+	ct_data = ipacm_evt_alloc<ipacm_ct_evt_data>();
 	if(ct_data == NULL)
 	{
 		IPACMERR("unable to allocate memory \n");
@@ -138,7 +189,7 @@ int IPACM_ConntrackClient::IPAConntrackEventCB
 	if(0 != IPACM_EvtDispatcher::PostEvt(&evt_data))
 	{
 		IPACMERR("Error sending Conntrack message to processing thread!\n");
-		free(ct_data);
+		IPACM_EvtPool::Free(ct_data);
 		goto IGNORE;
 	}
 
@@ -152,11 +203,144 @@ IGNORE:
 
 }
 
-int IPACM_ConntrackClient::IPA_Conntrack_Filters_Ignore_Bridge_Addrs
-(
-	 struct nfct_filter *filter
-)
+/* keyed by the original tuple, then the message type and the state
+	 the listener acts on */
+bool IPACM_ConntrackClient::CtEvtKey(const ipacm_cmd_q_data *data, ipacm_evt_key *key)
+{
+	const ipacm_ct_evt_data *ct_data = (const ipacm_ct_evt_data *)data->evt_data;
+	struct nf_conntrack *ct;
+	uint8_t l3proto, l4proto, type, tcp_state = 0;
+	uint16_t port;
+	uint32_t status;
+
+	if(ct_data == NULL || ct_data->ct == NULL)
+	{
+		return false;
+	}
+	ct = ct_data->ct;
+
+	l3proto = nfct_get_attr_u8(ct, ATTR_ORIG_L3PROTO);
+	l4proto = nfct_get_attr_u8(ct, ATTR_ORIG_L4PROTO);
+	ipacm_evt_key_add(key, &l3proto, sizeof(l3proto));
+	ipacm_evt_key_add(key, &l4proto, sizeof(l4proto));
+	if(AF_INET6 == l3proto)
+	{
+		ipacm_evt_key_add(key, nfct_get_attr(ct, ATTR_ORIG_IPV6_SRC), 16);
+		ipacm_evt_key_add(key, nfct_get_attr(ct, ATTR_ORIG_IPV6_DST), 16);
+	}
+	else
+	{
+		ipacm_evt_key_add(key, nfct_get_attr(ct, ATTR_ORIG_IPV4_SRC), 4);
+		ipacm_evt_key_add(key, nfct_get_attr(ct, ATTR_ORIG_IPV4_DST), 4);
+	}
+	port = nfct_get_attr_u16(ct, ATTR_ORIG_PORT_SRC);
+	ipacm_evt_key_add(key, &port, sizeof(port));
+	port = nfct_get_attr_u16(ct, ATTR_ORIG_PORT_DST);
+	ipacm_evt_key_add(key, &port, sizeof(port));
+	key->obj_len = key->len;
+
+	type = (uint8_t)ct_data->type;
+	status = nfct_get_attr_u32(ct, ATTR_STATUS);
+	if(IPPROTO_TCP == l4proto)
+	{
+		tcp_state = nfct_get_attr_u8(ct, ATTR_TCP_STATE);
+	}
+	ipacm_evt_key_add(key, &type, sizeof(type));
+	ipacm_evt_key_add(key, &status, sizeof(status));
+	ipacm_evt_key_add(key, &tcp_state, sizeof(tcp_state));
+	return true;
+}
+
+void IPACM_ConntrackClient::CtEvtDrop(ipacm_cmd_q_data *data)
+{
+	ipacm_ct_evt_data *ct_data = (ipacm_ct_evt_data *)data->evt_data;
+
+	if(ct_data != NULL)
+	{
+		nfct_destroy(ct_data->ct);
+		IPACM_EvtPool::Free(ct_data);
+	}
+}
+
+void IPACM_ConntrackClient::EnableCoalescing(void)
+{
+	MessageQueue::setCoalesce(IPA_PROCESS_CT_MESSAGE, CtEvtKey, CtEvtDrop);
+	MessageQueue::setCoalesce(IPA_PROCESS_CT_MESSAGE_V6, CtEvtKey, CtEvtDrop);
+}
+
+void IPACM_ConntrackClient::FlushBatch(ipacm_ct_batch_ctx *ctx)
+{
+	ipacm_cmd_q_data evt_data;
+	int cnt;
+
+	if(ctx->batch == NULL)
+	{
+		return;
+	}
+
+	IPACMDBG("posting %d conntrack messages\n", ctx->batch->num);
+	evt_data.event = IPA_PROCESS_CT_BATCH;
+	evt_data.evt_data = (void *)ctx->batch;
+	if(0 != IPACM_EvtDispatcher::PostEvt(&evt_data))
+	{
+		IPACMERR("Error sending Conntrack batch to processing thread!\n");
+		for(cnt = 0; cnt < ctx->batch->num; cnt++)
+		{
+			nfct_destroy(ctx->batch->evt[cnt].ct);
+		}
+		IPACM_EvtPool::Free(ctx->batch);
+	}
+	ctx->batch = NULL;
+}
+
+/* Milliseconds until the open batch is due, rounded up, or -1 to
+	 wait for the next message */
+int IPACM_ConntrackClient::BatchTimeLeft(ipacm_ct_batch_ctx *ctx)
+{
+	struct timespec now;
+	long usec;
+
+	if(ctx->batch == NULL)
+	{
+		return -1;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	usec = IPACM_CT_BATCH_USEC - ((now.tv_sec - ctx->start.tv_sec) * 1000000 +
+		(now.tv_nsec - ctx->start.tv_nsec) / 1000);
+	if(usec <= 0)
+	{
+		return 0;
+	}
+	return (usec + 999) / 1000;
+}
+
+/* Adds an address to one of the ignore lists of the socket filters */
+int IPACM_ConntrackClient::AddFilterAddr(uint32_t *addrs, int *num, uint32_t addr)
+{
+	int cnt;
+
+	for(cnt = 0; cnt < *num; cnt++)
+	{
+		if(addrs[cnt] == addr)
+		{
+			return 0;
+		}
+	}
+
+	if(*num == IPACM_CT_MAX_FILTER_ADDRS)
+	{
+		IPACMERR("conntrack filter is full, 0x%x not ignored\n", addr);
+		return -1;
+	}
+
+	addrs[(*num)++] = addr;
+	return 1;
+}
+
+int IPACM_ConntrackClient::IPA_Conntrack_Filters_Ignore_Bridge_Addrs(void)
 {
+	IPACM_ConntrackClient *pClient = IPACM_ConntrackClient::GetInstance();
 	int fd;
 	fd = socket(AF_INET, SOCK_DGRAM, 0);
 	if(fd < 0)
@@ -194,54 +378,21 @@ int IPACM_ConntrackClient::IPA_Conntrack_Filters_Ignore_Bridge_Addrs
 	ipv4_addr = ntohl(((struct sockaddr_in *)&ifr.ifr_addr)->sin_addr.s_addr);
 	close(fd);
 
-	/* ignore whatever is destined to or originates from broadcast ip address */
-	struct nfct_filter_ipv4 filter_ipv4;
-
-	filter_ipv4.addr = ipv4_addr;
-	filter_ipv4.mask = 0xffffffff;
-
-	nfct_filter_set_logic(filter,
-												NFCT_FILTER_DST_IPV4,
-												NFCT_FILTER_LOGIC_NEGATIVE);
-
-	nfct_filter_add_attr(filter, NFCT_FILTER_DST_IPV4, &filter_ipv4);
-
-	nfct_filter_set_logic(filter,
-												NFCT_FILTER_SRC_IPV4,
-												NFCT_FILTER_LOGIC_NEGATIVE);
-
-	nfct_filter_add_attr(filter, NFCT_FILTER_SRC_IPV4, &filter_ipv4);
-
-  return 0;
+	/* ignore whatever is destined to or originates from bridge ip address */
+	return AddFilterAddr(pClient->ignore_addrs, &pClient->num_ignore_addrs, ipv4_addr);
 }
 
 int IPACM_ConntrackClient::IPA_Conntrack_Filters_Ignore_Local_Iface
 (
-	 struct nfct_filter *filter,
 	 ipacm_event_iface_up *param
 )
 {
-	struct nfct_filter_ipv4 filter_ipv4;
-
-	filter_ipv4.addr = param->ipv4_addr;
-	filter_ipv4.mask = 0xffffffff;
+	IPACM_ConntrackClient *pClient = IPACM_ConntrackClient::GetInstance();
 
-	/* ignore whatever is destined to local interfaces */
-	IPACMDBG("Ignore connections destinated to interface %s", param->ifname);
+	/* ignore whatever is destined to or orignated from local interfaces */
+	IPACMDBG("Ignore connections of interface %s", param->ifname);
 	iptodot("with ipv4 address", param->ipv4_addr);
-	nfct_filter_set_logic(filter,
-												NFCT_FILTER_DST_IPV4,
-												NFCT_FILTER_LOGIC_NEGATIVE);
-
-	nfct_filter_add_attr(filter, NFCT_FILTER_DST_IPV4, &filter_ipv4);
-
-	IPACMDBG("Ignore connections orignated from interface %s", param->ifname);
-	iptodot("with ipv4 address", filter_ipv4.addr);
-	nfct_filter_set_logic(filter,
-												NFCT_FILTER_SRC_IPV4,
-												NFCT_FILTER_LOGIC_NEGATIVE);
-
-	nfct_filter_add_attr(filter, NFCT_FILTER_SRC_IPV4, &filter_ipv4);
+	AddFilterAddr(pClient->ignore_addrs, &pClient->num_ignore_addrs, param->ipv4_addr);
 
 	/* Retrieve broadcast address */
 	/* Intialize with 255.255.255.255 */
@@ -251,133 +402,174 @@ int IPACM_ConntrackClient::IPA_Conntrack_Filters_Ignore_Local_Iface
 	bc_ip_addr = (bc_ip_addr & (~param->addr_mask));
 	bc_ip_addr = (bc_ip_addr | (param->ipv4_addr & param->addr_mask));
 
-	/* netfitler expecting in host-byte order */
-	filter_ipv4.addr = bc_ip_addr;
-	filter_ipv4.mask = 0xffffffff;
-
-	iptodot("with broadcast address", filter_ipv4.addr);
-	nfct_filter_set_logic(filter,
-												NFCT_FILTER_DST_IPV4,
-												NFCT_FILTER_LOGIC_NEGATIVE);
-
-	nfct_filter_add_attr(filter, NFCT_FILTER_DST_IPV4, &filter_ipv4);
+	iptodot("with broadcast address", bc_ip_addr);
+	AddFilterAddr(pClient->ignore_dst_addrs, &pClient->num_ignore_dst_addrs, bc_ip_addr);
 
 	return 0;
 }
 
 /* Function which sets up filters to ignore
 		 connections to and from local interfaces */
-int IPACM_ConntrackClient::IPA_Conntrack_Filters_Ignore_Local_Addrs
-(
-	 struct nfct_filter *filter
-)
+int IPACM_ConntrackClient::IPA_Conntrack_Filters_Ignore_Local_Addrs(void)
 {
-	struct nfct_filter_ipv4 filter_ipv4;
+	IPACM_ConntrackClient *pClient = IPACM_ConntrackClient::GetInstance();
 
 	/* ignore whatever is destined to or originates from broadcast ip address */
-	filter_ipv4.addr = 0xffffffff;
-	filter_ipv4.mask = 0xffffffff;
-
-	nfct_filter_set_logic(filter,
-												NFCT_FILTER_DST_IPV4,
-												NFCT_FILTER_LOGIC_NEGATIVE);
-
-	nfct_filter_add_attr(filter, NFCT_FILTER_DST_IPV4, &filter_ipv4);
-
-	nfct_filter_set_logic(filter,
-												NFCT_FILTER_SRC_IPV4,
-												NFCT_FILTER_LOGIC_NEGATIVE);
-
-	nfct_filter_add_attr(filter, NFCT_FILTER_SRC_IPV4, &filter_ipv4);
-
-	return 0;
+	return AddFilterAddr(pClient->ignore_addrs, &pClient->num_ignore_addrs, BROADCAST_IPV4_ADDR);
 } /* IPA_Conntrack_Filters_Ignore_Local_Addrs() */
 
-/* Initialize TCP Filter */
-int IPACM_ConntrackClient::IPA_Conntrack_TCP_Filter_Init(void)
+/* Compiles the ignore lists and the protocol into a new filter,
+	 libnetfilter_conntrack turns it into one bpf program */
+struct nfct_filter *IPACM_ConntrackClient::BuildFilter(uint8_t l4proto)
 {
-	int ret = 0;
-	IPACM_ConntrackClient *pClient;
-
-	IPACMDBG("\n");
+	IPACM_ConntrackClient *pClient = IPACM_ConntrackClient::GetInstance();
+	struct nfct_filter *filter;
+	struct nfct_filter_ipv4 filter_ipv4;
+	struct nfct_filter_proto tcp_proto_state;
+	int cnt;
 
-	pClient = IPACM_ConntrackClient::GetInstance();
-	if(pClient == NULL)
+	filter = nfct_filter_create();
+	if(filter == NULL)
 	{
-		IPACMERR("unable to get conntrack client instance\n");
-		return -1;
+		IPACMERR("unable to create filter\n");
+		return NULL;
 	}
 
-	ret = nfct_filter_set_logic(pClient->tcp_filter,
-															NFCT_FILTER_L4PROTO,
-															NFCT_FILTER_LOGIC_POSITIVE);
-	if(ret == -1)
+	if(nfct_filter_set_logic(filter, NFCT_FILTER_L4PROTO, NFCT_FILTER_LOGIC_POSITIVE) == -1)
 	{
 		IPACMERR("Unable to set filter logic\n");
-		return -1;
+		nfct_filter_destroy(filter);
+		return NULL;
 	}
+	nfct_filter_add_attr_u32(filter, NFCT_FILTER_L4PROTO, l4proto);
 
-	/* set protocol filters as tcp and udp */
-	nfct_filter_add_attr_u32(pClient->tcp_filter, NFCT_FILTER_L4PROTO, IPPROTO_TCP);
+	if(IPPROTO_TCP == l4proto)
+	{
+		if(nfct_filter_set_logic(filter, NFCT_FILTER_L4PROTO_STATE, NFCT_FILTER_LOGIC_POSITIVE) == -1)
+		{
+			IPACMERR("unable to set filter logic\n");
+			nfct_filter_destroy(filter);
+			return NULL;
+		}
 
+		tcp_proto_state.proto = IPPROTO_TCP;
+		tcp_proto_state.state = TCP_CONNTRACK_ESTABLISHED;
+		nfct_filter_add_attr(filter, NFCT_FILTER_L4PROTO_STATE, &tcp_proto_state);
 
-	struct nfct_filter_proto tcp_proto_state;
-	tcp_proto_state.proto = IPPROTO_TCP;
-	tcp_proto_state.state = TCP_CONNTRACK_ESTABLISHED;
+		tcp_proto_state.state = TCP_CONNTRACK_FIN_WAIT;
+		nfct_filter_add_attr(filter, NFCT_FILTER_L4PROTO_STATE, &tcp_proto_state);
+	}
 
-	ret = nfct_filter_set_logic(pClient->tcp_filter,
-															NFCT_FILTER_L4PROTO_STATE,
-															NFCT_FILTER_LOGIC_POSITIVE);
-	if(ret == -1)
+	if(pClient->num_ignore_addrs > 0 || pClient->num_ignore_dst_addrs > 0)
 	{
-		IPACMERR("unable to set filter logic\n");
-		return -1;
+		nfct_filter_set_logic(filter, NFCT_FILTER_DST_IPV4, NFCT_FILTER_LOGIC_NEGATIVE);
+	}
+	if(pClient->num_ignore_addrs > 0)
+	{
+		nfct_filter_set_logic(filter, NFCT_FILTER_SRC_IPV4, NFCT_FILTER_LOGIC_NEGATIVE);
 	}
-	nfct_filter_add_attr(pClient->tcp_filter,
-											 NFCT_FILTER_L4PROTO_STATE,
-											 &tcp_proto_state);
-
 
-	tcp_proto_state.proto = IPPROTO_TCP;
-	tcp_proto_state.state = TCP_CONNTRACK_FIN_WAIT;
-	ret = nfct_filter_set_logic(pClient->tcp_filter,
-															NFCT_FILTER_L4PROTO_STATE,
-															NFCT_FILTER_LOGIC_POSITIVE);
-	if(ret == -1)
+	filter_ipv4.mask = 0xffffffff;
+	for(cnt = 0; cnt < pClient->num_ignore_addrs; cnt++)
 	{
-		IPACMERR("unable to set filter logic\n");
-		return -1;
+		filter_ipv4.addr = pClient->ignore_addrs[cnt];
+		nfct_filter_add_attr(filter, NFCT_FILTER_DST_IPV4, &filter_ipv4);
+		nfct_filter_add_attr(filter, NFCT_FILTER_SRC_IPV4, &filter_ipv4);
+	}
+	for(cnt = 0; cnt < pClient->num_ignore_dst_addrs; cnt++)
+	{
+		filter_ipv4.addr = pClient->ignore_dst_addrs[cnt];
+		nfct_filter_add_attr(filter, NFCT_FILTER_DST_IPV4, &filter_ipv4);
 	}
 
-	nfct_filter_add_attr(pClient->tcp_filter,
-											 NFCT_FILTER_L4PROTO_STATE,
-											 &tcp_proto_state);
-	return 0;
+	return filter;
 }
 
-
-/* Initialize UDP Filter */
-int IPACM_ConntrackClient::IPA_Conntrack_UDP_Filter_Init(void)
+/* Compiles new tcp and udp filters and attaches them to the open
+	 handles. SO_ATTACH_FILTER replaces the old program atomically, so
+	 the sockets never run without a filter. Called with filter_lock */
+int IPACM_ConntrackClient::AttachFilters(void)
 {
-	int ret = 0;
 	IPACM_ConntrackClient *pClient = IPACM_ConntrackClient::GetInstance();
-	if(pClient == NULL)
+	struct nfct_filter *tcp, *udp;
+	int ret = 0;
+
+	tcp = BuildFilter(IPPROTO_TCP);
+	udp = BuildFilter(IPPROTO_UDP);
+	if(tcp == NULL || udp == NULL)
 	{
-		IPACMERR("unable to get conntrack client instance\n");
+		IPACMERR("unable to build conntrack filters\n");
+		if(tcp != NULL)
+		{
+			nfct_filter_destroy(tcp);
+		}
+		if(udp != NULL)
+		{
+			nfct_filter_destroy(udp);
+		}
 		return -1;
 	}
 
-	ret = nfct_filter_set_logic(pClient->udp_filter,
-															NFCT_FILTER_L4PROTO,
-															NFCT_FILTER_LOGIC_POSITIVE);
-	if(ret == -1)
+	if(pClient->tcp_hdl != NULL &&
+		 nfct_filter_attach(nfct_fd(pClient->tcp_hdl), tcp) == -1)
 	{
-		IPACMERR("unable to set filter logic\n");
+		PERROR("unable to attach the filter to tcp handle\n");
+		ret = -1;
+	}
+	if(pClient->udp_hdl != NULL &&
+		 nfct_filter_attach(nfct_fd(pClient->udp_hdl), udp) == -1)
+	{
+		PERROR("unable to attach the filter to udp handle\n");
+		ret = -1;
 	}
-	/* set protocol filters as tcp and udp */
-	nfct_filter_add_attr_u32(pClient->udp_filter, NFCT_FILTER_L4PROTO, IPPROTO_UDP);
 
-	return 0;
+	if(pClient->tcp_filter != NULL)
+	{
+		nfct_filter_destroy(pClient->tcp_filter);
+	}
+	if(pClient->udp_filter != NULL)
+	{
+		nfct_filter_destroy(pClient->udp_filter);
+	}
+	pClient->tcp_filter = tcp;
+	pClient->udp_filter = udp;
+
+	pClient->filter_stats.rebuilds++;
+	IPACMDBG_H("conntrack filter %d: %d addresses, %d broadcast addresses ignored\n",
+						 pClient->filter_stats.rebuilds, pClient->num_ignore_addrs,
+						 pClient->num_ignore_dst_addrs);
+	IPACMDBG_H("conntrack events: %d received, %d accepted, %d dropped\n",
+						 pClient->filter_stats.received, pClient->filter_stats.accepted,
+						 pClient->filter_stats.dropped);
+	return ret;
+}
+
+/* ALG connections are never offloaded. The private and target ports
+	 of the nat rule are among the original ports and the reply source
+	 port */
+bool IPACM_ConntrackClient::isAlgConnection(struct nf_conntrack *ct)
+{
+	NatApp *nat_inst = NatApp::GetInstance();
+	uint8_t l4proto;
+
+	if(nat_inst == NULL)
+	{
+		return false;
+	}
+
+	l4proto = nfct_get_attr_u8(ct, ATTR_ORIG_L4PROTO);
+	return (nat_inst->isAlgPort(l4proto, ntohs(nfct_get_attr_u16(ct, ATTR_ORIG_PORT_SRC))) ||
+					nat_inst->isAlgPort(l4proto, ntohs(nfct_get_attr_u16(ct, ATTR_ORIG_PORT_DST))) ||
+					nat_inst->isAlgPort(l4proto, ntohs(nfct_get_attr_u16(ct, ATTR_REPL_PORT_SRC))));
+}
+
+void IPACM_ConntrackClient::GetFilterStats(ipacm_ct_filter_stats *stats)
+{
+	IPACM_ConntrackClient *pClient = IPACM_ConntrackClient::GetInstance();
+
+	pthread_mutex_lock(&pClient->filter_lock);
+	memcpy(stats, &pClient->filter_stats, sizeof(*stats));
+	pthread_mutex_unlock(&pClient->filter_lock);
 }
 
 void* IPACM_ConntrackClient::UDPConnTimeoutUpdate(void *ptr)
@@ -397,8 +589,7 @@ void* IPACM_ConntrackClient::UDPConnTimeoutUpdate(void *ptr)
 
 	while(1)
 	{
-		nat_inst->UpdateUDPTimeStamp();
-		sleep(UDP_TIMEOUT_UPDATE);
+		nat_inst->WaitSweep(nat_inst->SweepTimeStamps());
 	} /* end of while(1) loop */
 
 #ifdef IPACM_DEBUG
@@ -408,10 +599,40 @@ void* IPACM_ConntrackClient::UDPConnTimeoutUpdate(void *ptr)
 	return NULL;
 }
 
-/* Thread to initialize TCP Conntrack Filters*/
-void* IPACM_ConntrackClient::TCPRegisterWithConnTrack(void *)
+/* Non-blocking receive on a large buffer. Overruns must be reported
+	 with ENOBUFS as they trigger the resync, so NETLINK_NO_ENOBUFS is
+	 kept off */
+int IPACM_ConntrackClient::SetupEventSocket(struct nfct_handle *hdl)
+{
+	int fd = nfct_fd(hdl);
+	int flags, val;
+
+	flags = fcntl(fd, F_GETFL, 0);
+	if(flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0)
+	{
+		IPACMERR("unable to set fd %d non blocking (%s)\n", fd, strerror(errno));
+		return -1;
+	}
+
+	val = IPACM_CT_RCVBUF_SIZE;
+	if(setsockopt(fd, SOL_SOCKET, SO_RCVBUFFORCE, &val, sizeof(val)) < 0 &&
+		 setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &val, sizeof(val)) < 0)
+	{
+		IPACMERR("unable to set receive buffer of fd %d (%s)\n", fd, strerror(errno));
+	}
+
+	val = 0;
+	if(setsockopt(fd, SOL_NETLINK, NETLINK_NO_ENOBUFS, &val, sizeof(val)) < 0)
+	{
+		IPACMDBG("unable to clear NETLINK_NO_ENOBUFS on fd %d (%s)\n", fd, strerror(errno));
+	}
+
+	return 0;
+}
+
+/* Initialize TCP Conntrack Filters and handle */
+int IPACM_ConntrackClient::TCPRegisterWithConnTrack(void)
 {
-	int ret;
 	IPACM_ConntrackClient *pClient;
 	unsigned subscrips = 0;
 
@@ -421,7 +642,7 @@ void* IPACM_ConntrackClient::TCPRegisterWithConnTrack(void *)
 	if(pClient == NULL)
 	{
 		IPACMERR("unable to get conntrack client instance\n");
-		return NULL;
+		return -1;
 	}
 
 	subscrips = (NF_NETLINK_CONNTRACK_UPDATE | NF_NETLINK_CONNTRACK_DESTROY);
@@ -433,23 +654,12 @@ void* IPACM_ConntrackClient::TCPRegisterWithConnTrack(void *)
 	if(pClient->tcp_hdl == NULL)
 	{
 		PERROR("nfct_open\n");
-		return NULL;
-	}
-
-	/* Initialize the filter */
-	ret = IPA_Conntrack_TCP_Filter_Init();
-	if(ret == -1)
-	{
-		IPACMERR("Unable to initliaze TCP Filter\n");
-		return NULL;
+		return -1;
 	}
 
-	/* Attach the filter to net filter handler */
-	ret = nfct_filter_attach(nfct_fd(pClient->tcp_hdl), pClient->tcp_filter);
-	if(ret == -1)
+	if(SetupEventSocket(pClient->tcp_hdl) == -1)
 	{
-		IPACMDBG("unable to attach TCP filter\n");
-		return NULL;
+		return -1;
 	}
 
 	/* Register callback with netfilter handler */
@@ -457,43 +667,17 @@ void* IPACM_ConntrackClient::TCPRegisterWithConnTrack(void *)
 #ifndef CT_OPT
 	nfct_callback_register(pClient->tcp_hdl,
 			(nf_conntrack_msg_type)	(NFCT_T_UPDATE | NFCT_T_DESTROY | NFCT_T_NEW),
-						IPAConntrackEventCB, NULL);
+						IPAConntrackEventCB, &pClient->ct_batch);
 #else
-	nfct_callback_register(pClient->tcp_hdl, (nf_conntrack_msg_type) NFCT_T_ALL, IPAConntrackEventCB, NULL);
+	nfct_callback_register(pClient->tcp_hdl, (nf_conntrack_msg_type) NFCT_T_ALL, IPAConntrackEventCB, &pClient->ct_batch);
 #endif
 
-	/* Block to catch events from net filter connection track */
-	/* nfct_catch() receives conntrack events from kernel-space, by default it
-			 blocks waiting for events. */
-	IPACMDBG("Waiting for events\n");
-
-	ret = nfct_catch(pClient->tcp_hdl);
-	if(ret == -1)
-	{
-		IPACMERR("(%d)(%s)\n", ret, strerror(errno));
-		return NULL;
-	}
-
-	IPACMDBG("Exit from tcp thread\n");
-
-	/* destroy the filter.. this will not detach the filter */
-	nfct_filter_destroy(pClient->tcp_filter);
-	pClient->tcp_filter = NULL;
-
-	/* de-register the callback */
-	nfct_callback_unregister(pClient->tcp_hdl);
-	/* close the handle */
-	nfct_close(pClient->tcp_hdl);
-	pClient->tcp_hdl = NULL;
-
-	pthread_exit(NULL);
-	return NULL;
+	return 0;
 }
 
-/* Thread to initialize UDP Conntrack Filters*/
-void* IPACM_ConntrackClient::UDPRegisterWithConnTrack(void *)
+/* Initialize UDP Conntrack Filters and handle */
+int IPACM_ConntrackClient::UDPRegisterWithConnTrack(void)
 {
-	int ret;
 	IPACM_ConntrackClient *pClient = NULL;
 
 	IPACMDBG("\n");
@@ -502,7 +686,7 @@ void* IPACM_ConntrackClient::UDPRegisterWithConnTrack(void *)
 	if(pClient == NULL)
 	{
 		IPACMERR("unable to retrieve instance of conntrack client\n");
-		return NULL;
+		return -1;
 	}
 
 	pClient->udp_hdl = nfct_open(CONNTRACK,
@@ -510,23 +694,12 @@ void* IPACM_ConntrackClient::UDPRegisterWithConnTrack(void *)
 	if(pClient->udp_hdl == NULL)
 	{
 		PERROR("nfct_open\n");
-		return NULL;
-	}
-
-	/* Initialize Filter */
-	ret = IPA_Conntrack_UDP_Filter_Init();
-	if(-1 == ret)
-	{
-		IPACMDBG("Unable to initalize udp filters\n");
-		return NULL;
+		return -1;
 	}
 
-	/* Attach the filter to net filter handler */
-	ret = nfct_filter_attach(nfct_fd(pClient->udp_hdl), pClient->udp_filter);
-	if(ret == -1)
+	if(SetupEventSocket(pClient->udp_hdl) == -1)
 	{
-		IPACMDBG("unable to attach the filter\n");
-		return NULL;
+		return -1;
 	}
 
 	/* Register callback with netfilter handler */
@@ -534,89 +707,277 @@ void* IPACM_ConntrackClient::UDPRegisterWithConnTrack(void *)
 	nfct_callback_register(pClient->udp_hdl,
 			(nf_conntrack_msg_type)(NFCT_T_NEW | NFCT_T_DESTROY),
 			IPAConntrackEventCB,
-			NULL);
+			&pClient->ct_batch);
 
-	/* Block to catch events from net filter connection track */
-ctcatch:
-	ret = nfct_catch(pClient->udp_hdl);
-	if(ret == -1)
+	return 0;
+}
+
+/* Reads the socket until it is drained. Returns 1 if events were
+	 lost to a receive buffer overrun, -1 on error */
+int IPACM_ConntrackClient::CatchEvents(struct nfct_handle *hdl)
+{
+	int ret;
+
+	while(1)
 	{
-		IPACMDBG("(%d)(%s)\n", ret, strerror(errno));
-		return NULL;
+		ret = nfct_catch(hdl);
+		if(ret != -1)
+		{
+			continue;
+		}
+
+		switch(errno)
+		{
+		case EAGAIN:
+#if EWOULDBLOCK != EAGAIN
+		case EWOULDBLOCK:
+#endif
+			return 0;
+		case EINTR:
+			continue;
+		case ENOBUFS:
+			IPACMERR("conntrack events lost on fd %d\n", nfct_fd(hdl));
+			return 1;
+		default:
+			IPACMERR("(%d)(%s)\n", ret, strerror(errno));
+			return -1;
+		}
 	}
-	else
+}
+
+/* The dump reports the connections as updates, the listener only
+	 adds udp connections on a new event. Tcp connections are passed
+	 in any state, the listener adds the established ones and deletes
+	 the closing ones */
+int IPACM_ConntrackClient::IPAConntrackDumpCB
+(
+	 enum nf_conntrack_msg_type type,
+	 struct nf_conntrack *ct,
+	 void *data
+	 )
+{
+	uint8_t l4proto;
+
+	l4proto = nfct_get_attr_u8(ct, ATTR_ORIG_L4PROTO);
+	if(IPPROTO_UDP == l4proto)
+	{
+		type = NFCT_T_NEW;
+	}
+	else if(IPPROTO_TCP != l4proto)
 	{
-		IPACMDBG("ctcatch ret:%d\n", ret);
-		goto ctcatch;
+		return NFCT_CB_CONTINUE;
 	}
 
-	IPACMDBG("Exit from udp thread with ret: %d\n", ret);
+	return IPAConntrackEventCB(type, ct, data);
+}
 
-	/* destroy the filter.. this will not detach the filter */
-	nfct_filter_destroy(pClient->udp_filter);
-	pClient->udp_filter = NULL;
+/* Feed the current ipv4 conntrack table through the event path, run
+	 when the reader starts, on wan up and when events were lost. The
+	 listener filters the connections as it does events and they reach
+	 the nat table with the bulk adds of the batches, connections
+	 already offloaded are dropped as duplicates by NatApp */
+void IPACM_ConntrackClient::Resync(void)
+{
+	IPACM_ConntrackClient *pClient = IPACM_ConntrackClient::GetInstance();
+	uint32_t family = AF_INET;
 
-	/* de-register the callback */
-	nfct_callback_unregister(pClient->udp_hdl);
-	/* close the handle */
-	nfct_close(pClient->udp_hdl);
-	pClient->udp_hdl = NULL;
+	if(pClient->dump_hdl == NULL)
+	{
+		pClient->dump_hdl = nfct_open(CONNTRACK, 0);
+		if(pClient->dump_hdl == NULL)
+		{
+			PERROR("nfct_open\n");
+			return;
+		}
+		nfct_callback_register(pClient->dump_hdl, NFCT_T_ALL,
+				IPAConntrackDumpCB, &pClient->ct_batch);
+	}
 
-	pthread_exit(NULL);
-	return NULL;
+	pClient->resync_cnt++;
+	IPACMDBG_H("conntrack resync %d\n", pClient->resync_cnt);
+	if(nfct_query(pClient->dump_hdl, NFCT_Q_DUMP, &family) == -1)
+	{
+		IPACMERR("conntrack dump failed (%s)\n", strerror(errno));
+	}
+	FlushBatch(&pClient->ct_batch);
 }
 
-void IPACM_ConntrackClient::UpdateUDPFilters(void *param, bool isWan)
+/* Ask the reader thread for a resync, requests made before the
+	 reader gets to it are served by one dump */
+void IPACM_ConntrackClient::RequestResync(void)
 {
-	static bool isIgnore = false;
-	int ret = 0;
-	IPACM_ConntrackClient *pClient = NULL;
+	IPACM_ConntrackClient *pClient = IPACM_ConntrackClient::GetInstance();
+	uint64_t val = 1;
+
+	if(pClient == NULL || pClient->resync_fd < 0)
+	{
+		return;
+	}
+
+	if(write(pClient->resync_fd, &val, sizeof(val)) != sizeof(val))
+	{
+		IPACMERR("unable to request conntrack resync (%s)\n", strerror(errno));
+	}
+}
+
+/* Thread reading the TCP and UDP conntrack events */
+void* IPACM_ConntrackClient::ConnTrackReader(void *)
+{
+	struct epoll_event ev, events[IPACM_CT_MAX_EPOLL_EVENTS];
+	struct nfct_handle *hdl;
+	IPACM_ConntrackClient *pClient;
+	int epoll_fd, num, cnt, ret;
+	uint64_t val;
+	bool resync;
+
+	IPACMDBG("\n");
 
 	pClient = IPACM_ConntrackClient::GetInstance();
 	if(pClient == NULL)
 	{
-		IPACMERR("unable to retrieve conntrack client instance\n");
-		return;
+		IPACMERR("unable to get conntrack client instance\n");
+		return NULL;
 	}
 
-	if(pClient->udp_filter == NULL)
+	if(TCPRegisterWithConnTrack() == -1 || UDPRegisterWithConnTrack() == -1)
 	{
-		 return;
+		IPACMERR("unable to register with conntrack\n");
+		return NULL;
 	}
 
-	if(!isWan)
+	/* Attach the filters to net filter handlers */
+	pthread_mutex_lock(&pClient->filter_lock);
+	ret = AttachFilters();
+	pthread_mutex_unlock(&pClient->filter_lock);
+	if(ret == -1)
 	{
-		IPA_Conntrack_Filters_Ignore_Local_Iface(pClient->udp_filter,
-																		 (ipacm_event_iface_up *)param);
+		IPACMERR("unable to attach conntrack filters\n");
+		return NULL;
+	}
+
+	epoll_fd = epoll_create(IPACM_CT_MAX_EPOLL_EVENTS);
+	if(epoll_fd < 0)
+	{
+		PERROR("epoll_create\n");
+		return NULL;
+	}
 
-		if(!isIgnore)
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.ptr = pClient->tcp_hdl;
+	if(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, nfct_fd(pClient->tcp_hdl), &ev) < 0)
+	{
+		PERROR("epoll_ctl\n");
+		close(epoll_fd);
+		return NULL;
+	}
+	ev.data.ptr = pClient->udp_hdl;
+	if(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, nfct_fd(pClient->udp_hdl), &ev) < 0)
+	{
+		PERROR("epoll_ctl\n");
+		close(epoll_fd);
+		return NULL;
+	}
+	if(pClient->resync_fd >= 0)
+	{
+		ev.data.ptr = NULL;
+		if(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, pClient->resync_fd, &ev) < 0)
 		{
-			IPA_Conntrack_Filters_Ignore_Bridge_Addrs(pClient->udp_filter);
-			IPA_Conntrack_Filters_Ignore_Local_Addrs(pClient->udp_filter);
-			isIgnore = true;
+			PERROR("epoll_ctl\n");
 		}
 	}
 
-	/* Attach the filter to udp handle */
-	if(pClient->udp_hdl != NULL)
+	/* connections made before the daemon started are only in the
+		 conntrack table */
+	RequestResync();
+
+	/* Block to catch events from net filter connection track, the
+		 wait is cut short by an open batch */
+	IPACMDBG("Waiting for events\n");
+	while(1)
 	{
-		IPACMDBG("attaching the filter to udp handle\n");
-		ret = nfct_filter_attach(nfct_fd(pClient->udp_hdl), pClient->udp_filter);
-		if(ret == -1)
+		num = epoll_wait(epoll_fd, events, IPACM_CT_MAX_EPOLL_EVENTS,
+										 BatchTimeLeft(&pClient->ct_batch));
+		if(num < 0)
 		{
-			PERROR("unable to attach the filter to udp handle\n");
-			IPACMERR("udp handle:%p, fd:%d Error: %d\n",pClient->udp_hdl, nfct_fd(pClient->udp_hdl), ret);
-			return;
+			if(errno == EINTR)
+			{
+				continue;
+			}
+			PERROR("epoll_wait\n");
+			break;
+		}
+
+		resync = false;
+		for(cnt = 0; cnt < num; cnt++)
+		{
+			hdl = (struct nfct_handle *)events[cnt].data.ptr;
+			if(hdl == NULL)
+			{
+				if(read(pClient->resync_fd, &val, sizeof(val)) == sizeof(val))
+				{
+					resync = true;
+				}
+				continue;
+			}
+
+			ret = CatchEvents(hdl);
+			if(ret == -1)
+			{
+				goto exit;
+			}
+			if(ret == 1)
+			{
+				resync = true;
+				/* the socket may still hold events after the overrun */
+				if(CatchEvents(hdl) == -1)
+				{
+					goto exit;
+				}
+			}
+		}
+
+		if(resync)
+		{
+			FlushBatch(&pClient->ct_batch);
+			Resync();
+		}
+
+		if(BatchTimeLeft(&pClient->ct_batch) == 0)
+		{
+			FlushBatch(&pClient->ct_batch);
 		}
 	}
 
-	return;
+exit:
+	IPACMDBG("Exit from conntrack thread\n");
+	FlushBatch(&pClient->ct_batch);
+	close(epoll_fd);
+
+	/* de-register the callback */
+	nfct_callback_unregister(pClient->tcp_hdl);
+	nfct_callback_unregister(pClient->udp_hdl);
+	/* close the handle */
+	pthread_mutex_lock(&pClient->filter_lock);
+	nfct_close(pClient->tcp_hdl);
+	pClient->tcp_hdl = NULL;
+	nfct_close(pClient->udp_hdl);
+	pClient->udp_hdl = NULL;
+	pthread_mutex_unlock(&pClient->filter_lock);
+	if(pClient->dump_hdl != NULL)
+	{
+		nfct_close(pClient->dump_hdl);
+		pClient->dump_hdl = NULL;
+	}
+
+	pthread_exit(NULL);
+	return NULL;
 }
 
-void IPACM_ConntrackClient::UpdateTCPFilters(void *param, bool isWan)
+/* Ignore the connections of a local interface that came up, the
+	 whole interest set is compiled again */
+void IPACM_ConntrackClient::UpdateFilters(ipacm_event_iface_up *param)
 {
-	static bool isIgnore = false;
-	int ret = 0;
 	IPACM_ConntrackClient *pClient = NULL;
 
 	pClient = IPACM_ConntrackClient::GetInstance();
@@ -626,35 +987,21 @@ void IPACM_ConntrackClient::UpdateTCPFilters(void *param, bool isWan)
 		return;
 	}
 
-	if(pClient->tcp_filter == NULL)
-		return;
+	pthread_mutex_lock(&pClient->filter_lock);
 
-	if(!isWan)
+	IPA_Conntrack_Filters_Ignore_Local_Iface(param);
+	IPA_Conntrack_Filters_Ignore_Local_Addrs();
+	if(!pClient->bridge_ignored)
 	{
-		IPA_Conntrack_Filters_Ignore_Local_Iface(pClient->tcp_filter,
-																	(ipacm_event_iface_up *)param);
-
-		if(!isIgnore)
-		{
-			IPA_Conntrack_Filters_Ignore_Bridge_Addrs(pClient->udp_filter);
-			IPA_Conntrack_Filters_Ignore_Local_Addrs(pClient->udp_filter);
-			isIgnore = true;
-		}
+		pClient->bridge_ignored = (IPA_Conntrack_Filters_Ignore_Bridge_Addrs() != -1);
 	}
 
-	/* Attach the filter to tcp handle */
-	if(pClient->tcp_hdl != NULL)
+	if(pClient->tcp_hdl != NULL || pClient->udp_hdl != NULL)
 	{
-		IPACMDBG("attaching the filter to tcp handle\n");
-		ret = nfct_filter_attach(nfct_fd(pClient->tcp_hdl), pClient->tcp_filter);
-		if(ret == -1)
-		{
-			PERROR("unable to attach the filter to tcp handle\n");
-			IPACMERR("tcp handle:%p, fd:%d Error: %d\n",pClient->tcp_hdl, nfct_fd(pClient->tcp_hdl), ret);
-			return;
-		}
+		IPACMDBG("attaching the filters to conntrack handles\n");
+		AttachFilters();
 	}
 
-  return;
+	pthread_mutex_unlock(&pClient->filter_lock);
+	return;
 }
-
@@ -44,24 +44,29 @@ IPACM_ConntrackListener::IPACM_ConntrackListener()
 	 isCTReg = false;
 	 WanUp = false;
 	 nat_inst = NatApp::GetInstance();
+	 isBatching = false;
+	 nat_op_cnt = 0;
 
 	 NatIfaceCnt = 0;
 	 StaClntCnt = 0;
 	 pNatIfaces = NULL;
 	 pConfig = IPACM_Config::GetInstance();;
 
-	 memset(nat_iface_ipv4_addr, 0, sizeof(nat_iface_ipv4_addr));
-	 memset(nonnat_iface_ipv4_addr, 0, sizeof(nonnat_iface_ipv4_addr));
 	 memset(sta_clnt_ipv4_addr, 0, sizeof(sta_clnt_ipv4_addr));
+	 LoadPrivateSubnets();
 
 	 IPACM_EvtDispatcher::registr(IPA_HANDLE_WAN_UP, this);
 	 IPACM_EvtDispatcher::registr(IPA_HANDLE_WAN_DOWN, this);
 	 IPACM_EvtDispatcher::registr(IPA_PROCESS_CT_MESSAGE, this);
 	 IPACM_EvtDispatcher::registr(IPA_PROCESS_CT_MESSAGE_V6, this);
+	 IPACM_EvtDispatcher::registr(IPA_PROCESS_CT_BATCH, this);
+	 IPACM_EvtDispatcher::registr(IPA_HANDLE_CT_UPDATE_FAILED, this);
 	 IPACM_EvtDispatcher::registr(IPA_HANDLE_WLAN_UP, this);
 	 IPACM_EvtDispatcher::registr(IPA_HANDLE_LAN_UP, this);
 	 IPACM_EvtDispatcher::registr(IPA_NEIGH_CLIENT_IP_ADDR_ADD_EVENT, this);
 	 IPACM_EvtDispatcher::registr(IPA_NEIGH_CLIENT_IP_ADDR_DEL_EVENT, this);
+	 IPACM_EvtDispatcher::registr(IPA_PRIVATE_SUBNET_CHANGE_EVENT, this);
+	 IPACM_EvtDispatcher::registr(IPA_CFG_CHANGE_EVENT, this);
 
 #ifdef CT_OPT
 	 p_lan2lan = IPACM_LanToLan::getLan2LanInstance();
@@ -73,6 +78,18 @@ void IPACM_ConntrackListener::event_callback(ipa_cm_event_id evt,
 {
 	 ipacm_event_iface_up *wan_down = NULL;
 
+	 /* the private subnets and alg ports may have changed */
+	 if(evt == IPA_CFG_CHANGE_EVENT || evt == IPA_PRIVATE_SUBNET_CHANGE_EVENT)
+	 {
+		 IPACMDBG_H("Received event %d, reloading private subnets\n", evt);
+		 LoadPrivateSubnets();
+		 if(evt == IPA_CFG_CHANGE_EVENT && nat_inst != NULL)
+		 {
+			 nat_inst->LoadAlgPorts();
+		 }
+		 return;
+	 }
+
 	 if(data == NULL)
 	 {
 		 IPACMERR("Invalid Data\n");
@@ -86,6 +103,16 @@ void IPACM_ConntrackListener::event_callback(ipa_cm_event_id evt,
 			ProcessCTMessage(data);
 			break;
 
+	 case IPA_PROCESS_CT_BATCH:
+			IPACMDBG("Received IPA_PROCESS_CT_BATCH event\n");
+			ProcessCTBatch(data);
+			break;
+
+	 case IPA_HANDLE_CT_UPDATE_FAILED:
+			IPACMDBG("Received IPA_HANDLE_CT_UPDATE_FAILED event\n");
+			nat_inst->DeleteFailedFlows((nat_ct_failed_flows *)data);
+			break;
+
 #ifdef CT_OPT
 	 case IPA_PROCESS_CT_MESSAGE_V6:
 			IPACMDBG("Received IPA_PROCESS_CT_MESSAGE_V6 event\n");
@@ -119,8 +146,7 @@ void IPACM_ConntrackListener::event_callback(ipa_cm_event_id evt,
 							 evt, ((ipacm_event_iface_up *)data)->ifname,
 							 ((ipacm_event_iface_up *)data)->ipv4_addr);
 			CreateConnTrackThreads();
-			IPACM_ConntrackClient::UpdateUDPFilters(data, false);
-			IPACM_ConntrackClient::UpdateTCPFilters(data, false);
+			IPACM_ConntrackClient::UpdateFilters((ipacm_event_iface_up *)data);
 			break;
 
 	 case IPA_NEIGH_CLIENT_IP_ADDR_ADD_EVENT:
@@ -142,7 +168,7 @@ void IPACM_ConntrackListener::event_callback(ipa_cm_event_id evt,
 int IPACM_ConntrackListener::CheckNatIface(
    ipacm_event_data_all *data, bool *NatIface)
 {
-	int fd = 0, len = 0, cnt, i, j;
+	int fd = 0, len = 0, cnt, i;
 	struct ifreq ifr;
 	*NatIface = false;
 
@@ -213,8 +239,8 @@ int IPACM_ConntrackListener::CheckNatIface(
 					sizeof(pNatIfaces[i].iface_name)) == 0)
 		{
 			IPACMDBG_H("Nat iface (%s), entry (%d), dont cache",
-						pNatIfaces[i].iface_name, j);
-			iptodot("with ipv4 address: ", nat_iface_ipv4_addr[j]);
+						pNatIfaces[i].iface_name, i);
+			iptodot("with ipv4 address: ", data->ipv4_addr);
 			*NatIface = true;
 			return IPACM_SUCCESS;
 		}
@@ -228,7 +254,7 @@ void IPACM_ConntrackListener::HandleNonNatIPAddr(
 {
 	ipacm_event_data_all *data = (ipacm_event_data_all *)inParam;
 	bool NatIface = false;
-	int cnt, ret;
+	int ret;
 
 	if (isStaMode)
 	{
@@ -245,37 +271,67 @@ void IPACM_ConntrackListener::HandleNonNatIPAddr(
 		if (!NatIface && ret == IPACM_SUCCESS)
 		{
 			/* Cache the non nat iface ip address */
-			for (cnt = 0; cnt < MAX_IFACE_ADDRESS; cnt++)
+			if (addr_cls.Add(data->ipv4_addr, IPACM_ADDR_NONNAT) == 0)
 			{
-				if (nonnat_iface_ipv4_addr[cnt] == 0)
-				{
-					nonnat_iface_ipv4_addr[cnt] = data->ipv4_addr;
-					IPACMDBG("Add ip addr to non nat list (%d) ", cnt);
-					iptodot("with ipv4 address", nonnat_iface_ipv4_addr[cnt]);
-
-					/* Add dummy nat rule for non nat ifaces */
-					nat_inst->FlushTempEntries(data->ipv4_addr, true, true);
-					return;
-				}
+				iptodot("Add ip addr to non nat list with ipv4 address", data->ipv4_addr);
+
+				/* Add dummy nat rule for non nat ifaces */
+				nat_inst->FlushTempEntries(data->ipv4_addr, true, true);
+				return;
 			}
 		}
 	}
 	else
 	{
 		/* for delete operation */
-		for (cnt = 0; cnt < MAX_IFACE_ADDRESS; cnt++)
+		if (addr_cls.isClass(data->ipv4_addr, IPACM_ADDR_NONNAT))
 		{
-			if (nonnat_iface_ipv4_addr[cnt] == data->ipv4_addr)
-			{
-				IPACMDBG("Reseting ct filters, entry (%d) ", cnt);
-				iptodot("with ipv4 address", nonnat_iface_ipv4_addr[cnt]);
-				nonnat_iface_ipv4_addr[cnt] = 0;
-				nat_inst->FlushTempEntries(data->ipv4_addr, false);
-				nat_inst->DelEntriesOnClntDiscon(data->ipv4_addr);
-				return;
-			}
+			iptodot("Reseting ct filters with ipv4 address", data->ipv4_addr);
+			addr_cls.Del(data->ipv4_addr, IPACM_ADDR_NONNAT);
+			nat_inst->FlushTempEntries(data->ipv4_addr, false);
+			nat_inst->DelEntriesOnClntDiscon(data->ipv4_addr);
+			return;
 		}
+	}
+
+	return;
+}
+
+void IPACM_ConntrackListener::LoadPrivateSubnets(void)
+{
+	int cnt;
+
+	addr_cls.ClearSubnets(IPACM_ADDR_PRIVATE);
+	if(pConfig == NULL)
+	{
+		IPACMERR("Unable to get Config instance\n");
+		return;
+	}
 
+	for(cnt = 0; cnt < pConfig->ipa_num_private_subnet; cnt++)
+	{
+		IPACMDBG("Private subnet 0x%x mask 0x%x\n",
+				pConfig->private_subnet_table[cnt].subnet_addr,
+				pConfig->private_subnet_table[cnt].subnet_mask);
+		addr_cls.AddSubnet(pConfig->private_subnet_table[cnt].subnet_addr,
+				pConfig->private_subnet_table[cnt].subnet_mask, IPACM_ADDR_PRIVATE);
+	}
+
+	return;
+}
+
+void IPACM_ConntrackListener::LoadSTASubnets(void)
+{
+	int cnt;
+
+	addr_cls.ClearSubnets(IPACM_ADDR_STA_SUBNET);
+	for(cnt = 0; cnt < MAX_STA_CLNT_IFACES; cnt++)
+	{
+		if(sta_clnt_ipv4_addr[cnt] != 0)
+		{
+			addr_cls.AddSubnet(sta_clnt_ipv4_addr[cnt], STA_CLNT_SUBNET_MASK,
+					IPACM_ADDR_STA_SUBNET);
+		}
 	}
 
 	return;
@@ -285,28 +341,17 @@ void IPACM_ConntrackListener::HandleNeighIpAddrAddEvt(
    ipacm_event_data_all *data)
 {
 	bool NatIface = false;
-	int j, ret;
+	int ret;
 
 	ret = CheckNatIface(data, &NatIface);
 	if (NatIface && ret == IPACM_SUCCESS)
 	{
-		for (j = 0; j < MAX_IFACE_ADDRESS; j++)
-		{
-			/* check if duplicate NAT ip */
-			if (nat_iface_ipv4_addr[j] == data->ipv4_addr)
-				break;
-
-			/* Cache the new nat iface address */
-			if (nat_iface_ipv4_addr[j] == 0)
-			{
-				nat_iface_ipv4_addr[j] = data->ipv4_addr;
-				iptodot("Nating connections of addr: ", nat_iface_ipv4_addr[j]);
-				break;
-			}
-		}
+		/* Cache the new nat iface address, duplicates are fine */
+		iptodot("Nating connections of addr: ", data->ipv4_addr);
+		ret = addr_cls.Add(data->ipv4_addr, IPACM_ADDR_NAT);
 
 		/* Add the cached temp entries to NAT table */
-		if (j != MAX_IFACE_ADDRESS)
+		if (ret == 0)
 		{
 			nat_inst->ResetPwrSaveIf(data->ipv4_addr);
 			nat_inst->FlushTempEntries(data->ipv4_addr, true);
@@ -318,8 +363,6 @@ void IPACM_ConntrackListener::HandleNeighIpAddrAddEvt(
 void IPACM_ConntrackListener::HandleNeighIpAddrDelEvt(
    uint32_t ipv4_addr)
 {
-	int cnt;
-
 	if(ipv4_addr == 0)
 	{
 		IPACMDBG("Ignoring\n");
@@ -327,16 +370,12 @@ void IPACM_ConntrackListener::HandleNeighIpAddrDelEvt(
 	}
 
 	iptodot("HandleNeighIpAddrDelEvt(): Received ip addr", ipv4_addr);
-	for(cnt = 0; cnt<MAX_IFACE_ADDRESS; cnt++)
+	if (addr_cls.isClass(ipv4_addr, IPACM_ADDR_NAT))
 	{
-		if (nat_iface_ipv4_addr[cnt] == ipv4_addr)
-		{
-			IPACMDBG("Reseting ct nat iface, entry (%d) ", cnt);
-			iptodot("with ipv4 address", nat_iface_ipv4_addr[cnt]);
-			nat_iface_ipv4_addr[cnt] = 0;
-			nat_inst->FlushTempEntries(ipv4_addr, false);
-			nat_inst->DelEntriesOnClntDiscon(ipv4_addr);
-		}
+		iptodot("Reseting ct nat iface with ipv4 address", ipv4_addr);
+		addr_cls.Del(ipv4_addr, IPACM_ADDR_NAT);
+		nat_inst->FlushTempEntries(ipv4_addr, false);
+		nat_inst->DelEntriesOnClntDiscon(ipv4_addr);
 	}
 
 	return;
@@ -368,6 +407,9 @@ void IPACM_ConntrackListener::TriggerWANUp(void *in_param)
 		 nat_inst->AddTable(wanup_data->ipv4_addr);
 	 }
 
+	 /* offload the connections made while wan was down */
+	 IPACM_ConntrackClient::RequestResync();
+
 	 IPACMDBG("creating nat threads\n");
 	 CreateNatThreads();
 }
@@ -375,39 +417,22 @@ void IPACM_ConntrackListener::TriggerWANUp(void *in_param)
 int IPACM_ConntrackListener::CreateConnTrackThreads(void)
 {
 	int ret;
-	pthread_t tcp_thread = 0, udp_thread = 0;
+	pthread_t ct_thread = 0;
 
 	if(isCTReg == false)
 	{
-		if(!tcp_thread)
-		{
-			ret = pthread_create(&tcp_thread, NULL, IPACM_ConntrackClient::TCPRegisterWithConnTrack, NULL);
-			if(0 != ret)
-			{
-				IPACMERR("unable to create TCP conntrack event listner thread\n");
-				PERROR("unable to create TCP conntrack\n");
-				return -1;
-			}
-
-			IPACMDBG("created TCP conntrack event listner thread\n");
-			if(pthread_setname_np(tcp_thread, "tcp ct listener") != 0)
-			{
-				IPACMERR("unable to set thread name\n");
-			}
-		}
-
-		if(!udp_thread)
+		if(!ct_thread)
 		{
-			ret = pthread_create(&udp_thread, NULL, IPACM_ConntrackClient::UDPRegisterWithConnTrack, NULL);
+			ret = pthread_create(&ct_thread, NULL, IPACM_ConntrackClient::ConnTrackReader, NULL);
 			if(0 != ret)
 			{
-				IPACMERR("unable to create UDP conntrack event listner thread\n");
-				PERROR("unable to create UDP conntrack\n");
+				IPACMERR("unable to create conntrack event listner thread\n");
+				PERROR("unable to create conntrack\n");
 				goto error;
 			}
 
-			IPACMDBG("created UDP conntrack event listner thread\n");
-			if(pthread_setname_np(udp_thread, "udp ct listener") != 0)
+			IPACMDBG("created conntrack event listner thread\n");
+			if(pthread_setname_np(ct_thread, "ct listener") != 0)
 			{
 				IPACMERR("unable to set thread name\n");
 			}
@@ -686,10 +711,66 @@ void IPACM_ConntrackListener::ProcessCTMessage(void *param)
 	 return;
 }
 
+/* The nat entries of the whole batch are added and deleted together
+	 by NatApp::UpdateEntries() */
+void IPACM_ConntrackListener::ProcessCTBatch(void *param)
+{
+	 ipacm_ct_evt_batch *batch = (ipacm_ct_evt_batch *)param;
+	 int cnt;
+
+	 IPACMDBG("%d conntrack messages in batch\n", batch->num);
+
+	 isBatching = true;
+	 for(cnt = 0; cnt < batch->num; cnt++)
+	 {
+			ProcessCTMessage(&batch->evt[cnt]);
+	 }
+	 isBatching = false;
+
+	 FlushNatOps();
+	 return;
+}
+
+void IPACM_ConntrackListener::UpdateNatEntry(const nat_table_entry *rule, bool add)
+{
+	if (!isBatching)
+	{
+		if (add)
+		{
+			nat_inst->AddEntry(rule);
+		}
+		else
+		{
+			nat_inst->DeleteEntry(rule);
+		}
+		return;
+	}
+
+	if (nat_op_cnt == IPACM_CT_BATCH_MAX)
+	{
+		FlushNatOps();
+	}
+
+	memcpy(&nat_ops[nat_op_cnt].rule, rule, sizeof(nat_table_entry));
+	nat_ops[nat_op_cnt].add = add;
+	nat_op_cnt++;
+	return;
+}
+
+void IPACM_ConntrackListener::FlushNatOps(void)
+{
+	if (nat_op_cnt > 0)
+	{
+		nat_inst->UpdateEntries(nat_ops, nat_op_cnt);
+		nat_op_cnt = 0;
+	}
+	return;
+}
+
 bool IPACM_ConntrackListener::AddIface(
    nat_table_entry *rule, bool *isTempEntry)
 {
-	int cnt;
+	uint8_t cls;
 
 	*isTempEntry = false;
 
@@ -704,60 +785,33 @@ bool IPACM_ConntrackListener::AddIface(
 		}
 	}
 
+	/* one lookup for both ends of the connection */
+	cls = addr_cls.Classify(rule->private_ip, rule->target_ip);
+
 	/* check whether nat iface or not */
-	for (cnt = 0; cnt < MAX_IFACE_ADDRESS; cnt++)
+	if (cls & IPACM_ADDR_NAT)
 	{
-		if (nat_iface_ipv4_addr[cnt] != 0)
-		{
-			if (rule->private_ip == nat_iface_ipv4_addr[cnt] ||
-				rule->target_ip == nat_iface_ipv4_addr[cnt])
-			{
-				IPACMDBG("matched nat_iface_ipv4_addr entry(%d)\n", cnt);
-				iptodot("AddIface(): Nat entry match with ip addr",
-						nat_iface_ipv4_addr[cnt]);
-				return true;
-			}
-		}
+		IPACMDBG("matched nat iface address\n");
+		return true;
 	}
 
 	if (!isStaMode)
 	{
 		/* check whether non nat iface or not, on Non Nat iface
 		   add dummy rule by copying public ip to private ip */
-		for (cnt = 0; cnt < MAX_IFACE_ADDRESS; cnt++)
+		if (cls & IPACM_ADDR_NONNAT)
 		{
-			if (nonnat_iface_ipv4_addr[cnt] != 0)
-			{
-				if (rule->private_ip == nonnat_iface_ipv4_addr[cnt] ||
-					rule->target_ip == nonnat_iface_ipv4_addr[cnt])
-				{
-					IPACMDBG("matched non_nat_iface_ipv4_addr entry(%d)\n", cnt);
-					iptodot("AddIface(): Non Nat entry match with ip addr",
-							nonnat_iface_ipv4_addr[cnt]);
-
-					rule->private_ip = rule->public_ip;
-					rule->private_port = rule->public_port;
-					return true;
-				}
-			}
+			IPACMDBG("matched non nat iface address\n");
+			rule->private_ip = rule->public_ip;
+			rule->private_port = rule->public_port;
+			return true;
 		}
 		IPACMDBG_H("Not mtaching with non-nat ifaces\n");
 	}
 	else
 		IPACMDBG("In STA mode, don't compare against non nat ifaces\n");
 
-	if(pConfig == NULL)
-	{
-		pConfig = IPACM_Config::GetInstance();
-		if(pConfig == NULL)
-		{
-			IPACMERR("Unable to get Config instance\n");
-			return false;
-		}
-	}
-
-	if (pConfig->isPrivateSubnet(rule->private_ip) ||
-		pConfig->isPrivateSubnet(rule->target_ip))
+	if (cls & IPACM_ADDR_PRIVATE)
 	{
 		IPACMDBG("Matching with Private subnet\n");
 		*isTempEntry = true;
@@ -800,6 +854,7 @@ void IPACM_ConntrackListener::AddORDeleteNatEntry(const nat_entry_bundle *input)
 			if (!CtList->isWanUp())
 			{
 				IPACMDBG("Wan is not up, cache connections\n");
+				FlushNatOps();
 				nat_inst->CacheEntry(input->rule);
 			}
 			else if (input->isTempEntry)
@@ -808,7 +863,7 @@ void IPACM_ConntrackListener::AddORDeleteNatEntry(const nat_entry_bundle *input)
 			}
 			else
 			{
-				nat_inst->AddEntry(input->rule);
+				UpdateNatEntry(input->rule, true);
 			}
 		}
 		else if (TCP_CONNTRACK_FIN_WAIT == tcp_state ||
@@ -817,7 +872,7 @@ void IPACM_ConntrackListener::AddORDeleteNatEntry(const nat_entry_bundle *input)
 			IPACMDBG("TCP state TCP_CONNTRACK_FIN_WAIT(%d) "
 					 "or type NFCT_T_DESTROY(%d)\n", tcp_state, input->type);
 
-			nat_inst->DeleteEntry(input->rule);
+			UpdateNatEntry(input->rule, false);
 			nat_inst->DeleteTempEntry(input->rule);
 		}
 		else
@@ -835,6 +890,7 @@ void IPACM_ConntrackListener::AddORDeleteNatEntry(const nat_entry_bundle *input)
 			if (!CtList->isWanUp())
 			{
 				IPACMDBG("Wan is not up, cache connections\n");
+				FlushNatOps();
 				nat_inst->CacheEntry(input->rule);
 			}
 			else if (input->isTempEntry)
@@ -843,13 +899,13 @@ void IPACM_ConntrackListener::AddORDeleteNatEntry(const nat_entry_bundle *input)
 			}
 			else
 			{
-				nat_inst->AddEntry(input->rule);
+				UpdateNatEntry(input->rule, true);
 			}
 		}
 		else if (NFCT_T_DESTROY == input->type)
 		{
 			IPACMDBG("UDP connection close at time %ld\n", time(NULL));
-			nat_inst->DeleteEntry(input->rule);
+			UpdateNatEntry(input->rule, false);
 			nat_inst->DeleteTempEntry(input->rule);
 		}
 	}
@@ -985,7 +1041,7 @@ void IPACM_ConntrackListener::HandleLan2Lan(struct nf_conntrack *ct,
 void IPACM_ConntrackListener::CheckSTAClient(
    const nat_table_entry *rule, bool *isTempEntry)
 {
-	int nCnt;
+	uint8_t cls;
 
 	/* Check whether target is in STA client list or not
       if not ignore the connection */
@@ -994,23 +1050,17 @@ void IPACM_ConntrackListener::CheckSTAClient(
 		return;
 	 }
 
-	 if((sta_clnt_ipv4_addr[0] & STA_CLNT_SUBNET_MASK) !=
-		 (rule->target_ip & STA_CLNT_SUBNET_MASK))
+	 cls = addr_cls.Classify(rule->target_ip);
+	 if(!(cls & IPACM_ADDR_STA_SUBNET))
 	 {
 		IPACMDBG("STA client subnet mask not matching\n");
 		return;
 	 }
 
-	 IPACMDBG("StaClntCnt %d\n", StaClntCnt);
-	 for(nCnt = 0; nCnt < StaClntCnt; nCnt++)
+	 if(cls & IPACM_ADDR_STA)
 	 {
-		IPACMDBG("Comparing trgt_ip 0x%x with sta clnt ip: 0x%x\n",
-			 rule->target_ip, sta_clnt_ipv4_addr[nCnt]);
-		if(rule->target_ip == sta_clnt_ipv4_addr[nCnt])
-		{
-			IPACMDBG("Match index %d\n", nCnt);
-			return;
-		}
+		IPACMDBG("Matching with STA Clnt Ip Addr 0x%x\n", rule->target_ip);
+		return;
 	 }
 
 	IPACMDBG_H("Not matching with STA Clnt Ip Addrs 0x%x\n",
@@ -1166,6 +1216,8 @@ void IPACM_ConntrackListener::HandleSTAClientAddEvt(uint32_t clnt_ip_addr)
 			sta_clnt_ipv4_addr[cnt] = clnt_ip_addr;
 			StaClntCnt++;
 			IPACMDBG("STA client cnt %d\n", StaClntCnt);
+			addr_cls.Add(clnt_ip_addr, IPACM_ADDR_STA);
+			LoadSTASubnets();
 			break;
 		}
 
@@ -1191,6 +1243,8 @@ void IPACM_ConntrackListener::HandleSTAClientDelEvt(uint32_t clnt_ip_addr)
 			nat_inst->DelEntriesOnSTAClntDiscon(clnt_ip_addr);
 			StaClntCnt--;
 			IPACMDBG("STA client cnt %d\n", StaClntCnt);
+			addr_cls.Del(clnt_ip_addr, IPACM_ADDR_STA);
+			LoadSTASubnets();
 			break;
 		}
 	 }
@@ -0,0 +1,255 @@
+/*
+Copyright (c) 2016, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of The Linux Foundation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/*!
+	@file
+	IPACM_Conntrack_Classifier.cpp
+
+	@brief
+	This file implements the address classifier of the conntrack listener
+
+	@Author
+
+*/
+#include <string.h>
+
+#include "IPACM_Conntrack_Classifier.h"
+#include "IPACM_Log.h"
+
+AddrClassifier::AddrClassifier()
+{
+	memset(buckets, 0, sizeof(buckets));
+	count = 0;
+
+	memset(subnets, 0, sizeof(subnets));
+	num_subnets = 0;
+}
+
+uint32_t AddrClassifier::Hash(uint32_t addr)
+{
+	return (addr * 2654435761U) >> (32 - IPACM_ADDR_HASH_BITS);
+}
+
+/* Returns the bucket holding the address, or the empty bucket
+   where it would be inserted. Address 0 marks an empty bucket */
+int AddrClassifier::FindBucket(uint32_t addr)
+{
+	uint32_t pos = Hash(addr);
+
+	while(buckets[pos].addr != 0 && buckets[pos].addr != addr)
+	{
+		pos = (pos + 1) & (IPACM_ADDR_HASH_SIZE - 1);
+	}
+
+	return pos;
+}
+
+int AddrClassifier::Add(uint32_t addr, uint8_t cls)
+{
+	int pos;
+
+	if(addr == 0)
+	{
+		return -1;
+	}
+
+	pos = FindBucket(addr);
+	if(buckets[pos].addr == 0)
+	{
+		if(count >= IPACM_ADDR_HASH_SIZE / 2)
+		{
+			IPACMERR("address classifier is full, 0x%x not added\n", addr);
+			return -1;
+		}
+		buckets[pos].addr = addr;
+		buckets[pos].cls = 0;
+		count++;
+	}
+
+	buckets[pos].cls |= cls;
+	return 0;
+}
+
+/* backward shift deletion, keeps probe sequences intact
+	 without leaving tombstones behind */
+void AddrClassifier::Remove(int pos)
+{
+	uint32_t next = pos, home;
+	const uint32_t mask = IPACM_ADDR_HASH_SIZE - 1;
+
+	while(1)
+	{
+		next = (next + 1) & mask;
+		if(buckets[next].addr == 0)
+		{
+			break;
+		}
+
+		home = Hash(buckets[next].addr);
+		if(((next - home) & mask) >= ((next - pos) & mask))
+		{
+			buckets[pos] = buckets[next];
+			pos = next;
+		}
+	}
+
+	buckets[pos].addr = 0;
+	buckets[pos].cls = 0;
+	count--;
+}
+
+void AddrClassifier::Del(uint32_t addr, uint8_t cls)
+{
+	int pos;
+
+	if(addr == 0)
+	{
+		return;
+	}
+
+	pos = FindBucket(addr);
+	if(buckets[pos].addr == 0)
+	{
+		return;
+	}
+
+	buckets[pos].cls &= ~cls;
+	if(buckets[pos].cls == 0)
+	{
+		Remove(pos);
+	}
+}
+
+bool AddrClassifier::isClass(uint32_t addr, uint8_t cls)
+{
+	int pos;
+
+	if(addr == 0)
+	{
+		return false;
+	}
+
+	pos = FindBucket(addr);
+	return (buckets[pos].cls & cls) != 0;
+}
+
+/* Subnets with a longer prefix come first, a subnet also matches
+   the classes of the shorter subnets containing it */
+void AddrClassifier::UpdateSubnetMatch()
+{
+	int i, j;
+
+	for(i = 0; i < num_subnets; i++)
+	{
+		subnets[i].match = subnets[i].cls;
+		for(j = i + 1; j < num_subnets; j++)
+		{
+			if((subnets[i].addr & subnets[j].mask) == subnets[j].addr)
+			{
+				subnets[i].match |= subnets[j].cls;
+			}
+		}
+	}
+}
+
+int AddrClassifier::AddSubnet(uint32_t addr, uint32_t mask, uint8_t cls)
+{
+	subnet_class_entry entry;
+	int cnt;
+
+	addr &= mask;
+	for(cnt = 0; cnt < num_subnets; cnt++)
+	{
+		if(subnets[cnt].addr == addr && subnets[cnt].mask == mask)
+		{
+			subnets[cnt].cls |= cls;
+			UpdateSubnetMatch();
+			return 0;
+		}
+	}
+
+	if(num_subnets == IPACM_ADDR_MAX_SUBNETS)
+	{
+		IPACMERR("address classifier subnets full, 0x%x/0x%x not added\n", addr, mask);
+		return -1;
+	}
+
+	/* masks are contiguous, a longer prefix is a larger mask */
+	entry.addr = addr;
+	entry.mask = mask;
+	entry.cls = cls;
+	for(cnt = num_subnets; cnt > 0 && subnets[cnt - 1].mask < mask; cnt--)
+	{
+		subnets[cnt] = subnets[cnt - 1];
+	}
+	subnets[cnt] = entry;
+	num_subnets++;
+
+	UpdateSubnetMatch();
+	return 0;
+}
+
+void AddrClassifier::ClearSubnets(uint8_t cls)
+{
+	int cnt, num = 0;
+
+	for(cnt = 0; cnt < num_subnets; cnt++)
+	{
+		subnets[cnt].cls &= ~cls;
+		if(subnets[cnt].cls != 0)
+		{
+			subnets[num++] = subnets[cnt];
+		}
+	}
+	num_subnets = num;
+
+	UpdateSubnetMatch();
+}
+
+uint8_t AddrClassifier::Classify(uint32_t addr)
+{
+	uint8_t cls = IPACM_ADDR_IGNORE;
+	int cnt;
+
+	if(addr == 0)
+	{
+		return cls;
+	}
+
+	cls = buckets[FindBucket(addr)].cls;
+	for(cnt = 0; cnt < num_subnets; cnt++)
+	{
+		if((addr & subnets[cnt].mask) == subnets[cnt].addr)
+		{
+			cls |= subnets[cnt].match;
+			break;
+		}
+	}
+
+	return cls;
+}
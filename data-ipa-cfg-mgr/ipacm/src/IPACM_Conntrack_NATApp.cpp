@@ -26,8 +26,10 @@ WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
 OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
 IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
+#include <poll.h>
 #include "IPACM_Conntrack_NATApp.h"
 #include "IPACM_ConntrackClient.h"
+#include "IPACM_EvtPool.h"
 
 #define INVALID_IP_ADDR 0x0
 
@@ -35,27 +37,89 @@ IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 NatApp *NatApp::pInstance = NULL;
 NatApp::NatApp()
 {
+	pthread_condattr_t cond_attr;
+
 	max_entries = 0;
 	cache = NULL;
+	ts_snap = NULL;
+	hdl_idx = NULL;
+	hdl_idx_len = 0;
 
 	nat_table_hdl = 0;
 	pub_ip_addr = 0;
 
 	curCnt = 0;
 
-	pALGPorts = NULL;
-	nALGPort = 0;
+	memset(alg_tcp_ports, 0, sizeof(alg_tcp_ports));
+	memset(alg_udp_ports, 0, sizeof(alg_udp_ports));
 
 	ct = NULL;
 	ct_hdl = NULL;
 
-	memset(temp, 0, sizeof(temp));
+	ct_update_len = 0;
+	ct_last_msg = 0;
+	ct_update_cnt = 0;
+
+	tcp_timeout = 0;
+	udp_timeout = 0;
+	udp_unreplied_timeout = 0;
+	tcp_timeout_fd = -1;
+	udp_timeout_fd = -1;
+	udp_unreplied_timeout_fd = -1;
+	timeout_read_time = 0;
+
+	ct_sched = NULL;
+	for(int cnt = 0; cnt < CT_WHEEL_SLOTS; cnt++)
+	{
+		ct_wheel[cnt] = NAT_CACHE_INVALID_IDX;
+	}
+	ct_wheel_tick = 0;
+	ct_due = NULL;
+	ct_pending = NULL;
+	ct_drained = NULL;
+	ct_pending_cnt = 0;
+	ct_pending_overflow = false;
+	ct_last_sweep = 0;
+	ct_sweep_wake = 0;
+	pthread_condattr_init(&cond_attr);
+	pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&ct_sweep_cond, &cond_attr);
+	pthread_condattr_destroy(&cond_attr);
+	pthread_mutex_init(&ct_pending_lock, NULL);
+	memset(&sweep_stats, 0, sizeof(sweep_stats));
+
+	ct_hits = NULL;
+	hits_read_time = 0;
+	hits_snap = NULL;
+	hits_hdl_idx = NULL;
+	hits_hdl_idx_len = 0;
+	memset(&evict_udp, 0, sizeof(evict_udp));
+	memset(&evict_tcp, 0, sizeof(evict_tcp));
+	memset(&admit_stats, 0, sizeof(admit_stats));
+
+	tbl_entries = 0;
+	tbl_expn_entries = 0;
+	max_tbl_entries = 0;
+	max_tbl_expn_entries = 0;
+	resize_check_time = 0;
+	resize_rules = NULL;
+	resize_hdls = NULL;
+	resize_slots = NULL;
+	pthread_mutex_init(&ct_sweep_lock, NULL);
+	lost_pub_ip = 0;
+	restore_time = 0;
+
+	temp = NULL;
+	temp_age = NULL;
+	temp_oldest = NAT_CACHE_INVALID_IDX;
+	temp_newest = NAT_CACHE_INVALID_IDX;
+	max_temp_entries = 0;
+	memset(&temp_stats, 0, sizeof(temp_stats));
 }
 
 int NatApp::Init(void)
 {
 	IPACM_Config *pConfig;
-	int size = 0;
 
 	pConfig = IPACM_Config::GetInstance();
 	if(pConfig == NULL)
@@ -66,15 +130,143 @@ int NatApp::Init(void)
 
 	max_entries = pConfig->GetNatMaxEntries();
 
-	size = (sizeof(nat_table_entry) * max_entries);
-	cache = (nat_table_entry *)malloc(size);
-	if(cache == NULL)
+	if(nat_cache.Init(max_entries) != 0)
 	{
 		IPACMERR("Unable to allocate memory for cache\n");
 		goto fail;
 	}
-	IPACMDBG("Allocated %d bytes for config manager nat cache\n", size);
-	memset(cache, 0, size);
+	cache = nat_cache.GetEntries();
+	IPACMDBG("Allocated %d entries for config manager nat cache\n", max_entries);
+
+	ts_snap = (ipa_nat_ipv4_timestamp *)malloc(sizeof(ipa_nat_ipv4_timestamp) * max_entries);
+	if(ts_snap == NULL)
+	{
+		IPACMERR("Unable to allocate memory for timestamps\n");
+		goto fail;
+	}
+
+	ct_hits = (ct_hit_entry *)calloc(max_entries, sizeof(ct_hit_entry));
+	hits_snap = (ipa_nat_ipv4_timestamp *)malloc(sizeof(ipa_nat_ipv4_timestamp) * max_entries);
+	evict_udp.entry = (ct_evict_entry *)malloc(sizeof(ct_evict_entry) * max_entries);
+	evict_tcp.entry = (ct_evict_entry *)malloc(sizeof(ct_evict_entry) * max_entries);
+	if(ct_hits == NULL || hits_snap == NULL ||
+		 evict_udp.entry == NULL || evict_tcp.entry == NULL)
+	{
+		IPACMERR("Unable to allocate memory for admission control\n");
+		goto fail;
+	}
+
+	if(ipa_nat_get_ipv4_tbl_size(max_entries, &tbl_entries, &tbl_expn_entries) != 0)
+	{
+		IPACMERR("Unable to get nat table size for %d entries\n", max_entries);
+		goto fail;
+	}
+	max_tbl_entries = tbl_entries * CT_RESIZE_MAX_GROWTH;
+	if(tbl_entries * CT_RESIZE_MAX_GROWTH > CT_RESIZE_MAX_ENTRIES)
+	{
+		max_tbl_entries = (tbl_entries > CT_RESIZE_MAX_ENTRIES) ? tbl_entries : CT_RESIZE_MAX_ENTRIES;
+	}
+	max_tbl_expn_entries = tbl_expn_entries * CT_RESIZE_MAX_GROWTH;
+	if(tbl_expn_entries * CT_RESIZE_MAX_GROWTH > CT_RESIZE_MAX_ENTRIES)
+	{
+		max_tbl_expn_entries = (tbl_expn_entries > CT_RESIZE_MAX_ENTRIES) ? tbl_expn_entries : CT_RESIZE_MAX_ENTRIES;
+	}
+	IPACMDBG("nat table of %d/%d entries, grows up to %d/%d\n", tbl_entries,
+					 tbl_expn_entries, max_tbl_entries, max_tbl_expn_entries);
+
+	resize_rules = (ipa_nat_ipv4_rule *)malloc(sizeof(ipa_nat_ipv4_rule) * max_entries);
+	resize_hdls = (uint32_t *)malloc(sizeof(uint32_t) * max_entries);
+	resize_slots = (int *)malloc(sizeof(int) * max_entries);
+	if(resize_rules == NULL || resize_hdls == NULL || resize_slots == NULL)
+	{
+		IPACMERR("Unable to allocate memory for nat table resize\n");
+		goto fail;
+	}
+
+	max_temp_entries = pConfig->GetNatMaxTempEntries();
+	if(max_temp_entries <= 0)
+	{
+		max_temp_entries = DEFAULT_TEMP_ENTRIES;
+	}
+
+	if(temp_cache.Init(max_temp_entries) != 0)
+	{
+		IPACMERR("Unable to allocate memory for temp entries\n");
+		goto fail;
+	}
+	temp = temp_cache.GetEntries();
+	temp_age = (nat_cache_link *)malloc(sizeof(nat_cache_link) * max_temp_entries);
+	if(temp_age == NULL)
+	{
+		IPACMERR("Unable to allocate memory for temp entries\n");
+		goto fail;
+	}
+	IPACMDBG("Allocated %d temp entries\n", max_temp_entries);
+
+	ct_sched = (ct_sched_entry *)calloc(max_entries, sizeof(ct_sched_entry));
+	ct_due = (int *)malloc(sizeof(int) * max_entries);
+	ct_pending = (ct_pending_entry *)malloc(sizeof(ct_pending_entry) * max_entries);
+	ct_drained = (ct_pending_entry *)malloc(sizeof(ct_pending_entry) * max_entries);
+	if(ct_sched == NULL || ct_due == NULL || ct_pending == NULL || ct_drained == NULL)
+	{
+		IPACMERR("Unable to allocate memory for sweep scheduler\n");
+		goto fail;
+	}
+
+	if(LoadAlgPorts() != 0)
+	{
+		goto fail;
+	}
+
+	return 0;
+
+fail:
+	free(resize_rules);
+	free(resize_hdls);
+	free(resize_slots);
+	resize_rules = NULL;
+	resize_hdls = NULL;
+	resize_slots = NULL;
+	free(temp_age);
+	temp_age = NULL;
+	free(ct_hits);
+	ct_hits = NULL;
+	free(hits_snap);
+	hits_snap = NULL;
+	free(evict_udp.entry);
+	free(evict_tcp.entry);
+	evict_udp.entry = NULL;
+	evict_tcp.entry = NULL;
+	free(ct_sched);
+	free(ct_due);
+	free(ct_pending);
+	free(ct_drained);
+	ct_sched = NULL;
+	ct_due = NULL;
+	ct_pending = NULL;
+	ct_drained = NULL;
+	free(ts_snap);
+	ts_snap = NULL;
+	return -1;
+}
+
+int NatApp::LoadAlgPorts(void)
+{
+	IPACM_Config *pConfig;
+	ipacm_alg *pALGPorts;
+	uint32_t tcp_ports[ALG_PORT_WORDS], udp_ports[ALG_PORT_WORDS];
+	uint32_t *ports;
+	int nALGPort;
+
+	pConfig = IPACM_Config::GetInstance();
+	if(pConfig == NULL)
+	{
+		IPACMERR("Unable to get Config instance\n");
+		return -1;
+	}
+
+	memset(tcp_ports, 0, sizeof(tcp_ports));
+	memset(udp_ports, 0, sizeof(udp_ports));
 
 	nALGPort = pConfig->GetAlgPortCnt();
 	if(nALGPort > 0)
@@ -83,29 +275,44 @@ int NatApp::Init(void)
 		if(pALGPorts == NULL)
 		{
 			IPACMERR("Unable to allocate memory for alg prots\n");
-			goto fail;
+			return -1;
 		}
 		memset(pALGPorts, 0, sizeof(ipacm_alg) * nALGPort);
 
 		if(pConfig->GetAlgPorts(nALGPort, pALGPorts) != 0)
 		{
 			IPACMERR("Unable to retrieve ALG prots\n");
-			goto fail;
+			free(pALGPorts);
+			return -1;
 		}
 
 		IPACMDBG("Printing %d alg ports information\n", nALGPort);
 		for(int cnt=0; cnt<nALGPort; cnt++)
 		{
 			IPACMDBG("%d: Proto[%d], port[%d]\n", cnt, pALGPorts[cnt].protocol, pALGPorts[cnt].port);
+			if(pALGPorts[cnt].protocol == IPPROTO_TCP)
+			{
+				ports = tcp_ports;
+			}
+			else if(pALGPorts[cnt].protocol == IPPROTO_UDP)
+			{
+				ports = udp_ports;
+			}
+			else
+			{
+				continue;
+			}
+			ports[pALGPorts[cnt].port >> 5] |= (1U << (pALGPorts[cnt].port & 31));
 		}
+		free(pALGPorts);
 	}
 
-	return 0;
+	/* the conntrack client thread tests the bitmaps while they are
+		 copied, a port checked during the copy may see the old config */
+	memcpy(alg_tcp_ports, tcp_ports, sizeof(alg_tcp_ports));
+	memcpy(alg_udp_ports, udp_ports, sizeof(alg_udp_ports));
 
-fail:
-	free(cache);
-	free(pALGPorts);
-	return -1;
+	return 0;
 }
 
 NatApp* NatApp::GetInstance()
@@ -129,8 +336,8 @@ NatApp* NatApp::GetInstance()
 int NatApp::AddTable(uint32_t pub_ip)
 {
 	int ret;
-	int cnt = 0;
-	ipa_nat_ipv4_rule nat_rule;
+	int cnt = 0, num = 0;
+	int slots[MAX_BULK_NAT_ENTRIES];
 	IPACMDBG_H("%s() %d\n", __FUNCTION__, __LINE__);
 
 	/* Not reset the cache wait it timeout by destroy event */
@@ -138,11 +345,12 @@ int NatApp::AddTable(uint32_t pub_ip)
 	if (pub_ip != pub_ip_addr_pre)
 	{
 		IPACMDBG("Reset the cache because NAT-ipv4 different\n");
-		memset(cache, 0, sizeof(nat_table_entry) * max_entries);
+		nat_cache.Clear();
 		curCnt = 0;
 	}
 #endif
-	ret = ipa_nat_add_ipv4_tbl(pub_ip, max_entries, &nat_table_hdl);
+	/* the table comes back with the size it has grown to */
+	ret = ipa_nat_add_ipv4_tbl_sized(pub_ip, tbl_entries, tbl_expn_entries, &nat_table_hdl);
 	if(ret)
 	{
 		IPACMERR("unable to create nat table Error:%d\n", ret);
@@ -157,34 +365,20 @@ int NatApp::AddTable(uint32_t pub_ip)
 		{
 			if(cache[cnt].private_ip !=0)
 			{
-				memset(&nat_rule, 0 , sizeof(nat_rule));
-				nat_rule.private_ip = cache[cnt].private_ip;
-				nat_rule.target_ip = cache[cnt].target_ip;
-				nat_rule.target_port = cache[cnt].target_port;
-				nat_rule.private_port = cache[cnt].private_port;
-				nat_rule.public_port = cache[cnt].public_port;
-				nat_rule.protocol = cache[cnt].protocol;
-
-				if(ipa_nat_add_ipv4_rule(nat_table_hdl, &nat_rule, &cache[cnt].rule_hdl) < 0)
+				slots[num++] = cnt;
+				if(num == MAX_BULK_NAT_ENTRIES)
 				{
-					IPACMERR("unable to add the rule delete from cache\n");
-					memset(&cache[cnt], 0, sizeof(cache[cnt]));
-					curCnt--;
-					continue;
+					AddEntriesToHw(slots, num, false);
+					num = 0;
 				}
-				cache[cnt].enabled = true;
-
-				IPACMDBG("On wan-iface reset added below rule successfully\n");
-				iptodot("Private IP", nat_rule.private_ip);
-				iptodot("Target IP", nat_rule.target_ip);
-				IPACMDBG("Private Port:%d \t Target Port: %d\t", nat_rule.private_port, nat_rule.target_port);
-				IPACMDBG("Public Port:%d\n", nat_rule.public_port);
-				IPACMDBG("protocol: %d\n", nat_rule.protocol);
 			}
 		}
+		AddEntriesToHw(slots, num, false);
 	}
 
 	pub_ip_addr = pub_ip;
+	lost_pub_ip = 0;
+	restore_time = 0;
 	return 0;
 }
 
@@ -206,6 +400,14 @@ int NatApp::DeleteTable(uint32_t pub_ip)
 	int ret;
 	IPACMDBG_H("%s() %d\n", __FUNCTION__, __LINE__);
 
+	/* the table was lost in a resize, there is nothing to delete but
+		 it must not be created again */
+	if(nat_table_hdl == 0 && lost_pub_ip == pub_ip)
+	{
+		lost_pub_ip = 0;
+		return 0;
+	}
+
 	CHK_TBL_HDL();
 
 	if(pub_ip_addr != pub_ip)
@@ -216,35 +418,33 @@ int NatApp::DeleteTable(uint32_t pub_ip)
 	}
 
 	ret = ipa_nat_del_ipv4_tbl(nat_table_hdl);
-	if(ret)
+	if(ret == -EBUSY)
 	{
 		IPACMERR("unable to delete nat table Error: %d\n", ret);;
 		return ret;
 	}
 
+	/* any other error leaves the handle invalid as well */
+	if(ret)
+	{
+		IPACMERR("nat table deleted with Error: %d\n", ret);
+	}
+
 	pub_ip_addr_pre = pub_ip_addr;
 	Reset();
-	return 0;
+	return ret;
 }
 
 /* Check for duplicate entries */
 bool NatApp::ChkForDup(const nat_table_entry *rule)
 {
-	int cnt = 0;
 	IPACMDBG("%s() %d\n", __FUNCTION__, __LINE__);
 
-	for(; cnt < max_entries; cnt++)
+	if(nat_cache.Lookup(rule) != NAT_CACHE_INVALID_IDX)
 	{
-		if(cache[cnt].private_ip == rule->private_ip &&
-			 cache[cnt].target_ip == rule->target_ip &&
-			 cache[cnt].private_port ==  rule->private_port  &&
-			 cache[cnt].target_port == rule->target_port &&
-			 cache[cnt].protocol == rule->protocol)
-		{
-			log_nat(rule->protocol,rule->private_ip,rule->target_ip,rule->private_port,\
-			rule->target_port,"Duplicate Rule\n");
-			return true;
-		}
+		log_nat(rule->protocol,rule->private_ip,rule->target_ip,rule->private_port,\
+		rule->target_port,"Duplicate Rule\n");
+		return true;
 	}
 
 	return false;
@@ -253,52 +453,46 @@ bool NatApp::ChkForDup(const nat_table_entry *rule)
 /* Delete the entry from Nat table on connection close */
 int NatApp::DeleteEntry(const nat_table_entry *rule)
 {
-	int cnt = 0;
+	int cnt;
 	IPACMDBG("%s() %d\n", __FUNCTION__, __LINE__);
 
 	log_nat(rule->protocol,rule->private_ip,rule->target_ip,rule->private_port,\
 	rule->target_port,"for deletion\n");
 
+	cnt = nat_cache.Lookup(rule);
+	if(cnt == NAT_CACHE_INVALID_IDX)
+	{
+		return 0;
+	}
 
-	for(; cnt < max_entries; cnt++)
+	if(cache[cnt].enabled == true)
 	{
-		if(cache[cnt].private_ip == rule->private_ip &&
-			 cache[cnt].target_ip == rule->target_ip &&
-			 cache[cnt].private_port ==  rule->private_port  &&
-			 cache[cnt].target_port == rule->target_port &&
-			 cache[cnt].protocol == rule->protocol)
+		if(ipa_nat_del_ipv4_rule(nat_table_hdl, cache[cnt].rule_hdl) < 0)
 		{
-
-			if(cache[cnt].enabled == true)
-			{
-				if(ipa_nat_del_ipv4_rule(nat_table_hdl, cache[cnt].rule_hdl) < 0)
-				{
-					IPACMERR("%s() %d deletion failed\n", __FUNCTION__, __LINE__);
-				}
-
-				IPACMDBG_H("Deleted Nat entry(%d) Successfully\n", cnt);
-			}
-			else
-			{
-				IPACMDBG_H("Deleted Nat entry(%d) only from cache\n", cnt);
-			}
-
-			memset(&cache[cnt], 0, sizeof(cache[cnt]));
-			curCnt--;
-			break;
+			IPACMERR("%s() %d deletion failed\n", __FUNCTION__, __LINE__);
 		}
+
+		IPACMDBG_H("Deleted Nat entry(%d) Successfully\n", cnt);
 	}
+	else
+	{
+		IPACMDBG_H("Deleted Nat entry(%d) only from cache\n", cnt);
+	}
+
+	nat_cache.Remove(cnt);
+	curCnt--;
 
 	return 0;
 }
 
-/* Add new entry to the nat table on new connection */
-int NatApp::AddEntry(const nat_table_entry *rule)
+/* Validate the rule and reserve a disabled cache slot for it,
+   slot is set to NAT_CACHE_INVALID_IDX if the rule is ignored */
+int NatApp::ReserveEntry(const nat_table_entry *rule, int *slot)
 {
 	int cnt = 0;
-	ipa_nat_ipv4_rule nat_rule;
+	nat_table_entry new_entry;
 
-	IPACMDBG("%s() %d\n", __FUNCTION__, __LINE__);
+	*slot = NAT_CACHE_INVALID_IDX;
 
 	CHK_TBL_HDL();
 	log_nat(rule->protocol,rule->private_ip,rule->target_ip,rule->private_port,\
@@ -320,218 +514,1556 @@ int NatApp::AddEntry(const nat_table_entry *rule)
 		return 0;
 	}
 
-	if(!ChkForDup(rule))
+	if(ChkForDup(rule))
+	{
+		IPACMERR("Duplicate rule. Ignore it\n");
+		return -1;
+	}
+
+	memset(&new_entry, 0, sizeof(new_entry));
+	new_entry.private_ip = rule->private_ip;
+	new_entry.target_ip = rule->target_ip;
+	new_entry.target_port = rule->target_port;
+	new_entry.private_port = rule->private_port;
+	new_entry.protocol = rule->protocol;
+	new_entry.public_port = rule->public_port;
+	new_entry.dst_nat = rule->dst_nat;
+
+	cnt = nat_cache.Insert(&new_entry);
+	if(cnt == NAT_CACHE_INVALID_IDX && EvictColdFlow(rule) == 0)
+	{
+		cnt = nat_cache.Insert(&new_entry);
+	}
+
+	if(cnt == NAT_CACHE_INVALID_IDX)
+	{
+		IPACMERR("Error: Unable to add, reached maximum rules\n");
+		return -1;
+	}
+	curCnt++;
+
+	*slot = cnt;
+	return 0;
+}
+
+/* Push the given cached entries to the nat table with as few
+   dma commands as possible, entries ipa rejects are dropped unless
+   evict is set and a bigger table or a cold flow makes room for them */
+int NatApp::AddEntriesToHw(const int *slots, int num, bool evict)
+{
+	ipa_nat_ipv4_rule nat_rules[MAX_BULK_NAT_ENTRIES];
+	uint32_t rule_hdls[MAX_BULK_NAT_ENTRIES];
+	int cnt, base, len, pass, added = 0;
+	nat_table_entry *entry;
+
+	/* no table yet or a resize lost it, the entries stay in the
+		 cache and AddTable() adds them once there is one */
+	if(nat_table_hdl == 0)
+	{
+		IPACMDBG("No nat table, %d entries stay cached\n", num);
+		return 0;
+	}
+
+	for(base = 0; base < num; base += len)
 	{
-		for(; cnt < max_entries; cnt++)
+		len = num - base;
+		if(len > MAX_BULK_NAT_ENTRIES)
 		{
-			if(cache[cnt].private_ip == 0 &&
-				 cache[cnt].target_ip == 0 &&
-				 cache[cnt].private_port == 0  &&
-				 cache[cnt].target_port == 0 &&
-				 cache[cnt].protocol == 0)
-			{
-				break;
-			}
+			len = MAX_BULK_NAT_ENTRIES;
 		}
 
-		if(max_entries == cnt)
+		memset(nat_rules, 0, sizeof(nat_rules));
+		memset(rule_hdls, 0, sizeof(rule_hdls));
+		for(cnt = 0; cnt < len; cnt++)
 		{
-			IPACMERR("Error: Unable to add, reached maximum rules\n");
-			return -1;
+			entry = &cache[slots[base + cnt]];
+			nat_rules[cnt].private_ip = entry->private_ip;
+			nat_rules[cnt].target_ip = entry->target_ip;
+			nat_rules[cnt].target_port = entry->target_port;
+			nat_rules[cnt].private_port = entry->private_port;
+			nat_rules[cnt].public_port = entry->public_port;
+			nat_rules[cnt].protocol = entry->protocol;
 		}
-		else
+
+		if(ipa_nat_add_ipv4_rules(nat_table_hdl, nat_rules, len, rule_hdls) < 0)
 		{
-			nat_rule.private_ip = rule->private_ip;
-			nat_rule.target_ip = rule->target_ip;
-			nat_rule.target_port = rule->target_port;
-			nat_rule.private_port = rule->private_port;
-			nat_rule.public_port = rule->public_port;
-			nat_rule.protocol = rule->protocol;
+			IPACMERR("unable to add some of %d rules\n", len);
+		}
 
-			if(isPwrSaveIf(rule->private_ip) ||
-				 isPwrSaveIf(rule->target_ip))
-			{
-				IPACMDBG("Device is Power Save mode: Dont insert into nat table but cache\n");
-				cache[cnt].enabled = false;
-				cache[cnt].rule_hdl = 0;
-			}
-			else
+		/* the rules ipa took are enabled first, so that a resize for
+			 the rejected ones carries them over to the new table */
+		for(pass = 0; pass < 2; pass++)
+		{
+			for(cnt = 0; cnt < len; cnt++)
 			{
+				entry = &cache[slots[base + cnt]];
+				if((pass == 0) != (rule_hdls[cnt] != 0))
+				{
+					continue;
+				}
 
-				if(ipa_nat_add_ipv4_rule(nat_table_hdl, &nat_rule, &cache[cnt].rule_hdl) < 0)
+				/* a resize for an earlier rule lost the table */
+				if(pass == 1 && nat_table_hdl == 0)
 				{
-					IPACMERR("unable to add the rule\n");
-					return -1;
+					continue;
 				}
 
-				cache[cnt].enabled = true;
+				if(pass == 1 &&
+					 (!evict || RetryRejected(&nat_rules[cnt], entry, &rule_hdls[cnt]) != 0))
+				{
+					IPACMERR("unable to add the rule delete from cache\n");
+					nat_cache.Remove(slots[base + cnt]);
+					curCnt--;
+					continue;
+				}
+				entry->rule_hdl = rule_hdls[cnt];
+				entry->enabled = true;
+				MarkOffloaded(slots[base + cnt]);
+				ScheduleTs(slots[base + cnt]);
+				added++;
+
+				IPACMDBG("Added below rule successfully\n");
+				iptodot("Private IP", nat_rules[cnt].private_ip);
+				iptodot("Target IP", nat_rules[cnt].target_ip);
+				IPACMDBG("Private Port:%d \t Target Port: %d\t", nat_rules[cnt].private_port, nat_rules[cnt].target_port);
+				IPACMDBG("Public Port:%d\n", nat_rules[cnt].public_port);
+				IPACMDBG("protocol: %d\n", nat_rules[cnt].protocol);
 			}
+		}
+	}
+
+	return added;
+}
+
+/* Remove the given cached entries from the nat table with as few
+   dma commands as possible, the entries are kept in the cache.
+   Returns the number of rules removed, the others stay enabled */
+int NatApp::DelEntriesFromHw(const int *slots, int num)
+{
+	uint32_t rule_hdls[MAX_BULK_NAT_ENTRIES];
+	int cnt, base, len, deleted = 0;
+
+	for(base = 0; base < num; base += len)
+	{
+		len = num - base;
+		if(len > MAX_BULK_NAT_ENTRIES)
+		{
+			len = MAX_BULK_NAT_ENTRIES;
+		}
+
+		for(cnt = 0; cnt < len; cnt++)
+		{
+			rule_hdls[cnt] = cache[slots[base + cnt]].rule_hdl;
+		}
 
-			cache[cnt].private_ip = rule->private_ip;
-			cache[cnt].target_ip = rule->target_ip;
-			cache[cnt].target_port = rule->target_port;
-			cache[cnt].private_port = rule->private_port;
-			cache[cnt].protocol = rule->protocol;
-			cache[cnt].timestamp = 0;
-			cache[cnt].public_port = rule->public_port;
-			cache[cnt].dst_nat = rule->dst_nat;
-			curCnt++;
+		/* ipa clears the handles of the rules it deleted */
+		if(ipa_nat_del_ipv4_rules(nat_table_hdl, rule_hdls, len) < 0)
+		{
+			IPACMERR("unable to delete some of %d rules\n", len);
 		}
 
+		for(cnt = 0; cnt < len; cnt++)
+		{
+			if(rule_hdls[cnt] != 0)
+			{
+				IPACMERR("rule(%d) with handle %d is still in the nat table\n",
+								 slots[base + cnt], rule_hdls[cnt]);
+				continue;
+			}
+			cache[slots[base + cnt]].enabled = false;
+			cache[slots[base + cnt]].rule_hdl = 0;
+			deleted++;
+		}
 	}
-	else
+
+	return deleted;
+}
+
+static uint32_t GetUptime(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec;
+}
+
+/* A flow that just got its rule counts as hit */
+void NatApp::MarkOffloaded(int idx)
+{
+	ct_hits[idx].hw_ts = 0;
+	ct_hits[idx].last_hit = GetUptime();
+}
+
+/* Makes room in a rule handle to cache entry map for the given
+	 handle, the map grows in powers of 2 */
+static int GrowHdlIdx(int **hdl_idx, int *hdl_idx_len, uint32_t hdl, int min_len)
+{
+	int *tmp;
+	int len;
+
+	if(hdl < (uint32_t)*hdl_idx_len)
 	{
-		IPACMERR("Duplicate rule. Ignore it\n");
+		return 0;
+	}
+
+	len = (*hdl_idx_len > 0) ? *hdl_idx_len : min_len;
+	while((uint32_t)len <= hdl)
+	{
+		len *= 2;
+	}
+
+	tmp = (int *)realloc(*hdl_idx, sizeof(int) * len);
+	if(tmp == NULL)
+	{
+		IPACMERR("unable to allocate memory for %d rule handles\n", len);
 		return -1;
 	}
+	*hdl_idx = tmp;
+	*hdl_idx_len = len;
 
-	if(cache[cnt].enabled == true)
+	return 0;
+}
+
+static int CompareLastHit(const void *a, const void *b)
+{
+	const ct_evict_entry *ea = (const ct_evict_entry *)a;
+	const ct_evict_entry *eb = (const ct_evict_entry *)b;
+
+	if(ea->last_hit != eb->last_hit)
 	{
-		IPACMDBG_H("Added rule(%d) successfully\n", cnt);
+		return (ea->last_hit < eb->last_hit) ? -1 : 1;
 	}
-  else
-  {
-    IPACMDBG_H("Cached rule(%d) successfully\n", cnt);
-  }
+	return ea->idx - eb->idx;
+}
+
+/* Reads the rule timestamps with one pass over the nat table, a rule
+	 whose timestamp moved since the last read has been hit in between.
+	 The flows idle for CT_EVICT_MIN_IDLE seconds are then listed
+	 coldest first, evictions take them from these lists until the
+	 next read */
+void NatApp::ReadHits(uint32_t now)
+{
+	ct_evict_list *list;
+	uint16_t snap_num = 0;
+	uint32_t hdl;
+	int cnt, pos;
+
+	if(hits_read_time != 0 && now - hits_read_time < CT_EVICT_REFRESH)
+	{
+		return;
+	}
+	hits_read_time = now;
+	evict_udp.num = evict_udp.pos = 0;
+	evict_tcp.num = evict_tcp.pos = 0;
+
+	if(ipa_nat_query_timestamps_bulk(nat_table_hdl, hits_snap, max_entries, &snap_num) < 0)
+	{
+		IPACMERR("unable to retrieve timestamps of table: %d\n", nat_table_hdl);
+		return;
+	}
+
+	for(cnt = 0; cnt < max_entries; cnt++)
+	{
+		if(cache[cnt].enabled != true)
+		{
+			continue;
+		}
+
+		hdl = cache[cnt].rule_hdl;
+		if(GrowHdlIdx(&hits_hdl_idx, &hits_hdl_idx_len, hdl, max_entries) != 0)
+		{
+			continue;
+		}
+		hits_hdl_idx[hdl] = cnt;
+	}
+
+	for(cnt = 0; cnt < snap_num; cnt++)
+	{
+		hdl = hits_snap[cnt].rule_hdl;
+		if(hdl >= (uint32_t)hits_hdl_idx_len)
+		{
+			continue;
+		}
+
+		/* Slots of handles not set above are left over from
+			 earlier reads */
+		pos = hits_hdl_idx[hdl];
+		if(pos < 0 || pos >= max_entries ||
+			 cache[pos].enabled != true || cache[pos].rule_hdl != hdl)
+		{
+			continue;
+		}
+
+		if(hits_snap[cnt].time_stamp != ct_hits[pos].hw_ts)
+		{
+			ct_hits[pos].hw_ts = hits_snap[cnt].time_stamp;
+			ct_hits[pos].last_hit = now;
+		}
+	}
+
+	for(cnt = 0; cnt < max_entries; cnt++)
+	{
+		if(cache[cnt].enabled != true ||
+			 now - ct_hits[cnt].last_hit < CT_EVICT_MIN_IDLE)
+		{
+			continue;
+		}
+
+		list = (cache[cnt].protocol == IPPROTO_UDP) ? &evict_udp : &evict_tcp;
+		list->entry[list->num].idx = cnt;
+		list->entry[list->num].rule_hdl = cache[cnt].rule_hdl;
+		list->entry[list->num].last_hit = ct_hits[cnt].last_hit;
+		list->num++;
+	}
+
+	qsort(evict_udp.entry, evict_udp.num, sizeof(ct_evict_entry), CompareLastHit);
+	qsort(evict_tcp.entry, evict_tcp.num, sizeof(ct_evict_entry), CompareLastHit);
+}
+
+/* Takes the coldest flow of the list that is still offloaded with
+	 the same rule and has not been hit since the list was made */
+int NatApp::NextColdFlow(ct_evict_list *list)
+{
+	ct_evict_entry *entry;
+
+	while(list->pos < list->num)
+	{
+		entry = &list->entry[list->pos++];
+		if(cache[entry->idx].enabled == true &&
+			 cache[entry->idx].rule_hdl == entry->rule_hdl &&
+			 ct_hits[entry->idx].last_hit == entry->last_hit)
+		{
+			return entry->idx;
+		}
+	}
+
+	return NAT_CACHE_INVALID_IDX;
+}
+
+/* Sends the coldest offloaded flow back to the software path to make
+	 room for the given new flow, returns 0 if a flow was evicted. Udp
+	 flows go first, and a new udp flow only evicts udp flows */
+int NatApp::EvictColdFlow(const nat_table_entry *rule)
+{
+	uint32_t now;
+	int victim;
+	bool victim_udp = true;
+
+	now = GetUptime();
+	ReadHits(now);
+
+	victim = NextColdFlow(&evict_udp);
+	if(victim == NAT_CACHE_INVALID_IDX && rule->protocol != IPPROTO_UDP)
+	{
+		victim = NextColdFlow(&evict_tcp);
+		victim_udp = false;
+	}
+
+	if(victim == NAT_CACHE_INVALID_IDX)
+	{
+		admit_stats.rejected++;
+		IPACMDBG_H("No idle flow to evict, %d rejected so far\n", admit_stats.rejected);
+		return -1;
+	}
+
+	log_nat(cache[victim].protocol,cache[victim].private_ip,cache[victim].target_ip,
+					cache[victim].private_port,cache[victim].target_port,"evicted\n");
+	IPACMDBG_H("Evicting rule(%d), idle for %d sec\n", victim, now - ct_hits[victim].last_hit);
+
+	if(DelEntriesFromHw(&victim, 1) != 1)
+	{
+		admit_stats.rejected++;
+		return -1;
+	}
+	nat_cache.Remove(victim);
+	curCnt--;
+
+	if(victim_udp)
+	{
+		admit_stats.evicted_udp++;
+	}
+	else
+	{
+		admit_stats.evicted_tcp++;
+	}
+
+	return 0;
+}
+
+/* Retries a rule ipa rejected once the nat table has grown or, when
+	 it cannot grow any more, a cold flow has been evicted. Returns 0 if
+	 the rule got added */
+int NatApp::RetryRejected(const ipa_nat_ipv4_rule *nat_rule,
+		const nat_table_entry *rule, uint32_t *rule_hdl)
+{
+	/* the table may have grown for an earlier rule of the batch */
+	if(ipa_nat_add_ipv4_rule(nat_table_hdl, nat_rule, rule_hdl) == 0)
+	{
+		return 0;
+	}
+
+	if(GrowTable() != 0 && EvictColdFlow(rule) != 0)
+	{
+		return -1;
+	}
+
+	if(ipa_nat_add_ipv4_rule(nat_table_hdl, nat_rule, rule_hdl) < 0)
+	{
+		return -1;
+	}
+
+	return 0;
+}
+
+/* Fills resize_rules with the offloaded flows and resize_slots with
+	 their cache entries, returns the number of flows */
+int NatApp::GetOffloadedRules(void)
+{
+	int cnt, num = 0;
+
+	for(cnt = 0; cnt < max_entries; cnt++)
+	{
+		if(cache[cnt].enabled != true)
+		{
+			continue;
+		}
+
+		memset(&resize_rules[num], 0, sizeof(resize_rules[num]));
+		resize_rules[num].private_ip = cache[cnt].private_ip;
+		resize_rules[num].target_ip = cache[cnt].target_ip;
+		resize_rules[num].target_port = cache[cnt].target_port;
+		resize_rules[num].private_port = cache[cnt].private_port;
+		resize_rules[num].public_port = cache[cnt].public_port;
+		resize_rules[num].protocol = cache[cnt].protocol;
+		resize_slots[num++] = cnt;
+	}
+
+	return num;
+}
+
+/* Recreates the nat table with the given size and adds the offloaded
+	 flows back with their new rule handles. ipa has room for one table
+	 only, the flows go through the software path in between */
+int NatApp::ResizeTable(uint16_t table_entries, uint16_t expn_table_entries)
+{
+	int cnt, idx, num, ret;
+
+	CHK_TBL_HDL();
+
+	num = GetOffloadedRules();
+	IPACMDBG_H("Resizing nat table from %d/%d to %d/%d entries with %d rules\n",
+						 tbl_entries, tbl_expn_entries, table_entries, expn_table_entries, num);
+
+	pthread_mutex_lock(&ct_sweep_lock);
+
+	ret = ipa_nat_resize_ipv4_tbl(nat_table_hdl, table_entries, expn_table_entries,
+																resize_rules, num, resize_hdls);
+	/* the old table and its rules are still in place */
+	if(ret == -EINVAL || ret == -EBUSY)
+	{
+		pthread_mutex_unlock(&ct_sweep_lock);
+		IPACMERR("unable to resize nat table to %d/%d entries Error: %d\n",
+						 table_entries, expn_table_entries, ret);
+		return ret;
+	}
+
+	if(ret != 0 && ret != -ENOMEM)
+	{
+		/* the cached flows are added back with the next table, see
+			 RestoreTable() */
+		IPACMERR("nat table lost while resizing Error: %d, nat offload is off until it is created again\n", ret);
+		lost_pub_ip = pub_ip_addr;
+		restore_time = 0;
+		pub_ip_addr_pre = pub_ip_addr;
+		Reset();
+		pthread_mutex_unlock(&ct_sweep_lock);
+		return ret;
+	}
+
+	for(cnt = 0; cnt < num; cnt++)
+	{
+		idx = resize_slots[cnt];
+
+		/* new rules start with a zero timestamp */
+		cache[idx].timestamp = 0;
+		ct_hits[idx].hw_ts = 0;
+		ct_sched[idx].ts_read = false;
+
+		if(resize_hdls[cnt] == 0)
+		{
+			/* the sweep drops the flow from its wheel by itself */
+			log_nat(cache[idx].protocol,cache[idx].private_ip,cache[idx].target_ip,
+							cache[idx].private_port,cache[idx].target_port,"lost in resize\n");
+			cache[idx].enabled = false;
+			cache[idx].rule_hdl = 0;
+			nat_cache.Remove(idx);
+			curCnt--;
+			continue;
+		}
+
+		/* the flow keeps its place in the sweep wheel */
+		if(ct_sched[idx].rule_hdl != 0 && ct_sched[idx].rule_hdl == cache[idx].rule_hdl)
+		{
+			ct_sched[idx].rule_hdl = resize_hdls[cnt];
+		}
+		cache[idx].rule_hdl = resize_hdls[cnt];
+	}
+
+	pthread_mutex_unlock(&ct_sweep_lock);
+
+	if(ret != 0)
+	{
+		IPACMERR("unable to allocate %d/%d entries, nat table stays at %d/%d\n",
+						 table_entries, expn_table_entries, tbl_entries, tbl_expn_entries);
+		return ret;
+	}
+
+	tbl_entries = table_entries;
+	tbl_expn_entries = expn_table_entries;
+	admit_stats.resized++;
+	return 0;
+}
+
+/* Creates the nat table a resize lost again, at the size it had
+	 before the resize. Called before a flow is added and not from
+	 within a batch, AddTable() adds all the cached flows back */
+int NatApp::RestoreTable(void)
+{
+	uint32_t now;
+
+	if(nat_table_hdl != 0 || lost_pub_ip == 0)
+	{
+		return 0;
+	}
+
+	now = GetUptime();
+	if(restore_time != 0 && now - restore_time < CT_RESIZE_CHECK)
+	{
+		return -1;
+	}
+	restore_time = now;
+
+	if(AddTable(lost_pub_ip) != 0)
+	{
+		IPACMERR("unable to create the lost nat table with %d/%d entries, nat offload is off\n",
+						 tbl_entries, tbl_expn_entries);
+		return -1;
+	}
+
+	IPACMDBG_H("Created the lost nat table again with %d/%d entries\n",
+						 tbl_entries, tbl_expn_entries);
+	return 0;
+}
+
+/* Doubles the nat table up to its limit, returns 0 if it grew */
+int NatApp::GrowTable(void)
+{
+	int table_entries, expn_table_entries, ret;
+
+	if(nat_table_hdl == 0 ||
+		 (tbl_entries >= max_tbl_entries && tbl_expn_entries >= max_tbl_expn_entries))
+	{
+		return -1;
+	}
+
+	table_entries = tbl_entries * 2;
+	if(table_entries > max_tbl_entries)
+	{
+		table_entries = max_tbl_entries;
+	}
+
+	expn_table_entries = tbl_expn_entries * 2;
+	if(expn_table_entries > max_tbl_expn_entries)
+	{
+		expn_table_entries = max_tbl_expn_entries;
+	}
+
+	ret = ResizeTable(table_entries, expn_table_entries);
+	if(ret == -EBUSY)
+	{
+		/* the old table is kept, the next rejected rule tries again */
+		return -1;
+	}
+
+	if(ret != 0)
+	{
+		/* do not try again on every rejected rule */
+		max_tbl_entries = tbl_entries;
+		max_tbl_expn_entries = tbl_expn_entries;
+		return -1;
+	}
+
+	return 0;
+}
+
+/* Grows the nat table before ipa has to reject rules, when its base
+	 entries are mostly in use or its collision chains get long */
+void NatApp::CheckTableSize(void)
+{
+	ipa_nat_hash_stats stats;
+	uint32_t now;
+	int num, chain;
+
+	if(nat_table_hdl == 0 ||
+		 (tbl_entries >= max_tbl_entries && tbl_expn_entries >= max_tbl_expn_entries))
+	{
+		return;
+	}
+
+	now = GetUptime();
+	if(resize_check_time != 0 && now - resize_check_time < CT_RESIZE_CHECK)
+	{
+		return;
+	}
+	resize_check_time = now;
+
+	num = GetOffloadedRules();
+	if(num == 0)
+	{
+		return;
+	}
+
+	if(num > tbl_entries * CT_RESIZE_LOAD / 100)
+	{
+		IPACMDBG_H("%d rules in %d base entries, growing nat table\n", num, tbl_entries);
+		GrowTable();
+		return;
+	}
+
+	if(ipa_nat_analyze_ipv4_hash(resize_rules, num, tbl_entries, tbl_expn_entries, &stats) != 0)
+	{
+		IPACMERR("unable to analyze the nat hash\n");
+		return;
+	}
+
+	chain = stats.rule_tbl.max_chain;
+	if(stats.index_tbl.max_chain > chain)
+	{
+		chain = stats.index_tbl.max_chain;
+	}
+
+	if(chain > CT_RESIZE_MAX_CHAIN || stats.expn_overflow > 0)
+	{
+		IPACMDBG_H("chains of %d rules, %d rules without expansion entry, growing nat table\n",
+							 chain, stats.expn_overflow);
+		GrowTable();
+	}
+}
+
+/* Add new entry to the nat table on new connection */
+int NatApp::AddEntry(const nat_table_entry *rule)
+{
+	int cnt = 0;
+	int ret;
+	ipa_nat_ipv4_rule nat_rule;
+
+	IPACMDBG("%s() %d\n", __FUNCTION__, __LINE__);
+
+	RestoreTable();
+	ret = ReserveEntry(rule, &cnt);
+	if(ret != 0 || cnt == NAT_CACHE_INVALID_IDX)
+	{
+		return ret;
+	}
+
+	if(isPwrSaveIf(rule->private_ip) ||
+		 isPwrSaveIf(rule->target_ip))
+	{
+		IPACMDBG("Device is Power Save mode: Dont insert into nat table but cache\n");
+	}
+	else
+	{
+		memset(&nat_rule, 0, sizeof(nat_rule));
+		nat_rule.private_ip = rule->private_ip;
+		nat_rule.target_ip = rule->target_ip;
+		nat_rule.target_port = rule->target_port;
+		nat_rule.private_port = rule->private_port;
+		nat_rule.public_port = rule->public_port;
+		nat_rule.protocol = rule->protocol;
+
+		ret = ipa_nat_add_ipv4_rule(nat_table_hdl, &nat_rule, &cache[cnt].rule_hdl);
+		if(ret < 0)
+		{
+			ret = RetryRejected(&nat_rule, rule, &cache[cnt].rule_hdl);
+		}
+
+		if(ret < 0)
+		{
+			IPACMERR("unable to add the rule\n");
+			nat_cache.Remove(cnt);
+			curCnt--;
+			return -1;
+		}
+
+		cache[cnt].enabled = true;
+		MarkOffloaded(cnt);
+		ScheduleTs(cnt);
+	}
+
+	if(cache[cnt].enabled == true)
+	{
+		IPACMDBG_H("Added rule(%d) successfully\n", cnt);
+	}
+  else
+  {
+    IPACMDBG_H("Cached rule(%d) successfully\n", cnt);
+  }
+
+	CheckTableSize();
+	return 0;
+}
+
+/* Apply the nat updates of a conntrack batch in order. The deletes
+   go first with one bulk call and the adds follow with another, an
+   add is dropped if a later op of the batch deletes the same tuple */
+int NatApp::UpdateEntries(const nat_batch_op *ops, int num)
+{
+	int slots[IPACM_CT_BATCH_MAX];
+	int cnt, idx, slot, num_slots = 0, num_del;
+
+	RestoreTable();
+	CHK_TBL_HDL();
+	if(num > IPACM_CT_BATCH_MAX)
+	{
+		IPACMERR("%d ops exceed the batch size\n", num);
+		return -1;
+	}
+
+	for(cnt = 0; cnt < num; cnt++)
+	{
+		if(ops[cnt].add)
+		{
+			continue;
+		}
+
+		log_nat(ops[cnt].rule.protocol,ops[cnt].rule.private_ip,ops[cnt].rule.target_ip,
+						ops[cnt].rule.private_port,ops[cnt].rule.target_port,"for deletion\n");
+		slot = nat_cache.Lookup(&ops[cnt].rule);
+		if(slot == NAT_CACHE_INVALID_IDX)
+		{
+			continue;
+		}
+
+		for(idx = 0; idx < num_slots; idx++)
+		{
+			if(slots[idx] == slot)
+			{
+				break;
+			}
+		}
+		if(idx == num_slots)
+		{
+			slots[num_slots++] = slot;
+		}
+	}
+
+	/* the disabled entries are only in the cache */
+	num_del = num_slots;
+	num_slots = 0;
+	for(cnt = 0; cnt < num_del; cnt++)
+	{
+		if(cache[slots[cnt]].enabled == true)
+		{
+			slot = slots[num_slots];
+			slots[num_slots++] = slots[cnt];
+			slots[cnt] = slot;
+		}
+	}
+	DelEntriesFromHw(slots, num_slots);
+
+	for(cnt = 0; cnt < num_del; cnt++)
+	{
+		nat_cache.Remove(slots[cnt]);
+		curCnt--;
+	}
+	IPACMDBG_H("Deleted %d nat entries, %d from the nat table\n", num_del, num_slots);
+
+	num_slots = 0;
+	for(cnt = 0; cnt < num; cnt++)
+	{
+		if(!ops[cnt].add)
+		{
+			continue;
+		}
+
+		for(idx = cnt + 1; idx < num; idx++)
+		{
+			if(!ops[idx].add &&
+				 NatCache::isSameTuple(&ops[idx].rule, &ops[cnt].rule))
+			{
+				break;
+			}
+		}
+		if(idx < num)
+		{
+			IPACMDBG("connection closed within the batch, not added\n");
+			continue;
+		}
+
+		if(ReserveEntry(&ops[cnt].rule, &slot) != 0 ||
+			 slot == NAT_CACHE_INVALID_IDX)
+		{
+			continue;
+		}
+
+		if(isPwrSaveIf(ops[cnt].rule.private_ip) ||
+			 isPwrSaveIf(ops[cnt].rule.target_ip))
+		{
+			IPACMDBG_H("Cached rule(%d) successfully\n", slot);
+			continue;
+		}
+		slots[num_slots++] = slot;
+	}
+
+	cnt = AddEntriesToHw(slots, num_slots, true);
+	IPACMDBG_H("Added %d of %d nat entries\n", cnt, num_slots);
+
+	CheckTableSize();
+	return 0;
+}
+
+/* Deletes the flows the sweep thread could not update in conntrack,
+	 unless they have been deleted and added again since */
+void NatApp::DeleteFailedFlows(const nat_ct_failed_flows *flows)
+{
+	int cnt, idx;
+
+	for(cnt = 0; cnt < flows->num; cnt++)
+	{
+		idx = nat_cache.Lookup(&flows->rule[cnt]);
+		if(idx == NAT_CACHE_INVALID_IDX ||
+			 !IsSameFlow(idx, &flows->rule[cnt]))
+		{
+			continue;
+		}
+
+		DeleteEntry(&flows->rule[cnt]);
+	}
+}
+
+void NatApp::UpdateCTUdpTs(int idx, uint32_t new_ts)
+{
+	const nat_table_entry *rule = &cache[idx];
+	struct nlmsghdr *nlh;
+	int ret;
+
+	iptodot("Private IP:", rule->private_ip);
+	iptodot("Target IP:",  rule->target_ip);
+	IPACMDBG("Private Port: %d, Target Port: %d\n", rule->private_port, rule->target_port);
+
+	if(!ct_hdl)
+	{
+		ct_hdl = nfct_open(CONNTRACK, 0);
+		if(!ct_hdl)
+		{
+			PERROR("nfct_open");
+			return;
+		}
+	}
+
+	if(!ct)
+	{
+		ct = nfct_new();
+		if(!ct)
+		{
+			PERROR("nfct_new");
+			return;
+		}
+	}
+
+	nfct_set_attr_u8(ct, ATTR_L3PROTO, AF_INET);
+	if(rule->protocol == IPPROTO_UDP)
+	{
+		nfct_set_attr_u8(ct, ATTR_L4PROTO, rule->protocol);
+		nfct_set_attr_u32(ct, ATTR_TIMEOUT, udp_timeout);
+	}
+	else
+	{
+		nfct_set_attr_u8(ct, ATTR_L4PROTO, rule->protocol);
+		nfct_set_attr_u32(ct, ATTR_TIMEOUT, tcp_timeout);
+	}
+
+	if(rule->dst_nat == false)
+	{
+		nfct_set_attr_u32(ct, ATTR_IPV4_SRC, htonl(rule->private_ip));
+		nfct_set_attr_u16(ct, ATTR_PORT_SRC, htons(rule->private_port));
+
+		nfct_set_attr_u32(ct, ATTR_IPV4_DST, htonl(rule->target_ip));
+		nfct_set_attr_u16(ct, ATTR_PORT_DST, htons(rule->target_port));
+
+		IPACMDBG("dst nat is not set\n");
+	}
+	else
+	{
+		nfct_set_attr_u32(ct, ATTR_IPV4_SRC, htonl(rule->target_ip));
+		nfct_set_attr_u16(ct, ATTR_PORT_SRC, htons(rule->target_port));
+
+		nfct_set_attr_u32(ct, ATTR_IPV4_DST, htonl(pub_ip_addr));
+		nfct_set_attr_u16(ct, ATTR_PORT_DST, htons(rule->public_port));
+
+		IPACMDBG("dst nat is set\n");
+	}
+
+	iptodot("Source IP:", nfct_get_attr_u32(ct, ATTR_IPV4_SRC));
+	iptodot("Destination IP:",  nfct_get_attr_u32(ct, ATTR_IPV4_DST));
+	IPACMDBG("Source Port: %d, Destination Port: %d\n",
+					 nfct_get_attr_u16(ct, ATTR_PORT_SRC), nfct_get_attr_u16(ct, ATTR_PORT_DST));
+
+	IPACMDBG("updating %d connection with time: %d\n",
+					 rule->protocol, nfct_get_attr_u32(ct, ATTR_TIMEOUT));
+
+	if(ct_update_cnt == MAX_CT_UPDATE_ENTRIES ||
+		 (CT_UPDATE_BUF_SIZE - ct_update_len) < CT_UPDATE_MSG_SIZE)
+	{
+		FlushCTUpdates();
+	}
+
+	/* Queue the update, the ack is only asked for by the last
+		 message of the batch, see FlushCTUpdates() */
+	nlh = (struct nlmsghdr *)(ct_update_buf + ct_update_len);
+	ret = nfct_build_conntrack(nfct_subsys_ct(ct_hdl), nlh,
+														 CT_UPDATE_MSG_SIZE, IPCTNL_MSG_CT_NEW,
+														 NLM_F_REQUEST, ct);
+	if(ret == -1 || nlh->nlmsg_len > CT_UPDATE_MSG_SIZE)
+	{
+		IPACMERR("unable to build time stamp update\n");
+		return;
+	}
+
+	memcpy(&ct_updates[ct_update_cnt].rule, rule, sizeof(nat_table_entry));
+	ct_updates[ct_update_cnt].idx = idx;
+	ct_updates[ct_update_cnt].new_ts = new_ts;
+	ct_updates[ct_update_cnt].seq = nlh->nlmsg_seq;
+	ct_updates[ct_update_cnt].failed = false;
+	ct_update_cnt++;
+
+	ct_last_msg = ct_update_len;
+	ct_update_len += NLMSG_ALIGN(nlh->nlmsg_len);
+
+	return;
+}
+
+/* The sweep thread reads the cache without a lock, the flow it
+	 queued an update for may have been deleted and its slot reused */
+bool NatApp::IsSameFlow(int idx, const nat_table_entry *rule)
+{
+	const nat_table_entry *entry = &cache[idx];
+
+	return (entry->enabled == true &&
+					entry->rule_hdl == rule->rule_hdl &&
+					entry->private_ip == rule->private_ip &&
+					entry->private_port == rule->private_port &&
+					entry->target_ip == rule->target_ip &&
+					entry->target_port == rule->target_port &&
+					entry->protocol == rule->protocol);
+}
+
+/* Sends the queued timeout updates with one sendto(). The kernel
+	 handles the messages in order and only reports the failed ones,
+	 so the ack of the last message tells the batch is done. The
+	 flows that could not be updated are handed to the event thread,
+	 the only one that changes the nat cache. Called with
+	 ct_sweep_lock held, it is released while the acks are awaited */
+void NatApp::FlushCTUpdates()
+{
+	struct sockaddr_nl addr;
+	struct nlmsghdr *nlh;
+	ipacm_cmd_q_data evt_data;
+	nat_ct_failed_flows *failed = NULL;
+	bool acked = false;
+	int cnt;
+
+	if(ct_update_cnt == 0)
+	{
+		return;
+	}
+
+	nlh = (struct nlmsghdr *)(ct_update_buf + ct_last_msg);
+	nlh->nlmsg_flags |= NLM_F_ACK;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.nl_family = AF_NETLINK;
+
+	if(sendto(nfct_fd(ct_hdl), ct_update_buf, ct_update_len, 0,
+						(struct sockaddr *)&addr, sizeof(addr)) < 0)
+	{
+		/* The timestamps are left as they are, the flows are
+			 refreshed again on the next sweep */
+		PERROR("sendto");
+	}
+	else
+	{
+		/* a resize must not wait for the acks, the results are only
+			 applied to flows that still have the same rule below */
+		pthread_mutex_unlock(&ct_sweep_lock);
+		acked = (RecvCTUpdateAcks() == 0);
+		pthread_mutex_lock(&ct_sweep_lock);
+	}
+
+	for(cnt = 0; cnt < ct_update_cnt; cnt++)
+	{
+		if(!IsSameFlow(ct_updates[cnt].idx, &ct_updates[cnt].rule))
+		{
+			continue;
+		}
+
+		if(ct_updates[cnt].failed)
+		{
+			IPACMERR("unable to update time stamp\n");
+			if(failed == NULL)
+			{
+				failed = (nat_ct_failed_flows *)IPACM_EvtPool::Alloc(sizeof(nat_ct_failed_flows));
+				if(failed == NULL)
+				{
+					IPACMERR("unable to allocate memory for failed flows\n");
+					continue;
+				}
+				failed->num = 0;
+			}
+			memcpy(&failed->rule[failed->num++], &ct_updates[cnt].rule,
+						 sizeof(nat_table_entry));
+		}
+		else if(acked)
+		{
+			cache[ct_updates[cnt].idx].timestamp = ct_updates[cnt].new_ts;
+		}
+	}
+	IPACMDBG("Sent %d time stamp updates, acked: %d\n", ct_update_cnt, acked);
+
+	if(failed != NULL)
+	{
+		evt_data.event = IPA_HANDLE_CT_UPDATE_FAILED;
+		evt_data.evt_data = (void *)failed;
+		if(0 != IPACM_EvtDispatcher::PostEvt(&evt_data))
+		{
+			IPACMERR("Error sending %d failed flows to processing thread!\n", failed->num);
+			IPACM_EvtPool::Free(failed);
+		}
+	}
+
+	ct_update_cnt = 0;
+	ct_update_len = 0;
+	ct_last_msg = 0;
+
+	return;
+}
+
+/* Waits at most CT_UPDATE_ACK_TIMEOUT milliseconds for the ack of
+	 the batch, the acks of a batch that timed out are skipped by the
+	 next one as their sequence numbers do not match */
+int NatApp::RecvCTUpdateAcks()
+{
+	char buf[CT_UPDATE_MSG_SIZE * 8];
+	struct nlmsghdr *nlh;
+	struct nlmsgerr *err;
+	struct pollfd pfd;
+	struct timespec start, now;
+	uint32_t last_seq;
+	int len, cnt, wait_ms;
+
+	last_seq = ct_updates[ct_update_cnt - 1].seq;
+
+	pfd.fd = nfct_fd(ct_hdl);
+	pfd.events = POLLIN;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	while(1)
+	{
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		wait_ms = CT_UPDATE_ACK_TIMEOUT - ((now.tv_sec - start.tv_sec) * 1000 +
+			(now.tv_nsec - start.tv_nsec) / 1000000);
+		if(wait_ms <= 0)
+		{
+			IPACMERR("no ack for %d time stamp updates\n", ct_update_cnt);
+			return -1;
+		}
+
+		len = poll(&pfd, 1, wait_ms);
+		if(len < 0)
+		{
+			if(errno == EINTR)
+			{
+				continue;
+			}
+			PERROR("poll");
+			return -1;
+		}
+		if(len == 0)
+		{
+			continue;
+		}
+
+		len = recv(pfd.fd, buf, sizeof(buf), MSG_DONTWAIT);
+		if(len < 0)
+		{
+			if(errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)
+			{
+				continue;
+			}
+			PERROR("recv");
+			return -1;
+		}
+
+		for(nlh = (struct nlmsghdr *)buf; NLMSG_OK(nlh, (unsigned int)len);
+				nlh = NLMSG_NEXT(nlh, len))
+		{
+			if(nlh->nlmsg_type != NLMSG_ERROR)
+			{
+				continue;
+			}
+
+			err = (struct nlmsgerr *)NLMSG_DATA(nlh);
+			if(err->error != 0)
+			{
+				for(cnt = 0; cnt < ct_update_cnt; cnt++)
+				{
+					if(ct_updates[cnt].seq == nlh->nlmsg_seq)
+					{
+						ct_updates[cnt].failed = true;
+						break;
+					}
+				}
+			}
+
+			if(nlh->nlmsg_seq == last_seq)
+			{
+				return 0;
+			}
+		}
+	}
+}
+
+/* Hands a flow that just got its nat rule over to the sweep thread,
+	 and wakes the thread up if the flow is due before it would */
+void NatApp::ScheduleTs(int idx)
+{
+	struct timespec now;
+	uint32_t check;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	check = now.tv_sec + FlowTimeout(&cache[idx], true) - CT_SWEEP_MARGIN;
+
+	pthread_mutex_lock(&ct_pending_lock);
+	if(ct_pending_cnt < max_entries)
+	{
+		ct_pending[ct_pending_cnt].idx = idx;
+		ct_pending[ct_pending_cnt].added = now.tv_sec;
+		ct_pending_cnt++;
+	}
+	else
+	{
+		/* the next sweep looks for the flows itself */
+		ct_pending_overflow = true;
+	}
+
+	if(ct_sweep_wake != 0 && check < ct_sweep_wake)
+	{
+		ct_sweep_wake = 0;
+		pthread_cond_signal(&ct_sweep_cond);
+	}
+	pthread_mutex_unlock(&ct_pending_lock);
+}
+
+/* Sleeps the given seconds, or until ScheduleTs() has a flow that is
+	 due earlier */
+void NatApp::WaitSweep(int sec)
+{
+	struct timespec wake;
+
+	clock_gettime(CLOCK_MONOTONIC, &wake);
+	wake.tv_sec += sec;
+
+	pthread_mutex_lock(&ct_pending_lock);
+	ct_sweep_wake = wake.tv_sec;
+	while(ct_sweep_wake != 0)
+	{
+		if(pthread_cond_timedwait(&ct_sweep_cond, &ct_pending_lock, &wake) == ETIMEDOUT)
+		{
+			break;
+		}
+	}
+	ct_sweep_wake = 0;
+	pthread_mutex_unlock(&ct_pending_lock);
+}
+
+/* Conntrack expiry of a flow, udp flows are offloaded before their
+	 reply is seen and keep the unreplied timeout until refreshed */
+uint32_t NatApp::FlowTimeout(const nat_table_entry *rule, bool is_new)
+{
+	if(rule->protocol != IPPROTO_UDP)
+	{
+		return tcp_timeout;
+	}
+
+	if(is_new && udp_unreplied_timeout != 0 && udp_unreplied_timeout < udp_timeout)
+	{
+		return udp_unreplied_timeout;
+	}
+
+	return udp_timeout;
+}
+
+/* Links the flow into the bucket of the tick it has to be checked
+	 at. Deadlines past the end of the wheel go to its last bucket and
+	 are put back from there */
+void NatApp::WheelInsert(int idx)
+{
+	uint32_t check, tick;
+	int *head;
+
+	check = 0;
+	if(ct_sched[idx].deadline > CT_SWEEP_MARGIN)
+	{
+		check = ct_sched[idx].deadline - CT_SWEEP_MARGIN;
+	}
+
+	tick = check / CT_WHEEL_TICK;
+	if(tick <= ct_wheel_tick)
+	{
+		tick = ct_wheel_tick + 1;
+	}
+	else if(tick - ct_wheel_tick >= CT_WHEEL_SLOTS)
+	{
+		tick = ct_wheel_tick + CT_WHEEL_SLOTS - 1;
+	}
+
+	ct_sched[idx].bucket = tick % CT_WHEEL_SLOTS;
+	head = &ct_wheel[ct_sched[idx].bucket];
+
+	ct_sched[idx].link.prev = NAT_CACHE_INVALID_IDX;
+	ct_sched[idx].link.next = *head;
+	if(*head != NAT_CACHE_INVALID_IDX)
+	{
+		ct_sched[*head].link.prev = idx;
+	}
+	*head = idx;
+}
+
+void NatApp::WheelRemove(int idx)
+{
+	nat_cache_link *link = &ct_sched[idx].link;
+
+	if(link->prev != NAT_CACHE_INVALID_IDX)
+	{
+		ct_sched[link->prev].link.next = link->next;
+	}
+	else
+	{
+		ct_wheel[ct_sched[idx].bucket] = link->next;
+	}
+
+	if(link->next != NAT_CACHE_INVALID_IDX)
+	{
+		ct_sched[link->next].link.prev = link->prev;
+	}
+	ct_sched[idx].rule_hdl = 0;
+}
+
+/* Puts the flows added since the last sweep in the wheel, conntrack
+	 saw their packets when they were added so they expire a timeout
+	 from then */
+void NatApp::DrainPending(uint32_t now)
+{
+	ct_pending_entry *tmp;
+	int cnt, num, idx;
+	bool overflow;
+
+	pthread_mutex_lock(&ct_pending_lock);
+	num = ct_pending_cnt;
+	tmp = ct_drained;
+	ct_drained = ct_pending;
+	ct_pending = tmp;
+	overflow = ct_pending_overflow;
+	ct_pending_cnt = 0;
+	ct_pending_overflow = false;
+	pthread_mutex_unlock(&ct_pending_lock);
+
+	if(overflow)
+	{
+		/* the flows were added after the last sweep, at the latest */
+		num = 0;
+		for(cnt = 0; cnt < max_entries; cnt++)
+		{
+			if(cache[cnt].enabled == true &&
+				 cache[cnt].rule_hdl != ct_sched[cnt].rule_hdl)
+			{
+				ct_drained[num].idx = cnt;
+				ct_drained[num].added = (ct_last_sweep != 0) ? ct_last_sweep : now;
+				num++;
+			}
+		}
+	}
+	ct_last_sweep = now;
 
-	return 0;
+	for(cnt = 0; cnt < num; cnt++)
+	{
+		idx = ct_drained[cnt].idx;
+		if(cache[idx].enabled != true || cache[idx].rule_hdl == 0)
+		{
+			continue;
+		}
+
+		if(ct_sched[idx].rule_hdl != 0)
+		{
+			WheelRemove(idx);
+		}
+		ct_sched[idx].rule_hdl = cache[idx].rule_hdl;
+		ct_sched[idx].deadline = ct_drained[cnt].added + FlowTimeout(&cache[idx], true);
+		WheelInsert(idx);
+	}
 }
 
-void NatApp::UpdateCTUdpTs(nat_table_entry *rule, uint32_t new_ts)
+/* Reads the timestamps of the due flows, one query each or one pass
+	 over the nat table when many flows are due */
+void NatApp::ReadTimeStamps(int num)
 {
-	int ret;
-
-	iptodot("Private IP:", rule->private_ip);
-	iptodot("Target IP:",  rule->target_ip);
-	IPACMDBG("Private Port: %d, Target Port: %d\n", rule->private_port, rule->target_port);
+	int cnt, idx, pos;
+	uint16_t snap_num = 0;
+	uint32_t hdl;
 
-	if(!ct_hdl)
+	for(cnt = 0; cnt < num; cnt++)
 	{
-		ct_hdl = nfct_open(CONNTRACK, 0);
-		if(!ct_hdl)
-		{
-			PERROR("nfct_open");
-			return;
-		}
+		ct_sched[ct_due[cnt]].ts_read = false;
 	}
 
-	if(!ct)
+	if(num < CT_SWEEP_BULK_MIN)
 	{
-		ct = nfct_new();
-		if(!ct)
+		for(cnt = 0; cnt < num; cnt++)
 		{
-			PERROR("nfct_new");
-			return;
+			idx = ct_due[cnt];
+			if(ipa_nat_query_timestamp(nat_table_hdl, cache[idx].rule_hdl,
+																 &ct_sched[idx].hw_ts) < 0)
+			{
+				IPACMERR("unable to retrieve timeout for rule hanle: %d\n", cache[idx].rule_hdl);
+				continue;
+			}
+			ct_sched[idx].ts_read = true;
 		}
+		return;
 	}
 
-	nfct_set_attr_u8(ct, ATTR_L3PROTO, AF_INET);
-	if(rule->protocol == IPPROTO_UDP)
+	if(ipa_nat_query_timestamps_bulk(nat_table_hdl, ts_snap, max_entries, &snap_num) < 0)
 	{
-		nfct_set_attr_u8(ct, ATTR_L4PROTO, rule->protocol);
-		nfct_set_attr_u32(ct, ATTR_TIMEOUT, udp_timeout);
+		IPACMERR("unable to retrieve timestamps of table: %d\n", nat_table_hdl);
+		return;
 	}
-	else
+
+	/* Map the rule handles to the due flows */
+	for(cnt = 0; cnt < num; cnt++)
 	{
-		nfct_set_attr_u8(ct, ATTR_L4PROTO, rule->protocol);
-		nfct_set_attr_u32(ct, ATTR_TIMEOUT, tcp_timeout);
+		hdl = cache[ct_due[cnt]].rule_hdl;
+		if(GrowHdlIdx(&hdl_idx, &hdl_idx_len, hdl, max_entries) != 0)
+		{
+			continue;
+		}
+		hdl_idx[hdl] = cnt;
 	}
 
-	if(rule->dst_nat == false)
+	for(cnt = 0; cnt < snap_num; cnt++)
 	{
-		nfct_set_attr_u32(ct, ATTR_IPV4_SRC, htonl(rule->private_ip));
-		nfct_set_attr_u16(ct, ATTR_PORT_SRC, htons(rule->private_port));
+		hdl = ts_snap[cnt].rule_hdl;
+		if(hdl >= (uint32_t)hdl_idx_len)
+		{
+			continue;
+		}
 
-		nfct_set_attr_u32(ct, ATTR_IPV4_DST, htonl(rule->target_ip));
-		nfct_set_attr_u16(ct, ATTR_PORT_DST, htons(rule->target_port));
+		/* Slots of handles not set above are left over from
+			 earlier sweeps */
+		pos = hdl_idx[hdl];
+		if(pos < 0 || pos >= num || cache[ct_due[pos]].rule_hdl != hdl)
+		{
+			continue;
+		}
 
-		IPACMDBG("dst nat is not set\n");
+		ct_sched[ct_due[pos]].hw_ts = ts_snap[cnt].time_stamp;
+		ct_sched[ct_due[pos]].ts_read = true;
 	}
-	else
+}
+
+/* Refreshes the due flows that saw traffic in hardware and puts them
+	 back in the wheel */
+void NatApp::CheckTimeStamps(int num, uint32_t now)
+{
+	nat_table_entry *entry;
+	ct_sched_entry *sched;
+	int cnt;
+
+	ReadTimeStamps(num);
+
+	for(cnt = 0; cnt < num; cnt++)
 	{
-		nfct_set_attr_u32(ct, ATTR_IPV4_SRC, htonl(rule->target_ip));
-		nfct_set_attr_u16(ct, ATTR_PORT_SRC, htons(rule->target_port));
+		entry = &cache[ct_due[cnt]];
+		sched = &ct_sched[ct_due[cnt]];
 
-		nfct_set_attr_u32(ct, ATTR_IPV4_DST, htonl(pub_ip_addr));
-		nfct_set_attr_u16(ct, ATTR_PORT_DST, htons(rule->public_port));
+		/* a batch flushed above lets a resize run, the timestamps
+			 read before it are of the old rules */
+		if(sched->ts_read == true && entry->enabled == true &&
+			 entry->rule_hdl == sched->rule_hdl)
+		{
+			sweep_stats.checked++;
 
-		IPACMDBG("dst nat is set\n");
+			if(entry->timestamp != sched->hw_ts)
+			{
+				UpdateCTUdpTs(ct_due[cnt], sched->hw_ts);
+				sweep_stats.refreshed++;
+				sched->deadline = now + FlowTimeout(entry, false);
+			}
+			else if(now >= sched->deadline)
+			{
+				/* No traffic in hardware, conntrack either expires
+					 the flow or has seen its packets itself */
+				sched->deadline = now + FlowTimeout(entry, false);
+			}
+			else
+			{
+				IPACMDBG("No Change in Time Stamp: cahce:%d, ipahw:%d\n",
+								 entry->timestamp, sched->hw_ts);
+			}
+		}
+
+		WheelInsert(ct_due[cnt]);
 	}
 
-	iptodot("Source IP:", nfct_get_attr_u32(ct, ATTR_IPV4_SRC));
-	iptodot("Destination IP:",  nfct_get_attr_u32(ct, ATTR_IPV4_DST));
-	IPACMDBG("Source Port: %d, Destination Port: %d\n",
-					 nfct_get_attr_u16(ct, ATTR_PORT_SRC), nfct_get_attr_u16(ct, ATTR_PORT_DST));
+	FlushCTUpdates();
+}
 
-	IPACMDBG("updating %d connection with time: %d\n",
-					 rule->protocol, nfct_get_attr_u32(ct, ATTR_TIMEOUT));
+/* One pass of the timestamp sweep, checks the flows due by now and
+	 returns the seconds to sleep until the next ones are due */
+int NatApp::SweepTimeStamps()
+{
+	struct timespec start, end;
+	uint32_t now, now_tick, tick;
+	int idx, next, num = 0;
+	int sleep_time;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	now = start.tv_sec;
+	now_tick = now / CT_WHEEL_TICK;
 
-	ret = nfct_query(ct_hdl, NFCT_Q_UPDATE, ct);
-	if(ret == -1)
+	if(ct_sched == NULL)
 	{
-		IPACMERR("unable to update time stamp");
-		DeleteEntry(rule);
+		return CT_SWEEP_MAX_SLEEP;
 	}
-	else
+
+	pthread_mutex_lock(&ct_sweep_lock);
+
+	if(timeout_read_time == 0 || now - timeout_read_time >= CT_TIMEOUT_REFRESH)
 	{
-		rule->timestamp = new_ts;
-		IPACMDBG("Updated time stamp successfully\n");
+		Read_TcpUdp_Timeout();
+		timeout_read_time = now;
 	}
 
-	return;
-}
-
-void NatApp::UpdateUDPTimeStamp()
-{
-	int cnt;
-	uint32_t ts;
-	bool read_to = false;
+	/* First sweep, or a round of the wheel after a long sleep */
+	if(ct_wheel_tick == 0 || now_tick - ct_wheel_tick > CT_WHEEL_SLOTS)
+	{
+		ct_wheel_tick = (now_tick > CT_WHEEL_SLOTS) ? now_tick - CT_WHEEL_SLOTS : 0;
+	}
 
-	for(cnt = 0; cnt < max_entries; cnt++)
+	while(ct_wheel_tick < now_tick)
 	{
-		ts = 0;
-		if(cache[cnt].enabled == true &&
-		   (cache[cnt].private_ip != cache[cnt].public_ip))
+		ct_wheel_tick++;
+		idx = ct_wheel[ct_wheel_tick % CT_WHEEL_SLOTS];
+		ct_wheel[ct_wheel_tick % CT_WHEEL_SLOTS] = NAT_CACHE_INVALID_IDX;
+
+		for(; idx != NAT_CACHE_INVALID_IDX; idx = next)
 		{
-			IPACMDBG("\n");
-			if(ipa_nat_query_timestamp(nat_table_hdl, cache[cnt].rule_hdl, &ts) < 0)
+			next = ct_sched[idx].link.next;
+
+			/* deleted, or the slot has been taken by another flow */
+			if(cache[idx].enabled != true ||
+				 cache[idx].rule_hdl != ct_sched[idx].rule_hdl ||
+				 (cache[idx].private_ip == cache[idx].public_ip))
 			{
-				IPACMERR("unable to retrieve timeout for rule hanle: %d\n", cache[cnt].rule_hdl);
+				ct_sched[idx].rule_hdl = 0;
 				continue;
 			}
 
-			if(cache[cnt].timestamp == ts)
+			if(ct_sched[idx].deadline > now + CT_SWEEP_MARGIN)
 			{
-				IPACMDBG("No Change in Time Stamp: cahce:%d, ipahw:%d\n",
-								                  cache[cnt].timestamp, ts);
+				WheelInsert(idx);
 				continue;
 			}
+			ct_due[num++] = idx;
+		}
+	}
 
-			if (read_to == false) {
-				read_to = true;
-				Read_TcpUdp_Timeout();
-			}
+	if(num > 0)
+	{
+		CheckTimeStamps(num, now);
+	}
+	DrainPending(now);
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	sweep_stats.sweeps++;
+	sweep_stats.sweep_usec += (end.tv_sec - start.tv_sec) * 1000000LL +
+		(end.tv_nsec - start.tv_nsec) / 1000;
+	IPACMDBG("sweep %d: %d flows due, checked %d, refreshed %d in total, %llu usec\n",
+					 sweep_stats.sweeps, num, sweep_stats.checked, sweep_stats.refreshed,
+					 (unsigned long long)sweep_stats.sweep_usec);
+
+	/* Sleep until the next bucket with flows in it */
+	sleep_time = CT_SWEEP_MAX_SLEEP;
+	for(tick = now_tick + 1; (tick * CT_WHEEL_TICK) - now < (uint32_t)sleep_time; tick++)
+	{
+		if(ct_wheel[tick % CT_WHEEL_SLOTS] != NAT_CACHE_INVALID_IDX)
+		{
+			sleep_time = (tick * CT_WHEEL_TICK) - now;
+			break;
+		}
+	}
 
-			UpdateCTUdpTs(&cache[cnt], ts);
-		} /* end of outer if */
+	pthread_mutex_unlock(&ct_sweep_lock);
+	return sleep_time;
+}
 
-	} /* end of for loop */
+void NatApp::GetSweepStats(nat_sweep_stats *stats)
+{
+	memcpy(stats, &sweep_stats, sizeof(sweep_stats));
+}
 
+void NatApp::GetTempStats(nat_temp_stats *stats)
+{
+	memcpy(stats, &temp_stats, sizeof(temp_stats));
 }
 
-bool NatApp::isAlgPort(uint8_t proto, uint16_t port)
+void NatApp::GetAdmitStats(nat_admit_stats *stats)
 {
 	int cnt;
-	for(cnt = 0; cnt < nALGPort; cnt++)
+
+	admit_stats.max_entries = max_entries;
+	admit_stats.table_entries = tbl_entries;
+	admit_stats.expn_table_entries = tbl_expn_entries;
+	admit_stats.cached = nat_cache.GetCount();
+	admit_stats.offloaded = 0;
+	for(cnt = 0; cnt < max_entries; cnt++)
 	{
-		if(proto == pALGPorts[cnt].protocol &&
-			 port == pALGPorts[cnt].port)
+		if(cache[cnt].enabled == true)
 		{
-			return true;
+			admit_stats.offloaded++;
 		}
 	}
 
-	return false;
+	memcpy(stats, &admit_stats, sizeof(admit_stats));
+}
+
+bool NatApp::isAlgPort(uint8_t proto, uint16_t port)
+{
+	const uint32_t *ports;
+
+	if(proto == IPPROTO_TCP)
+	{
+		ports = alg_tcp_ports;
+	}
+	else if(proto == IPPROTO_UDP)
+	{
+		ports = alg_udp_ports;
+	}
+	else
+	{
+		return false;
+	}
+
+	return (ports[port >> 5] & (1U << (port & 31))) != 0;
 }
 
 bool NatApp::isPwrSaveIf(uint32_t ip_addr)
@@ -552,7 +2084,8 @@ bool NatApp::isPwrSaveIf(uint32_t ip_addr)
 
 int NatApp::UpdatePwrSaveIf(uint32_t client_lan_ip)
 {
-	int cnt;
+	int cnt, num = 0;
+	int slots[MAX_BULK_NAT_ENTRIES];
 	IPACMDBG_H("Received IP address: 0x%x\n", client_lan_ip);
 
 	if(client_lan_ip == INVALID_IP_ADDR)
@@ -580,29 +2113,28 @@ int NatApp::UpdatePwrSaveIf(uint32_t client_lan_ip)
 		}
 	}
 
-	for(cnt = 0; cnt < max_entries; cnt++)
+	for(cnt = nat_cache.FirstByPrivateIp(client_lan_ip); cnt != NAT_CACHE_INVALID_IDX;
+			cnt = nat_cache.NextByPrivateIp(cnt))
 	{
-		if(cache[cnt].private_ip == client_lan_ip &&
-			 cache[cnt].enabled == true)
+		if(cache[cnt].enabled == true)
 		{
-			if(ipa_nat_del_ipv4_rule(nat_table_hdl, cache[cnt].rule_hdl) < 0)
+			slots[num++] = cnt;
+			if(num == MAX_BULK_NAT_ENTRIES)
 			{
-				IPACMERR("unable to delete the rule\n");
-				continue;
+				DelEntriesFromHw(slots, num);
+				num = 0;
 			}
-
-			cache[cnt].enabled = false;
-			cache[cnt].rule_hdl = 0;
 		}
 	}
+	DelEntriesFromHw(slots, num);
 
 	return 0;
 }
 
 int NatApp::ResetPwrSaveIf(uint32_t client_lan_ip)
 {
-	int cnt;
-	ipa_nat_ipv4_rule nat_rule;
+	int cnt, next, num = 0;
+	int slots[MAX_BULK_NAT_ENTRIES];
 
 	IPACMDBG_H("Received ip address: 0x%x\n", client_lan_ip);
 
@@ -621,39 +2153,22 @@ int NatApp::ResetPwrSaveIf(uint32_t client_lan_ip)
 		}
 	}
 
-	for(cnt = 0; cnt < max_entries; cnt++)
+	for(cnt = nat_cache.FirstByPrivateIp(client_lan_ip); cnt != NAT_CACHE_INVALID_IDX; cnt = next)
 	{
+		next = nat_cache.NextByPrivateIp(cnt);
 		IPACMDBG("cache (%d): enable %d, ip 0x%x\n", cnt, cache[cnt].enabled, cache[cnt].private_ip);
 
-		if(cache[cnt].private_ip == client_lan_ip &&
-			 cache[cnt].enabled == false)
+		if(cache[cnt].enabled == false)
 		{
-			memset(&nat_rule, 0 , sizeof(nat_rule));
-			nat_rule.private_ip = cache[cnt].private_ip;
-			nat_rule.target_ip = cache[cnt].target_ip;
-			nat_rule.target_port = cache[cnt].target_port;
-			nat_rule.private_port = cache[cnt].private_port;
-			nat_rule.public_port = cache[cnt].public_port;
-			nat_rule.protocol = cache[cnt].protocol;
-
-			if(ipa_nat_add_ipv4_rule(nat_table_hdl, &nat_rule, &cache[cnt].rule_hdl) < 0)
+			slots[num++] = cnt;
+			if(num == MAX_BULK_NAT_ENTRIES)
 			{
-				IPACMERR("unable to add the rule delete from cache\n");
-				memset(&cache[cnt], 0, sizeof(cache[cnt]));
-				curCnt--;
-				continue;
+				AddEntriesToHw(slots, num, false);
+				num = 0;
 			}
-			cache[cnt].enabled = true;
-
-			IPACMDBG("On power reset added below rule successfully\n");
-			iptodot("Private IP", nat_rule.private_ip);
-			iptodot("Target IP", nat_rule.target_ip);
-			IPACMDBG("Private Port:%d \t Target Port: %d\t", nat_rule.private_port, nat_rule.target_port);
-			IPACMDBG("Public Port:%d\n", nat_rule.public_port);
-			IPACMDBG("protocol: %d\n", nat_rule.protocol);
-
 		}
 	}
+	AddEntriesToHw(slots, num, false);
 
 	return -1;
 }
@@ -690,34 +2205,67 @@ void NatApp::AddTempEntry(const nat_table_entry *new_entry)
 		return;
 	}
 
-	for(cnt=0; cnt<MAX_TEMP_ENTRIES; cnt++)
+	if(temp_cache.Lookup(new_entry) != NAT_CACHE_INVALID_IDX)
 	{
-		if(temp[cnt].private_ip == new_entry->private_ip &&
-			 temp[cnt].target_ip == new_entry->target_ip &&
-			 temp[cnt].private_port ==  new_entry->private_port  &&
-			 temp[cnt].target_port == new_entry->target_port &&
-			 temp[cnt].protocol == new_entry->protocol)
-		{
-			IPACMDBG("Received duplicate Temp entry\n");
-			return;
-		}
+		IPACMDBG("Received duplicate Temp entry\n");
+		return;
 	}
 
-	for(cnt=0; cnt<MAX_TEMP_ENTRIES; cnt++)
+	/* make room by dropping the flow staged first */
+	if(temp_cache.GetCount() >= max_temp_entries)
 	{
-		if(temp[cnt].private_ip == 0 &&
-			 temp[cnt].target_ip == 0)
-		{
-			memcpy(&temp[cnt], new_entry, sizeof(nat_table_entry));
-			IPACMDBG("Added Temp Entry\n");
-			return;
-		}
+		IPACMDBG("Temp entries full, evicting the oldest one\n");
+		UnstageTempEntry(temp_oldest);
+		temp_stats.evicted++;
+	}
+
+	cnt = temp_cache.Insert(new_entry);
+	if(cnt == NAT_CACHE_INVALID_IDX)
+	{
+		IPACMERR("Unable to add temp entry\n");
+		return;
 	}
 
-	IPACMDBG("Unable to add temp entry, cache full\n");
+	temp_age[cnt].next = NAT_CACHE_INVALID_IDX;
+	temp_age[cnt].prev = temp_newest;
+	if(temp_newest != NAT_CACHE_INVALID_IDX)
+	{
+		temp_age[temp_newest].next = cnt;
+	}
+	else
+	{
+		temp_oldest = cnt;
+	}
+	temp_newest = cnt;
+	temp_stats.staged++;
+
+	IPACMDBG("Added Temp Entry, %d staged\n", temp_cache.GetCount());
 	return;
 }
 
+void NatApp::UnstageTempEntry(int idx)
+{
+	if(temp_age[idx].prev != NAT_CACHE_INVALID_IDX)
+	{
+		temp_age[temp_age[idx].prev].next = temp_age[idx].next;
+	}
+	else
+	{
+		temp_oldest = temp_age[idx].next;
+	}
+
+	if(temp_age[idx].next != NAT_CACHE_INVALID_IDX)
+	{
+		temp_age[temp_age[idx].next].prev = temp_age[idx].prev;
+	}
+	else
+	{
+		temp_newest = temp_age[idx].prev;
+	}
+
+	temp_cache.Remove(idx);
+}
+
 void NatApp::DeleteTempEntry(const nat_table_entry *entry)
 {
 	int cnt;
@@ -728,68 +2276,120 @@ void NatApp::DeleteTempEntry(const nat_table_entry *entry)
 	IPACMDBG("Private Port: %d\t Target Port: %d\n", entry->private_port, entry->target_port);
 	IPACMDBG("protocol: %d\n", entry->protocol);
 
-	for(cnt=0; cnt<MAX_TEMP_ENTRIES; cnt++)
+	cnt = temp_cache.Lookup(entry);
+	if(cnt != NAT_CACHE_INVALID_IDX)
 	{
-		if(temp[cnt].private_ip == entry->private_ip &&
-			 temp[cnt].target_ip == entry->target_ip &&
-			 temp[cnt].private_port ==  entry->private_port  &&
-			 temp[cnt].target_port == entry->target_port &&
-			 temp[cnt].protocol == entry->protocol)
-		{
-			memset(&temp[cnt], 0, sizeof(nat_table_entry));
-			IPACMDBG("Delete Temp Entry\n");
-			return;
-		}
+		UnstageTempEntry(cnt);
+		IPACMDBG("Delete Temp Entry\n");
+		return;
 	}
 
 	IPACMDBG("No Such Temp Entry exists\n");
 	return;
 }
 
+/* Takes one flow out of the staging area and, when adding, reserves
+	 its nat cache slot. Returns the slot to push to the nat table or
+	 NAT_CACHE_INVALID_IDX */
+int NatApp::FlushTempEntry(int idx, bool isAdd, bool isDummy)
+{
+	nat_table_entry entry;
+	int slot, ret;
+
+	memcpy(&entry, &temp[idx], sizeof(entry));
+	UnstageTempEntry(idx);
+
+	if(!isAdd || entry.public_ip != pub_ip_addr)
+	{
+		return NAT_CACHE_INVALID_IDX;
+	}
+
+	if (isDummy) {
+		/* To avoild DL expections for non IPA path */
+		entry.private_ip = entry.public_ip;
+		entry.private_port = entry.public_port;
+		IPACMDBG("Flushing dummy temp rule");
+		iptodot("Private IP", entry.private_ip);
+	}
+
+	ret = ReserveEntry(&entry, &slot);
+	if(ret)
+	{
+		IPACMERR("unable to add temp entry: %d\n", ret);
+		return NAT_CACHE_INVALID_IDX;
+	}
+
+	if(slot != NAT_CACHE_INVALID_IDX &&
+		 !isPwrSaveIf(entry.private_ip) &&
+		 !isPwrSaveIf(entry.target_ip))
+	{
+		temp_stats.flushed++;
+		return slot;
+	}
+
+	return NAT_CACHE_INVALID_IDX;
+}
+
 void NatApp::FlushTempEntries(uint32_t ip_addr, bool isAdd,
 		bool isDummy)
 {
-	int cnt;
-	int ret;
+	int cnt, next, slot, num = 0;
+	int slots[MAX_BULK_NAT_ENTRIES];
 
 	IPACMDBG_H("Received below with isAdd:%d ", isAdd);
 	iptodot("IP Address: ", ip_addr);
 
-	for(cnt=0; cnt<MAX_TEMP_ENTRIES; cnt++)
+	if(isAdd)
 	{
-		if(temp[cnt].private_ip == ip_addr ||
-			 temp[cnt].target_ip == ip_addr)
+		RestoreTable();
+	}
+
+	/* the flows of the client are on its private ip list or on its
+		 target ip list, fetch the next one before unstaging */
+	for(cnt = temp_cache.FirstByPrivateIp(ip_addr); cnt != NAT_CACHE_INVALID_IDX; cnt = next)
+	{
+		next = temp_cache.NextByPrivateIp(cnt);
+		slot = FlushTempEntry(cnt, isAdd, isDummy);
+		if(slot != NAT_CACHE_INVALID_IDX)
 		{
-			if(isAdd)
+			slots[num++] = slot;
+			if(num == MAX_BULK_NAT_ENTRIES)
 			{
-				if(temp[cnt].public_ip == pub_ip_addr)
-				{
-					if (isDummy) {
-						/* To avoild DL expections for non IPA path */
-						temp[cnt].private_ip = temp[cnt].public_ip;
-						temp[cnt].private_port = temp[cnt].public_port;
-						IPACMDBG("Flushing dummy temp rule");
-						iptodot("Private IP", temp[cnt].private_ip);
-					}
+				AddEntriesToHw(slots, num, true);
+				num = 0;
+			}
+		}
+	}
 
-					ret = AddEntry(&temp[cnt]);
-					if(ret)
-					{
-						IPACMERR("unable to add temp entry: %d\n", ret);
-						continue;
-					}
-				}
+	for(cnt = temp_cache.FirstByTargetIp(ip_addr); cnt != NAT_CACHE_INVALID_IDX; cnt = next)
+	{
+		next = temp_cache.NextByTargetIp(cnt);
+		slot = FlushTempEntry(cnt, isAdd, isDummy);
+		if(slot != NAT_CACHE_INVALID_IDX)
+		{
+			slots[num++] = slot;
+			if(num == MAX_BULK_NAT_ENTRIES)
+			{
+				AddEntriesToHw(slots, num, true);
+				num = 0;
 			}
-			memset(&temp[cnt], 0, sizeof(nat_table_entry));
 		}
 	}
 
+	/* push all the flushed entries to the nat table at once */
+	AddEntriesToHw(slots, num, true);
+
+	IPACMDBG_H("Temp entries: %d staged, %u flushed, %u evicted so far\n",
+			temp_cache.GetCount(), temp_stats.flushed, temp_stats.evicted);
+
+	CheckTableSize();
 	return;
 }
 
 int NatApp::DelEntriesOnClntDiscon(uint32_t ip_addr)
 {
-	int cnt, tmp = 0;
+	int cnt, tmp = 0, num = 0;
+	int slots[MAX_BULK_NAT_ENTRIES];
 	IPACMDBG_H("Received IP address: 0x%x\n", ip_addr);
 
 	if(ip_addr == INVALID_IP_ADDR)
@@ -808,27 +2408,22 @@ int NatApp::DelEntriesOnClntDiscon(uint32_t ip_addr)
 		}
 	}
 
-	for(cnt = 0; cnt < max_entries; cnt++)
+	for(cnt = nat_cache.FirstByPrivateIp(ip_addr); cnt != NAT_CACHE_INVALID_IDX;
+			cnt = nat_cache.NextByPrivateIp(cnt))
 	{
-		if(cache[cnt].private_ip == ip_addr)
+		if(cache[cnt].enabled == true)
 		{
-			if(cache[cnt].enabled == true)
+			slots[num++] = cnt;
+			tmp++;
+			if(num == MAX_BULK_NAT_ENTRIES)
 			{
-				if(ipa_nat_del_ipv4_rule(nat_table_hdl, cache[cnt].rule_hdl) < 0)
-				{
-					IPACMERR("unable to delete the rule\n");
-					continue;
-				}
-				else
-				{
-					IPACMDBG("won't delete the rule\n");
-					cache[cnt].enabled = false;
-					tmp++;
-				}
+				DelEntriesFromHw(slots, num);
+				num = 0;
 			}
-			IPACMDBG("won't delete the rule for entry %d, enabled %d\n",cnt, cache[cnt].enabled);
 		}
+		IPACMDBG("won't delete the rule for entry %d, enabled %d\n",cnt, cache[cnt].enabled);
 	}
+	DelEntriesFromHw(slots, num);
 
 	IPACMDBG("Deleted (but cached) %d entries\n", tmp);
 	return 0;
@@ -836,7 +2431,8 @@ int NatApp::DelEntriesOnClntDiscon(uint32_t ip_addr)
 
 int NatApp::DelEntriesOnSTAClntDiscon(uint32_t ip_addr)
 {
-	int cnt, tmp = curCnt;
+	int cnt, next, tmp = curCnt, num = 0;
+	int slots[MAX_BULK_NAT_ENTRIES];
 	IPACMDBG_H("Received IP address: 0x%x\n", ip_addr);
 
 	if(ip_addr == INVALID_IP_ADDR)
@@ -845,23 +2441,35 @@ int NatApp::DelEntriesOnSTAClntDiscon(uint32_t ip_addr)
 		return -1;
 	}
 
-
-	for(cnt = 0; cnt < max_entries; cnt++)
+	/* remove the rules from nat table first, then from the cache */
+	for(cnt = nat_cache.FirstByTargetIp(ip_addr); cnt != NAT_CACHE_INVALID_IDX;
+			cnt = nat_cache.NextByTargetIp(cnt))
 	{
-		if(cache[cnt].target_ip == ip_addr)
+		if(cache[cnt].enabled == true)
 		{
-			if(cache[cnt].enabled == true)
+			slots[num++] = cnt;
+			if(num == MAX_BULK_NAT_ENTRIES)
 			{
-				if(ipa_nat_del_ipv4_rule(nat_table_hdl, cache[cnt].rule_hdl) < 0)
-				{
-					IPACMERR("unable to delete the rule\n");
-					continue;
-				}
+				DelEntriesFromHw(slots, num);
+				num = 0;
 			}
+		}
+	}
+	DelEntriesFromHw(slots, num);
 
-			memset(&cache[cnt], 0, sizeof(cache[cnt]));
-			curCnt--;
+	for(cnt = nat_cache.FirstByTargetIp(ip_addr); cnt != NAT_CACHE_INVALID_IDX; cnt = next)
+	{
+		next = nat_cache.NextByTargetIp(cnt);
+
+		/* a rule ipa did not delete keeps its handle */
+		if(cache[cnt].enabled == true)
+		{
+			IPACMERR("unable to delete the rule\n");
+			continue;
 		}
+
+		nat_cache.Remove(cnt);
+		curCnt--;
 	}
 
 	IPACMDBG("Deleted %d entries\n", (tmp - curCnt));
@@ -871,6 +2479,7 @@ int NatApp::DelEntriesOnSTAClntDiscon(uint32_t ip_addr)
 void NatApp::CacheEntry(const nat_table_entry *rule)
 {
 	int cnt;
+	nat_table_entry new_entry;
 
 	if(rule->private_ip == 0 ||
 		 rule->target_ip == 0 ||
@@ -884,39 +2493,26 @@ void NatApp::CacheEntry(const nat_table_entry *rule)
 
 	if(!ChkForDup(rule))
 	{
-		for(cnt=0; cnt < max_entries; cnt++)
-		{
-			if(cache[cnt].private_ip == 0 &&
-				 cache[cnt].target_ip == 0 &&
-				 cache[cnt].private_port == 0  &&
-				 cache[cnt].target_port == 0 &&
-				 cache[cnt].protocol == 0)
-			{
-				break;
-			}
-		}
-
-		if(max_entries == cnt)
+		memset(&new_entry, 0, sizeof(new_entry));
+		new_entry.enabled = false;
+		new_entry.rule_hdl = 0;
+		new_entry.private_ip = rule->private_ip;
+		new_entry.target_ip = rule->target_ip;
+		new_entry.target_port = rule->target_port;
+		new_entry.private_port = rule->private_port;
+		new_entry.protocol = rule->protocol;
+		new_entry.timestamp = 0;
+		new_entry.public_port = rule->public_port;
+		new_entry.public_ip = rule->public_ip;
+		new_entry.dst_nat = rule->dst_nat;
+
+		cnt = nat_cache.Insert(&new_entry);
+		if(cnt == NAT_CACHE_INVALID_IDX)
 		{
 			IPACMERR("Error: Unable to add, reached maximum rules\n");
 			return;
 		}
-		else
-		{
-			cache[cnt].enabled = false;
-			cache[cnt].rule_hdl = 0;
-			cache[cnt].private_ip = rule->private_ip;
-			cache[cnt].target_ip = rule->target_ip;
-			cache[cnt].target_port = rule->target_port;
-			cache[cnt].private_port = rule->private_port;
-			cache[cnt].protocol = rule->protocol;
-			cache[cnt].timestamp = 0;
-			cache[cnt].public_port = rule->public_port;
-			cache[cnt].public_ip = rule->public_ip;
-			cache[cnt].dst_nat = rule->dst_nat;
-			curCnt++;
-		}
-
+		curCnt++;
 	}
 	else
 	{
@@ -928,42 +2524,41 @@ void NatApp::CacheEntry(const nat_table_entry *rule)
 	return;
 }
 
-void NatApp::Read_TcpUdp_Timeout(void) {
-	FILE *udp_fd = NULL, *tcp_fd = NULL;
+/* The proc file is opened once, pread() gets the current value
+	 without opening it again */
+void NatApp::ReadTimeout(int *fd, const char *file_name, uint32_t *timeout)
+{
+	char buf[16];
+	ssize_t len;
 
-	/* Read UDP timeout value */
-	udp_fd = fopen(IPACM_UDP_FULL_FILE_NAME, "r");
-	if (udp_fd == NULL) {
-		IPACMERR("unable to open %s\n", IPACM_UDP_FULL_FILE_NAME);
-		goto fail;
+	if (*fd < 0) {
+		*fd = open(file_name, O_RDONLY | O_CLOEXEC);
+		if (*fd < 0) {
+			IPACMERR("unable to open %s\n", file_name);
+			return;
+		}
 	}
 
-	if (fscanf(udp_fd, "%d", &udp_timeout) != 1) {
-		IPACMERR("Error reading udp timeout\n");
+	len = pread(*fd, buf, sizeof(buf) - 1, 0);
+	if (len <= 0) {
+		IPACMERR("Error reading %s\n", file_name);
+		return;
 	}
-	IPACMDBG_H("udp timeout value: %d\n", udp_timeout);
+	buf[len] = '\0';
 
+	*timeout = strtoul(buf, NULL, 10);
+}
 
-	/* Read TCP timeout value */
-	tcp_fd = fopen(IPACM_TCP_FULL_FILE_NAME, "r");
-	if (tcp_fd == NULL) {
-		IPACMERR("unable to open %s\n", IPACM_TCP_FULL_FILE_NAME);
-		goto fail;
-	}
+void NatApp::Read_TcpUdp_Timeout(void) {
+	ReadTimeout(&udp_timeout_fd, IPACM_UDP_FULL_FILE_NAME, &udp_timeout);
+	IPACMDBG_H("udp timeout value: %d\n", udp_timeout);
 
+	ReadTimeout(&udp_unreplied_timeout_fd, IPACM_UDP_UNREPLIED_FILE_NAME,
+							&udp_unreplied_timeout);
+	IPACMDBG_H("udp unreplied timeout value: %d\n", udp_unreplied_timeout);
 
-	if (fscanf(tcp_fd, "%d", &tcp_timeout) != 1) {
-		IPACMERR("Error reading tcp timeout\n");
-	}
+	ReadTimeout(&tcp_timeout_fd, IPACM_TCP_FULL_FILE_NAME, &tcp_timeout);
 	IPACMDBG_H("tcp timeout value: %d\n", tcp_timeout);
 
-fail:
-	if (udp_fd) {
-		fclose(udp_fd);
-	}
-	if (tcp_fd) {
-		fclose(tcp_fd);
-	}
-
 	return;
 }
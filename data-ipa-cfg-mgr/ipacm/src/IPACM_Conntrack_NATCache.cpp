@@ -0,0 +1,373 @@
+/*
+Copyright (c) 2016, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of The Linux Foundation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/*!
+	@file
+	IPACM_Conntrack_NATCache.cpp
+
+	@brief
+	This file implements the NAT rule cache with O(1) 5-tuple lookup
+
+	@Author
+
+*/
+#include <stdlib.h>
+#include <string.h>
+
+#include "IPACM_Conntrack_NATCache.h"
+#include "IPACM_Log.h"
+
+#define NAT_CACHE_EMPTY_BUCKET (-1)
+
+NatCache::NatCache()
+{
+	entries = NULL;
+	max_entries = 0;
+	count = 0;
+
+	buckets = NULL;
+	bucket_mask = 0;
+
+	free_slots = NULL;
+	free_cnt = 0;
+
+	priv_heads = NULL;
+	tgt_heads = NULL;
+	ip_mask = 0;
+	priv_links = NULL;
+	tgt_links = NULL;
+}
+
+NatCache::~NatCache()
+{
+	free(entries);
+	free(buckets);
+	free(free_slots);
+	free(priv_heads);
+	free(tgt_heads);
+	free(priv_links);
+	free(tgt_links);
+}
+
+int NatCache::Init(int num_entries)
+{
+	uint32_t num_buckets = 1, num_ip_buckets = 1;
+
+	if(num_entries <= 0)
+	{
+		IPACMERR("Invalid number of cache entries: %d\n", num_entries);
+		return -1;
+	}
+
+	/* keep the load factor at or below 0.5 */
+	while(num_buckets < (uint32_t)(2 * num_entries))
+	{
+		num_buckets <<= 1;
+	}
+
+	while(num_ip_buckets < (uint32_t)num_entries)
+	{
+		num_ip_buckets <<= 1;
+	}
+
+	entries = (nat_table_entry *)malloc(sizeof(nat_table_entry) * num_entries);
+	buckets = (int *)malloc(sizeof(int) * num_buckets);
+	free_slots = (int *)malloc(sizeof(int) * num_entries);
+	priv_heads = (int *)malloc(sizeof(int) * num_ip_buckets);
+	tgt_heads = (int *)malloc(sizeof(int) * num_ip_buckets);
+	priv_links = (nat_cache_link *)malloc(sizeof(nat_cache_link) * num_entries);
+	tgt_links = (nat_cache_link *)malloc(sizeof(nat_cache_link) * num_entries);
+	if(entries == NULL || buckets == NULL || free_slots == NULL ||
+		 priv_heads == NULL || tgt_heads == NULL ||
+		 priv_links == NULL || tgt_links == NULL)
+	{
+		IPACMERR("Unable to allocate memory for nat cache\n");
+		goto fail;
+	}
+
+	max_entries = num_entries;
+	bucket_mask = num_buckets - 1;
+	ip_mask = num_ip_buckets - 1;
+	Clear();
+
+	IPACMDBG("Allocated nat cache: %d entries, %d buckets\n", max_entries, num_buckets);
+	return 0;
+
+fail:
+	free(entries);
+	free(buckets);
+	free(free_slots);
+	free(priv_heads);
+	free(tgt_heads);
+	free(priv_links);
+	free(tgt_links);
+	entries = NULL;
+	buckets = NULL;
+	free_slots = NULL;
+	priv_heads = NULL;
+	tgt_heads = NULL;
+	priv_links = NULL;
+	tgt_links = NULL;
+	return -1;
+}
+
+void NatCache::Clear()
+{
+	int cnt;
+
+	memset(entries, 0, sizeof(nat_table_entry) * max_entries);
+	for(cnt = 0; cnt <= (int)bucket_mask; cnt++)
+	{
+		buckets[cnt] = NAT_CACHE_EMPTY_BUCKET;
+	}
+
+	for(cnt = 0; cnt <= (int)ip_mask; cnt++)
+	{
+		priv_heads[cnt] = NAT_CACHE_INVALID_IDX;
+		tgt_heads[cnt] = NAT_CACHE_INVALID_IDX;
+	}
+
+	/* hand out the lowest slots first */
+	for(cnt = 0; cnt < max_entries; cnt++)
+	{
+		free_slots[cnt] = max_entries - 1 - cnt;
+	}
+	free_cnt = max_entries;
+	count = 0;
+}
+
+uint32_t NatCache::Hash(const nat_table_entry *rule)
+{
+	uint32_t hash;
+
+	hash = rule->private_ip;
+	hash = (hash * 0x9E3779B1) ^ rule->target_ip;
+	hash = (hash * 0x9E3779B1) ^ (((uint32_t)rule->private_port << 16) | rule->target_port);
+	hash = (hash * 0x9E3779B1) ^ rule->protocol;
+
+	/* final avalanche so that the low bits depend on every field */
+	hash ^= hash >> 16;
+	hash *= 0x85EBCA6B;
+	hash ^= hash >> 13;
+	hash *= 0xC2B2AE35;
+	hash ^= hash >> 16;
+
+	return hash;
+}
+
+uint32_t NatCache::HashIp(uint32_t ip_addr)
+{
+	ip_addr ^= ip_addr >> 16;
+	ip_addr *= 0x85EBCA6B;
+	ip_addr ^= ip_addr >> 13;
+
+	return ip_addr & ip_mask;
+}
+
+bool NatCache::isSameTuple(const nat_table_entry *a, const nat_table_entry *b)
+{
+	return (a->private_ip == b->private_ip &&
+					a->target_ip == b->target_ip &&
+					a->private_port == b->private_port &&
+					a->target_port == b->target_port &&
+					a->protocol == b->protocol);
+}
+
+/* Returns the bucket holding the rule, or the empty bucket
+   where it would be inserted */
+int NatCache::FindBucket(const nat_table_entry *rule)
+{
+	uint32_t pos = Hash(rule) & bucket_mask;
+
+	while(buckets[pos] != NAT_CACHE_EMPTY_BUCKET)
+	{
+		if(isSameTuple(&entries[buckets[pos]], rule))
+		{
+			break;
+		}
+		pos = (pos + 1) & bucket_mask;
+	}
+
+	return pos;
+}
+
+/* Returns the slot index of the entry matching the rule 5-tuple */
+int NatCache::Lookup(const nat_table_entry *rule)
+{
+	if(entries == NULL)
+	{
+		return NAT_CACHE_INVALID_IDX;
+	}
+
+	return buckets[FindBucket(rule)];
+}
+
+/* Copies the rule into a free slot and indexes it. Caller is
+   expected to have checked for duplicates with Lookup() */
+int NatCache::Insert(const nat_table_entry *rule)
+{
+	int idx, pos;
+
+	if(entries == NULL || free_cnt == 0)
+	{
+		return NAT_CACHE_INVALID_IDX;
+	}
+
+	pos = FindBucket(rule);
+	if(buckets[pos] != NAT_CACHE_EMPTY_BUCKET)
+	{
+		return NAT_CACHE_INVALID_IDX;
+	}
+
+	idx = free_slots[--free_cnt];
+	memcpy(&entries[idx], rule, sizeof(nat_table_entry));
+	buckets[pos] = idx;
+	count++;
+
+	Link(&priv_heads[HashIp(rule->private_ip)], priv_links, idx);
+	Link(&tgt_heads[HashIp(rule->target_ip)], tgt_links, idx);
+
+	return idx;
+}
+
+/* Unindexes the slot and returns it to the free stack */
+void NatCache::Remove(int idx)
+{
+	uint32_t pos, next, home;
+
+	if(idx < 0 || idx >= max_entries)
+	{
+		return;
+	}
+
+	pos = FindBucket(&entries[idx]);
+	if(buckets[pos] != idx)
+	{
+		return;
+	}
+
+	/* backward shift deletion, keeps probe sequences intact
+		 without leaving tombstones behind */
+	next = pos;
+	while(1)
+	{
+		next = (next + 1) & bucket_mask;
+		if(buckets[next] == NAT_CACHE_EMPTY_BUCKET)
+		{
+			break;
+		}
+
+		home = Hash(&entries[buckets[next]]) & bucket_mask;
+		if(((next - home) & bucket_mask) >= ((next - pos) & bucket_mask))
+		{
+			buckets[pos] = buckets[next];
+			pos = next;
+		}
+	}
+	buckets[pos] = NAT_CACHE_EMPTY_BUCKET;
+
+	Unlink(&priv_heads[HashIp(entries[idx].private_ip)], priv_links, idx);
+	Unlink(&tgt_heads[HashIp(entries[idx].target_ip)], tgt_links, idx);
+
+	memset(&entries[idx], 0, sizeof(nat_table_entry));
+	free_slots[free_cnt++] = idx;
+	count--;
+}
+
+void NatCache::Link(int *head, nat_cache_link *links, int idx)
+{
+	links[idx].prev = NAT_CACHE_INVALID_IDX;
+	links[idx].next = *head;
+	if(*head != NAT_CACHE_INVALID_IDX)
+	{
+		links[*head].prev = idx;
+	}
+	*head = idx;
+}
+
+void NatCache::Unlink(int *head, nat_cache_link *links, int idx)
+{
+	if(links[idx].prev != NAT_CACHE_INVALID_IDX)
+	{
+		links[links[idx].prev].next = links[idx].next;
+	}
+	else
+	{
+		*head = links[idx].next;
+	}
+
+	if(links[idx].next != NAT_CACHE_INVALID_IDX)
+	{
+		links[links[idx].next].prev = links[idx].prev;
+	}
+}
+
+/* Several clients can share a list, skip the entries of the others */
+int NatCache::SkipToIp(const nat_cache_link *links, int idx, uint32_t ip_addr, bool is_private)
+{
+	while(idx != NAT_CACHE_INVALID_IDX)
+	{
+		if((is_private ? entries[idx].private_ip : entries[idx].target_ip) == ip_addr)
+		{
+			break;
+		}
+		idx = links[idx].next;
+	}
+
+	return idx;
+}
+
+int NatCache::FirstByPrivateIp(uint32_t ip_addr)
+{
+	if(entries == NULL)
+	{
+		return NAT_CACHE_INVALID_IDX;
+	}
+
+	return SkipToIp(priv_links, priv_heads[HashIp(ip_addr)], ip_addr, true);
+}
+
+int NatCache::NextByPrivateIp(int idx)
+{
+	return SkipToIp(priv_links, priv_links[idx].next, entries[idx].private_ip, true);
+}
+
+int NatCache::FirstByTargetIp(uint32_t ip_addr)
+{
+	if(entries == NULL)
+	{
+		return NAT_CACHE_INVALID_IDX;
+	}
+
+	return SkipToIp(tgt_links, tgt_heads[HashIp(ip_addr)], ip_addr, false);
+}
+
+int NatCache::NextByTargetIp(int idx)
+{
+	return SkipToIp(tgt_links, tgt_links[idx].next, entries[idx].target_ip, false);
+}
@@ -44,10 +44,9 @@ IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "IPACM_Defs.h"
 
 
-extern pthread_mutex_t mutex;
-extern pthread_cond_t  cond_var;
-
-cmd_evts *IPACM_EvtDispatcher::head = NULL;
+std::vector<IPACM_Listener *> IPACM_EvtDispatcher::listeners[IPACM_EVENT_MAX];
+bool IPACM_EvtDispatcher::dispatching = false;
+bool IPACM_EvtDispatcher::removed = false;
 extern uint32_t ipacm_event_stats[IPACM_EVENT_MAX];
 
 int IPACM_EvtDispatcher::PostEvt
@@ -55,7 +54,7 @@ int IPACM_EvtDispatcher::PostEvt
 	 ipacm_cmd_q_data *data
 )
 {
-	Message *item = NULL;
+	cmd_t evt;
 	MessageQueue *MsgQueue = NULL;
 
 	if(data->event < IPA_EXTERNAL_EVENT_MAX)
@@ -74,141 +73,176 @@ int IPACM_EvtDispatcher::PostEvt
 		return IPACM_FAILURE;
 	}
 
-	item = new Message();
-	if(item == NULL)
-	{
-		IPACMERR("unable to create new message item\n");
-		return IPACM_FAILURE;
-	}
-
-	item->evt.callback_ptr = IPACM_EvtDispatcher::ProcessEvt;
-	memcpy(&item->evt.data, data, sizeof(ipacm_cmd_q_data));
-
-	if(pthread_mutex_lock(&mutex) != 0)
-	{
-		IPACMERR("unable to lock the mutex\n");
-		return IPACM_FAILURE;
-	}
-
-	IPACMDBG("Enqueing item\n");
-	MsgQueue->enqueue(item);
-	IPACMDBG("Enqueued item %p\n", item);
+	evt.callback_ptr = IPACM_EvtDispatcher::ProcessEvt;
+	memcpy(&evt.data, data, sizeof(ipacm_cmd_q_data));
 
-	if(pthread_cond_signal(&cond_var) != 0)
-	{
-		IPACMDBG("unable to lock the mutex\n");
-		/* Release the mutex before you return failure */
-		if(pthread_mutex_unlock(&mutex) != 0)
-		{
-			IPACMERR("unable to unlock the mutex\n");
-			return IPACM_FAILURE;
-		}
-		return IPACM_FAILURE;
-	}
-
-	if(pthread_mutex_unlock(&mutex) != 0)
-	{
-		IPACMERR("unable to unlock the mutex\n");
-		return IPACM_FAILURE;
-	}
+	IPACMDBG("Enqueing event\n");
+	MsgQueue->enqueue(&evt);
 
 	return IPACM_SUCCESS;
 }
 
 void IPACM_EvtDispatcher::ProcessEvt(ipacm_cmd_q_data *data)
 {
+	std::vector<IPACM_Listener *> *list;
+	IPACM_Listener *obj;
+	size_t cnt;
 
-	cmd_evts *tmp = head, tmp1;
+	if(data->event >= IPACM_EVENT_MAX)
+	{
+		IPACMERR("invalid event %d\n", data->event);
+		goto free_data;
+	}
+	list = &listeners[data->event];
 
-	if(head == NULL)
+	if(list->empty())
 	{
-		IPACMDBG("Queue is empty\n");
+		IPACMDBG("No listener for event %d\n", data->event);
 	}
 
-	while(tmp != NULL)
+	/* index based, the callbacks may register new listeners and grow
+		 the vector. Entries they deregister are cleared in place */
+	dispatching = true;
+	for(cnt = 0; cnt < list->size(); cnt++)
 	{
-	        memcpy(&tmp1, tmp, sizeof(tmp1));
-		if(data->event == tmp1.event)
+		obj = (*list)[cnt];
+		if(obj != NULL)
 		{
 			ipacm_event_stats[data->event]++;
-			tmp1.obj->event_callback(data->event, data->evt_data);
+			obj->event_callback(data->event, data->evt_data);
 			IPACMDBG(" Find matched registered events\n");
 		}
-	        tmp = tmp1.next;
+	}
+	dispatching = false;
+
+	if(removed)
+	{
+		Compact();
 	}
 
 	IPACMDBG(" Finished process events\n");
-			
+
+free_data:
 	if(data->evt_data != NULL)
 	{
 		IPACMDBG("free the event:%d data: %p\n", data->event, data->evt_data);
-		free(data->evt_data);
+		IPACM_EvtPool::Free(data->evt_data);
 	}
 	return;
 }
 
 int IPACM_EvtDispatcher::registr(ipa_cm_event_id event, IPACM_Listener *obj)
 {
-	cmd_evts *tmp = head,*nw;
-
-	nw = (cmd_evts *)malloc(sizeof(cmd_evts));
-	if(nw != NULL)
-	{
-		nw->event = event;
-		nw->obj = obj;
-		nw->next = NULL;
-	}
-	else
+	if(event >= IPACM_EVENT_MAX || obj == NULL)
 	{
+		IPACMERR("invalid listener for event %d\n", event);
 		return IPACM_FAILURE;
 	}
 
-	if(head == NULL)
-	{
-		head = nw;
-	}
-	else
-	{
-		while(tmp->next)
-		{
-			tmp = tmp->next;
-		}
-		tmp->next = nw;
-	}
+	listeners[event].push_back(obj);
 	return IPACM_SUCCESS;
 }
 
 
 int IPACM_EvtDispatcher::deregistr(IPACM_Listener *param)
 {
-	cmd_evts *tmp = head,*tmp1,*prev = head;
+	std::vector<IPACM_Listener *> *list;
+	size_t cnt;
+	int evt;
 
-	while(tmp != NULL)
+	for(evt = 0; evt < IPACM_EVENT_MAX; evt++)
 	{
-		if(tmp->obj == param)
+		list = &listeners[evt];
+		for(cnt = 0; cnt < list->size(); cnt++)
 		{
-			tmp1 = tmp;
-			if(tmp == head)
+			if((*list)[cnt] == param)
 			{
-				head = head->next;
+				(*list)[cnt] = NULL;
+				removed = true;
 			}
-			else if(tmp->next == NULL)
-			{
-				prev->next = NULL;
-			}
-			else
-			{
-				prev->next = tmp->next;
-			}
-
-			tmp = tmp->next;
-			free(tmp1);
 		}
-		else
+	}
+
+	/* keep the indexes of a running dispatch valid */
+	if(removed && !dispatching)
+	{
+		Compact();
+	}
+	return IPACM_SUCCESS;
+}
+
+/* drop the cleared entries, keeping the order of the others */
+void IPACM_EvtDispatcher::Compact(void)
+{
+	std::vector<IPACM_Listener *> *list;
+	size_t cnt, num;
+	int evt;
+
+	for(evt = 0; evt < IPACM_EVENT_MAX; evt++)
+	{
+		list = &listeners[evt];
+		for(cnt = 0, num = 0; cnt < list->size(); cnt++)
 		{
-			prev = tmp;
-			tmp = tmp->next;
+			if((*list)[cnt] != NULL)
+			{
+				(*list)[num++] = (*list)[cnt];
+			}
 		}
+		list->resize(num);
 	}
-	return IPACM_SUCCESS;
+	removed = false;
+}
+
+/* keyed by the client, what is said about its address comes after */
+bool IPACM_EvtDispatcher::NeighKey(const ipacm_cmd_q_data *data, ipacm_evt_key *key)
+{
+	const ipacm_event_data_all *neigh = (const ipacm_event_data_all *)data->evt_data;
+
+	if(neigh == NULL)
+	{
+		return false;
+	}
+
+	ipacm_evt_key_add(key, &neigh->if_index, sizeof(neigh->if_index));
+	ipacm_evt_key_add(key, neigh->mac_addr, sizeof(neigh->mac_addr));
+	key->obj_len = key->len;
+
+	ipacm_evt_key_add(key, &neigh->iptype, sizeof(neigh->iptype));
+	ipacm_evt_key_add(key, &neigh->ipv4_addr, sizeof(neigh->ipv4_addr));
+	ipacm_evt_key_add(key, neigh->ipv6_addr, sizeof(neigh->ipv6_addr));
+	return true;
+}
+
+/* keyed by the interface and ip type, then the addresses */
+bool IPACM_EvtDispatcher::AddrKey(const ipacm_cmd_q_data *data, ipacm_evt_key *key)
+{
+	const ipacm_event_data_addr *addr = (const ipacm_event_data_addr *)data->evt_data;
+
+	if(addr == NULL)
+	{
+		return false;
+	}
+
+	ipacm_evt_key_add(key, &addr->if_index, sizeof(addr->if_index));
+	ipacm_evt_key_add(key, &addr->iptype, sizeof(addr->iptype));
+	key->obj_len = key->len;
+
+	ipacm_evt_key_add(key, &addr->ipv4_addr, sizeof(addr->ipv4_addr));
+	ipacm_evt_key_add(key, &addr->ipv4_addr_mask, sizeof(addr->ipv4_addr_mask));
+	ipacm_evt_key_add(key, &addr->ipv4_addr_gw, sizeof(addr->ipv4_addr_gw));
+	ipacm_evt_key_add(key, addr->ipv6_addr, sizeof(addr->ipv6_addr));
+	ipacm_evt_key_add(key, addr->ipv6_addr_mask, sizeof(addr->ipv6_addr_mask));
+	ipacm_evt_key_add(key, addr->ipv6_addr_gw, sizeof(addr->ipv6_addr_gw));
+	return true;
+}
+
+void IPACM_EvtDispatcher::EnableCoalescing(void)
+{
+	MessageQueue::setCoalesce(IPA_NEW_NEIGH_EVENT, NeighKey, NULL);
+	MessageQueue::setCoalesce(IPA_DEL_NEIGH_EVENT, NeighKey, NULL);
+	MessageQueue::setCoalesce(IPA_NEIGH_CLIENT_IP_ADDR_ADD_EVENT, NeighKey, NULL);
+	MessageQueue::setCoalesce(IPA_NEIGH_CLIENT_IP_ADDR_DEL_EVENT, NeighKey, NULL);
+	MessageQueue::setCoalesce(IPA_ADDR_ADD_EVENT, AddrKey, NULL);
+	MessageQueue::setCoalesce(IPA_ROUTE_ADD_EVENT, AddrKey, NULL);
+	MessageQueue::setCoalesce(IPA_ROUTE_DEL_EVENT, AddrKey, NULL);
 }
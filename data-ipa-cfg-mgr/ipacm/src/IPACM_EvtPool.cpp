@@ -0,0 +1,321 @@
+/*
+Copyright (c) 2016, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of The Linux Foundation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/*!
+	@file
+	IPACM_EvtPool.cpp
+
+	@brief
+	This file implements the pool allocator for event payloads
+
+	@Author
+
+*/
+#include <stdlib.h>
+#include <string.h>
+
+#include "IPACM_EvtPool.h"
+#include "IPACM_Log.h"
+
+IPACM_EvtPool::evt_class IPACM_EvtPool::pool[IPACM_EVT_POOL_CLASSES] =
+{
+	{ IPACM_EVT_POOL_MIN_BLOCK, { NULL }, 0, NULL, 0, 0, 0 },
+	{ IPACM_EVT_POOL_MIN_BLOCK << 1, { NULL }, 0, NULL, 0, 0, 0 },
+	{ IPACM_EVT_POOL_MIN_BLOCK << 2, { NULL }, 0, NULL, 0, 0, 0 },
+	{ IPACM_EVT_POOL_MIN_BLOCK << 3, { NULL }, 0, NULL, 0, 0, 0 }
+};
+uint32_t IPACM_EvtPool::fallback = 0;
+pthread_mutex_t IPACM_EvtPool::lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_key_t IPACM_EvtPool::cache_key;
+pthread_once_t IPACM_EvtPool::cache_once = PTHREAD_ONCE_INIT;
+static bool cache_key_valid = false;
+
+int IPACM_EvtPool::ClassOf(size_t size)
+{
+	int cls;
+
+	for(cls = 0; cls < IPACM_EVT_POOL_CLASSES; cls++)
+	{
+		if(size <= pool[cls].block_size)
+		{
+			return cls;
+		}
+	}
+
+	return -1;
+}
+
+int IPACM_EvtPool::SlabClassOf(void *ptr)
+{
+	char *p = (char *)ptr;
+	uint32_t cls, cnt, slabs;
+
+	for(cls = 0; cls < IPACM_EVT_POOL_CLASSES; cls++)
+	{
+		/* slab pointers are set before the count is published */
+		slabs = __atomic_load_n(&pool[cls].slabs, __ATOMIC_ACQUIRE);
+		for(cnt = 0; cnt < slabs; cnt++)
+		{
+			if(p >= pool[cls].slab[cnt] &&
+				 p < pool[cls].slab[cnt] + pool[cls].block_size * IPACM_EVT_POOL_SLAB_BLOCKS)
+			{
+				return cls;
+			}
+		}
+	}
+
+	return -1;
+}
+
+void IPACM_EvtPool::CreateKey(void)
+{
+	if(pthread_key_create(&cache_key, ReleaseCache) != 0)
+	{
+		IPACMERR("unable to create event pool key, no thread caches\n");
+		return;
+	}
+	cache_key_valid = true;
+}
+
+IPACM_EvtPool::evt_cache* IPACM_EvtPool::GetCache(void)
+{
+	evt_cache *cache;
+
+	pthread_once(&cache_once, CreateKey);
+	if(!cache_key_valid)
+	{
+		return NULL;
+	}
+
+	cache = (evt_cache *)pthread_getspecific(cache_key);
+	if(cache == NULL)
+	{
+		cache = (evt_cache *)calloc(1, sizeof(evt_cache));
+		if(cache == NULL)
+		{
+			return NULL;
+		}
+		if(pthread_setspecific(cache_key, cache) != 0)
+		{
+			free(cache);
+			return NULL;
+		}
+	}
+
+	return cache;
+}
+
+/* thread exit, give the cached blocks back */
+void IPACM_EvtPool::ReleaseCache(void *arg)
+{
+	evt_cache *cache = (evt_cache *)arg;
+	int cls;
+
+	for(cls = 0; cls < IPACM_EVT_POOL_CLASSES; cls++)
+	{
+		Drain(cache, cls, cache->cnt[cls]);
+	}
+	free(cache);
+}
+
+/* Move a batch of free blocks to the thread cache, adds a slab when
+	 the shared list is empty. Returns the number of blocks moved */
+int IPACM_EvtPool::Refill(evt_cache *cache, int cls)
+{
+	evt_class *pc = &pool[cls];
+	char *slab;
+	void *blk;
+	int cnt;
+
+	pthread_mutex_lock(&lock);
+	if(pc->head == NULL)
+	{
+		if(pc->slabs == IPACM_EVT_POOL_MAX_SLABS)
+		{
+			pthread_mutex_unlock(&lock);
+			return 0;
+		}
+
+		slab = (char *)malloc(pc->block_size * IPACM_EVT_POOL_SLAB_BLOCKS);
+		if(slab == NULL)
+		{
+			pthread_mutex_unlock(&lock);
+			IPACMERR("unable to allocate event pool slab\n");
+			return 0;
+		}
+
+		for(cnt = IPACM_EVT_POOL_SLAB_BLOCKS - 1; cnt >= 0; cnt--)
+		{
+			blk = slab + cnt * pc->block_size;
+			*(void **)blk = pc->head;
+			pc->head = blk;
+		}
+		pc->cnt += IPACM_EVT_POOL_SLAB_BLOCKS;
+
+		pc->slab[pc->slabs] = slab;
+		__atomic_store_n(&pc->slabs, pc->slabs + 1, __ATOMIC_RELEASE);
+		IPACMDBG("event pool %d byte blocks: %d slabs, %d in use, high water %d\n",
+						 pc->block_size, pc->slabs,
+						 __atomic_load_n(&pc->in_use, __ATOMIC_RELAXED),
+						 __atomic_load_n(&pc->high_water, __ATOMIC_RELAXED));
+	}
+
+	for(cnt = 0; cnt < IPACM_EVT_POOL_BATCH && pc->head != NULL; cnt++)
+	{
+		blk = pc->head;
+		pc->head = *(void **)blk;
+		pc->cnt--;
+
+		*(void **)blk = cache->head[cls];
+		cache->head[cls] = blk;
+		cache->cnt[cls]++;
+	}
+	pthread_mutex_unlock(&lock);
+
+	return cnt;
+}
+
+void IPACM_EvtPool::Drain(evt_cache *cache, int cls, int num)
+{
+	evt_class *pc = &pool[cls];
+	void *blk;
+
+	pthread_mutex_lock(&lock);
+	while(num-- > 0 && cache->head[cls] != NULL)
+	{
+		blk = cache->head[cls];
+		cache->head[cls] = *(void **)blk;
+		cache->cnt[cls]--;
+
+		*(void **)blk = pc->head;
+		pc->head = blk;
+		pc->cnt++;
+	}
+	pthread_mutex_unlock(&lock);
+}
+
+void* IPACM_EvtPool::Alloc(size_t size)
+{
+	evt_cache *cache;
+	evt_class *pc;
+	uint32_t in_use, high;
+	void *blk;
+	int cls;
+
+	cls = ClassOf(size);
+	if(cls < 0)
+	{
+		goto fail;
+	}
+	pc = &pool[cls];
+
+	cache = GetCache();
+	if(cache == NULL)
+	{
+		goto fail;
+	}
+
+	if(cache->cnt[cls] == 0 && Refill(cache, cls) == 0)
+	{
+		goto fail;
+	}
+
+	blk = cache->head[cls];
+	cache->head[cls] = *(void **)blk;
+	cache->cnt[cls]--;
+
+	in_use = __atomic_add_fetch(&pc->in_use, 1, __ATOMIC_RELAXED);
+	high = __atomic_load_n(&pc->high_water, __ATOMIC_RELAXED);
+	while(in_use > high &&
+				!__atomic_compare_exchange_n(&pc->high_water, &high, in_use, true,
+																		 __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+	{
+	}
+
+	return blk;
+
+fail:
+	__atomic_add_fetch(&fallback, 1, __ATOMIC_RELAXED);
+	return malloc(size);
+}
+
+void IPACM_EvtPool::Free(void *ptr)
+{
+	evt_cache *cache;
+	int cls;
+
+	if(ptr == NULL)
+	{
+		return;
+	}
+
+	cls = SlabClassOf(ptr);
+	if(cls < 0)
+	{
+		free(ptr);
+		return;
+	}
+	__atomic_sub_fetch(&pool[cls].in_use, 1, __ATOMIC_RELAXED);
+
+	cache = GetCache();
+	if(cache == NULL)
+	{
+		pthread_mutex_lock(&lock);
+		*(void **)ptr = pool[cls].head;
+		pool[cls].head = ptr;
+		pool[cls].cnt++;
+		pthread_mutex_unlock(&lock);
+		return;
+	}
+
+	*(void **)ptr = cache->head[cls];
+	cache->head[cls] = ptr;
+	cache->cnt[cls]++;
+
+	/* keep one batch around for the posts of this thread */
+	if(cache->cnt[cls] >= 2 * IPACM_EVT_POOL_BATCH)
+	{
+		Drain(cache, cls, IPACM_EVT_POOL_BATCH);
+	}
+}
+
+void IPACM_EvtPool::GetStats(ipacm_evt_pool_stats *stats)
+{
+	int cls;
+
+	pthread_mutex_lock(&lock);
+	for(cls = 0; cls < IPACM_EVT_POOL_CLASSES; cls++)
+	{
+		stats->cls[cls].block_size = pool[cls].block_size;
+		stats->cls[cls].slabs = pool[cls].slabs;
+		stats->cls[cls].in_use = __atomic_load_n(&pool[cls].in_use, __ATOMIC_RELAXED);
+		stats->cls[cls].high_water = __atomic_load_n(&pool[cls].high_water, __ATOMIC_RELAXED);
+	}
+	stats->fallback = __atomic_load_n(&fallback, __ATOMIC_RELAXED);
+	pthread_mutex_unlock(&lock);
+}
@@ -443,7 +443,7 @@ void IPACM_Iface::iface_addr_query
 					IPACMDBG_H("ipv4 address %s\n",inet_ntoa(s4->sin_addr));
 					iface_ipv4 = s4->sin_addr;
 					/* post new_addr event to command queue */
-					data_addr = (ipacm_event_data_addr *)malloc(sizeof(ipacm_event_data_addr));
+					data_addr = ipacm_evt_alloc<ipacm_event_data_addr>();
 					if(data_addr == NULL)
 					{
 						IPACMERR("unable to allocate memory for event data_addr\n");
@@ -468,7 +468,7 @@ void IPACM_Iface::iface_addr_query
 				{
 					struct sockaddr_in6 *s6 = (struct sockaddr_in6 *)ifa->ifa_addr;
 					/* post new_addr event to command queue */
-					data_addr = (ipacm_event_data_addr *)malloc(sizeof(ipacm_event_data_addr));
+					data_addr = ipacm_evt_alloc<ipacm_event_data_addr>();
 					if(data_addr == NULL)
 					{
 						IPACMERR("unable to allocate memory for event data_addr\n");
@@ -270,7 +270,7 @@ void IPACM_Lan::event_callback(ipa_cm_event_id event, void *param)
 				memset(&evt_data, 0, sizeof(evt_data));
 
 				ipacm_event_data_fid *data_fid = NULL;
-				data_fid = (ipacm_event_data_fid *)malloc(sizeof(ipacm_event_data_fid));
+				data_fid = ipacm_evt_alloc<ipacm_event_data_fid>();
 				if(data_fid == NULL)
 				{
 					IPACMERR("unable to allocate memory for IPA_USB_LINK_UP_EVENT data_fid\n");
@@ -400,8 +400,7 @@ void IPACM_Lan::event_callback(ipa_cm_event_id event, void *param)
 							ipacm_cmd_q_data evt_data;
 							ipacm_event_iface_up *info;
 
-							info = (ipacm_event_iface_up *)
-								malloc(sizeof(ipacm_event_iface_up));
+							info = ipacm_evt_alloc<ipacm_event_iface_up>();
 							if (info == NULL)
 							{
 								IPACMERR("Unable to allocate memory\n");
@@ -3106,7 +3105,7 @@ void IPACM_Lan::post_del_self_evt()
 {
 	ipacm_cmd_q_data evt;
 	ipacm_event_data_fid* fid;
-	fid = (ipacm_event_data_fid*)malloc(sizeof(ipacm_event_data_fid));
+	fid = ipacm_evt_alloc<ipacm_event_data_fid>();
 	if(fid == NULL)
 	{
 		IPACMERR("Failed to allocate fid memory.\n");
@@ -3864,7 +3863,7 @@ void IPACM_Lan::eth_bridge_post_event(ipa_cm_event_id evt, ipa_ip_type iptype, u
 	ipacm_cmd_q_data eth_bridge_evt;
 	ipacm_event_eth_bridge *evt_data;
 
-	evt_data = (ipacm_event_eth_bridge*)malloc(sizeof(ipacm_event_eth_bridge));
+	evt_data = ipacm_evt_alloc<ipacm_event_eth_bridge>();
 	if(evt_data == NULL)
 	{
 		IPACMERR("Failed to allocate memory.\n");
@@ -282,7 +282,7 @@ void* ipa_driver_msg_notifier(void *param)
 			IPACMDBG_H("AP Mac Address %02x:%02x:%02x:%02x:%02x:%02x\n",
 							 event_wlan->mac_addr[0], event_wlan->mac_addr[1], event_wlan->mac_addr[2],
 							 event_wlan->mac_addr[3], event_wlan->mac_addr[4], event_wlan->mac_addr[5]);
-                        data_fid = (ipacm_event_data_fid *)malloc(sizeof(ipacm_event_data_fid));
+                        data_fid = ipacm_evt_alloc<ipacm_event_data_fid>();
 			if(data_fid == NULL)
 			{
 				IPACMERR("unable to allocate memory for event_wlan data_fid\n");
@@ -299,7 +299,7 @@ void* ipa_driver_msg_notifier(void *param)
 			IPACMDBG_H("AP Mac Address %02x:%02x:%02x:%02x:%02x:%02x\n",
 							 event_wlan->mac_addr[0], event_wlan->mac_addr[1], event_wlan->mac_addr[2],
 							 event_wlan->mac_addr[3], event_wlan->mac_addr[4], event_wlan->mac_addr[5]);
-                        data_fid = (ipacm_event_data_fid *)malloc(sizeof(ipacm_event_data_fid));
+                        data_fid = ipacm_evt_alloc<ipacm_event_data_fid>();
 			if(data_fid == NULL)
 			{
 				IPACMERR("unable to allocate memory for event_wlan data_fid\n");
@@ -315,7 +315,7 @@ void* ipa_driver_msg_notifier(void *param)
 			IPACMDBG_H("STA Mac Address %02x:%02x:%02x:%02x:%02x:%02x\n",
 							 event_wlan->mac_addr[0], event_wlan->mac_addr[1], event_wlan->mac_addr[2],
 							 event_wlan->mac_addr[3], event_wlan->mac_addr[4], event_wlan->mac_addr[5]);
-			data = (ipacm_event_data_mac *)malloc(sizeof(ipacm_event_data_mac));
+			data = ipacm_evt_alloc<ipacm_event_data_mac>();
 			if(data == NULL)
 			{
 				IPACMERR("unable to allocate memory for event_wlan data_fid\n");
@@ -335,7 +335,7 @@ void* ipa_driver_msg_notifier(void *param)
 			IPACMDBG_H("STA Mac Address %02x:%02x:%02x:%02x:%02x:%02x\n",
 							 event_wlan->mac_addr[0], event_wlan->mac_addr[1], event_wlan->mac_addr[2],
 							 event_wlan->mac_addr[3], event_wlan->mac_addr[4], event_wlan->mac_addr[5]);
-                        data_fid = (ipacm_event_data_fid *)malloc(sizeof(ipacm_event_data_fid));
+                        data_fid = ipacm_evt_alloc<ipacm_event_data_fid>();
 			if(data_fid == NULL)
 			{
 				IPACMERR("unable to allocate memory for event_wlan data_fid\n");
@@ -352,7 +352,7 @@ void* ipa_driver_msg_notifier(void *param)
 			IPACMDBG_H("Mac Address %02x:%02x:%02x:%02x:%02x:%02x\n",
 							 event_wlan->mac_addr[0], event_wlan->mac_addr[1], event_wlan->mac_addr[2],
 							 event_wlan->mac_addr[3], event_wlan->mac_addr[4], event_wlan->mac_addr[5]);
-		        data = (ipacm_event_data_mac *)malloc(sizeof(ipacm_event_data_mac));
+		        data = ipacm_evt_alloc<ipacm_event_data_mac>();
 		        if (data == NULL)
 		        {
 		    	        IPACMERR("unable to allocate memory for event_wlan data\n");
@@ -384,7 +384,7 @@ void* ipa_driver_msg_notifier(void *param)
 				return NULL;
 			}
 			memcpy(event_ex, buffer + sizeof(struct ipa_msg_meta), length);
-			data_ex = (ipacm_event_data_wlan_ex *)malloc(sizeof(ipacm_event_data_wlan_ex) + event_ex_o.num_of_attribs * sizeof(ipa_wlan_hdr_attrib_val));
+			data_ex = (ipacm_event_data_wlan_ex *)IPACM_EvtPool::Alloc(sizeof(ipacm_event_data_wlan_ex) + event_ex_o.num_of_attribs * sizeof(ipa_wlan_hdr_attrib_val));
 		    if (data_ex == NULL)
 		    {
 				IPACMERR("unable to allocate memory for event data\n");
@@ -401,7 +401,7 @@ void* ipa_driver_msg_notifier(void *param)
 			evt_data.evt_data = data_ex;
 
 			/* Construct new_neighbor msg with netdev device internally */
-			new_neigh_data = (ipacm_event_data_all*)malloc(sizeof(ipacm_event_data_all));
+			new_neigh_data = ipacm_evt_alloc<ipacm_event_data_all>();
 			if(new_neigh_data == NULL)
 			{
 				IPACMERR("Failed to allocate memory.\n");
@@ -439,7 +439,7 @@ void* ipa_driver_msg_notifier(void *param)
 			IPACMDBG_H("Mac Address %02x:%02x:%02x:%02x:%02x:%02x\n",
 							 event_wlan->mac_addr[0], event_wlan->mac_addr[1], event_wlan->mac_addr[2],
 							 event_wlan->mac_addr[3], event_wlan->mac_addr[4], event_wlan->mac_addr[5]);
-		        data = (ipacm_event_data_mac *)malloc(sizeof(ipacm_event_data_mac));
+		        data = ipacm_evt_alloc<ipacm_event_data_mac>();
 		        if (data == NULL)
 		        {
 		    	        IPACMERR("unable to allocate memory for event_wlan data\n");
@@ -459,7 +459,7 @@ void* ipa_driver_msg_notifier(void *param)
 			IPACMDBG_H("Mac Address %02x:%02x:%02x:%02x:%02x:%02x\n",
 							 event_wlan->mac_addr[0], event_wlan->mac_addr[1], event_wlan->mac_addr[2],
 							 event_wlan->mac_addr[3], event_wlan->mac_addr[4], event_wlan->mac_addr[5]);
-		        data = (ipacm_event_data_mac *)malloc(sizeof(ipacm_event_data_mac));
+		        data = ipacm_evt_alloc<ipacm_event_data_mac>();
 		        if (data == NULL)
 		        {
 		    	        IPACMERR("unable to allocate memory for event_wlan data\n");
@@ -479,7 +479,7 @@ void* ipa_driver_msg_notifier(void *param)
 			IPACMDBG_H("Mac Address %02x:%02x:%02x:%02x:%02x:%02x\n",
 							 event_wlan->mac_addr[0], event_wlan->mac_addr[1], event_wlan->mac_addr[2],
 							 event_wlan->mac_addr[3], event_wlan->mac_addr[4], event_wlan->mac_addr[5]);
-		        data = (ipacm_event_data_mac *)malloc(sizeof(ipacm_event_data_mac));
+		        data = ipacm_evt_alloc<ipacm_event_data_mac>();
 		        if (data == NULL)
 		        {
 		    	       IPACMERR("unable to allocate memory for event_wlan data\n");
@@ -496,7 +496,7 @@ void* ipa_driver_msg_notifier(void *param)
 		case ECM_CONNECT:
 			memcpy(&event_ecm, buffer + sizeof(struct ipa_msg_meta), sizeof(struct ipa_ecm_msg));
 			IPACMDBG_H("Received ECM_CONNECT name: %s\n",event_ecm.name);
-			data_fid = (ipacm_event_data_fid *)malloc(sizeof(ipacm_event_data_fid));
+			data_fid = ipacm_evt_alloc<ipacm_event_data_fid>();
 			if(data_fid == NULL)
 			{
 				IPACMERR("unable to allocate memory for event_ecm data_fid\n");
@@ -510,7 +510,7 @@ void* ipa_driver_msg_notifier(void *param)
 		case ECM_DISCONNECT:
 			memcpy(&event_ecm, buffer + sizeof(struct ipa_msg_meta), sizeof(struct ipa_ecm_msg));
 			IPACMDBG_H("Received ECM_DISCONNECT name: %s\n",event_ecm.name);
-			data_fid = (ipacm_event_data_fid *)malloc(sizeof(ipacm_event_data_fid));
+			data_fid = ipacm_evt_alloc<ipacm_event_data_fid>();
 			if(data_fid == NULL)
 			{
 				IPACMERR("unable to allocate memory for event_ecm data_fid\n");
@@ -524,7 +524,7 @@ void* ipa_driver_msg_notifier(void *param)
 		case WAN_UPSTREAM_ROUTE_ADD:
 			memcpy(&event_wan, buffer + sizeof(struct ipa_msg_meta), sizeof(struct ipa_wan_msg));
 			IPACMDBG_H("Received WAN_UPSTREAM_ROUTE_ADD name: %s, tethered name: %s\n", event_wan.upstream_ifname, event_wan.tethered_ifname);
-			data_iptype = (ipacm_event_data_iptype *)malloc(sizeof(ipacm_event_data_iptype));
+			data_iptype = ipacm_evt_alloc<ipacm_event_data_iptype>();
 			if(data_iptype == NULL)
 			{
 				IPACMERR("unable to allocate memory for event_ecm data_iptype\n");
@@ -551,7 +551,7 @@ void* ipa_driver_msg_notifier(void *param)
 		case WAN_UPSTREAM_ROUTE_DEL:
 			memcpy(&event_wan, buffer + sizeof(struct ipa_msg_meta), sizeof(struct ipa_wan_msg));
 			IPACMDBG_H("Received WAN_UPSTREAM_ROUTE_DEL name: %s, tethered name: %s\n", event_wan.upstream_ifname, event_wan.tethered_ifname);
-			data_iptype = (ipacm_event_data_iptype *)malloc(sizeof(ipacm_event_data_iptype));
+			data_iptype = ipacm_evt_alloc<ipacm_event_data_iptype>();
 			if(data_iptype == NULL)
 			{
 				IPACMERR("unable to allocate memory for event_ecm data_iptype\n");
@@ -570,7 +570,7 @@ void* ipa_driver_msg_notifier(void *param)
 		case WAN_EMBMS_CONNECT:
 			memcpy(&event_wan, buffer + sizeof(struct ipa_msg_meta), sizeof(struct ipa_wan_msg));
 			IPACMDBG("Received WAN_EMBMS_CONNECT name: %s\n",event_wan.upstream_ifname);
-			data_fid = (ipacm_event_data_fid *)malloc(sizeof(ipacm_event_data_fid));
+			data_fid = ipacm_evt_alloc<ipacm_event_data_fid>();
 			if(data_fid == NULL)
 			{
 				IPACMERR("unable to allocate memory for event data_fid\n");
@@ -748,6 +748,10 @@ int main(int argc, char **argv)
 	IPACM_ConntrackClient *cc = IPACM_ConntrackClient::GetInstance();
 	CtList = new IPACM_ConntrackListener();
 
+	/* squash repeated events before they reach the listeners */
+	IPACM_EvtDispatcher::EnableCoalescing();
+	IPACM_ConntrackClient::EnableCoalescing();
+
 	IPACMDBG_H("Staring IPA main\n");
 	IPACMDBG_H("ipa_cmdq_successful\n");
 
@@ -121,7 +121,7 @@ void IPACM_Neighbor::event_callback(ipa_cm_event_id event, void *param)
 						if (neighbor_client[i].v4_addr != 0) /* not 0.0.0.0 */
 						{
 							evt_data.event = IPA_NEIGH_CLIENT_IP_ADDR_ADD_EVENT;
-							data_all = (ipacm_event_data_all *)malloc(sizeof(ipacm_event_data_all));
+							data_all = ipacm_evt_alloc<ipacm_event_data_all>();
 							if (data_all == NULL)
 							{
 								IPACMERR("Unable to allocate memory\n");
@@ -198,7 +198,7 @@ void IPACM_Neighbor::event_callback(ipa_cm_event_id event, void *param)
 								else
 									/* not to clean-up the client mac cache on bridge0 delneigh */
 									evt_data.event = IPA_NEIGH_CLIENT_IP_ADDR_DEL_EVENT;
-								data_all = (ipacm_event_data_all *)malloc(sizeof(ipacm_event_data_all));
+								data_all = ipacm_evt_alloc<ipacm_event_data_all>();
 								if (data_all == NULL)
 								{
 									IPACMERR("Unable to allocate memory\n");
@@ -333,7 +333,7 @@ void IPACM_Neighbor::event_callback(ipa_cm_event_id event, void *param)
 							/* not find client, no need clean-up */
 						}
 
-						data_all = (ipacm_event_data_all *)malloc(sizeof(ipacm_event_data_all));
+						data_all = ipacm_evt_alloc<ipacm_event_data_all>();
 						if (data_all == NULL)
 						{
 							IPACMERR("Unable to allocate memory\n");
@@ -366,7 +366,7 @@ void IPACM_Neighbor::event_callback(ipa_cm_event_id event, void *param)
 								/* construct IPA_NEIGH_CLIENT_IP_ADDR_ADD_EVENT command and insert to command-queue */
 								if (event == IPA_NEW_NEIGH_EVENT) evt_data.event = IPA_NEIGH_CLIENT_IP_ADDR_ADD_EVENT;
 								else evt_data.event = IPA_NEIGH_CLIENT_IP_ADDR_DEL_EVENT;
-								data_all = (ipacm_event_data_all *)malloc(sizeof(ipacm_event_data_all));
+								data_all = ipacm_evt_alloc<ipacm_event_data_all>();
 								if (data_all == NULL)
 								{
 									IPACMERR("Unable to allocate memory\n");
@@ -397,7 +397,7 @@ void IPACM_Neighbor::event_callback(ipa_cm_event_id event, void *param)
 							evt_data.event = IPA_NEIGH_CLIENT_IP_ADDR_ADD_EVENT;
 						else
 							evt_data.event = IPA_NEIGH_CLIENT_IP_ADDR_DEL_EVENT;
-						data_all = (ipacm_event_data_all *)malloc(sizeof(ipacm_event_data_all));
+						data_all = ipacm_evt_alloc<ipacm_event_data_all>();
 						if (data_all == NULL)
 						{
 							IPACMERR("Unable to allocate memory\n");
@@ -452,7 +452,7 @@ void IPACM_Neighbor::event_callback(ipa_cm_event_id event, void *param)
 										evt_data.event = IPA_NEIGH_CLIENT_IP_ADDR_ADD_EVENT;
 									else
 										evt_data.event = IPA_NEIGH_CLIENT_IP_ADDR_DEL_EVENT;
-									data_all = (ipacm_event_data_all *)malloc(sizeof(ipacm_event_data_all));
+									data_all = ipacm_evt_alloc<ipacm_event_data_all>();
 									if (data_all == NULL)
 									{
 										IPACMERR("Unable to allocate memory\n");
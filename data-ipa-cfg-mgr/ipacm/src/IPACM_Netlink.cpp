@@ -659,7 +659,7 @@ static int ipa_nl_decode_nlmsg
 						return IPACM_FAILURE;
 					}
 
-					data_fid = (ipacm_event_data_fid *)malloc(sizeof(ipacm_event_data_fid));
+					data_fid = ipacm_evt_alloc<ipacm_event_data_fid>();
 					if(data_fid == NULL)
 					{
 						IPACMERR("unable to allocate memory for event data_fid\n");
@@ -696,7 +696,7 @@ static int ipa_nl_decode_nlmsg
                    (msg_ptr->nl_link_info.metainfo.ifi_flags & IFF_LOWER_UP))
                 {
 
-					data_fid = (ipacm_event_data_fid *)malloc(sizeof(ipacm_event_data_fid));
+					data_fid = ipacm_evt_alloc<ipacm_event_data_fid>();
 					if(data_fid == NULL)
 					{
 						IPACMERR("unable to allocate memory for event data_fid\n");
@@ -723,7 +723,7 @@ static int ipa_nl_decode_nlmsg
                 }
                 else if (!(msg_ptr->nl_link_info.metainfo.ifi_flags & IFF_LOWER_UP))
 				{
-					data_fid = (ipacm_event_data_fid *)malloc(sizeof(ipacm_event_data_fid));
+					data_fid = ipacm_evt_alloc<ipacm_event_data_fid>();
 					if(data_fid == NULL)
 					{
 						IPACMERR("unable to allocate memory for event data_fid\n");
@@ -788,7 +788,7 @@ static int ipa_nl_decode_nlmsg
 
 				/* post link down to command queue */
 				evt_data.event = IPA_LINK_DOWN_EVENT;
-				data_fid = (ipacm_event_data_fid *)malloc(sizeof(ipacm_event_data_fid));
+				data_fid = ipacm_evt_alloc<ipacm_event_data_fid>();
 				if(data_fid == NULL)
 				{
 					IPACMERR("unable to allocate memory for event data_fid\n");
@@ -821,7 +821,7 @@ static int ipa_nl_decode_nlmsg
 				}
 				IPACMDBG("Interface %s \n", dev_name);
 
-				data_addr = (ipacm_event_data_addr *)malloc(sizeof(ipacm_event_data_addr));
+				data_addr = ipacm_evt_alloc<ipacm_event_data_addr>();
 				if(data_addr == NULL)
 				{
 					IPACMERR("unable to allocate memory for event data_addr\n");
@@ -911,7 +911,7 @@ static int ipa_nl_decode_nlmsg
 					temp = (-1);
 
 					evt_data.event = IPA_ROUTE_ADD_EVENT;
-					data_addr = (ipacm_event_data_addr *)malloc(sizeof(ipacm_event_data_addr));
+					data_addr = ipacm_evt_alloc<ipacm_event_data_addr>();
 					if(data_addr == NULL)
 					{
 						IPACMERR("unable to allocate memory for event data_addr\n");
@@ -944,7 +944,7 @@ static int ipa_nl_decode_nlmsg
 					if(AF_INET6 == msg_ptr->nl_route_info.metainfo.rtm_family)
 					{
 						/* insert to command queue */
-						data_addr = (ipacm_event_data_addr *)malloc(sizeof(ipacm_event_data_addr));
+						data_addr = ipacm_evt_alloc<ipacm_event_data_addr>();
 						if(data_addr == NULL)
 						{
 							IPACMERR("unable to allocate memory for event data_addr\n");
@@ -999,7 +999,7 @@ static int ipa_nl_decode_nlmsg
 						IPACM_NL_REPORT_ADDR( "dstIP:", msg_ptr->nl_route_info.attr_info.dst_addr );
 
 						/* insert to command queue */
-						data_addr = (ipacm_event_data_addr *)malloc(sizeof(ipacm_event_data_addr));
+						data_addr = ipacm_evt_alloc<ipacm_event_data_addr>();
 						if(data_addr == NULL)
 						{
 							IPACMERR("unable to allocate memory for event data_addr\n");
@@ -1052,7 +1052,7 @@ static int ipa_nl_decode_nlmsg
 									 dev_name);
 
 					/* insert to command queue */
-					data_addr = (ipacm_event_data_addr *)malloc(sizeof(ipacm_event_data_addr));
+					data_addr = ipacm_evt_alloc<ipacm_event_data_addr>();
 					if(data_addr == NULL)
 					{
 						IPACMERR("unable to allocate memory for event data_addr\n");
@@ -1111,7 +1111,7 @@ static int ipa_nl_decode_nlmsg
 									 dev_name);
 
 					/* insert to command queue */
-					data_addr = (ipacm_event_data_addr *)malloc(sizeof(ipacm_event_data_addr));
+					data_addr = ipacm_evt_alloc<ipacm_event_data_addr>();
 					if(data_addr == NULL)
 					{
 						IPACMERR("unable to allocate memory for event data_addr\n");
@@ -1172,7 +1172,7 @@ static int ipa_nl_decode_nlmsg
 					IPACMDBG("dev %s\n", dev_name);
 
 					/* insert to command queue */
-					data_addr = (ipacm_event_data_addr *)malloc(sizeof(ipacm_event_data_addr));
+					data_addr = ipacm_evt_alloc<ipacm_event_data_addr>();
 					if(data_addr == NULL)
 					{
 						IPACMERR("unable to allocate memory for event data_addr\n");
@@ -1206,7 +1206,7 @@ static int ipa_nl_decode_nlmsg
 					}
 
 					/* insert to command queue */
-					data_addr = (ipacm_event_data_addr *)malloc(sizeof(ipacm_event_data_addr));
+					data_addr = ipacm_evt_alloc<ipacm_event_data_addr>();
 					if(data_addr == NULL)
 					{
 						IPACMERR("unable to allocate memory for event data_addr\n");
@@ -1293,7 +1293,7 @@ static int ipa_nl_decode_nlmsg
 									 dev_name);
 
 					/* insert to command queue */
-					data_addr = (ipacm_event_data_addr *)malloc(sizeof(ipacm_event_data_addr));
+					data_addr = ipacm_evt_alloc<ipacm_event_data_addr>();
 					if(data_addr == NULL)
 					{
 						IPACMERR("unable to allocate memory for event data_addr\n");
@@ -1377,7 +1377,7 @@ static int ipa_nl_decode_nlmsg
 			}
 
 			/* insert to command queue */
-		    data_all = (ipacm_event_data_all *)malloc(sizeof(ipacm_event_data_all));
+		    data_all = ipacm_evt_alloc<ipacm_event_data_all>();
 		    if(data_all == NULL)
 			{
 		    	IPACMERR("unable to allocate memory for event data_all\n");
@@ -1464,7 +1464,7 @@ static int ipa_nl_decode_nlmsg
 			}
 
 				/* insert to command queue */
-				data_all = (ipacm_event_data_all *)malloc(sizeof(ipacm_event_data_all));
+				data_all = ipacm_evt_alloc<ipacm_event_data_all>();
 				if(data_all == NULL)
 				{
 					IPACMERR("unable to allocate memory for event data_all\n");
@@ -578,7 +578,7 @@ void IPACM_Wan::event_callback(ipa_cm_event_id event, void *param)
 						memset(&evt_data, 0, sizeof(evt_data));
 
 						ipacm_event_cradle_wan_mode *data_wan_mode = NULL;
-						data_wan_mode = (ipacm_event_cradle_wan_mode *)malloc(sizeof(ipacm_event_cradle_wan_mode));
+						data_wan_mode = ipacm_evt_alloc<ipacm_event_cradle_wan_mode>();
 						if(data_wan_mode == NULL)
 						{
 							IPACMERR("unable to allocate memory.\n");
@@ -616,7 +616,7 @@ void IPACM_Wan::event_callback(ipa_cm_event_id event, void *param)
 				memset(&evt_data, 0, sizeof(evt_data));
 
 				ipacm_event_data_fid *data_fid = NULL;
-				data_fid = (ipacm_event_data_fid *)malloc(sizeof(ipacm_event_data_fid));
+				data_fid = ipacm_evt_alloc<ipacm_event_data_fid>();
 				if(data_fid == NULL)
 				{
 					IPACMERR("unable to allocate memory for IPA_USB_LINK_UP_EVENT data_fid\n");
@@ -1498,7 +1498,7 @@ int IPACM_Wan::handle_route_add_evt(ipa_ip_type iptype)
 	}
 
 	ipacm_event_iface_up *wanup_data;
-	wanup_data = (ipacm_event_iface_up *)malloc(sizeof(ipacm_event_iface_up));
+	wanup_data = ipacm_evt_alloc<ipacm_event_iface_up>();
 	if (wanup_data == NULL)
 	{
 		IPACMERR("Unable to allocate memory\n");
@@ -1618,7 +1618,7 @@ int IPACM_Wan::post_wan_up_tether_evt(ipa_ip_type iptype, int ipa_if_num_tether)
 	ipacm_cmd_q_data evt_data;
 	ipacm_event_iface_up_tehter *wanup_data;
 
-	wanup_data = (ipacm_event_iface_up_tehter *)malloc(sizeof(ipacm_event_iface_up_tehter));
+	wanup_data = ipacm_evt_alloc<ipacm_event_iface_up_tehter>();
 	if (wanup_data == NULL)
 	{
 		IPACMERR("Unable to allocate memory\n");
@@ -1676,7 +1676,7 @@ int IPACM_Wan::post_wan_down_tether_evt(ipa_ip_type iptype, int ipa_if_num_tethe
 	ipacm_event_iface_up_tehter *wandown_data;
 	int i, j;
 
-	wandown_data = (ipacm_event_iface_up_tehter *)malloc(sizeof(ipacm_event_iface_up_tehter));
+	wandown_data = ipacm_evt_alloc<ipacm_event_iface_up_tehter>();
 	if (wandown_data == NULL)
 	{
 		IPACMERR("Unable to allocate memory\n");
@@ -1714,7 +1714,7 @@ int IPACM_Wan::post_wan_down_tether_evt(ipa_ip_type iptype, int ipa_if_num_tethe
 		if(i == IPACM_Wan::ipa_if_num_tether_v4_total)
 		{
 			IPACMDBG_H("Not finding the tether client.\n");
-			free(wandown_data);
+			IPACM_EvtPool::Free(wandown_data);
 			return IPACM_SUCCESS;
 		}
 		for(j = i+1; j < IPACM_Wan::ipa_if_num_tether_v4_total; j++)
@@ -1742,7 +1742,7 @@ int IPACM_Wan::post_wan_down_tether_evt(ipa_ip_type iptype, int ipa_if_num_tethe
 		if(i == IPACM_Wan::ipa_if_num_tether_v6_total)
 		{
 			IPACMDBG_H("Not finding the tether client.\n");
-			free(wandown_data);
+			IPACM_EvtPool::Free(wandown_data);
 			return IPACM_SUCCESS;
 		}
 		for(j = i+1; j < IPACM_Wan::ipa_if_num_tether_v6_total; j++)
@@ -3954,7 +3954,7 @@ int IPACM_Wan::handle_route_del_evt(ipa_ip_type iptype)
 			}
 		}
 		ipacm_event_iface_up *wandown_data;
-		wandown_data = (ipacm_event_iface_up *)malloc(sizeof(ipacm_event_iface_up));
+		wandown_data = ipacm_evt_alloc<ipacm_event_iface_up>();
 		if (wandown_data == NULL)
 		{
 			IPACMERR("Unable to allocate memory\n");
@@ -4068,7 +4068,7 @@ int IPACM_Wan::handle_route_del_evt_ex(ipa_ip_type iptype)
 		}
 
 		ipacm_event_iface_up *wandown_data;
-		wandown_data = (ipacm_event_iface_up *)malloc(sizeof(ipacm_event_iface_up));
+		wandown_data = ipacm_evt_alloc<ipacm_event_iface_up>();
 		if (wandown_data == NULL)
 		{
 			IPACMERR("Unable to allocate memory\n");
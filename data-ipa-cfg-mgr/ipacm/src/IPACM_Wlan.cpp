@@ -229,8 +229,7 @@ void IPACM_Wlan::event_callback(ipa_cm_event_id event, void *param)
 						ipacm_cmd_q_data evt_data;
 						ipacm_event_iface_up *info;
 
-						info = (ipacm_event_iface_up *)
-							 malloc(sizeof(ipacm_event_iface_up));
+						info = ipacm_evt_alloc<ipacm_event_iface_up>();
 						if (info == NULL)
 						{
 							IPACMERR("Unable to allocate memory\n");
@@ -439,6 +439,18 @@ static int ipacm_cfg_xml_parse_tree
 						IPACMDBG_H("Nat Table Max Entries %d\n", config->nat_max_entries);
 					}
 				}
+				else if (IPACM_util_icmp_string((char*)xml_node->name, NAT_MaxTempEntries_TAG) == 0)
+				{
+					content = IPACM_read_content_element(xml_node);
+					if (content)
+					{
+						str_size = strlen(content);
+						memset(content_buf, 0, sizeof(content_buf));
+						memcpy(content_buf, (void *)content, str_size);
+						config->nat_max_temp_entries = atoi(content_buf);
+						IPACMDBG_H("Nat Temp Max Entries %d\n", config->nat_max_temp_entries);
+					}
+				}
 			}
 			break;
 		default:
@@ -0,0 +1,283 @@
+/*
+Copyright (c) 2016, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of The Linux Foundation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/*!
+	@file
+	ipacm_evt_queue_bench.cpp
+
+	@brief
+	Posts events from concurrent producers through the old mutex and
+	condition variable queue and the lock free MessageQueue ring and
+	reports events/sec and ordering errors
+
+	@Author
+
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+
+#include "IPACM_CmdQueue.h"
+#include "IPACM_Iface.h"
+
+#define BENCH_DEFAULT_PRODUCERS 4
+#define BENCH_DEFAULT_EVENTS 1000000
+#define BENCH_MAX_PRODUCERS 16
+
+/* MessageQueue::Process() is not run, these only satisfy the linker */
+IPACM_Config *IPACM_Iface::ipacmcfg = NULL;
+
+const char* IPACM_Config::getEventName(ipa_cm_event_id event_id)
+{
+	return "";
+}
+
+/* Copy of the queue IPACM used before the ring, every post takes the
+	 one mutex and signals the condition variable */
+class MutexQueue
+{
+private:
+	Message *Head;
+	Message *Tail;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+
+public:
+	MutexQueue()
+	{
+		Head = NULL;
+		Tail = NULL;
+		pthread_mutex_init(&lock, NULL);
+		pthread_cond_init(&cond, NULL);
+	}
+
+	void enqueue(const cmd_t *evt)
+	{
+		Message *item = new Message();
+
+		if(item == NULL)
+		{
+			return;
+		}
+		memcpy(&item->evt, evt, sizeof(cmd_t));
+
+		pthread_mutex_lock(&lock);
+		if(!Head)
+		{
+			Head = item;
+		}
+		else
+		{
+			Tail->setnext(item);
+		}
+		Tail = item;
+		pthread_cond_signal(&cond);
+		pthread_mutex_unlock(&lock);
+	}
+
+	void dequeue(cmd_t *evt)
+	{
+		Message *item;
+
+		pthread_mutex_lock(&lock);
+		while(Head == NULL)
+		{
+			pthread_cond_wait(&cond, &lock);
+		}
+		item = Head;
+		Head = Head->getnext();
+		pthread_mutex_unlock(&lock);
+
+		memcpy(evt, &item->evt, sizeof(cmd_t));
+		delete item;
+	}
+};
+
+typedef struct
+{
+	MutexQueue *mutex_q;
+	MessageQueue *ring_q;
+	int producer;
+	int num_events;
+} bench_producer;
+
+static int bench_num_producers;
+static int bench_num_events;
+static long bench_last[BENCH_MAX_PRODUCERS];
+static long bench_order_err;
+static long bench_done;
+
+/* The payload carries the producer and its sequence number, the
+	 events of one producer must come out in the order it posted them */
+static void bench_callback(ipacm_cmd_q_data *data)
+{
+	long val = (long)data->evt_data;
+	int producer = val % BENCH_MAX_PRODUCERS;
+	long seq = val / BENCH_MAX_PRODUCERS;
+
+	if(seq != bench_last[producer] + 1)
+	{
+		bench_order_err++;
+	}
+	bench_last[producer] = seq;
+	bench_done++;
+}
+
+static void *bench_produce(void *param)
+{
+	bench_producer *prod = (bench_producer *)param;
+	cmd_t evt;
+	long seq;
+
+	evt.callback_ptr = bench_callback;
+	evt.data.event = IPA_PROCESS_CT_MESSAGE;
+	for(seq = 1; seq <= prod->num_events; seq++)
+	{
+		evt.data.evt_data = (void *)(seq * BENCH_MAX_PRODUCERS + prod->producer);
+		if(prod->mutex_q != NULL)
+		{
+			prod->mutex_q->enqueue(&evt);
+		}
+		else
+		{
+			prod->ring_q->enqueue(&evt);
+		}
+	}
+
+	return NULL;
+}
+
+static double elapsed_ms(struct timespec *start, struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) * 1000.0 +
+		(end->tv_nsec - start->tv_nsec) / 1000000.0;
+}
+
+/* Runs the producers against one of the queues and consumes on the
+	 calling thread, returns the time it took in ms */
+static double bench_run(MutexQueue *mutex_q, MessageQueue *ring_q)
+{
+	bench_producer prod[BENCH_MAX_PRODUCERS];
+	pthread_t thread[BENCH_MAX_PRODUCERS];
+	struct timespec start, end;
+	long total = (long)bench_num_producers * bench_num_events;
+	cmd_t evt;
+	int cnt;
+
+	memset(bench_last, 0, sizeof(bench_last));
+	bench_order_err = 0;
+	bench_done = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(cnt = 0; cnt < bench_num_producers; cnt++)
+	{
+		prod[cnt].mutex_q = mutex_q;
+		prod[cnt].ring_q = ring_q;
+		prod[cnt].producer = cnt;
+		prod[cnt].num_events = bench_num_events;
+		pthread_create(&thread[cnt], NULL, bench_produce, &prod[cnt]);
+	}
+
+	while(bench_done < total)
+	{
+		if(mutex_q != NULL)
+		{
+			mutex_q->dequeue(&evt);
+		}
+		else if(!ring_q->dequeue(&evt))
+		{
+			/* the eventfd wait belongs to Process(), poll instead */
+			sched_yield();
+			continue;
+		}
+		evt.callback_ptr(&evt.data);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	for(cnt = 0; cnt < bench_num_producers; cnt++)
+	{
+		pthread_join(thread[cnt], NULL);
+	}
+
+	return elapsed_ms(&start, &end);
+}
+
+int main(int argc, char **argv)
+{
+	MutexQueue mutex_q;
+	MessageQueue *ring_q;
+	double mutex_ms, ring_ms;
+	long total, mutex_err, ring_err;
+
+	bench_num_producers = BENCH_DEFAULT_PRODUCERS;
+	bench_num_events = BENCH_DEFAULT_EVENTS;
+	if(argc > 1)
+	{
+		bench_num_producers = atoi(argv[1]);
+	}
+	if(argc > 2)
+	{
+		bench_num_events = atoi(argv[2]);
+	}
+	if(bench_num_producers <= 0 || bench_num_producers > BENCH_MAX_PRODUCERS ||
+		 bench_num_events <= 0)
+	{
+		printf("usage: %s [producers, up to %d] [events per producer]\n",
+			argv[0], BENCH_MAX_PRODUCERS);
+		return -1;
+	}
+
+	ring_q = MessageQueue::getInstanceExternal();
+	if(ring_q == NULL)
+	{
+		printf("unable to create message queue\n");
+		return -1;
+	}
+	total = (long)bench_num_producers * bench_num_events;
+
+	mutex_ms = bench_run(&mutex_q, NULL);
+	mutex_err = bench_order_err;
+
+	ring_ms = bench_run(NULL, ring_q);
+	ring_err = bench_order_err;
+
+	printf("producers %d, events %ld\n", bench_num_producers, total);
+	printf("mutex queue: %.3f ms (%.0f events/sec), %ld out of order\n",
+		mutex_ms, total * 1000.0 / mutex_ms, mutex_err);
+	printf("lock free ring: %.3f ms (%.0f events/sec), %ld out of order\n",
+		ring_ms, total * 1000.0 / ring_ms, ring_err);
+	if(ring_ms > 0)
+	{
+		printf("speedup: %.1fx\n", mutex_ms / ring_ms);
+	}
+
+	return (mutex_err == 0 && ring_err == 0) ? 0 : -1;
+}
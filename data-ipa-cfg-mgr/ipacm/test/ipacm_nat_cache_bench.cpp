@@ -0,0 +1,293 @@
+/*
+Copyright (c) 2016, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of The Linux Foundation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/*!
+	@file
+	ipacm_nat_cache_bench.cpp
+
+	@brief
+	Replays synthetic conntrack add/delete events against the old
+	linear scan NAT cache and the hashed NatCache and reports timing
+
+	@Author
+
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <netinet/in.h>
+
+#include "IPACM_Conntrack_NATCache.h"
+
+#define BENCH_DEFAULT_ENTRIES 500
+#define BENCH_DEFAULT_EVENTS 100000
+
+/* Copy of the cache walk NatApp used before the hashed index */
+class LinearCache
+{
+private:
+	nat_table_entry *cache;
+	int max_entries;
+
+public:
+	LinearCache(int num_entries)
+	{
+		max_entries = num_entries;
+		cache = (nat_table_entry *)calloc(num_entries, sizeof(nat_table_entry));
+	}
+
+	~LinearCache()
+	{
+		free(cache);
+	}
+
+	bool ChkForDup(const nat_table_entry *rule)
+	{
+		int cnt;
+
+		for(cnt = 0; cnt < max_entries; cnt++)
+		{
+			if(cache[cnt].private_ip == rule->private_ip &&
+				 cache[cnt].target_ip == rule->target_ip &&
+				 cache[cnt].private_port == rule->private_port &&
+				 cache[cnt].target_port == rule->target_port &&
+				 cache[cnt].protocol == rule->protocol)
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	int AddEntry(const nat_table_entry *rule)
+	{
+		int cnt;
+
+		if(ChkForDup(rule))
+		{
+			return -1;
+		}
+
+		for(cnt = 0; cnt < max_entries; cnt++)
+		{
+			if(cache[cnt].private_ip == 0 &&
+				 cache[cnt].target_ip == 0 &&
+				 cache[cnt].private_port == 0 &&
+				 cache[cnt].target_port == 0 &&
+				 cache[cnt].protocol == 0)
+			{
+				break;
+			}
+		}
+
+		if(cnt == max_entries)
+		{
+			return -1;
+		}
+		memcpy(&cache[cnt], rule, sizeof(nat_table_entry));
+		return 0;
+	}
+
+	int DeleteEntry(const nat_table_entry *rule)
+	{
+		int cnt;
+
+		for(cnt = 0; cnt < max_entries; cnt++)
+		{
+			if(cache[cnt].private_ip == rule->private_ip &&
+				 cache[cnt].target_ip == rule->target_ip &&
+				 cache[cnt].private_port == rule->private_port &&
+				 cache[cnt].target_port == rule->target_port &&
+				 cache[cnt].protocol == rule->protocol)
+			{
+				memset(&cache[cnt], 0, sizeof(nat_table_entry));
+				return 0;
+			}
+		}
+		return -1;
+	}
+};
+
+typedef struct _bench_event
+{
+	bool is_add;
+	nat_table_entry rule;
+} bench_event;
+
+static uint32_t bench_seed = 0x12345678;
+
+static uint32_t bench_rand(void)
+{
+	bench_seed = bench_seed * 1103515245 + 12345;
+	return bench_seed >> 8;
+}
+
+/* Builds an add/delete sequence that keeps the cache close to full,
+	 which is where the linear scans hurt the most */
+static bench_event *build_events(int num_events, int max_entries)
+{
+	bench_event *evts;
+	nat_table_entry *live;
+	int num_live = 0, cnt, idx;
+
+	evts = (bench_event *)calloc(num_events, sizeof(bench_event));
+	live = (nat_table_entry *)calloc(max_entries, sizeof(nat_table_entry));
+	if(evts == NULL || live == NULL)
+	{
+		free(evts);
+		free(live);
+		return NULL;
+	}
+
+	for(cnt = 0; cnt < num_events; cnt++)
+	{
+		if(num_live < max_entries && (num_live < (max_entries * 9) / 10 || (bench_rand() & 1)))
+		{
+			nat_table_entry *rule = &live[num_live++];
+
+			memset(rule, 0, sizeof(nat_table_entry));
+			rule->private_ip = 0xC0A80100 | (bench_rand() % 254 + 1);
+			rule->target_ip = bench_rand() | 0x01000000;
+			rule->private_port = bench_rand() % 64511 + 1024;
+			rule->target_port = (bench_rand() & 1) ? 443 : 53;
+			rule->protocol = (rule->target_port == 53) ? IPPROTO_UDP : IPPROTO_TCP;
+
+			evts[cnt].is_add = true;
+			evts[cnt].rule = *rule;
+		}
+		else
+		{
+			idx = bench_rand() % num_live;
+			evts[cnt].is_add = false;
+			evts[cnt].rule = live[idx];
+			live[idx] = live[--num_live];
+		}
+	}
+
+	free(live);
+	return evts;
+}
+
+static double elapsed_ms(struct timespec *start, struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) * 1000.0 +
+		(end->tv_nsec - start->tv_nsec) / 1000000.0;
+}
+
+int main(int argc, char **argv)
+{
+	int max_entries = BENCH_DEFAULT_ENTRIES;
+	int num_events = BENCH_DEFAULT_EVENTS;
+	int cnt, idx, linear_fail = 0, hash_fail = 0;
+	bench_event *evts;
+	struct timespec start, end;
+	double linear_ms, hash_ms;
+
+	if(argc > 1)
+	{
+		max_entries = atoi(argv[1]);
+	}
+	if(argc > 2)
+	{
+		num_events = atoi(argv[2]);
+	}
+	if(max_entries <= 0 || num_events <= 0)
+	{
+		printf("usage: %s [max_entries] [num_events]\n", argv[0]);
+		return -1;
+	}
+
+	evts = build_events(num_events, max_entries);
+	if(evts == NULL)
+	{
+		printf("unable to allocate events\n");
+		return -1;
+	}
+
+	LinearCache linear(max_entries);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(cnt = 0; cnt < num_events; cnt++)
+	{
+		if(evts[cnt].is_add)
+		{
+			linear_fail += (linear.AddEntry(&evts[cnt].rule) != 0);
+		}
+		else
+		{
+			linear_fail += (linear.DeleteEntry(&evts[cnt].rule) != 0);
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	linear_ms = elapsed_ms(&start, &end);
+
+	NatCache hashed;
+	if(hashed.Init(max_entries) != 0)
+	{
+		printf("unable to init nat cache\n");
+		free(evts);
+		return -1;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(cnt = 0; cnt < num_events; cnt++)
+	{
+		if(evts[cnt].is_add)
+		{
+			if(hashed.Lookup(&evts[cnt].rule) != NAT_CACHE_INVALID_IDX ||
+				 hashed.Insert(&evts[cnt].rule) == NAT_CACHE_INVALID_IDX)
+			{
+				hash_fail++;
+			}
+		}
+		else
+		{
+			idx = hashed.Lookup(&evts[cnt].rule);
+			if(idx == NAT_CACHE_INVALID_IDX)
+			{
+				hash_fail++;
+				continue;
+			}
+			hashed.Remove(idx);
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	hash_ms = elapsed_ms(&start, &end);
+
+	printf("entries %d, events %d\n", max_entries, num_events);
+	printf("linear cache: %.3f ms (%.1f ns/event), %d failed\n",
+		linear_ms, linear_ms * 1000000.0 / num_events, linear_fail);
+	printf("hashed cache: %.3f ms (%.1f ns/event), %d failed\n",
+		hash_ms, hash_ms * 1000000.0 / num_events, hash_fail);
+	if(hash_ms > 0)
+	{
+		printf("speedup: %.1fx\n", linear_ms / hash_ms);
+	}
+
+	free(evts);
+	return (linear_fail == hash_fail) ? 0 : -1;
+}
@@ -48,6 +48,73 @@ typedef struct {
 	uint8_t  protocol;
 } ipa_nat_ipv4_rule;
 
+/**
+ * struct ipa_nat_ipv4_timestamp - timestamp of one nat rule
+ * @rule_hdl: ipv4 nat rule handle
+ * @time_stamp: time stamp of rule
+ * @protocol: protocol of rule (tcp/udp)
+ */
+typedef struct {
+	uint32_t rule_hdl;
+	uint32_t time_stamp;
+	uint8_t  protocol;
+} ipa_nat_ipv4_timestamp;
+
+/**
+ * enum ipa_nat_backend - where the nat tables live
+ * @IPA_NAT_BACKEND_HW: ipa hardware, through /dev/ipa
+ * @IPA_NAT_BACKEND_SIM: in process software tables, for
+ *                       testing without ipa hardware
+ */
+typedef enum {
+	IPA_NAT_BACKEND_HW = 0,
+	IPA_NAT_BACKEND_SIM
+} ipa_nat_backend;
+
+#define IPA_NAT_CHAIN_HIST_LEN 8
+
+/**
+ * struct ipa_nat_chain_stats - collision chains of one nat table
+ * @used_entries: base entries holding at least one rule
+ * @expn_entries: rules that go to the expansion table
+ * @max_chain: longest chain, in rules
+ * @chain_hist: [n] counts the chains of n+1 rules, the last
+ *              element counts the longer chains too
+ */
+typedef struct {
+	uint16_t used_entries;
+	uint16_t expn_entries;
+	uint16_t max_chain;
+	uint16_t chain_hist[IPA_NAT_CHAIN_HIST_LEN];
+} ipa_nat_chain_stats;
+
+/**
+ * struct ipa_nat_hash_stats - hash analysis of a flow set
+ * @table_entries: base table entries analyzed
+ * @expn_table_entries: expansion table entries analyzed
+ * @rule_tbl: chains of the ipv4 rule table
+ * @index_tbl: chains of the ipv4 index table
+ * @expn_overflow: rules that find no free expansion entry
+ */
+typedef struct {
+	uint16_t table_entries;
+	uint16_t expn_table_entries;
+	ipa_nat_chain_stats rule_tbl;
+	ipa_nat_chain_stats index_tbl;
+	uint16_t expn_overflow;
+} ipa_nat_hash_stats;
+
+/**
+ * ipa_nat_set_backend() - select where the nat tables live
+ * @backend: [in] IPA_NAT_BACKEND_HW or IPA_NAT_BACKEND_SIM
+ *
+ * To be called before the first table is added, the ipa
+ * hardware is used when it is never called
+ *
+ * Returns:	0  On Success, negative on failure
+ */
+int ipa_nat_set_backend(ipa_nat_backend backend);
+
 /**
  * ipa_nat_add_ipv4_tbl() - create ipv4 nat table
  * @public_ip_addr: [in] public ipv4 address
@@ -62,16 +129,79 @@ int ipa_nat_add_ipv4_tbl(uint32_t public_ip_addr,
 				uint16_t number_of_entries,
 				uint32_t *table_handle);
 
+/**
+ * ipa_nat_add_ipv4_tbl_sized() - create ipv4 nat table of given size
+ * @public_ip_addr: [in] public ipv4 address
+ * @table_entries: [in] base table entries, power of 2
+ * @expn_table_entries: [in] expansion table entries, even
+ * @table_handle: [out] Handle of new ipv4 nat table
+ *
+ * To create new ipv4 nat table without the fixed base and
+ * expansion split of ipa_nat_add_ipv4_tbl(), e.g. with the
+ * sizes from ipa_nat_recommend_ipv4_tbl()
+ *
+ * Returns:	0  On Success, negative on failure
+ */
+int ipa_nat_add_ipv4_tbl_sized(uint32_t public_ip_addr,
+				uint16_t table_entries,
+				uint16_t expn_table_entries,
+				uint32_t *table_handle);
+
+/**
+ * ipa_nat_get_ipv4_tbl_size() - nat table size for a number of rules
+ * @number_of_entries: [in] number of nat rules
+ * @table_entries: [out] base table entries
+ * @expn_table_entries: [out] expansion table entries
+ *
+ * Gives the base and expansion table sizes ipa_nat_add_ipv4_tbl()
+ * uses for the given number of entries
+ *
+ * Returns:	0  On Success, negative on failure
+ */
+int ipa_nat_get_ipv4_tbl_size(uint16_t number_of_entries,
+				uint16_t *table_entries,
+				uint16_t *expn_table_entries);
+
 /**
  * ipa_nat_del_ipv4_tbl() - delete ipv4 table
  * @table_handle: [in] Handle of ipv4 nat table
  *
  * To delete given ipv4 nat table
  *
- * Returns:	0  On Success, negative on failure
+ * Returns:	0  On Success, -EBUSY if the table is left as it
+ *          was, else negative and the handle is no longer valid
  */
 int ipa_nat_del_ipv4_tbl(uint32_t table_handle);
 
+/**
+ * ipa_nat_resize_ipv4_tbl() - recreate ipv4 table with a new size
+ * @table_handle: [in] Handle of ipv4 nat table
+ * @table_entries: [in] new base table entries, power of 2
+ * @expn_table_entries: [in] new expansion table entries, even
+ * @rules: [in] live rules to add back to the new table
+ * @num_rules: [in] number of rules in the array
+ * @rule_handles: [out] array of new handles, one per rule
+ *
+ * The ipa has room for one nat table only, so the table is
+ * deleted, allocated again with the given sizes for the same
+ * public address and the rules are added back with one bulk
+ * add. The table handle does not change, the rule handles do.
+ * If the new size cannot be allocated the old size is restored
+ * and the rules are still added back. Rules that do not fit get
+ * a rule handle of 0
+ *
+ * Returns:	0  On Success, -ENOMEM if the old size was restored,
+ *          -EIO if the table is lost, -EINVAL if the parameters
+ *          are invalid and -EBUSY if the old table could not be
+ *          deleted, in both cases the table is left as it was
+ */
+int ipa_nat_resize_ipv4_tbl(uint32_t table_handle,
+				uint16_t table_entries,
+				uint16_t expn_table_entries,
+				const ipa_nat_ipv4_rule *rules,
+				uint16_t num_rules,
+				uint32_t *rule_handles);
+
 /**
  * ipa_nat_add_ipv4_rule() - to insert new ipv4 rule
  * @table_handle: [in] handle of ipv4 nat table
@@ -86,6 +216,24 @@ int ipa_nat_add_ipv4_rule(uint32_t table_handle,
 				const ipa_nat_ipv4_rule * rule,
 				uint32_t *rule_handle);
 
+/**
+ * ipa_nat_add_ipv4_rules() - to insert several ipv4 rules at once
+ * @table_handle: [in] handle of ipv4 nat table
+ * @rules: [in] array of new rules
+ * @num_rules: [in] number of rules in the array
+ * @rule_handles: [out] array of handles, one per rule
+ *
+ * To insert several ipv4 nat rules into ipv4 nat table and
+ * enable them with a single dma command instead of one per rule.
+ * Rules that could not be added get a rule handle of 0
+ *
+ * Returns:	0  On Success, negative if any rule failed
+ */
+int ipa_nat_add_ipv4_rules(uint32_t table_handle,
+				const ipa_nat_ipv4_rule *rules,
+				uint16_t num_rules,
+				uint32_t *rule_handles);
+
 /**
  * ipa_nat_del_ipv4_rule() - to delete ipv4 nat rule
  * @table_handle: [in] handle of ipv4 nat table
@@ -98,6 +246,23 @@ int ipa_nat_add_ipv4_rule(uint32_t table_handle,
 int ipa_nat_del_ipv4_rule(uint32_t table_handle,
 				uint32_t rule_handle);
 
+/**
+ * ipa_nat_del_ipv4_rules() - to delete several ipv4 nat rules at once
+ * @table_handle: [in] handle of ipv4 nat table
+ * @rule_handles: [in/out] array of ipv4 nat rule handles
+ * @num_rules: [in] number of handles in the array
+ *
+ * To delete several ipv4 nat rules with a single dma command
+ * instead of one per rule. The handles of the rules deleted are
+ * set to 0, the rules whose handle is left could not be deleted
+ * and are still in the table
+ *
+ * Returns:	0  On Success, negative if any rule failed
+ */
+int ipa_nat_del_ipv4_rules(uint32_t table_handle,
+				uint32_t *rule_handles,
+				uint16_t num_rules);
+
 
 /**
  * ipa_nat_query_timestamp() - to query timestamp
@@ -114,3 +279,60 @@ int ipa_nat_query_timestamp(uint32_t  table_handle,
 				uint32_t  rule_handle,
 				uint32_t  *time_stamp);
 
+/**
+ * ipa_nat_query_timestamps_bulk() - query the timestamps of all rules
+ * @table_handle: [in] handle of ipv4 nat table
+ * @time_stamps: [out] rule handle, time stamp and protocol per rule
+ * @max_entries: [in] number of elements in time_stamps
+ * @num_entries: [out] number of elements filled
+ *
+ * Reads the rule and expansion tables once, in memory order,
+ * instead of one query per rule. The rules are returned in
+ * table order, at most max_entries of them
+ *
+ * Returns:	0  On Success, negative on failure
+ */
+int ipa_nat_query_timestamps_bulk(uint32_t table_handle,
+				ipa_nat_ipv4_timestamp *time_stamps,
+				uint16_t max_entries,
+				uint16_t *num_entries);
+
+/**
+ * ipa_nat_analyze_ipv4_hash() - analyze the nat hash for a flow set
+ * @rules: [in] recorded flows, one rule per flow
+ * @num_rules: [in] number of flows
+ * @table_entries: [in] base table entries, power of 2
+ * @expn_table_entries: [in] expansion table entries
+ * @stats: [out] collision chain histograms
+ *
+ * The hardware dictates the hash, this tells how the given
+ * flows would chain up in tables of the given size. No nat
+ * table or ipa device is needed
+ *
+ * Returns:	0  On Success, negative on failure
+ */
+int ipa_nat_analyze_ipv4_hash(const ipa_nat_ipv4_rule *rules,
+				uint16_t num_rules,
+				uint16_t table_entries,
+				uint16_t expn_table_entries,
+				ipa_nat_hash_stats *stats);
+
+/**
+ * ipa_nat_recommend_ipv4_tbl() - recommend nat table size for a flow set
+ * @rules: [in] recorded flows, one rule per flow
+ * @num_rules: [in] number of flows
+ * @max_chain: [in] longest collision chain allowed, in rules
+ * @table_entries: [out] base table entries
+ * @expn_table_entries: [out] expansion table entries
+ *
+ * Finds the smallest tables that hold all the flows with no
+ * chain longer than max_chain, to be passed on to
+ * ipa_nat_add_ipv4_tbl_sized()
+ *
+ * Returns:	0  On Success, negative on failure
+ */
+int ipa_nat_recommend_ipv4_tbl(const ipa_nat_ipv4_rule *rules,
+				uint16_t num_rules,
+				uint8_t max_chain,
+				uint16_t *table_entries,
+				uint16_t *expn_table_entries);
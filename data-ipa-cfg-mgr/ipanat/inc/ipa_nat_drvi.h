@@ -40,6 +40,7 @@ IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <sys/inotify.h>
 #include <errno.h>
 #include <pthread.h>
+#include <sched.h>
 
 #include "ipa_nat_logi.h"
 
@@ -85,8 +86,22 @@ IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define IPA_NAT_INVALID_INDEX 0xFF
 #define IPA_NAT_INVALID_NAT_ENTRY 0x0
 
+/* Bounds one IPA_IOC_NAT_DMA command, the kernel turns every
+	 entry into a separate immediate command */
+#define IPA_NAT_MAX_DMA_ENTRIES 64
+/* Adding a rule takes at most two next index updates
+	 (base and index table) plus the enable bit */
+#define IPA_NAT_MAX_ADD_DMA_ENTRIES 3
+/* Deleting a rule takes one base table update and up to
+	 two index table updates */
+#define IPA_NAT_MAX_DEL_DMA_ENTRIES 3
+
 #define INDX_TBL_ENTRY_SIZE_IN_BITS  16
 
+/* Words of the used entry bitmap of an expansion table, there is
+	 always one spare bit so the last word never reads as all free */
+#define IPA_NAT_MAP_WORDS(entries) (((entries) / 64) + 1)
+
 /* ----------- Rule id -----------------------
 
    ------------------------------------------------
@@ -100,6 +115,9 @@ IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define IPA_NAT_RULE_HDL_TBL_TYPE_BITS        0x1
 #define IPA_NAT_RULE_HDL_TBL_TYPE_MASK        0x1
 
+/* Entries the 12 bit index of the rule id can address */
+#define IPA_NAT_MAX_TBL_ENTRIES               4096
+
 /* ----------- sw specif parameter -----
    ------------------------------------
    |     16 bits     |     16 bits    |
@@ -294,6 +312,23 @@ struct ipa_nat_indx_tbl_meta_info {
 	uint16_t prev_index;
 };
 
+/* Table memory the cpu clears only after the dma command
+	 of a bulk delete has been posted */
+struct ipa_nat_mem_reset {
+	void *addr;
+	uint16_t size;
+};
+
+/* Value a bulk delete changed outside the dma command, put
+	 back if the command fails. Either the sw specific params
+	 of rule or size bytes at addr */
+struct ipa_nat_sw_undo {
+	struct ipa_nat_rule *rule;
+	void *addr;
+	uint32_t data;
+	uint8_t size;
+};
+
 struct ipa_nat_ip4_table_cache {
 	uint8_t valid;
 	uint32_t public_addr;
@@ -314,6 +349,24 @@ struct ipa_nat_ip4_table_cache {
 	struct ipa_nat_indx_tbl_meta_info *index_expn_table_meta;
 
 	uint16_t *rule_id_array;
+
+	/* One bit per expansion and index expansion entry, set while
+		 the entry is in use. The free words hint at the first word
+		 that may still have a clear bit */
+	uint64_t *expn_used_map;
+	uint64_t *indx_expn_used_map;
+	uint16_t expn_free_word;
+	uint16_t indx_expn_free_word;
+
+	/* DMA command collecting the updates of a bulk add or
+		 delete, NULL when rules are posted one by one */
+	struct ipa_ioc_nat_dma_cmd *dma_batch;
+	/* resets held back until dma_batch is posted, bulk delete only */
+	struct ipa_nat_mem_reset *mem_resets;
+	uint16_t mem_reset_cnt;
+	/* values to restore if dma_batch fails, bulk delete only */
+	struct ipa_nat_sw_undo *sw_undo;
+	uint16_t sw_undo_cnt;
 #ifdef IPA_ON_R3PC
 	uint32_t mmap_offset;
 #endif
@@ -322,12 +375,51 @@ struct ipa_nat_ip4_table_cache {
 	uint16_t cur_expn_tbl_cnt;
 };
 
+/* Lets timestamp queries read a table without the nat mutex.
+	 closed is set while the table is created or deleted and
+	 readers counts the queries in flight, the table is unmapped
+	 only once they are done. Rules never move within the rule
+	 tables, so rule add and delete need no more than that.
+	 Kept out of ipa_nat_ip4_table_cache as that is cleared when
+	 the table is deleted */
+struct ipa_nat_tbl_sync {
+	uint32_t closed;
+	uint32_t readers;
+};
+
 struct ipa_nat_cache {
 	struct ipa_nat_ip4_table_cache ip4_tbl[IPA_NAT_MAX_IP4_TBLS];
+	struct ipa_nat_tbl_sync tbl_sync[IPA_NAT_MAX_IP4_TBLS];
 	int ipa_fd;
 	uint8_t table_cnt;
 };
 
+/**
+ * struct ipa_nat_ops - device access of the nat driver
+ * @open_dev: open /dev/ipa or the nat table device
+ * @close_dev: close a device opened with open_dev
+ * @ioctl_dev: post an ipa ioctl
+ * @mmap_dev: map the nat table device
+ * @munmap_dev: unmap the nat table device
+ *
+ * Same semantics as the system calls they stand in for, all
+ * accesses to the ipa driver go through them
+ */
+struct ipa_nat_ops {
+	int (*open_dev)(const char *name, int flags);
+	int (*close_dev)(int fd);
+	int (*ioctl_dev)(int fd, unsigned long req, void *arg);
+	void *(*mmap_dev)(void *addr, size_t len, int prot, int flags,
+				int fd, off_t offset);
+	int (*munmap_dev)(void *addr, size_t len);
+};
+
+/* Talks to the ipa driver */
+extern const struct ipa_nat_ops ipa_nat_hw_ops;
+/* Keeps the tables in anonymous memory and interprets the
+	 dma commands in process, no ipa hardware needed */
+extern const struct ipa_nat_ops ipa_nat_sim_ops;
+
 struct ipa_nat_indx_tbl_sw_rule {
 	uint16_t tbl_entry;
 	uint16_t next_index;
@@ -385,15 +477,50 @@ int ipa_nati_add_ipv4_tbl(uint32_t public_ip_addr,
 				uint16_t number_of_entries,
 				uint32_t *table_hanle);
 
-int ipa_nati_alloc_table(uint16_t number_of_entries,
-				struct ipa_ioc_nat_alloc_mem *mem,
-				uint16_t*, uint16_t*);
+int ipa_nati_add_ipv4_tbl_sized(uint32_t public_ip_addr,
+				uint16_t table_entries,
+				uint16_t expn_table_entries,
+				uint32_t *table_hanle);
+
+/**
+ * ipa_nati_resize_ipv4_tbl() - recreate the nat table with a new size
+ * @tbl_hdl: [in] nat table handle
+ * @table_entries: [in] new base table entries
+ * @expn_table_entries: [in] new expansion table entries
+ * @clnt_rules: [in] rules to add back
+ * @num_rules: [in] number of rules in the array
+ * @rule_hdls: [out] new rule handles, IPA_NAT_INVALID_NAT_ENTRY for
+ *             the rules that could not be added back
+ *
+ * Only one table fits into the nat memory, so the table is deleted
+ * before the new one is allocated. When that fails the old sizes
+ * are allocated again, the rules are added back either way
+ *
+ * Returns:	0  On Success, -ENOMEM if the old sizes were restored,
+ *          -EIO if the table could not be recreated at all
+ */
+int ipa_nati_resize_ipv4_tbl(uint32_t tbl_hdl,
+				uint16_t table_entries,
+				uint16_t expn_table_entries,
+				const ipa_nat_ipv4_rule *clnt_rules,
+				uint16_t num_rules,
+				uint32_t *rule_hdls);
+
+int ipa_nati_get_tbl_size(uint16_t number_of_entries,
+				uint16_t *table_entries,
+				uint16_t *expn_table_entries);
+
+int ipa_nati_alloc_table(uint16_t table_entries,
+				uint16_t expn_table_entries,
+				struct ipa_ioc_nat_alloc_mem *mem);
 
 int ipa_nati_update_cache(struct ipa_ioc_nat_alloc_mem *,
 				uint32_t public_ip_addr,
 				uint16_t tbl_entries,
 				uint16_t expn_tbl_entries);
 
+int ipa_nati_set_backend(ipa_nat_backend backend);
+
 int ipa_nati_del_ipv4_table(uint32_t tbl_hdl);
 int ipa_nati_reset_ipv4_table(uint32_t tbl_hdl);
 int ipa_nati_post_ipv4_init_cmd(uint8_t tbl_index);
@@ -402,6 +529,11 @@ int ipa_nati_query_timestamp(uint32_t  tbl_hdl,
 				uint32_t  rule_hdl,
 				uint32_t  *time_stamp);
 
+int ipa_nati_query_timestamps_bulk(uint32_t tbl_hdl,
+				ipa_nat_ipv4_timestamp *time_stamps,
+				uint16_t max_entries,
+				uint16_t *num_entries);
+
 int ipa_nati_add_ipv4_rule(uint32_t tbl_hdl,
 				const ipa_nat_ipv4_rule *clnt_rule,
 				uint32_t *rule_hdl);
@@ -413,8 +545,7 @@ int ipa_nati_generate_rule(uint32_t tbl_hdl,
 				uint16_t *tbl_entry,
 				uint16_t *indx_tbl_entry);
 
-uint16_t ipa_nati_expn_tbl_free_entry(struct ipa_nat_rule *expn_tbl,
-				uint16_t size);
+uint16_t ipa_nati_expn_tbl_free_entry(struct ipa_nat_ip4_table_cache *tbl_ptr);
 
 uint16_t ipa_nati_generate_tbl_rule(const ipa_nat_ipv4_rule *clnt_rule,
 				struct ipa_nat_sw_rule *sw_rule,
@@ -424,8 +555,7 @@ uint16_t ipa_nati_generate_index_rule(const ipa_nat_ipv4_rule *clnt_rule,
 				struct ipa_nat_indx_tbl_sw_rule *sw_rule,
 				struct ipa_nat_ip4_table_cache *tbl_ptr);
 
-uint16_t ipa_nati_index_expn_get_free_entry(struct ipa_nat_indx_tbl_rule *tbl,
-				uint16_t size);
+uint16_t ipa_nati_index_expn_get_free_entry(struct ipa_nat_ip4_table_cache *tbl_ptr);
 
 void ipa_nati_copy_ipv4_rule_to_hw(
 				struct ipa_nat_ip4_table_cache *ipv4_cache,
@@ -445,9 +575,46 @@ void ipa_nati_write_next_index(uint8_t tbl_indx,
 int ipa_nati_post_ipv4_dma_cmd(uint8_t tbl_indx,
 				uint16_t entry);
 
+/**
+ * ipa_nati_add_ipv4_rules() - add several rules with one dma command
+ * @tbl_hdl: [in] nat table handle
+ * @clnt_rules: [in] array of rules
+ * @num_rules: [in] number of rules in the array
+ * @rule_hdls: [out] rule handles, IPA_NAT_INVALID_NAT_ENTRY for the
+ *             rules that could not be added
+ *
+ * Writes all the rules to the shared memory and enables them with
+ * as few IPA_IOC_NAT_DMA commands as IPA_NAT_MAX_DMA_ENTRIES allows
+ *
+ * Returns:	0  On Success, negative if any of the rules failed
+ */
+int ipa_nati_add_ipv4_rules(uint32_t tbl_hdl,
+				const ipa_nat_ipv4_rule *clnt_rules,
+				uint16_t num_rules,
+				uint32_t *rule_hdls);
+
 int ipa_nati_del_ipv4_rule(uint32_t tbl_hdl,
 				uint32_t rule_hdl);
 
+/**
+ * ipa_nati_del_ipv4_rules() - delete several rules with one dma command
+ * @tbl_hdl: [in] nat table handle
+ * @rule_hdls: [in/out] handles of the rules to delete, reset to
+ *             IPA_NAT_INVALID_NAT_ENTRY for the rules deleted
+ * @num_rules: [in] number of handles in the array
+ *
+ * Unlinks and disables all the rules with as few IPA_IOC_NAT_DMA
+ * commands as IPA_NAT_MAX_DMA_ENTRIES allows, the cleared entries
+ * and the handles are released only after the command is posted.
+ * The rules of a command that fails stay in the table and keep
+ * their handles
+ *
+ * Returns:	0  On Success, negative if any of the rules failed
+ */
+int ipa_nati_del_ipv4_rules(uint32_t tbl_hdl,
+				uint32_t *rule_hdls,
+				uint16_t num_rules);
+
 int ipa_nati_post_del_dma_cmd(uint8_t tbl_indx,
 				uint16_t tbl_entry,
 				uint8_t expn_tbl,
@@ -468,6 +635,44 @@ void ipa_nati_del_dead_ipv4_head_nodes(uint8_t tbl_indx);
 uint16_t Read16BitFieldValue(uint32_t param,
 				ipa_nat_rule_field_type fld_type);
 
+/**
+ * ipa_nati_analyze_hash() - collision chains of a flow set
+ * @clnt_rules: [in] recorded flows
+ * @num_rules: [in] number of flows
+ * @table_entries: [in] base table entries, power of 2
+ * @expn_table_entries: [in] expansion table entries
+ * @stats: [out] chain histograms of the rule and index tables
+ *
+ * Hashes the flows the same way rules are placed into the
+ * tables, no table needs to exist for this
+ *
+ * Returns:	0  On Success, negative on failure
+ */
+int ipa_nati_analyze_hash(const ipa_nat_ipv4_rule *clnt_rules,
+				uint16_t num_rules,
+				uint16_t table_entries,
+				uint16_t expn_table_entries,
+				ipa_nat_hash_stats *stats);
+
+/**
+ * ipa_nati_recommend_tbl_size() - smallest tables for a flow set
+ * @clnt_rules: [in] recorded flows
+ * @num_rules: [in] number of flows
+ * @max_chain: [in] longest collision chain allowed
+ * @table_entries: [out] base table entries
+ * @expn_table_entries: [out] expansion table entries
+ *
+ * Tries every base table size the rule handle can address and
+ * sizes the expansion table to hold all the collisions
+ *
+ * Returns:	0  On Success, negative if no size keeps the chains short
+ */
+int ipa_nati_recommend_tbl_size(const ipa_nat_ipv4_rule *clnt_rules,
+				uint16_t num_rules,
+				uint8_t max_chain,
+				uint16_t *table_entries,
+				uint16_t *expn_table_entries);
+
 /* ========================================================
 								Debug functions
    ========================================================*/
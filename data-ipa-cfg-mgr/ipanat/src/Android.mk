@@ -14,7 +14,8 @@ LOCAL_C_INCLUDES += $(TARGET_OUT_INTERMEDIATES)/KERNEL_OBJ/usr/include
 LOCAL_ADDITIONAL_DEPENDENCIES := $(TARGET_OUT_INTERMEDIATES)/KERNEL_OBJ/usr
 
 LOCAL_SRC_FILES := ipa_nat_drv.c \
-                   ipa_nat_drvi.c
+                   ipa_nat_drvi.c \
+                   ipa_nat_sim.c
 
 LOCAL_CFLAGS := -DDEBUG
 LOCAL_MODULE := libipanat
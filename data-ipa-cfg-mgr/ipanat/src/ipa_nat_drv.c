@@ -30,6 +30,26 @@ IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "ipa_nat_drv.h"
 #include "ipa_nat_drvi.h"
 
+/**
+ * ipa_nat_set_backend() - select where the nat tables live
+ * @backend: [in] IPA_NAT_BACKEND_HW or IPA_NAT_BACKEND_SIM
+ *
+ * To select the ipa hardware or the software tables
+ * before the first table is added
+ *
+ * Returns:	0  On Success, negative on failure
+ */
+int ipa_nat_set_backend(ipa_nat_backend backend)
+{
+  if (IPA_NAT_BACKEND_HW != backend && IPA_NAT_BACKEND_SIM != backend) {
+    IPAERR("Invalid backend %d\n", backend);
+    return -EINVAL;
+  }
+  IPADBG("Passed backend: %d\n", backend);
+
+  return ipa_nati_set_backend(backend);
+}
+
 /**
  * ipa_nat_add_ipv4_tbl() - create ipv4 nat table
  * @public_ip_addr: [in] public ipv4 address
@@ -63,13 +83,82 @@ int ipa_nat_add_ipv4_tbl(uint32_t public_ip_addr,
   return ret;
 } /* __ipa_nat_add_ipv4_tbl() */
 
+/**
+ * ipa_nat_add_ipv4_tbl_sized() - create ipv4 nat table of given size
+ * @public_ip_addr: [in] public ipv4 address
+ * @table_entries: [in] base table entries, power of 2
+ * @expn_table_entries: [in] expansion table entries, even
+ * @table_handle: [out] Handle of new ipv4 nat table
+ *
+ * To create new ipv4 nat table with the given base and
+ * expansion table sizes
+ *
+ * Returns:	0  On Success, negative on failure
+ */
+int ipa_nat_add_ipv4_tbl_sized(uint32_t public_ip_addr,
+		uint16_t table_entries,
+		uint16_t expn_table_entries,
+		uint32_t *tbl_hdl)
+{
+  int ret;
+
+  if (NULL == tbl_hdl || table_entries < 2 ||
+      table_entries > IPA_NAT_MAX_TBL_ENTRIES ||
+      (table_entries & (table_entries - 1)) ||
+      expn_table_entries < 2 ||
+      expn_table_entries > IPA_NAT_MAX_TBL_ENTRIES ||
+      (expn_table_entries % 2)) {
+    IPAERR("Invalid parameters \n");
+    return -EINVAL;
+  }
+
+  ret = ipa_nati_add_ipv4_tbl_sized(public_ip_addr,
+									table_entries,
+									expn_table_entries,
+									tbl_hdl);
+  if (ret != 0) {
+    IPAERR("unable to add table \n");
+    return -EINVAL;
+  }
+  IPADBG("Returning table handle 0x%x\n", *tbl_hdl);
+
+  return ret;
+}
+
+/**
+ * ipa_nat_get_ipv4_tbl_size() - nat table size for a number of rules
+ * @number_of_entries: [in] number of nat rules
+ * @table_entries: [out] base table entries
+ * @expn_table_entries: [out] expansion table entries
+ *
+ * To get the base and expansion table sizes of a table
+ * created with ipa_nat_add_ipv4_tbl()
+ *
+ * Returns:	0  On Success, negative on failure
+ */
+int ipa_nat_get_ipv4_tbl_size(uint16_t number_of_entries,
+		uint16_t *table_entries,
+		uint16_t *expn_table_entries)
+{
+  if (0 == number_of_entries || NULL == table_entries ||
+      NULL == expn_table_entries) {
+    IPAERR("Invalid parameters \n");
+    return -EINVAL;
+  }
+
+  return ipa_nati_get_tbl_size(number_of_entries,
+                               table_entries,
+                               expn_table_entries);
+}
+
 /**
  * ipa_nat_del_ipv4_tbl() - delete ipv4 table
  * @table_handle: [in] Handle of ipv4 nat table
  *
  * To delete given ipv4 nat table
  *
- * Returns:	0  On Success, negative on failure
+ * Returns:	0  On Success, -EBUSY if the table is left as it
+ *          was, else negative and the handle is no longer valid
  */
 int ipa_nat_del_ipv4_tbl(uint32_t tbl_hdl)
 {
@@ -83,6 +172,52 @@ int ipa_nat_del_ipv4_tbl(uint32_t tbl_hdl)
   return ipa_nati_del_ipv4_table(tbl_hdl);
 }
 
+/**
+ * ipa_nat_resize_ipv4_tbl() - recreate ipv4 table with a new size
+ * @table_handle: [in] Handle of ipv4 nat table
+ * @table_entries: [in] new base table entries, power of 2
+ * @expn_table_entries: [in] new expansion table entries, even
+ * @rules: [in] live rules to add back to the new table
+ * @num_rules: [in] number of rules in the array
+ * @rule_handles: [out] array of new handles, one per rule
+ *
+ * To delete given ipv4 nat table, create it again with the
+ * given sizes and add the rules back in bulk
+ *
+ * Returns:	0  On Success, -ENOMEM if the old size was restored,
+ *          -EIO if the table is lost, -EBUSY if the old table
+ *          is kept
+ */
+int ipa_nat_resize_ipv4_tbl(uint32_t tbl_hdl,
+		uint16_t table_entries,
+		uint16_t expn_table_entries,
+		const ipa_nat_ipv4_rule *clnt_rules,
+		uint16_t num_rules,
+		uint32_t *rule_hdls)
+{
+  if (IPA_NAT_INVALID_NAT_ENTRY == tbl_hdl ||
+      tbl_hdl > IPA_NAT_MAX_IP4_TBLS ||
+      table_entries < 2 ||
+      table_entries > IPA_NAT_MAX_TBL_ENTRIES ||
+      (table_entries & (table_entries - 1)) ||
+      expn_table_entries < 2 ||
+      expn_table_entries > IPA_NAT_MAX_TBL_ENTRIES ||
+      (expn_table_entries % 2) ||
+      (num_rules && (NULL == clnt_rules || NULL == rule_hdls))) {
+    IPAERR("Invalid parameters \n");
+    return -EINVAL;
+  }
+  IPADBG("Passed Table Handle: 0x%x, sizes: %d/%d, rules: %d\n",
+         tbl_hdl, table_entries, expn_table_entries, num_rules);
+
+  return ipa_nati_resize_ipv4_tbl(tbl_hdl,
+                                  table_entries,
+                                  expn_table_entries,
+                                  clnt_rules,
+                                  num_rules,
+                                  rule_hdls);
+}
+
 /**
  * ipa_nat_add_ipv4_rule() - to insert new ipv4 rule
  * @table_handle: [in] handle of ipv4 nat table
@@ -115,6 +250,39 @@ int ipa_nat_add_ipv4_rule(uint32_t tbl_hdl,
   return 0;
 }
 
+/**
+ * ipa_nat_add_ipv4_rules() - to insert several ipv4 rules at once
+ * @table_handle: [in] handle of ipv4 nat table
+ * @rules: [in] array of new rules
+ * @num_rules: [in] number of rules in the array
+ * @rule_handles: [out] array of handles, one per rule
+ *
+ * To insert several ipv4 nat rules into ipv4 nat table and
+ * enable them with a single dma command instead of one per rule.
+ * Rules that could not be added get a rule handle of 0
+ *
+ * Returns:	0  On Success, negative if any rule failed
+ */
+int ipa_nat_add_ipv4_rules(uint32_t tbl_hdl,
+		const ipa_nat_ipv4_rule *clnt_rules,
+		uint16_t num_rules,
+		uint32_t *rule_hdls)
+{
+  if (NULL != rule_hdls && 0 != num_rules) {
+    memset(rule_hdls, 0, num_rules * sizeof(uint32_t));
+  }
+
+  if (IPA_NAT_INVALID_NAT_ENTRY == tbl_hdl ||
+      tbl_hdl > IPA_NAT_MAX_IP4_TBLS || NULL == rule_hdls ||
+      NULL == clnt_rules || 0 == num_rules) {
+    IPAERR("invalid parameters passed \n");
+    return -EINVAL;
+  }
+  IPADBG("Passed Table handle: 0x%x, rules: %d\n", tbl_hdl, num_rules);
+
+  return ipa_nati_add_ipv4_rules(tbl_hdl, clnt_rules, num_rules, rule_hdls);
+}
+
 
 /**
  * ipa_nat_del_ipv4_rule() - to delete ipv4 nat rule
@@ -146,6 +314,42 @@ int ipa_nat_del_ipv4_rule(uint32_t tbl_hdl,
   return 0;
 }
 
+/**
+ * ipa_nat_del_ipv4_rules() - to delete several ipv4 nat rules at once
+ * @table_handle: [in] handle of ipv4 nat table
+ * @rule_handles: [in/out] array of ipv4 nat rule handles
+ * @num_rules: [in] number of handles in the array
+ *
+ * To delete several ipv4 nat rules with a single dma command
+ * instead of one per rule. The handles of the rules deleted are
+ * set to 0, the rules whose handle is left could not be deleted
+ * and are still in the table
+ *
+ * Returns:	0  On Success, negative if any rule failed
+ */
+int ipa_nat_del_ipv4_rules(uint32_t tbl_hdl,
+		uint32_t *rule_hdls,
+		uint16_t num_rules)
+{
+  int result;
+
+  if (IPA_NAT_INVALID_NAT_ENTRY == tbl_hdl ||
+      tbl_hdl > IPA_NAT_MAX_IP4_TBLS || NULL == rule_hdls ||
+      0 == num_rules) {
+    IPAERR("invalid parameters passed \n");
+    return -EINVAL;
+  }
+  IPADBG("Passed Table: 0x%x, rules: %d\n", tbl_hdl, num_rules);
+
+  result = ipa_nati_del_ipv4_rules(tbl_hdl, rule_hdls, num_rules);
+  if (result) {
+    IPAERR("unable to delete all the rules from hw \n");
+    return result;
+  }
+
+  return 0;
+}
+
 /**
  * ipa_nat_query_timestamp() - to query timestamp
  * @table_handle: [in] handle of ipv4 nat table
@@ -172,4 +376,90 @@ int ipa_nat_query_timestamp(uint32_t  tbl_hdl,
   return ipa_nati_query_timestamp(tbl_hdl, rule_hdl, time_stamp);
 }
 
+/**
+ * ipa_nat_query_timestamps_bulk() - query the timestamps of all rules
+ * @tbl_hdl: [in] handle of ipv4 nat table
+ * @time_stamps: [out] rule handle, time stamp and protocol per rule
+ * @max_entries: [in] number of elements in time_stamps
+ * @num_entries: [out] number of elements filled
+ *
+ * Returns:	0  On Success, negative on failure
+ */
+int ipa_nat_query_timestamps_bulk(uint32_t tbl_hdl,
+		ipa_nat_ipv4_timestamp *time_stamps,
+		uint16_t max_entries,
+		uint16_t *num_entries)
+{
+
+  if (0 == tbl_hdl || tbl_hdl > IPA_NAT_MAX_IP4_TBLS ||
+      NULL == time_stamps || NULL == num_entries) {
+    IPAERR("invalid parameters passed \n");
+    return -EINVAL;
+  }
+  IPADBG("Passed Table: 0x%x, entries %d\n", tbl_hdl, max_entries);
+
+  return ipa_nati_query_timestamps_bulk(tbl_hdl, time_stamps,
+                                        max_entries, num_entries);
+}
+
+/**
+ * ipa_nat_analyze_ipv4_hash() - analyze the nat hash for a flow set
+ * @rules: [in] recorded flows, one rule per flow
+ * @num_rules: [in] number of flows
+ * @table_entries: [in] base table entries, power of 2
+ * @expn_table_entries: [in] expansion table entries
+ * @stats: [out] collision chain histograms
+ *
+ * To find out how the given flows chain up in nat
+ * tables of the given size
+ *
+ * Returns:	0  On Success, negative on failure
+ */
+int ipa_nat_analyze_ipv4_hash(const ipa_nat_ipv4_rule *rules,
+		uint16_t num_rules,
+		uint16_t table_entries,
+		uint16_t expn_table_entries,
+		ipa_nat_hash_stats *stats)
+{
+  if (NULL == rules || NULL == stats || 0 == num_rules ||
+      table_entries < 2 || table_entries > IPA_NAT_MAX_TBL_ENTRIES ||
+      (table_entries & (table_entries - 1))) {
+    IPAERR("invalid parameters passed \n");
+    return -EINVAL;
+  }
+  IPADBG("Flows: %d, table entries: %d, expansion entries: %d\n",
+         num_rules, table_entries, expn_table_entries);
+
+  return ipa_nati_analyze_hash(rules, num_rules, table_entries,
+                               expn_table_entries, stats);
+}
+
+/**
+ * ipa_nat_recommend_ipv4_tbl() - recommend nat table size for a flow set
+ * @rules: [in] recorded flows, one rule per flow
+ * @num_rules: [in] number of flows
+ * @max_chain: [in] longest collision chain allowed, in rules
+ * @table_entries: [out] base table entries
+ * @expn_table_entries: [out] expansion table entries
+ *
+ * To find the smallest nat tables that keep the
+ * collision chains of the given flows short
+ *
+ * Returns:	0  On Success, negative on failure
+ */
+int ipa_nat_recommend_ipv4_tbl(const ipa_nat_ipv4_rule *rules,
+		uint16_t num_rules,
+		uint8_t max_chain,
+		uint16_t *table_entries,
+		uint16_t *expn_table_entries)
+{
+  if (NULL == rules || NULL == table_entries ||
+      NULL == expn_table_entries || 0 == num_rules || 0 == max_chain) {
+    IPAERR("invalid parameters passed \n");
+    return -EINVAL;
+  }
+  IPADBG("Flows: %d, max chain: %d\n", num_rules, max_chain);
 
+  return ipa_nati_recommend_tbl_size(rules, num_rules, max_chain,
+                                     table_entries, expn_table_entries);
+}
@@ -38,6 +38,26 @@ IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 struct ipa_nat_cache ipv4_nat_cache;
 pthread_mutex_t nat_mutex    = PTHREAD_MUTEX_INITIALIZER;
 
+static int ipa_nati_hw_open(const char *name, int flags)
+{
+	return open(name, flags);
+}
+
+static int ipa_nati_hw_ioctl(int fd, unsigned long req, void *arg)
+{
+	return ioctl(fd, req, arg);
+}
+
+const struct ipa_nat_ops ipa_nat_hw_ops = {
+	.open_dev = ipa_nati_hw_open,
+	.close_dev = close,
+	.ioctl_dev = ipa_nati_hw_ioctl,
+	.mmap_dev = mmap,
+	.munmap_dev = munmap,
+};
+
+static const struct ipa_nat_ops *nat_ops = &ipa_nat_hw_ops;
+
 /* ------------------------------------------
 		UTILITY FUNCTIONS START
 	 --------------------------------------------*/
@@ -168,7 +188,7 @@ int CreateNatDevice(struct ipa_ioc_nat_alloc_mem *mem)
 {
 	int ret;
 
-	ret = ioctl(ipv4_nat_cache.ipa_fd, IPA_IOC_ALLOC_NAT_MEM, mem);
+	ret = nat_ops->ioctl_dev(ipv4_nat_cache.ipa_fd, IPA_IOC_ALLOC_NAT_MEM, mem);
 	if (ret != 0) {
 		perror("CreateNatDevice(): ioctl error value");
 		IPAERR("unable to post nat mem init. Error ;%d\n", ret);
@@ -590,6 +610,351 @@ uint32_t ipa_nati_get_index_entry_offset(struct ipa_nat_ip4_table_cache *cache_p
 	return ret;
 }
 
+/**
+ * ipa_nati_get_enable_offset() - offset of the flag field of a rule
+ * @cache_ptr: [in] nat table cache
+ * @entry: [in] rule entry, expansion entries start at table_entries
+ * @tbl_type: [out] table the entry belongs to
+ *
+ * Returns: offset to be passed in the dma command enabling the rule
+ */
+static uint32_t ipa_nati_get_enable_offset(
+				struct ipa_nat_ip4_table_cache *cache_ptr,
+				uint16_t entry,
+				nat_table_type *tbl_type)
+{
+	uint32_t offset;
+
+	if (entry < cache_ptr->table_entries) {
+		*tbl_type = IPA_NAT_BASE_TBL;
+		offset = entry * sizeof(struct ipa_nat_rule);
+	} else {
+		*tbl_type = IPA_NAT_EXPN_TBL;
+		offset = (entry - cache_ptr->table_entries) * sizeof(struct ipa_nat_rule);
+		offset += cache_ptr->tbl_addr_offset;
+	}
+
+	return offset + IPA_NAT_RULE_FLAG_FIELD_OFFSET;
+}
+
+/**
+ * ipa_nati_queue_dma() - append a write to the bulk add command
+ * @cache_ptr: [in] nat table cache, with dma_batch set
+ * @tbl_indx: [in] nat table index
+ * @tbl_type: [in] table to write
+ * @offset: [in] offset of the field
+ * @data: [in] value to write
+ *
+ * Returns: 0 On Success, negative if the command is full
+ */
+static int ipa_nati_queue_dma(struct ipa_nat_ip4_table_cache *cache_ptr,
+				uint8_t tbl_indx,
+				nat_table_type tbl_type,
+				uint32_t offset,
+				uint16_t data)
+{
+	struct ipa_ioc_nat_dma_cmd *cmd = cache_ptr->dma_batch;
+
+	if (cmd->entries >= IPA_NAT_MAX_DMA_ENTRIES) {
+		IPAERR("bulk dma command is full\n");
+		return -ENOMEM;
+	}
+
+	cmd->dma[cmd->entries].table_index = tbl_indx;
+	cmd->dma[cmd->entries].base_addr = tbl_type;
+	cmd->dma[cmd->entries].offset = offset;
+	cmd->dma[cmd->entries].data = data;
+	cmd->entries++;
+
+	return 0;
+}
+
+/**
+ * ipa_nati_get_next_index() - read next index of a rule
+ * @cache_ptr: [in] nat table cache
+ * @tbl_type: [in] table the entry belongs to
+ * @entry: [in] entry within that table
+ *
+ * Rules added in bulk are linked only when the dma command is
+ * posted, so the updates queued so far take precedence over
+ * the value found in the table
+ *
+ * Returns: next index of the entry
+ */
+static uint16_t ipa_nati_get_next_index(
+				struct ipa_nat_ip4_table_cache *cache_ptr,
+				nat_table_type tbl_type,
+				uint16_t entry)
+{
+	struct ipa_ioc_nat_dma_cmd *cmd = cache_ptr->dma_batch;
+	struct ipa_nat_rule *tbl;
+	struct ipa_nat_indx_tbl_rule *indx_tbl;
+	uint16_t next_index;
+	uint32_t offset;
+	int cnt;
+
+	if (IPA_NAT_BASE_TBL == tbl_type || IPA_NAT_EXPN_TBL == tbl_type) {
+		tbl = (struct ipa_nat_rule *)((IPA_NAT_BASE_TBL == tbl_type) ?
+			 cache_ptr->ipv4_rules_addr : cache_ptr->ipv4_expn_rules_addr);
+		next_index = Read16BitFieldValue(tbl[entry].nxt_indx_pub_port,
+																		 NEXT_INDEX_FIELD);
+		if (NULL == cmd)
+			return next_index;
+
+		offset = ipa_nati_get_entry_offset(cache_ptr, tbl_type, entry);
+		offset += IPA_NAT_RULE_NEXT_FIELD_OFFSET;
+	} else {
+		indx_tbl = (struct ipa_nat_indx_tbl_rule *)((IPA_NAT_INDX_TBL == tbl_type) ?
+			 cache_ptr->index_table_addr : cache_ptr->index_table_expn_addr);
+		next_index = Read16BitFieldValue(indx_tbl[entry].tbl_entry_nxt_indx,
+																		 INDX_TBL_NEXT_INDEX_FILED);
+		if (NULL == cmd)
+			return next_index;
+
+		offset = ipa_nati_get_index_entry_offset(cache_ptr, tbl_type, entry);
+		offset += IPA_NAT_INDEX_RULE_NEXT_FIELD_OFFSET;
+	}
+
+	/* next index values never reach the enable bit mask, which
+		 tells them apart from enable commands on the same offset */
+	for (cnt = 0; cnt < cmd->entries; cnt++) {
+		if (cmd->dma[cnt].base_addr == tbl_type &&
+				cmd->dma[cnt].offset == offset &&
+				cmd->dma[cnt].data != IPA_NAT_FLAG_ENABLE_BIT_MASK) {
+			next_index = cmd->dma[cnt].data;
+		}
+	}
+
+	return next_index;
+}
+
+/**
+ * ipa_nati_is_rule_pending() - check for a rule waiting to be enabled
+ * @cache_ptr: [in] nat table cache
+ * @entry: [in] rule entry, expansion entries start at table_entries
+ *
+ * Returns: 1 if the rule is already written as part of the current
+ *          bulk add, 0 otherwise
+ */
+static int ipa_nati_is_rule_pending(
+				struct ipa_nat_ip4_table_cache *cache_ptr,
+				uint16_t entry)
+{
+	struct ipa_ioc_nat_dma_cmd *cmd = cache_ptr->dma_batch;
+	nat_table_type tbl_type;
+	uint32_t offset;
+	int cnt;
+
+	if (NULL == cmd)
+		return 0;
+
+	offset = ipa_nati_get_enable_offset(cache_ptr, entry, &tbl_type);
+	for (cnt = 0; cnt < cmd->entries; cnt++) {
+		if (cmd->dma[cnt].base_addr == tbl_type &&
+				cmd->dma[cnt].offset == offset &&
+				cmd->dma[cnt].data == IPA_NAT_FLAG_ENABLE_BIT_MASK) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * ipa_nati_map_reset() - mark all the expansion entries free
+ * @map: [in] used entry bitmap
+ * @free_word: [out] first word that may have a free entry
+ * @size: [in] number of entries in the table
+ *
+ * Entry 0 is unused in nat tables and bits past the end
+ * of the table do not map to an entry, both stay set
+ *
+ * Returns: None
+ */
+static void ipa_nati_map_reset(uint64_t *map,
+				uint16_t *free_word,
+				uint16_t size)
+{
+	uint32_t cnt;
+
+	memset(map, 0, IPA_NAT_MAP_WORDS(size) * sizeof(uint64_t));
+	map[0] |= 1;
+	for (cnt = size; cnt < IPA_NAT_MAP_WORDS(size) * 64; cnt++) {
+		map[cnt / 64] |= (1ULL << (cnt % 64));
+	}
+
+	*free_word = 0;
+}
+
+/**
+ * ipa_nati_map_get_free() - find the lowest free expansion entry
+ * @map: [in] used entry bitmap
+ * @free_word: [in/out] first word that may have a free entry
+ * @size: [in] number of entries in the table
+ *
+ * Full words are skipped once and the hint moves past them,
+ * so the lookup does not depend on how full the table is
+ *
+ * Returns: free entry, IPA_NAT_INVALID_NAT_ENTRY if the table is full
+ */
+static uint16_t ipa_nati_map_get_free(const uint64_t *map,
+				uint16_t *free_word,
+				uint16_t size)
+{
+	while (*free_word < IPA_NAT_MAP_WORDS(size) &&
+				 map[*free_word] == ~0ULL) {
+		(*free_word)++;
+	}
+
+	if (*free_word == IPA_NAT_MAP_WORDS(size)) {
+		return IPA_NAT_INVALID_NAT_ENTRY;
+	}
+
+	return (uint16_t)((*free_word * 64) + __builtin_ctzll(~map[*free_word]));
+}
+
+/**
+ * ipa_nati_map_update() - mark an expansion entry used or free
+ * @map: [in] used entry bitmap
+ * @free_word: [in/out] first word that may have a free entry
+ * @entry: [in] entry within the expansion table
+ * @used: [in] 1 when the entry is taken, 0 when it is released
+ *
+ * Returns: None
+ */
+static void ipa_nati_map_update(uint64_t *map,
+				uint16_t *free_word,
+				uint16_t entry,
+				int used)
+{
+	uint16_t word = entry / 64;
+
+	if (used) {
+		map[word] |= (1ULL << (entry % 64));
+	} else {
+		map[word] &= ~(1ULL << (entry % 64));
+		if (word < *free_word) {
+			*free_word = word;
+		}
+	}
+}
+
+/**
+ * ipa_nati_release_mem() - clear table memory and free the entry
+ * @cache_ptr: [in] nat table cache
+ * @addr: [in] start of the memory to clear
+ * @size: [in] number of bytes to clear
+ *
+ * Entries of the expansion tables are returned to their free maps
+ *
+ * Returns: None
+ */
+static void ipa_nati_release_mem(struct ipa_nat_ip4_table_cache *cache_ptr,
+				void *addr,
+				uint16_t size)
+{
+	char *ptr = (char *)addr;
+
+	memset(addr, 0, size);
+
+	if (ptr >= cache_ptr->ipv4_expn_rules_addr &&
+			ptr < cache_ptr->ipv4_expn_rules_addr +
+			(cache_ptr->expn_table_entries * sizeof(struct ipa_nat_rule))) {
+		ipa_nati_map_update(cache_ptr->expn_used_map,
+				&cache_ptr->expn_free_word,
+				(ptr - cache_ptr->ipv4_expn_rules_addr) / sizeof(struct ipa_nat_rule),
+				0);
+	} else if (ptr >= cache_ptr->index_table_expn_addr &&
+			ptr < cache_ptr->index_table_expn_addr +
+			(cache_ptr->expn_table_entries * sizeof(struct ipa_nat_indx_tbl_rule))) {
+		ipa_nati_map_update(cache_ptr->indx_expn_used_map,
+				&cache_ptr->indx_expn_free_word,
+				(ptr - cache_ptr->index_table_expn_addr) / sizeof(struct ipa_nat_indx_tbl_rule),
+				0);
+	}
+}
+
+/**
+ * ipa_nati_reset_mem() - clear table memory of a deleted rule
+ * @cache_ptr: [in] nat table cache
+ * @addr: [in] start of the memory to clear
+ * @size: [in] number of bytes to clear
+ *
+ * During a bulk delete the memory may still be reachable by the
+ * hardware until the dma command is posted, so the reset is only
+ * recorded and done by ipa_nati_post_del_batch()
+ *
+ * Returns: None
+ */
+static void ipa_nati_reset_mem(struct ipa_nat_ip4_table_cache *cache_ptr,
+				void *addr,
+				uint16_t size)
+{
+	if (NULL == cache_ptr->mem_resets) {
+		ipa_nati_release_mem(cache_ptr, addr, size);
+		return;
+	}
+
+	cache_ptr->mem_resets[cache_ptr->mem_reset_cnt].addr = addr;
+	cache_ptr->mem_resets[cache_ptr->mem_reset_cnt].size = size;
+	cache_ptr->mem_reset_cnt++;
+}
+
+/**
+ * ipa_nati_save_sw() - remember a value a bulk delete changes
+ * @cache_ptr: [in] nat table cache
+ * @rule: [in] rule whose sw specific params change, or NULL
+ * @addr: [in] value that changes when rule is NULL
+ * @size: [in] size of the value at addr
+ *
+ * The cpu changes these right away while the dma command is only
+ * posted later, ipa_nati_post_del_batch() puts them back if the
+ * command fails. Nothing is saved outside of a bulk delete
+ *
+ * Returns: None
+ */
+static void ipa_nati_save_sw(struct ipa_nat_ip4_table_cache *cache_ptr,
+				struct ipa_nat_rule *rule,
+				void *addr,
+				uint8_t size)
+{
+	struct ipa_nat_sw_undo *undo;
+
+	if (NULL == cache_ptr->sw_undo)
+		return;
+
+	undo = &cache_ptr->sw_undo[cache_ptr->sw_undo_cnt++];
+	undo->rule = rule;
+	undo->addr = addr;
+	undo->size = size;
+	if (NULL != rule) {
+		undo->data = rule->sw_spec_params;
+	} else {
+		memcpy(&undo->data, addr, size);
+	}
+}
+
+/**
+ * ipa_nati_restore_sw() - undo the changes of a failed bulk delete
+ * @cache_ptr: [in] nat table cache
+ *
+ * Returns: None
+ */
+static void ipa_nati_restore_sw(struct ipa_nat_ip4_table_cache *cache_ptr)
+{
+	struct ipa_nat_sw_undo *undo;
+
+	/* latest first, a value may have been saved more than once */
+	while (cache_ptr->sw_undo_cnt > 0) {
+		undo = &cache_ptr->sw_undo[--cache_ptr->sw_undo_cnt];
+		if (NULL != undo->rule) {
+			undo->rule->sw_spec_params = undo->data;
+		} else {
+			memcpy(undo->addr, &undo->data, undo->size);
+		}
+	}
+}
+
 /* ------------------------------------------
 		UTILITY FUNCTIONS END
 --------------------------------------------*/
@@ -634,29 +999,110 @@ void ipa_nati_reset_tbl(uint8_t tbl_indx)
 				 0,
 				 IPA_NAT_INDEX_TABLE_ENTRY_SIZE * expn_table_entries);
 
+	/* Both expansion tables are empty now */
+	ipa_nati_map_reset(ipv4_nat_cache.ip4_tbl[tbl_indx].expn_used_map,
+				 &ipv4_nat_cache.ip4_tbl[tbl_indx].expn_free_word,
+				 expn_table_entries);
+	ipa_nati_map_reset(ipv4_nat_cache.ip4_tbl[tbl_indx].indx_expn_used_map,
+				 &ipv4_nat_cache.ip4_tbl[tbl_indx].indx_expn_free_word,
+				 expn_table_entries);
+
 	IPADBG("returning from ipa_nati_reset_tbl()\n");
 	return;
 }
 
+/**
+ * ipa_nati_tbl_close() - keep timestamp queries off a table
+ * @tbl_indx: [in] nat table index
+ *
+ * Waits for the queries already reading the table, the ones
+ * that come later fail until ipa_nati_tbl_open()
+ *
+ * Returns: None
+ */
+static void ipa_nati_tbl_close(uint8_t tbl_indx)
+{
+	struct ipa_nat_tbl_sync *sync = &ipv4_nat_cache.tbl_sync[tbl_indx];
+
+	__atomic_store_n(&sync->closed, 1, __ATOMIC_SEQ_CST);
+	while (__atomic_load_n(&sync->readers, __ATOMIC_SEQ_CST)) {
+		sched_yield();
+	}
+}
+
+static void ipa_nati_tbl_open(uint8_t tbl_indx)
+{
+	__atomic_store_n(&ipv4_nat_cache.tbl_sync[tbl_indx].closed, 0,
+									 __ATOMIC_SEQ_CST);
+}
+
+/**
+ * ipa_nati_tbl_read_begin() - start a lock free table read
+ * @tbl_indx: [in] nat table index
+ *
+ * Returns: 0 if the table may be read, negative while it is
+ * created or deleted. ipa_nati_tbl_read_end() has to follow
+ * either way
+ */
+static int ipa_nati_tbl_read_begin(uint8_t tbl_indx)
+{
+	struct ipa_nat_tbl_sync *sync = &ipv4_nat_cache.tbl_sync[tbl_indx];
+
+	__atomic_add_fetch(&sync->readers, 1, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&sync->closed, __ATOMIC_SEQ_CST)) {
+		return -EAGAIN;
+	}
+
+	return 0;
+}
+
+static void ipa_nati_tbl_read_end(uint8_t tbl_indx)
+{
+	__atomic_sub_fetch(&ipv4_nat_cache.tbl_sync[tbl_indx].readers, 1,
+										 __ATOMIC_SEQ_CST);
+}
+
 int ipa_nati_add_ipv4_tbl(uint32_t public_ip_addr,
 				uint16_t number_of_entries,
 				uint32_t *tbl_hdl)
+{
+	uint16_t table_entries, expn_table_entries;
+
+	*tbl_hdl = 0;
+	if (ipa_nati_get_tbl_size(number_of_entries,
+														&table_entries,
+														&expn_table_entries)) {
+		IPAERR("unable to calculate nat table size\n");
+		return -EINVAL;
+	}
+
+	return ipa_nati_add_ipv4_tbl_sized(public_ip_addr,
+																		 table_entries,
+																		 expn_table_entries,
+																		 tbl_hdl);
+}
+
+int ipa_nati_add_ipv4_tbl_sized(uint32_t public_ip_addr,
+				uint16_t table_entries,
+				uint16_t expn_table_entries,
+				uint32_t *tbl_hdl)
 {
 	struct ipa_ioc_nat_alloc_mem mem;
 	uint8_t tbl_indx = ipv4_nat_cache.table_cnt;
-	uint16_t table_entries, expn_table_entries;
 	int ret;
 
 	*tbl_hdl = 0;
+	ipa_nati_tbl_close(tbl_indx);
+
 	/* Allocate table */
 	memset(&mem, 0, sizeof(mem));
-	ret = ipa_nati_alloc_table(number_of_entries,
-														 &mem,
-														 &table_entries,
-														 &expn_table_entries);
+	ret = ipa_nati_alloc_table(table_entries,
+														 expn_table_entries,
+														 &mem);
 	if (0 != ret) {
 		IPAERR("unable to allocate nat table\n");
-		return -ENOMEM;
+		ret = -ENOMEM;
+		goto done;
 	}
 
 	/* Update the cache
@@ -669,7 +1115,8 @@ int ipa_nati_add_ipv4_tbl(uint32_t public_ip_addr,
 															expn_table_entries);
 	if (0 != ret) {
 		IPAERR("unable to update cache Error: %d\n", ret);
-		return -EINVAL;
+		ret = -EINVAL;
+		goto done;
 	}
 
 	/* Reset the nat table before posting init cmd */
@@ -679,7 +1126,8 @@ int ipa_nati_add_ipv4_tbl(uint32_t public_ip_addr,
 	ret = ipa_nati_post_ipv4_init_cmd(tbl_indx);
 	if (0 != ret) {
 		IPAERR("unable to post nat_init command Error %d\n", ret);
-		return -EINVAL;
+		ret = -EINVAL;
+		goto done;
 	}
 
 	/* Return table handle */
@@ -689,20 +1137,82 @@ int ipa_nati_add_ipv4_tbl(uint32_t public_ip_addr,
 #ifdef NAT_DUMP
 	ipa_nat_dump_ipv4_table(*tbl_hdl);
 #endif
-	return 0;
+
+done:
+	ipa_nati_tbl_open(tbl_indx);
+	return ret;
 }
 
-int ipa_nati_alloc_table(uint16_t number_of_entries,
-				struct ipa_ioc_nat_alloc_mem *mem,
-				uint16_t *table_entries,
-				uint16_t *expn_table_entries)
+int ipa_nati_resize_ipv4_tbl(uint32_t tbl_hdl,
+				uint16_t table_entries,
+				uint16_t expn_table_entries,
+				const ipa_nat_ipv4_rule *clnt_rules,
+				uint16_t num_rules,
+				uint32_t *rule_hdls)
 {
-	int fd = 0, ret;
-	uint16_t total_entries;
+	uint8_t tbl_indx = (uint8_t)(tbl_hdl - 1);
+	uint16_t old_entries, old_expn_entries;
+	uint32_t public_addr, new_hdl;
+	int ret, resize_ret = 0;
 
-	/* Copy the table name */
-	strlcpy(mem->dev_name, NAT_DEV_NAME, IPA_RESOURCE_NAME_MAX);
+	/* The new table takes the index of the last table */
+	if (!ipv4_nat_cache.ip4_tbl[tbl_indx].valid ||
+			tbl_hdl != ipv4_nat_cache.table_cnt) {
+		IPAERR("invalid table handle passed\n");
+		return -EINVAL;
+	}
 
+	if (num_rules)
+		memset(rule_hdls, 0, num_rules * sizeof(uint32_t));
+
+	public_addr = ipv4_nat_cache.ip4_tbl[tbl_indx].public_addr;
+	old_entries = ipv4_nat_cache.ip4_tbl[tbl_indx].table_entries;
+	old_expn_entries = ipv4_nat_cache.ip4_tbl[tbl_indx].expn_table_entries;
+	IPADBG("resizing table from %d/%d to %d/%d entries\n",
+				 old_entries, old_expn_entries, table_entries, expn_table_entries);
+
+	/* -EBUSY leaves the old table and its rules as they are */
+	ret = ipa_nati_del_ipv4_table(tbl_hdl);
+	if (-EBUSY == ret) {
+		IPAERR("unable to delete nat table, it is kept\n");
+		return -EBUSY;
+	}
+	if (0 != ret) {
+		IPAERR("unable to delete nat table Error: %d\n", ret);
+		return -EIO;
+	}
+
+	ret = ipa_nati_add_ipv4_tbl_sized(public_addr,
+																		table_entries,
+																		expn_table_entries,
+																		&new_hdl);
+	if (0 != ret) {
+		IPAERR("unable to add resized table, restoring %d/%d entries\n",
+					 old_entries, old_expn_entries);
+		resize_ret = -ENOMEM;
+		ret = ipa_nati_add_ipv4_tbl_sized(public_addr,
+																			old_entries,
+																			old_expn_entries,
+																			&new_hdl);
+		if (0 != ret) {
+			IPAERR("unable to restore nat table Error: %d\n", ret);
+			return -EIO;
+		}
+	}
+
+	/* Rules that do not fit are left with an invalid handle */
+	if (num_rules &&
+			ipa_nati_add_ipv4_rules(new_hdl, clnt_rules, num_rules, rule_hdls)) {
+		IPAERR("unable to add back all the %d rules\n", num_rules);
+	}
+
+	return resize_ret;
+}
+
+int ipa_nati_get_tbl_size(uint16_t number_of_entries,
+				uint16_t *table_entries,
+				uint16_t *expn_table_entries)
+{
 	/* Calculate the size for base table and expansion table */
 	*table_entries = (uint16_t)(number_of_entries * IPA_NAT_BASE_TABLE_PERCENTAGE);
 	if (*table_entries == 0) {
@@ -716,7 +1226,20 @@ int ipa_nati_alloc_table(uint16_t number_of_entries,
 	*expn_table_entries = (uint16_t)(number_of_entries * IPA_NAT_EXPANSION_TABLE_PERCENTAGE);
 	GetNearestEven(*expn_table_entries, expn_table_entries);
 
-	total_entries = (*table_entries)+(*expn_table_entries);
+	return 0;
+}
+
+int ipa_nati_alloc_table(uint16_t table_entries,
+				uint16_t expn_table_entries,
+				struct ipa_ioc_nat_alloc_mem *mem)
+{
+	int fd = 0, ret;
+	uint16_t total_entries;
+
+	/* Copy the table name */
+	strlcpy(mem->dev_name, NAT_DEV_NAME, IPA_RESOURCE_NAME_MAX);
+
+	total_entries = table_entries + expn_table_entries;
 
 	/* Calclate the memory size for both table and index table entries */
 	mem->size = (IPA_NAT_TABLE_ENTRY_SIZE * total_entries);
@@ -725,7 +1248,7 @@ int ipa_nati_alloc_table(uint16_t number_of_entries,
 	IPADBG("Nat Base and Index Table size: %d\n", mem->size);
 
 	if (!ipv4_nat_cache.ipa_fd) {
-		fd = open(IPA_DEV_NAME, O_RDONLY);
+		fd = nat_ops->open_dev(IPA_DEV_NAME, O_RDONLY);
 		if (fd < 0) {
 			perror("ipa_nati_alloc_table(): open error value:");
 			IPAERR("unable to open ipa device\n");
@@ -797,10 +1320,32 @@ int ipa_nati_update_cache(struct ipa_ioc_nat_alloc_mem *mem,
 					 sizeof(uint16_t) * (tbl_entries + expn_tbl_entries));
 	}
 
+	/* Allocate the used entry maps of both expansion tables,
+		 they are initialized along with the tables */
+	if (NULL == ipv4_nat_cache.ip4_tbl[index].expn_used_map) {
+		ipv4_nat_cache.ip4_tbl[index].expn_used_map =
+			 malloc(sizeof(uint64_t) * IPA_NAT_MAP_WORDS(expn_tbl_entries));
+
+		if (NULL == ipv4_nat_cache.ip4_tbl[index].expn_used_map) {
+			IPAERR("Fail to allocate expansion table map\n");
+			return 0;
+		}
+	}
+
+	if (NULL == ipv4_nat_cache.ip4_tbl[index].indx_expn_used_map) {
+		ipv4_nat_cache.ip4_tbl[index].indx_expn_used_map =
+			 malloc(sizeof(uint64_t) * IPA_NAT_MAP_WORDS(expn_tbl_entries));
+
+		if (NULL == ipv4_nat_cache.ip4_tbl[index].indx_expn_used_map) {
+			IPAERR("Fail to allocate index expansion table map\n");
+			return 0;
+		}
+	}
+
 
 	/* open the nat table */
 	strlcpy(mem->dev_name, NAT_DEV_FULL_NAME, IPA_RESOURCE_NAME_MAX);
-	fd = open(mem->dev_name, O_RDWR);
+	fd = nat_ops->open_dev(mem->dev_name, O_RDWR);
 	if (fd < 0) {
 		perror("ipa_nati_update_cache(): open error value:");
 		IPAERR("unable to open nat device. Error:%d\n", fd);
@@ -815,12 +1360,12 @@ int ipa_nati_update_cache(struct ipa_ioc_nat_alloc_mem *mem,
 
 	/* open the nat device Table */
 #ifndef IPA_ON_R3PC
-	ipv4_rules_addr = (void *)mmap(NULL, mem->size,
+	ipv4_rules_addr = (void *)nat_ops->mmap_dev(NULL, mem->size,
 																 prot, flags,
 																 fd, offset);
 #else
 	IPADBG("user space r3pc\n");
-	ipv4_rules_addr = (void *)mmap((caddr_t)0, NAT_MMAP_MEM_SIZE,
+	ipv4_rules_addr = (void *)nat_ops->mmap_dev((caddr_t)0, NAT_MMAP_MEM_SIZE,
 																 prot, flags,
 																 fd, offset);
 #endif
@@ -830,7 +1375,7 @@ int ipa_nati_update_cache(struct ipa_ioc_nat_alloc_mem *mem,
 	}
 
 #ifdef IPA_ON_R3PC
-	ret = ioctl(ipv4_nat_cache.ipa_fd, IPA_IOC_GET_NAT_OFFSET, &nat_mem_offset);
+	ret = nat_ops->ioctl_dev(ipv4_nat_cache.ipa_fd, IPA_IOC_GET_NAT_OFFSET, &nat_mem_offset);
 	if (ret != 0) {
 		perror("ipa_nati_post_ipv4_init_cmd(): ioctl error value");
 		IPAERR("unable to post ant offset cmd Error: %d\n", ret);
@@ -884,7 +1429,7 @@ int ipa_nati_post_ipv4_init_cmd(uint8_t tbl_index)
 
 	cmd.ip_addr = ipv4_nat_cache.ip4_tbl[tbl_index].public_addr;
 
-	ret = ioctl(ipv4_nat_cache.ipa_fd, IPA_IOC_V4_INIT_NAT, &cmd);
+	ret = nat_ops->ioctl_dev(ipv4_nat_cache.ipa_fd, IPA_IOC_V4_INIT_NAT, &cmd);
 	if (ret != 0) {
 		perror("ipa_nati_post_ipv4_init_cmd(): ioctl error value");
 		IPAERR("unable to post init cmd Error: %d\n", ret);
@@ -896,6 +1441,42 @@ int ipa_nati_post_ipv4_init_cmd(uint8_t tbl_index)
 	return 0;
 }
 
+int ipa_nati_set_backend(ipa_nat_backend backend)
+{
+	const struct ipa_nat_ops *ops;
+	int ret = 0;
+
+	ops = (IPA_NAT_BACKEND_SIM == backend) ? &ipa_nat_sim_ops : &ipa_nat_hw_ops;
+
+	if (pthread_mutex_lock(&nat_mutex) != 0) {
+		IPAERR("unable to lock the nat mutex\n");
+		return -EINVAL;
+	}
+
+	if (ops != nat_ops) {
+		if (ipv4_nat_cache.table_cnt) {
+			IPAERR("tables exist, unable to change backend\n");
+			ret = -EBUSY;
+			goto unlock;
+		}
+
+		/* /dev/ipa stays open after the last table is deleted */
+		if (ipv4_nat_cache.ipa_fd) {
+			nat_ops->close_dev(ipv4_nat_cache.ipa_fd);
+			ipv4_nat_cache.ipa_fd = 0;
+		}
+		nat_ops = ops;
+	}
+
+unlock:
+	if (pthread_mutex_unlock(&nat_mutex) != 0) {
+		IPAERR("unable to unlock the nat mutex\n");
+		return -EINVAL;
+	}
+
+	return ret;
+}
+
 int ipa_nati_del_ipv4_table(uint32_t tbl_hdl)
 {
 	uint8_t index = (uint8_t)(tbl_hdl - 1);
@@ -909,48 +1490,53 @@ int ipa_nati_del_ipv4_table(uint32_t tbl_hdl)
 		goto fail;
 	}
 
+	/* nothing is touched yet, the table is still usable */
 	if (pthread_mutex_lock(&nat_mutex) != 0) {
-		ret = -1;
+		ret = -EBUSY;
 		goto lock_mutex_fail;
 	}
 
+	/* Timestamp queries do not take the mutex, wait for them */
+	ipa_nati_tbl_close(index);
+
 	/* unmap the device memory from user space */
 #ifndef IPA_ON_R3PC
-	munmap(addr, ipv4_nat_cache.ip4_tbl[index].size);
+	nat_ops->munmap_dev(addr, ipv4_nat_cache.ip4_tbl[index].size);
 #else
 	addr = (char *)addr - ipv4_nat_cache.ip4_tbl[index].mmap_offset;
-	munmap(addr, NAT_MMAP_MEM_SIZE);
+	nat_ops->munmap_dev(addr, NAT_MMAP_MEM_SIZE);
 #endif
 
-	/* close the file descriptor of nat device */
-	if (close(ipv4_nat_cache.ip4_tbl[index].nat_fd)) {
+	/* From here on the table cannot be used any more. If the kernel
+		 keeps it, it is still released below so that a new table can
+		 be added once the kernel lets go of it */
+	if (nat_ops->close_dev(ipv4_nat_cache.ip4_tbl[index].nat_fd)) {
 		IPAERR("unable to close the file descriptor\n");
-		ret = -EINVAL;
-		if (pthread_mutex_unlock(&nat_mutex) != 0)
-			goto unlock_mutex_fail;
-		goto fail;
+		ret = -EIO;
+	} else {
+		ret = 0;
 	}
 
 	del_cmd.table_index = index;
 	del_cmd.public_ip_addr = ipv4_nat_cache.ip4_tbl[index].public_addr;
-	ret = ioctl(ipv4_nat_cache.ipa_fd, IPA_IOC_V4_DEL_NAT, &del_cmd);
-	if (ret != 0) {
+	if (nat_ops->ioctl_dev(ipv4_nat_cache.ipa_fd, IPA_IOC_V4_DEL_NAT, &del_cmd)) {
 		perror("ipa_nati_del_ipv4_table(): ioctl error value");
-		IPAERR("unable to post nat del command init Error: %d\n", ret);
+		IPAERR("unable to post nat del command init\n");
 		IPADBG("ipa fd %d\n", ipv4_nat_cache.ipa_fd);
-		ret = -EINVAL;
-		if (pthread_mutex_unlock(&nat_mutex) != 0)
-			goto unlock_mutex_fail;
-		goto fail;
+		ret = -EIO;
+	} else {
+		IPAERR("posted IPA_IOC_V4_DEL_NAT to kernel successfully\n");
 	}
-	IPAERR("posted IPA_IOC_V4_DEL_NAT to kernel successfully\n");
 
 	free(ipv4_nat_cache.ip4_tbl[index].index_expn_table_meta);
 	free(ipv4_nat_cache.ip4_tbl[index].rule_id_array);
+	free(ipv4_nat_cache.ip4_tbl[index].expn_used_map);
+	free(ipv4_nat_cache.ip4_tbl[index].indx_expn_used_map);
 
 	memset(&ipv4_nat_cache.ip4_tbl[index],
 				 0,
 				 sizeof(ipv4_nat_cache.ip4_tbl[index]));
+	ipa_nati_tbl_open(index);
 
 	/* Decrease the table count by 1*/
 	ipv4_nat_cache.table_cnt--;
@@ -960,7 +1546,7 @@ int ipa_nati_del_ipv4_table(uint32_t tbl_hdl)
 		goto unlock_mutex_fail;
 	}
 
-	return 0;
+	return ret;
 
 lock_mutex_fail:
 	IPAERR("unable to lock the nat mutex\n");
@@ -981,15 +1567,17 @@ int ipa_nati_query_timestamp(uint32_t  tbl_hdl,
 	uint8_t expn_tbl = 0;
 	uint16_t tbl_entry = 0;
 	struct ipa_nat_rule *tbl_ptr = NULL;
+	int ret = 0;
 
-	if (!ipv4_nat_cache.ip4_tbl[tbl_index].valid) {
+	/* Lock free, rule add and delete are not held up by the
+		 timestamp sweeps. The timestamp is a single word the
+		 hardware updates and a rule stays in its entry until
+		 it is deleted */
+	if (ipa_nati_tbl_read_begin(tbl_index) ||
+			!ipv4_nat_cache.ip4_tbl[tbl_index].valid) {
 		IPAERR("invalid table handle\n");
-		return -EINVAL;
-	}
-
-	if (pthread_mutex_lock(&nat_mutex) != 0) {
-		IPAERR("unable to lock the nat mutex\n");
-		return -1;
+		ret = -EINVAL;
+		goto done;
 	}
 
 	ipa_nati_parse_ipv4_rule_hdl(tbl_index, (uint16_t)rule_hdl,
@@ -1006,15 +1594,135 @@ int ipa_nati_query_timestamp(uint32_t  tbl_hdl,
 		*time_stamp = Read32BitFieldValue(tbl_ptr[tbl_entry].ts_proto,
 					TIME_STAMP_FIELD);
 
+done:
+	ipa_nati_tbl_read_end(tbl_index);
+	return ret;
+}
+
+/**
+ * ipa_nati_read_rule_timestamps() - timestamps of one rule table
+ * @tbl_ptr: [in] rule or expansion rule table
+ * @entries: [in] number of entries in the table
+ * @hdl_map: [in] rule handle of each entry, 0 for no rule
+ * @time_stamps: [out] rule timestamps
+ * @max_entries: [in] number of elements in time_stamps
+ * @num_entries: [in/out] number of elements filled
+ *
+ * Returns: None
+ */
+static void ipa_nati_read_rule_timestamps(struct ipa_nat_rule *tbl_ptr,
+				uint16_t entries,
+				const uint16_t *hdl_map,
+				ipa_nat_ipv4_timestamp *time_stamps,
+				uint16_t max_entries,
+				uint16_t *num_entries)
+{
+	uint16_t cnt;
+
+	/* Entry 0 is never used */
+	for (cnt = 1; cnt < entries && *num_entries < max_entries; cnt++) {
+		if (!hdl_map[cnt] ||
+				!Read16BitFieldValue(tbl_ptr[cnt].ip_cksm_enbl, ENABLE_FIELD)) {
+			continue;
+		}
+
+		time_stamps[*num_entries].rule_hdl = hdl_map[cnt];
+		time_stamps[*num_entries].time_stamp =
+			Read32BitFieldValue(tbl_ptr[cnt].ts_proto, TIME_STAMP_FIELD);
+		time_stamps[*num_entries].protocol =
+			Read8BitFieldValue(tbl_ptr[cnt].ts_proto, PROTOCOL_FIELD);
+		(*num_entries)++;
+	}
+}
+
+int ipa_nati_query_timestamps_bulk(uint32_t tbl_hdl,
+				ipa_nat_ipv4_timestamp *time_stamps,
+				uint16_t max_entries,
+				uint16_t *num_entries)
+{
+	struct ipa_nat_ip4_table_cache *cache_ptr;
+	uint8_t tbl_index = (uint8_t)(tbl_hdl - 1);
+	uint16_t *hdl_map = NULL;
+	uint16_t total_entries, rule_id, entry;
+	uint16_t cnt;
+	int ret = 0;
+
+	*num_entries = 0;
+
+	/* Held once for the whole sweep, so the handles match the
+		 rules they are read from */
+	if (pthread_mutex_lock(&nat_mutex) != 0) {
+		IPAERR("unable to lock the nat mutex\n");
+		return -1;
+	}
+
+	cache_ptr = &ipv4_nat_cache.ip4_tbl[tbl_index];
+	if (!cache_ptr->valid) {
+		IPAERR("invalid table handle\n");
+		ret = -EINVAL;
+		goto unlock;
+	}
+
+	/* Rule handle of each entry, the expansion entries follow
+		 the base entries */
+	total_entries = cache_ptr->table_entries + cache_ptr->expn_table_entries;
+	hdl_map = (uint16_t *)calloc(total_entries, sizeof(uint16_t));
+	if (NULL == hdl_map) {
+		IPAERR("unable to allocate memory\n");
+		ret = -ENOMEM;
+		goto unlock;
+	}
+
+	for (cnt = 0; cnt < total_entries; cnt++) {
+		rule_id = cache_ptr->rule_id_array[cnt];
+		if (IPA_NAT_INVALID_NAT_ENTRY == rule_id) {
+			continue;
+		}
+
+		entry = (rule_id >> IPA_NAT_RULE_HDL_TBL_TYPE_BITS);
+		if (rule_id & IPA_NAT_RULE_HDL_TBL_TYPE_MASK) {
+			entry += cache_ptr->table_entries;
+		}
+
+		if (entry < total_entries) {
+			hdl_map[entry] = cnt + 1;
+		}
+	}
+
+	ipa_nati_read_rule_timestamps(
+		 (struct ipa_nat_rule *)cache_ptr->ipv4_rules_addr,
+		 cache_ptr->table_entries, hdl_map,
+		 time_stamps, max_entries, num_entries);
+
+	ipa_nati_read_rule_timestamps(
+		 (struct ipa_nat_rule *)cache_ptr->ipv4_expn_rules_addr,
+		 cache_ptr->expn_table_entries, &hdl_map[cache_ptr->table_entries],
+		 time_stamps, max_entries, num_entries);
+
+	IPADBG("read %d rule timestamps\n", *num_entries);
+	free(hdl_map);
+
+unlock:
 	if (pthread_mutex_unlock(&nat_mutex) != 0) {
 		IPAERR("unable to unlock the nat mutex\n");
 		return -1;
 	}
 
-	return 0;
+	return ret;
 }
 
-int ipa_nati_add_ipv4_rule(uint32_t tbl_hdl,
+/**
+ * ipa_nati_add_one_ipv4_rule() - insert one ipv4 nat rule
+ * @tbl_hdl: [in] handle of ipv4 nat table
+ * @clnt_rule: [in] new rule
+ * @rule_hdl: [out] handle of the new rule
+ *
+ * The caller holds nat_mutex, a bulk add queues the dma command
+ * into the batch of the table
+ *
+ * Returns:	0  On Success, negative on failure
+ */
+static int ipa_nati_add_one_ipv4_rule(uint32_t tbl_hdl,
 				const ipa_nat_ipv4_rule *clnt_rule,
 				uint32_t *rule_hdl)
 {
@@ -1061,6 +1769,28 @@ int ipa_nati_add_ipv4_rule(uint32_t tbl_hdl,
 	return 0;
 }
 
+int ipa_nati_add_ipv4_rule(uint32_t tbl_hdl,
+				const ipa_nat_ipv4_rule *clnt_rule,
+				uint32_t *rule_hdl)
+{
+	int ret;
+
+	/* a bulk add or delete of the table may be in progress */
+	if (pthread_mutex_lock(&nat_mutex) != 0) {
+		IPAERR("unable to lock the nat mutex\n");
+		return -1;
+	}
+
+	ret = ipa_nati_add_one_ipv4_rule(tbl_hdl, clnt_rule, rule_hdl);
+
+	if (pthread_mutex_unlock(&nat_mutex) != 0) {
+		IPAERR("unable to unlock the nat mutex\n");
+		return -1;
+	}
+
+	return ret;
+}
+
 int ipa_nati_generate_rule(uint32_t tbl_hdl,
 				const ipa_nat_ipv4_rule *clnt_rule,
 				struct ipa_nat_sw_rule *rule,
@@ -1112,12 +1842,11 @@ uint16_t ipa_nati_generate_tbl_rule(const ipa_nat_ipv4_rule *clnt_rule,
 {
 	uint32_t pub_ip_addr;
 	uint16_t prev = 0, nxt_indx = 0, new_entry;
-	struct ipa_nat_rule *tbl = NULL, *expn_tbl = NULL;
+	struct ipa_nat_rule *tbl = NULL;
 
 	pub_ip_addr = tbl_ptr->public_addr;
 
 	tbl = (struct ipa_nat_rule *)tbl_ptr->ipv4_rules_addr;
-	expn_tbl = (struct ipa_nat_rule *)tbl_ptr->ipv4_expn_rules_addr;
 
 	/* copy the values from client rule to sw rule */
 	sw_rule->private_ip = clnt_rule->private_ip;
@@ -1164,27 +1893,26 @@ uint16_t ipa_nati_generate_tbl_rule(const ipa_nat_ipv4_rule *clnt_rule,
 	/* check whether there is any collision
 		 if no collision return */
 	if (!Read16BitFieldValue(tbl[new_entry].ip_cksm_enbl,
-													 ENABLE_FIELD)) {
+													 ENABLE_FIELD) &&
+			!ipa_nati_is_rule_pending(tbl_ptr, new_entry)) {
 		sw_rule->prev_index = 0;
 		IPADBG("Destination Nat New Entry Index %d\n", new_entry);
 		return new_entry;
 	}
 
 	/* First collision */
-	if (Read16BitFieldValue(tbl[new_entry].nxt_indx_pub_port,
-													NEXT_INDEX_FIELD) == IPA_NAT_INVALID_NAT_ENTRY) {
+	if (ipa_nati_get_next_index(tbl_ptr, IPA_NAT_BASE_TBL,
+															new_entry) == IPA_NAT_INVALID_NAT_ENTRY) {
 		sw_rule->prev_index = new_entry;
 	} else { /* check for more than one collision	*/
 		/* Find the IPA_NAT_DEL_TYPE_LAST entry in list */
-		nxt_indx = Read16BitFieldValue(tbl[new_entry].nxt_indx_pub_port,
-																	 NEXT_INDEX_FIELD);
+		nxt_indx = ipa_nati_get_next_index(tbl_ptr, IPA_NAT_BASE_TBL, new_entry);
 
 		while (nxt_indx != IPA_NAT_INVALID_NAT_ENTRY) {
 			prev = nxt_indx;
 
 			nxt_indx -= tbl_ptr->table_entries;
-			nxt_indx = Read16BitFieldValue(expn_tbl[nxt_indx].nxt_indx_pub_port,
-																		 NEXT_INDEX_FIELD);
+			nxt_indx = ipa_nati_get_next_index(tbl_ptr, IPA_NAT_EXPN_TBL, nxt_indx);
 
 			/* Handling error case */
 			if (prev == nxt_indx) {
@@ -1197,8 +1925,7 @@ uint16_t ipa_nati_generate_tbl_rule(const ipa_nat_ipv4_rule *clnt_rule,
 	}
 
 	/* On collision check for the free entry in expansion table */
-	new_entry = ipa_nati_expn_tbl_free_entry(expn_tbl,
-					tbl_ptr->expn_table_entries);
+	new_entry = ipa_nati_expn_tbl_free_entry(tbl_ptr);
 
 	if (IPA_NAT_INVALID_NAT_ENTRY == new_entry) {
 		/* Expansion table is full return*/
@@ -1214,34 +1941,33 @@ uint16_t ipa_nati_generate_tbl_rule(const ipa_nat_ipv4_rule *clnt_rule,
 }
 
 /* returns expn table entry index */
-uint16_t ipa_nati_expn_tbl_free_entry(struct ipa_nat_rule *expn_tbl,
-						uint16_t size)
+uint16_t ipa_nati_expn_tbl_free_entry(struct ipa_nat_ip4_table_cache *tbl_ptr)
 {
-	int cnt;
-
-	for (cnt = 1; cnt < size; cnt++) {
-		if (!Read16BitFieldValue(expn_tbl[cnt].ip_cksm_enbl,
-														 ENABLE_FIELD)) {
-			IPADBG("new expansion table entry index %d\n", cnt);
-			return cnt;
-		}
+	uint16_t entry;
+
+	/* Entries are taken once enabled (or queued for enabling)
+		 and released when they are cleared on delete */
+	entry = ipa_nati_map_get_free(tbl_ptr->expn_used_map,
+																&tbl_ptr->expn_free_word,
+																tbl_ptr->expn_table_entries);
+	if (IPA_NAT_INVALID_NAT_ENTRY == entry) {
+		IPAERR("nat expansion table is full\n");
+		return 0;
 	}
 
-	IPAERR("nat expansion table is full\n");
-	return 0;
+	IPADBG("new expansion table entry index %d\n", entry);
+	return entry;
 }
 
 uint16_t ipa_nati_generate_index_rule(const ipa_nat_ipv4_rule *clnt_rule,
 						struct ipa_nat_indx_tbl_sw_rule *sw_rule,
 						struct ipa_nat_ip4_table_cache *tbl_ptr)
 {
-	struct ipa_nat_indx_tbl_rule *indx_tbl, *indx_expn_tbl;
+	struct ipa_nat_indx_tbl_rule *indx_tbl;
 	uint16_t prev = 0, nxt_indx = 0, new_entry;
 
 	indx_tbl =
 	(struct ipa_nat_indx_tbl_rule *)tbl_ptr->index_table_addr;
-	indx_expn_tbl =
-	(struct ipa_nat_indx_tbl_rule *)tbl_ptr->index_table_expn_addr;
 
 	new_entry = src_hash(clnt_rule->private_ip,
 											 clnt_rule->private_port,
@@ -1260,21 +1986,19 @@ uint16_t ipa_nati_generate_index_rule(const ipa_nat_ipv4_rule *clnt_rule,
 	}
 
 	/* check for more than one collision	*/
-	if (Read16BitFieldValue(indx_tbl[new_entry].tbl_entry_nxt_indx,
-													INDX_TBL_NEXT_INDEX_FILED) == IPA_NAT_INVALID_NAT_ENTRY) {
+	if (ipa_nati_get_next_index(tbl_ptr, IPA_NAT_INDX_TBL,
+															new_entry) == IPA_NAT_INVALID_NAT_ENTRY) {
 		sw_rule->prev_index = new_entry;
 		IPADBG("First collosion. Entry %d\n", new_entry);
 	} else {
 		/* Find the IPA_NAT_DEL_TYPE_LAST entry in list */
-		nxt_indx = Read16BitFieldValue(indx_tbl[new_entry].tbl_entry_nxt_indx,
-																	 INDX_TBL_NEXT_INDEX_FILED);
+		nxt_indx = ipa_nati_get_next_index(tbl_ptr, IPA_NAT_INDX_TBL, new_entry);
 
 		while (nxt_indx != IPA_NAT_INVALID_NAT_ENTRY) {
 			prev = nxt_indx;
 
 			nxt_indx -= tbl_ptr->table_entries;
-			nxt_indx = Read16BitFieldValue(indx_expn_tbl[nxt_indx].tbl_entry_nxt_indx,
-																		 INDX_TBL_NEXT_INDEX_FILED);
+			nxt_indx = ipa_nati_get_next_index(tbl_ptr, IPA_NAT_INDEX_EXPN_TBL, nxt_indx);
 
 			/* Handling error case */
 			if (prev == nxt_indx) {
@@ -1287,8 +2011,7 @@ uint16_t ipa_nati_generate_index_rule(const ipa_nat_ipv4_rule *clnt_rule,
 	}
 
 	/* On collision check for the free entry in expansion table */
-	new_entry = ipa_nati_index_expn_get_free_entry(indx_expn_tbl,
-					tbl_ptr->expn_table_entries);
+	new_entry = ipa_nati_index_expn_get_free_entry(tbl_ptr);
 
 	if (IPA_NAT_INVALID_NAT_ENTRY == new_entry) {
 		/* Expansion table is full return*/
@@ -1313,19 +2036,20 @@ uint16_t ipa_nati_generate_index_rule(const ipa_nat_ipv4_rule *clnt_rule,
 
 /* returns index expn table entry index */
 uint16_t ipa_nati_index_expn_get_free_entry(
-						struct ipa_nat_indx_tbl_rule *indx_tbl,
-						uint16_t size)
+						struct ipa_nat_ip4_table_cache *tbl_ptr)
 {
-	int cnt;
-	for (cnt = 1; cnt < size; cnt++) {
-		if (!Read16BitFieldValue(indx_tbl[cnt].tbl_entry_nxt_indx,
-														 INDX_TBL_TBL_ENTRY_FIELD)) {
-			return cnt;
-		}
+	uint16_t entry;
+
+	/* Entries are taken once written and released when cleared */
+	entry = ipa_nati_map_get_free(tbl_ptr->indx_expn_used_map,
+																&tbl_ptr->indx_expn_free_word,
+																tbl_ptr->expn_table_entries);
+	if (IPA_NAT_INVALID_NAT_ENTRY == entry) {
+		IPAERR("nat index expansion table is full\n");
+		return 0;
 	}
 
-	IPAERR("nat index expansion table is full\n");
-	return 0;
+	return entry;
 }
 
 void ipa_nati_write_next_index(uint8_t tbl_indx,
@@ -1338,6 +2062,12 @@ void ipa_nati_write_next_index(uint8_t tbl_indx,
 	IPADBG("Updating next index field of table %d on collosion using dma\n", tbl_type);
 	IPADBG("table index: %d, value: %d offset;%d\n", tbl_indx, value, offset);
 
+	if (NULL != ipv4_nat_cache.ip4_tbl[tbl_indx].dma_batch) {
+		ipa_nati_queue_dma(&ipv4_nat_cache.ip4_tbl[tbl_indx],
+											 tbl_indx, tbl_type, offset, value);
+		return;
+	}
+
 	cmd = (struct ipa_ioc_nat_dma_cmd *)
 	malloc(sizeof(struct ipa_ioc_nat_dma_cmd)+
 				 sizeof(struct ipa_ioc_nat_dma_one));
@@ -1352,7 +2082,7 @@ void ipa_nati_write_next_index(uint8_t tbl_indx,
 	cmd->dma[0].offset = offset;
 
 	cmd->entries = 1;
-	if (ioctl(ipv4_nat_cache.ipa_fd, IPA_IOC_NAT_DMA, cmd)) {
+	if (nat_ops->ioctl_dev(ipv4_nat_cache.ipa_fd, IPA_IOC_NAT_DMA, cmd)) {
 		perror("ipa_nati_post_ipv4_dma_cmd(): ioctl error value");
 		IPAERR("unable to call dma icotl to update next index\n");
 		IPAERR("ipa fd %d\n", ipv4_nat_cache.ipa_fd);
@@ -1420,7 +2150,7 @@ void ipa_nati_copy_ipv4_index_rule_to_hw(
 	struct ipa_nat_sw_indx_tbl_rule sw_rule;
 	uint16_t prev_entry = indx_sw_rule->prev_index;
 	nat_table_type tbl_type;
-	uint16_t offset = 0;
+	uint32_t offset = 0;
 
 	sw_rule.next_index = indx_sw_rule->next_index;
 	sw_rule.tbl_entry = indx_sw_rule->tbl_entry;
@@ -1437,6 +2167,9 @@ void ipa_nati_copy_ipv4_index_rule_to_hw(
 		memcpy(&tbl_ptr[entry - ipv4_cache->table_entries],
 					 &sw_rule,
 					 sizeof(struct ipa_nat_indx_tbl_rule));
+		ipa_nati_map_update(ipv4_cache->indx_expn_used_map,
+					 &ipv4_cache->indx_expn_free_word,
+					 entry - ipv4_cache->table_entries, 1);
 	}
 
 	/* Update the next field of previous entry on collosion */
@@ -1465,10 +2198,20 @@ int ipa_nati_post_ipv4_dma_cmd(uint8_t tbl_indx,
 				uint16_t entry)
 {
 	struct ipa_ioc_nat_dma_cmd *cmd;
-	struct ipa_nat_rule *tbl_ptr;
-	uint32_t offset = ipv4_nat_cache.ip4_tbl[tbl_indx].tbl_addr_offset;
+	struct ipa_nat_ip4_table_cache *cache_ptr = &ipv4_nat_cache.ip4_tbl[tbl_indx];
+	nat_table_type tbl_type;
+	uint32_t offset;
 	int ret = 0;
 
+	offset = ipa_nati_get_enable_offset(cache_ptr, entry, &tbl_type);
+
+	/* Bulk add, the rule gets enabled when the batch is posted */
+	if (NULL != cache_ptr->dma_batch) {
+		ret = ipa_nati_queue_dma(cache_ptr, tbl_indx, tbl_type,
+														 offset, IPA_NAT_FLAG_ENABLE_BIT_MASK);
+		goto mark_used;
+	}
+
 	cmd = (struct ipa_ioc_nat_dma_cmd *)
 	malloc(sizeof(struct ipa_ioc_nat_dma_cmd)+
 				 sizeof(struct ipa_ioc_nat_dma_one));
@@ -1477,32 +2220,13 @@ int ipa_nati_post_ipv4_dma_cmd(uint8_t tbl_indx,
 		return -ENOMEM;
 	}
 
-	if (entry < ipv4_nat_cache.ip4_tbl[tbl_indx].table_entries) {
-		tbl_ptr =
-			 (struct ipa_nat_rule *)ipv4_nat_cache.ip4_tbl[tbl_indx].ipv4_rules_addr;
-
-		cmd->dma[0].table_index = tbl_indx;
-		cmd->dma[0].base_addr = IPA_NAT_BASE_TBL;
-		cmd->dma[0].data = IPA_NAT_FLAG_ENABLE_BIT_MASK;
-
-		cmd->dma[0].offset = (char *)&tbl_ptr[entry] - (char *)tbl_ptr;
-		cmd->dma[0].offset += IPA_NAT_RULE_FLAG_FIELD_OFFSET;
-	} else {
-		tbl_ptr =
-			 (struct ipa_nat_rule *)ipv4_nat_cache.ip4_tbl[tbl_indx].ipv4_expn_rules_addr;
-		entry = entry - ipv4_nat_cache.ip4_tbl[tbl_indx].table_entries;
-
-		cmd->dma[0].table_index = tbl_indx;
-		cmd->dma[0].base_addr = IPA_NAT_EXPN_TBL;
-		cmd->dma[0].data = IPA_NAT_FLAG_ENABLE_BIT_MASK;
-
-		cmd->dma[0].offset = (char *)&tbl_ptr[entry] - (char *)tbl_ptr;
-		cmd->dma[0].offset += IPA_NAT_RULE_FLAG_FIELD_OFFSET;
-		cmd->dma[0].offset += offset;
-	}
+	cmd->dma[0].table_index = tbl_indx;
+	cmd->dma[0].base_addr = tbl_type;
+	cmd->dma[0].data = IPA_NAT_FLAG_ENABLE_BIT_MASK;
+	cmd->dma[0].offset = offset;
 
 	cmd->entries = 1;
-	if (ioctl(ipv4_nat_cache.ipa_fd, IPA_IOC_NAT_DMA, cmd)) {
+	if (nat_ops->ioctl_dev(ipv4_nat_cache.ipa_fd, IPA_IOC_NAT_DMA, cmd)) {
 		perror("ipa_nati_post_ipv4_dma_cmd(): ioctl error value");
 		IPAERR("unable to call dma icotl\n");
 		IPADBG("ipa fd %d\n", ipv4_nat_cache.ipa_fd);
@@ -1515,6 +2239,181 @@ int ipa_nati_post_ipv4_dma_cmd(uint8_t tbl_indx,
 fail:
 	free(cmd);
 
+mark_used:
+	if (0 == ret && IPA_NAT_EXPN_TBL == tbl_type) {
+		ipa_nati_map_update(cache_ptr->expn_used_map,
+				&cache_ptr->expn_free_word,
+				entry - cache_ptr->table_entries, 1);
+	}
+
+	return ret;
+}
+
+/**
+ * ipa_nati_undo_add() - release a rule that never got enabled
+ * @cache_ptr: [in] nat table cache
+ * @tbl_indx: [in] nat table index
+ * @rule_hdl: [in] handle of the rule
+ *
+ * Clears the rule and its index table entry written by the
+ * bulk add, along with their expansion entries. The links to
+ * them were only queued, so nothing else points to them
+ *
+ * Returns: None
+ */
+static void ipa_nati_undo_add(struct ipa_nat_ip4_table_cache *cache_ptr,
+				uint8_t tbl_indx,
+				uint32_t rule_hdl)
+{
+	struct ipa_nat_rule *tbl_ptr;
+	struct ipa_nat_indx_tbl_rule *indx_tbl_ptr;
+	uint16_t tbl_entry, indx_tbl_entry;
+	uint8_t expn_tbl;
+
+	ipa_nati_parse_ipv4_rule_hdl(tbl_indx, (uint16_t)rule_hdl,
+															 &expn_tbl, &tbl_entry);
+	if (IPA_NAT_INVALID_NAT_ENTRY == tbl_entry)
+		return;
+
+	if (expn_tbl) {
+		tbl_ptr = (struct ipa_nat_rule *)cache_ptr->ipv4_expn_rules_addr;
+		cache_ptr->cur_expn_tbl_cnt--;
+	} else {
+		tbl_ptr = (struct ipa_nat_rule *)cache_ptr->ipv4_rules_addr;
+		cache_ptr->cur_tbl_cnt--;
+	}
+
+	indx_tbl_entry =
+		Read16BitFieldValue(tbl_ptr[tbl_entry].sw_spec_params,
+			SW_SPEC_PARAM_INDX_TBL_ENTRY_FIELD);
+	if (indx_tbl_entry >= cache_ptr->table_entries) {
+		indx_tbl_entry -= cache_ptr->table_entries;
+		indx_tbl_ptr =
+			 (struct ipa_nat_indx_tbl_rule *)cache_ptr->index_table_expn_addr;
+		cache_ptr->index_expn_table_meta[indx_tbl_entry].prev_index =
+			 IPA_NAT_INVALID_NAT_ENTRY;
+	} else {
+		indx_tbl_ptr =
+			 (struct ipa_nat_indx_tbl_rule *)cache_ptr->index_table_addr;
+	}
+
+	ipa_nati_release_mem(cache_ptr, &indx_tbl_ptr[indx_tbl_entry],
+			sizeof(struct ipa_nat_indx_tbl_rule));
+	ipa_nati_release_mem(cache_ptr, &tbl_ptr[tbl_entry],
+			sizeof(struct ipa_nat_rule));
+
+	cache_ptr->rule_id_array[rule_hdl - 1] = IPA_NAT_INVALID_NAT_ENTRY;
+}
+
+/**
+ * ipa_nati_post_add_batch() - post the queued bulk add command
+ * @tbl_indx: [in] nat table index
+ * @rule_hdls: [in/out] handles of the rules in the command
+ * @num_rules: [in] number of handles
+ *
+ * On failure none of the rules got enabled, their table and
+ * index table entries are released and the handles are reset
+ * to IPA_NAT_INVALID_NAT_ENTRY
+ *
+ * Returns: 0 On Success, negative on failure
+ */
+static int ipa_nati_post_add_batch(uint8_t tbl_indx,
+				uint32_t *rule_hdls,
+				uint16_t num_rules)
+{
+	struct ipa_nat_ip4_table_cache *cache_ptr = &ipv4_nat_cache.ip4_tbl[tbl_indx];
+	struct ipa_ioc_nat_dma_cmd *cmd = cache_ptr->dma_batch;
+	int cnt, ret = 0;
+
+	if (0 == cmd->entries)
+		return 0;
+
+	if (nat_ops->ioctl_dev(ipv4_nat_cache.ipa_fd, IPA_IOC_NAT_DMA, cmd)) {
+		perror("ipa_nati_post_add_batch(): ioctl error value");
+		IPAERR("unable to post bulk dma command with %d entries\n", cmd->entries);
+		IPADBG("ipa fd %d\n", ipv4_nat_cache.ipa_fd);
+		ret = -EIO;
+
+		for (cnt = 0; cnt < num_rules; cnt++) {
+			if (IPA_NAT_INVALID_NAT_ENTRY == rule_hdls[cnt])
+				continue;
+
+			ipa_nati_undo_add(cache_ptr, tbl_indx, rule_hdls[cnt]);
+			rule_hdls[cnt] = IPA_NAT_INVALID_NAT_ENTRY;
+		}
+	} else {
+		IPADBG("posted bulk IPA_IOC_NAT_DMA with %d entries\n", cmd->entries);
+	}
+
+	cmd->entries = 0;
+	return ret;
+}
+
+int ipa_nati_add_ipv4_rules(uint32_t tbl_hdl,
+				const ipa_nat_ipv4_rule *clnt_rules,
+				uint16_t num_rules,
+				uint32_t *rule_hdls)
+{
+	struct ipa_nat_ip4_table_cache *cache_ptr;
+	uint8_t tbl_indx = (uint8_t)(tbl_hdl - 1);
+	uint16_t cnt, first = 0;
+	int ret = 0;
+
+	/* rules that are never added keep an invalid handle */
+	memset(rule_hdls, 0, num_rules * sizeof(uint32_t));
+
+	/* Held for the whole batch, so no other add or delete queues
+		 into it or is rolled back with it */
+	if (pthread_mutex_lock(&nat_mutex) != 0) {
+		IPAERR("unable to lock the nat mutex\n");
+		return -1;
+	}
+
+	cache_ptr = &ipv4_nat_cache.ip4_tbl[tbl_indx];
+	if (!cache_ptr->valid) {
+		IPAERR("invalid table handle\n");
+		ret = -EINVAL;
+		goto unlock;
+	}
+
+	cache_ptr->dma_batch = (struct ipa_ioc_nat_dma_cmd *)
+	malloc(sizeof(struct ipa_ioc_nat_dma_cmd)+
+				 (IPA_NAT_MAX_DMA_ENTRIES * sizeof(struct ipa_ioc_nat_dma_one)));
+	if (NULL == cache_ptr->dma_batch) {
+		IPAERR("unable to allocate memory\n");
+		ret = -ENOMEM;
+		goto unlock;
+	}
+	cache_ptr->dma_batch->entries = 0;
+
+	for (cnt = 0; cnt < num_rules; cnt++) {
+		/* post what is queued when next rule may not fit */
+		if (cache_ptr->dma_batch->entries + IPA_NAT_MAX_ADD_DMA_ENTRIES >
+				IPA_NAT_MAX_DMA_ENTRIES) {
+			if (ipa_nati_post_add_batch(tbl_indx, &rule_hdls[first], cnt - first))
+				ret = -EIO;
+			first = cnt;
+		}
+
+		if (ipa_nati_add_one_ipv4_rule(tbl_hdl, &clnt_rules[cnt], &rule_hdls[cnt])) {
+			IPAERR("unable to add rule %d of %d\n", cnt, num_rules);
+			rule_hdls[cnt] = IPA_NAT_INVALID_NAT_ENTRY;
+			ret = -EINVAL;
+		}
+	}
+
+	if (ipa_nati_post_add_batch(tbl_indx, &rule_hdls[first], cnt - first))
+		ret = -EIO;
+
+	free(cache_ptr->dma_batch);
+	cache_ptr->dma_batch = NULL;
+
+unlock:
+	if (pthread_mutex_unlock(&nat_mutex) != 0) {
+		IPAERR("unable to unlock the nat mutex\n");
+		return -1;
+	}
+
 	return ret;
 }
 
@@ -1596,6 +2495,158 @@ fail:
 	return ret;
 }
 
+/**
+ * ipa_nati_post_del_batch() - post the queued bulk delete command
+ * @tbl_indx: [in] nat table index
+ *
+ * Once the rules are unlinked in hardware, the memory held back
+ * by ipa_nati_reset_mem() is cleared, which also releases the
+ * expansion entries. On failure the hardware still has all the
+ * rules of the command, the memory is left as is and the values
+ * saved by ipa_nati_save_sw() are put back, rule handles included
+ *
+ * Returns: 0 On Success, negative on failure
+ */
+static int ipa_nati_post_del_batch(uint8_t tbl_indx)
+{
+	struct ipa_nat_ip4_table_cache *cache_ptr = &ipv4_nat_cache.ip4_tbl[tbl_indx];
+	struct ipa_ioc_nat_dma_cmd *cmd = cache_ptr->dma_batch;
+	int cnt, ret = 0;
+
+	if (0 == cmd->entries)
+		return 0;
+
+	if (nat_ops->ioctl_dev(ipv4_nat_cache.ipa_fd, IPA_IOC_NAT_DMA, cmd)) {
+		perror("ipa_nati_post_del_batch(): ioctl error value");
+		IPAERR("unable to post bulk dma command with %d entries\n", cmd->entries);
+		IPADBG("ipa fd %d\n", ipv4_nat_cache.ipa_fd);
+		ipa_nati_restore_sw(cache_ptr);
+		ret = -EIO;
+	} else {
+		for (cnt = 0; cnt < cache_ptr->mem_reset_cnt; cnt++) {
+			ipa_nati_release_mem(cache_ptr, cache_ptr->mem_resets[cnt].addr,
+						 cache_ptr->mem_resets[cnt].size);
+		}
+	}
+
+	cmd->entries = 0;
+	cache_ptr->mem_reset_cnt = 0;
+	cache_ptr->sw_undo_cnt = 0;
+
+	return ret;
+}
+
+int ipa_nati_del_ipv4_rules(uint32_t tbl_hdl,
+				uint32_t *rule_hdls,
+				uint16_t num_rules)
+{
+	struct ipa_nat_ip4_table_cache *cache_ptr;
+	uint8_t tbl_indx = (uint8_t)(tbl_hdl - 1);
+	uint8_t expn_tbl;
+	uint16_t tbl_entry, cnt;
+	del_type rule_pos;
+	int ret = 0;
+
+	if (pthread_mutex_lock(&nat_mutex) != 0) {
+		IPAERR("unable to lock the nat mutex\n");
+		return -1;
+	}
+
+	cache_ptr = &ipv4_nat_cache.ip4_tbl[tbl_indx];
+	if (!cache_ptr->valid) {
+		IPAERR("invalid table handle\n");
+		ret = -EINVAL;
+		goto unlock;
+	}
+
+	cache_ptr->dma_batch = (struct ipa_ioc_nat_dma_cmd *)
+	malloc(sizeof(struct ipa_ioc_nat_dma_cmd)+
+				 (IPA_NAT_MAX_DMA_ENTRIES * sizeof(struct ipa_ioc_nat_dma_one)));
+	/* a rule never needs more resets than dma entries */
+	cache_ptr->mem_resets = (struct ipa_nat_mem_reset *)
+	malloc(IPA_NAT_MAX_DMA_ENTRIES * sizeof(struct ipa_nat_mem_reset));
+	/* a rule queues at least two dma entries and saves at most five values */
+	cache_ptr->sw_undo = (struct ipa_nat_sw_undo *)
+	malloc(IPA_NAT_MAX_DMA_ENTRIES * 3 * sizeof(struct ipa_nat_sw_undo));
+	if (NULL == cache_ptr->dma_batch || NULL == cache_ptr->mem_resets ||
+			NULL == cache_ptr->sw_undo) {
+		IPAERR("unable to allocate memory\n");
+		ret = -ENOMEM;
+		goto free_batch;
+	}
+	cache_ptr->dma_batch->entries = 0;
+	cache_ptr->mem_reset_cnt = 0;
+	cache_ptr->sw_undo_cnt = 0;
+
+	for (cnt = 0; cnt < num_rules; cnt++) {
+		/* post what is queued when next rule may not fit */
+		if (cache_ptr->dma_batch->entries + IPA_NAT_MAX_DEL_DMA_ENTRIES >
+				IPA_NAT_MAX_DMA_ENTRIES) {
+			if (ipa_nati_post_del_batch(tbl_indx))
+				ret = -EIO;
+		}
+
+		if (IPA_NAT_INVALID_NAT_ENTRY == rule_hdls[cnt]) {
+			IPAERR("Invalid Rule handle at %d\n", cnt);
+			ret = -EINVAL;
+			continue;
+		}
+
+		ipa_nati_parse_ipv4_rule_hdl(tbl_indx, (uint16_t)rule_hdls[cnt],
+																 &expn_tbl, &tbl_entry);
+		if (IPA_NAT_INVALID_NAT_ENTRY == tbl_entry) {
+			IPAERR("Invalid Rule Entry at %d\n", cnt);
+			ret = -EINVAL;
+			continue;
+		}
+
+		IPADBG("tbl_entry:%d expn_tbl:%d\n", tbl_entry, expn_tbl);
+		ipa_nati_find_rule_pos(cache_ptr, expn_tbl, tbl_entry, &rule_pos);
+		IPADBG("rule_pos:%d\n", rule_pos);
+
+		if (ipa_nati_post_del_dma_cmd(tbl_indx, tbl_entry,
+						expn_tbl, rule_pos)) {
+			ret = -EINVAL;
+			continue;
+		}
+
+		/* Reset rule_id_array entry, both come back if the dma fails */
+		ipa_nati_save_sw(cache_ptr, NULL,
+				&cache_ptr->rule_id_array[rule_hdls[cnt]-1], sizeof(uint16_t));
+		ipa_nati_save_sw(cache_ptr, NULL, &rule_hdls[cnt], sizeof(uint32_t));
+		cache_ptr->rule_id_array[rule_hdls[cnt]-1] = IPA_NAT_INVALID_NAT_ENTRY;
+		rule_hdls[cnt] = IPA_NAT_INVALID_NAT_ENTRY;
+	}
+
+	if (ipa_nati_post_del_batch(tbl_indx))
+		ret = -EIO;
+
+	ipa_nati_del_dead_ipv4_head_nodes(tbl_indx);
+
+#ifdef NAT_DUMP
+	IPADBG("Dumping Table after deleting rules\n");
+	ipa_nat_dump_ipv4_table(tbl_hdl);
+#endif
+
+free_batch:
+	free(cache_ptr->dma_batch);
+	cache_ptr->dma_batch = NULL;
+	free(cache_ptr->mem_resets);
+	cache_ptr->mem_resets = NULL;
+	cache_ptr->mem_reset_cnt = 0;
+	free(cache_ptr->sw_undo);
+	cache_ptr->sw_undo = NULL;
+	cache_ptr->sw_undo_cnt = 0;
+
+unlock:
+	if (pthread_mutex_unlock(&nat_mutex) != 0) {
+		IPAERR("unable to unlock the nat mutex\n");
+		return -1;
+	}
+
+	return ret;
+}
+
 void ReorderCmds(struct ipa_ioc_nat_dma_cmd *cmd, int size)
 {
 	int indx_tbl_start = 0, cnt, cnt1;
@@ -1646,9 +2697,6 @@ int ipa_nati_post_del_dma_cmd(uint8_t tbl_indx,
 				uint8_t expn_tbl,
 				del_type rule_pos)
 {
-
-#define MAX_DMA_ENTRIES_FOR_DEL 3
-
 	struct ipa_nat_ip4_table_cache *cache_ptr;
 	struct ipa_nat_indx_tbl_rule *indx_tbl_ptr;
 	struct ipa_nat_rule *tbl_ptr;
@@ -1664,10 +2712,11 @@ int ipa_nati_post_del_dma_cmd(uint8_t tbl_indx,
 	uint16_t next_entry = IPA_NAT_INVALID_NAT_ENTRY;
 	uint16_t indx_next_entry = IPA_NAT_INVALID_NAT_ENTRY;
 	uint16_t indx_next_next_entry = IPA_NAT_INVALID_NAT_ENTRY;
-	uint16_t table_entry;
+	uint16_t table_entry = IPA_NAT_INVALID_NAT_ENTRY;
+	int cnt;
 
 	size = sizeof(struct ipa_ioc_nat_dma_cmd)+
-	(MAX_DMA_ENTRIES_FOR_DEL * sizeof(struct ipa_ioc_nat_dma_one));
+	(IPA_NAT_MAX_DEL_DMA_ENTRIES * sizeof(struct ipa_ioc_nat_dma_one));
 
 	cmd = (struct ipa_ioc_nat_dma_cmd *)malloc(size);
 	if (NULL == cmd) {
@@ -1736,8 +2785,7 @@ int ipa_nati_post_del_dma_cmd(uint8_t tbl_indx,
 
 		cmd->dma[no_of_cmds].table_index = tbl_indx;
 		cmd->dma[no_of_cmds].data =
-			Read16BitFieldValue(tbl_ptr[cur_tbl_entry].nxt_indx_pub_port,
-					NEXT_INDEX_FIELD);
+			ipa_nati_get_next_index(cache_ptr, IPA_NAT_EXPN_TBL, cur_tbl_entry);
 
 		cmd->dma[no_of_cmds].base_addr = IPA_NAT_BASE_TBL;
 		if (prev_entry >= cache_ptr->table_entries) {
@@ -1816,8 +2864,7 @@ int ipa_nati_post_del_dma_cmd(uint8_t tbl_indx,
 	/* copy the next entry values to current entry */
 	else if (IPA_NAT_DEL_TYPE_HEAD == indx_rule_pos) {
 		next_entry =
-			Read16BitFieldValue(indx_tbl_ptr[indx_tbl_entry].tbl_entry_nxt_indx,
-				INDX_TBL_NEXT_INDEX_FILED);
+			ipa_nati_get_next_index(cache_ptr, IPA_NAT_INDX_TBL, indx_tbl_entry);
 
 		next_entry -= cache_ptr->table_entries;
 
@@ -1828,9 +2875,10 @@ int ipa_nati_post_del_dma_cmd(uint8_t tbl_indx,
 		/* Copy the nat_table_index field value of next entry */
 		indx_tbl_ptr =
 			 (struct ipa_nat_indx_tbl_rule *)cache_ptr->index_table_expn_addr;
-		cmd->dma[no_of_cmds].data =
+		table_entry =
 			Read16BitFieldValue(indx_tbl_ptr[next_entry].tbl_entry_nxt_indx,
 				INDX_TBL_TBL_ENTRY_FIELD);
+		cmd->dma[no_of_cmds].data = table_entry;
 
 		cmd->dma[no_of_cmds].offset =
 			ipa_nati_get_index_entry_offset(cache_ptr,
@@ -1845,8 +2893,7 @@ int ipa_nati_post_del_dma_cmd(uint8_t tbl_indx,
 		cmd->dma[no_of_cmds].base_addr = IPA_NAT_INDX_TBL;
 		cmd->dma[no_of_cmds].table_index = tbl_indx;
 		cmd->dma[no_of_cmds].data =
-			Read16BitFieldValue(indx_tbl_ptr[next_entry].tbl_entry_nxt_indx,
-				INDX_TBL_NEXT_INDEX_FILED);
+			ipa_nati_get_next_index(cache_ptr, IPA_NAT_INDEX_EXPN_TBL, next_entry);
 
 		cmd->dma[no_of_cmds].offset =
 			ipa_nati_get_index_entry_offset(cache_ptr,
@@ -1867,8 +2914,7 @@ int ipa_nati_post_del_dma_cmd(uint8_t tbl_indx,
 		no_of_cmds++;
 		cmd->dma[no_of_cmds].table_index = tbl_indx;
 		cmd->dma[no_of_cmds].data =
-			Read16BitFieldValue(indx_tbl_ptr[indx_tbl_entry].tbl_entry_nxt_indx,
-				INDX_TBL_NEXT_INDEX_FILED);
+			ipa_nati_get_next_index(cache_ptr, IPA_NAT_INDEX_EXPN_TBL, indx_tbl_entry);
 
 		cmd->dma[no_of_cmds].base_addr = IPA_NAT_INDX_TBL;
 		if (prev_entry >= cache_ptr->table_entries) {
@@ -1923,7 +2969,18 @@ int ipa_nati_post_del_dma_cmd(uint8_t tbl_indx,
 	if (cmd->entries > 1) {
 		ReorderCmds(cmd, size);
 	}
-	if (ioctl(ipv4_nat_cache.ipa_fd, IPA_IOC_NAT_DMA, cmd)) {
+
+	/* Bulk delete, keep the order and post along with other rules */
+	if (NULL != cache_ptr->dma_batch) {
+		for (cnt = 0; cnt < cmd->entries; cnt++) {
+			ret = ipa_nati_queue_dma(cache_ptr, tbl_indx,
+					cmd->dma[cnt].base_addr,
+					cmd->dma[cnt].offset,
+					cmd->dma[cnt].data);
+			if (ret)
+				goto fail;
+		}
+	} else if (nat_ops->ioctl_dev(ipv4_nat_cache.ipa_fd, IPA_IOC_NAT_DMA, cmd)) {
 		perror("ipa_nati_post_del_dma_cmd(): ioctl error value");
 		IPAERR("unable to post cmd\n");
 		IPADBG("ipa fd %d\n", ipv4_nat_cache.ipa_fd);
@@ -1942,13 +2999,13 @@ int ipa_nati_post_del_dma_cmd(uint8_t tbl_indx,
 
 		/* Retrieve the next entry */
 		next_entry =
-			Read16BitFieldValue(tbl_ptr[cur_tbl_entry].nxt_indx_pub_port,
-				NEXT_INDEX_FIELD);
+			ipa_nati_get_next_index(cache_ptr, IPA_NAT_EXPN_TBL, cur_tbl_entry);
 
 		next_entry -= cache_ptr->table_entries;
 		tbl_ptr = (struct ipa_nat_rule *)cache_ptr->ipv4_expn_rules_addr;
 
 		/* copy the current entry prev_entry value to next entry*/
+		ipa_nati_save_sw(cache_ptr, &tbl_ptr[next_entry], NULL, 0);
 		UpdateSwSpecParams(&tbl_ptr[next_entry],
 											 IPA_NAT_SW_PARAM_PREV_INDX_BYTE,
 											 prev_entry);
@@ -1957,7 +3014,8 @@ int ipa_nati_post_del_dma_cmd(uint8_t tbl_indx,
 	/* Reset the other field values of current delete entry
 			 In case of IPA_NAT_DEL_TYPE_HEAD, don't reset */
 	if (IPA_NAT_DEL_TYPE_HEAD != rule_pos) {
-		memset(&tbl_ptr[cur_tbl_entry], 0, sizeof(struct ipa_nat_rule));
+		ipa_nati_reset_mem(cache_ptr, &tbl_ptr[cur_tbl_entry],
+				sizeof(struct ipa_nat_rule));
 	}
 
 	if (indx_rule_pos == IPA_NAT_DEL_TYPE_HEAD) {
@@ -1966,8 +3024,8 @@ int ipa_nati_post_del_dma_cmd(uint8_t tbl_indx,
        entry as we moved the next entry values
        to current entry */
 		indx_next_next_entry =
-			Read16BitFieldValue(indx_tbl_ptr[indx_next_entry].tbl_entry_nxt_indx,
-				INDX_TBL_NEXT_INDEX_FILED);
+			ipa_nati_get_next_index(cache_ptr, IPA_NAT_INDEX_EXPN_TBL,
+				indx_next_entry);
 
 		if (indx_next_next_entry != 0 &&
 			indx_next_next_entry >= cache_ptr->table_entries) {
@@ -1977,6 +3035,9 @@ int ipa_nati_post_del_dma_cmd(uint8_t tbl_indx,
 
 			IPADBG("Updating entry: %d prev index to: %d\n",
 				indx_next_next_entry, indx_tbl_entry);
+			ipa_nati_save_sw(cache_ptr, NULL,
+				 &cache_ptr->index_expn_table_meta[indx_next_next_entry].prev_index,
+				 sizeof(uint16_t));
 			cache_ptr->index_expn_table_meta[indx_next_next_entry].prev_index =
 				 indx_tbl_entry;
 		}
@@ -1987,18 +3048,14 @@ int ipa_nati_post_del_dma_cmd(uint8_t tbl_indx,
 			(cache_ptr->table_entries + indx_next_entry));
 
     /* This resets both table entry and next index values */
-		indx_tbl_ptr[indx_next_entry].tbl_entry_nxt_indx = 0;
+		ipa_nati_reset_mem(cache_ptr, &indx_tbl_ptr[indx_next_entry],
+				sizeof(struct ipa_nat_indx_tbl_rule));
 
 		/*
 				 In case of IPA_NAT_DEL_TYPE_HEAD, update the sw specific parameters
-				 (index table entry) of base table entry
+				 (index table entry) of base table entry, table_entry holds the
+				 value copied to the head entry
 		*/
-		indx_tbl_ptr =
-			 (struct ipa_nat_indx_tbl_rule *)cache_ptr->index_table_addr;
-		table_entry =
-				Read16BitFieldValue(indx_tbl_ptr[indx_tbl_entry].tbl_entry_nxt_indx,
-						INDX_TBL_TBL_ENTRY_FIELD);
-
 		if (table_entry >= cache_ptr->table_entries) {
 			tbl_ptr = (struct ipa_nat_rule *)cache_ptr->ipv4_expn_rules_addr;
 			table_entry -= cache_ptr->table_entries;
@@ -2006,6 +3063,7 @@ int ipa_nati_post_del_dma_cmd(uint8_t tbl_indx,
 			tbl_ptr = (struct ipa_nat_rule *)cache_ptr->ipv4_rules_addr;
 		}
 
+		ipa_nati_save_sw(cache_ptr, &tbl_ptr[table_entry], NULL, 0);
 		UpdateSwSpecParams(&tbl_ptr[table_entry],
 				IPA_NAT_SW_PARAM_INDX_TBL_ENTRY_BYTE,
 				indx_tbl_entry);
@@ -2015,13 +3073,19 @@ int ipa_nati_post_del_dma_cmd(uint8_t tbl_indx,
 		*/
 		if (IPA_NAT_DEL_TYPE_MIDDLE == indx_rule_pos) {
 			next_entry =
-				Read16BitFieldValue(indx_tbl_ptr[indx_tbl_entry].tbl_entry_nxt_indx,
-					INDX_TBL_NEXT_INDEX_FILED);
+				ipa_nati_get_next_index(cache_ptr, IPA_NAT_INDEX_EXPN_TBL,
+					indx_tbl_entry);
 
 			if (next_entry >= cache_ptr->table_entries) {
 				next_entry -= cache_ptr->table_entries;
 			}
 
+			ipa_nati_save_sw(cache_ptr, NULL,
+				 &cache_ptr->index_expn_table_meta[next_entry].prev_index,
+				 sizeof(uint16_t));
+			ipa_nati_save_sw(cache_ptr, NULL,
+				 &cache_ptr->index_expn_table_meta[indx_tbl_entry].prev_index,
+				 sizeof(uint16_t));
 			cache_ptr->index_expn_table_meta[next_entry].prev_index =
 				 cache_ptr->index_expn_table_meta[indx_tbl_entry].prev_index;
 
@@ -2033,7 +3097,8 @@ int ipa_nati_post_del_dma_cmd(uint8_t tbl_indx,
 		IPADBG("At, indx_tbl_entry member address: %p\n",
 					 &indx_tbl_ptr[indx_tbl_entry].tbl_entry_nxt_indx);
 
-		indx_tbl_ptr[indx_tbl_entry].tbl_entry_nxt_indx = 0;
+		ipa_nati_reset_mem(cache_ptr, &indx_tbl_ptr[indx_tbl_entry],
+				sizeof(struct ipa_nat_indx_tbl_rule));
 
 	}
 
@@ -2048,25 +3113,17 @@ void ipa_nati_find_index_rule_pos(
 				uint16_t tbl_entry,
 				del_type *rule_pos)
 {
-	struct ipa_nat_indx_tbl_rule *tbl_ptr;
-
 	if (tbl_entry >= cache_ptr->table_entries) {
-		tbl_ptr =
-			 (struct ipa_nat_indx_tbl_rule *)cache_ptr->index_table_expn_addr;
-
 		tbl_entry -= cache_ptr->table_entries;
-		if (Read16BitFieldValue(tbl_ptr[tbl_entry].tbl_entry_nxt_indx,
-					INDX_TBL_NEXT_INDEX_FILED) == IPA_NAT_INVALID_NAT_ENTRY) {
+		if (ipa_nati_get_next_index(cache_ptr, IPA_NAT_INDEX_EXPN_TBL,
+					tbl_entry) == IPA_NAT_INVALID_NAT_ENTRY) {
 			*rule_pos = IPA_NAT_DEL_TYPE_LAST;
 		} else {
 			*rule_pos = IPA_NAT_DEL_TYPE_MIDDLE;
 		}
 	} else {
-		tbl_ptr =
-			 (struct ipa_nat_indx_tbl_rule *)cache_ptr->index_table_addr;
-
-		if (Read16BitFieldValue(tbl_ptr[tbl_entry].tbl_entry_nxt_indx,
-					INDX_TBL_NEXT_INDEX_FILED) == IPA_NAT_INVALID_NAT_ENTRY) {
+		if (ipa_nati_get_next_index(cache_ptr, IPA_NAT_INDX_TBL,
+					tbl_entry) == IPA_NAT_INVALID_NAT_ENTRY) {
 			*rule_pos = IPA_NAT_DEL_TYPE_ONLY_ONE;
 		} else {
 			*rule_pos = IPA_NAT_DEL_TYPE_HEAD;
@@ -2079,20 +3136,16 @@ void ipa_nati_find_rule_pos(struct ipa_nat_ip4_table_cache *cache_ptr,
 														uint16_t tbl_entry,
 														del_type *rule_pos)
 {
-	struct ipa_nat_rule *tbl_ptr;
-
 	if (expn_tbl) {
-		tbl_ptr = (struct ipa_nat_rule *)cache_ptr->ipv4_expn_rules_addr;
-		if (Read16BitFieldValue(tbl_ptr[tbl_entry].nxt_indx_pub_port,
-														NEXT_INDEX_FIELD) == IPA_NAT_INVALID_NAT_ENTRY) {
+		if (ipa_nati_get_next_index(cache_ptr, IPA_NAT_EXPN_TBL,
+					tbl_entry) == IPA_NAT_INVALID_NAT_ENTRY) {
 			*rule_pos = IPA_NAT_DEL_TYPE_LAST;
 		} else {
 			*rule_pos = IPA_NAT_DEL_TYPE_MIDDLE;
 		}
 	} else {
-		tbl_ptr = (struct ipa_nat_rule *)cache_ptr->ipv4_rules_addr;
-		if (Read16BitFieldValue(tbl_ptr[tbl_entry].nxt_indx_pub_port,
-					NEXT_INDEX_FIELD) == IPA_NAT_INVALID_NAT_ENTRY) {
+		if (ipa_nati_get_next_index(cache_ptr, IPA_NAT_BASE_TBL,
+					tbl_entry) == IPA_NAT_INVALID_NAT_ENTRY) {
 			*rule_pos = IPA_NAT_DEL_TYPE_ONLY_ONE;
 		} else {
 			*rule_pos = IPA_NAT_DEL_TYPE_HEAD;
@@ -2126,6 +3179,161 @@ void ipa_nati_del_dead_ipv4_head_nodes(uint8_t tbl_indx)
 	return;
 }
 
+/**
+ * ipa_nati_chain_stats() - summarize the chains of one table
+ * @chain_len: [in] rules hashed to each base table entry
+ * @table_entries: [in] base table entries
+ * @stats: [out] chain statistics
+ *
+ * Returns: None
+ */
+static void ipa_nati_chain_stats(const uint16_t *chain_len,
+				uint16_t table_entries,
+				ipa_nat_chain_stats *stats)
+{
+	uint16_t cnt, hist;
+
+	memset(stats, 0, sizeof(ipa_nat_chain_stats));
+	for (cnt = 0; cnt < table_entries; cnt++) {
+		if (0 == chain_len[cnt]) {
+			continue;
+		}
+
+		stats->used_entries++;
+		stats->expn_entries += chain_len[cnt] - 1;
+		if (chain_len[cnt] > stats->max_chain) {
+			stats->max_chain = chain_len[cnt];
+		}
+
+		hist = chain_len[cnt] - 1;
+		if (hist >= IPA_NAT_CHAIN_HIST_LEN) {
+			hist = IPA_NAT_CHAIN_HIST_LEN - 1;
+		}
+		stats->chain_hist[hist]++;
+	}
+}
+
+int ipa_nati_analyze_hash(const ipa_nat_ipv4_rule *clnt_rules,
+				uint16_t num_rules,
+				uint16_t table_entries,
+				uint16_t expn_table_entries,
+				ipa_nat_hash_stats *stats)
+{
+	uint16_t *rule_chain, *index_chain;
+	uint16_t cnt, expn_entries, usable;
+
+	rule_chain = (uint16_t *)calloc(table_entries, sizeof(uint16_t));
+	index_chain = (uint16_t *)calloc(table_entries, sizeof(uint16_t));
+	if (NULL == rule_chain || NULL == index_chain) {
+		IPAERR("Can't allocate memory for chain lengths\n");
+		free(rule_chain);
+		free(index_chain);
+		return -ENOMEM;
+	}
+
+	/* Same hashing as ipa_nati_generate_tbl_rule() and
+		 ipa_nati_generate_index_rule() */
+	for (cnt = 0; cnt < num_rules; cnt++) {
+		rule_chain[dst_hash(clnt_rules[cnt].target_ip,
+												clnt_rules[cnt].target_port,
+												clnt_rules[cnt].public_port,
+												clnt_rules[cnt].protocol,
+												table_entries-1)]++;
+
+		index_chain[src_hash(clnt_rules[cnt].private_ip,
+												 clnt_rules[cnt].private_port,
+												 clnt_rules[cnt].target_ip,
+												 clnt_rules[cnt].target_port,
+												 clnt_rules[cnt].protocol,
+												 table_entries-1)]++;
+	}
+
+	memset(stats, 0, sizeof(ipa_nat_hash_stats));
+	stats->table_entries = table_entries;
+	stats->expn_table_entries = expn_table_entries;
+	ipa_nati_chain_stats(rule_chain, table_entries, &stats->rule_tbl);
+	ipa_nati_chain_stats(index_chain, table_entries, &stats->index_tbl);
+
+	/* Entry 0 of the expansion tables is unused as well */
+	usable = (expn_table_entries > 0) ? (expn_table_entries - 1) : 0;
+	expn_entries = stats->rule_tbl.expn_entries;
+	if (stats->index_tbl.expn_entries > expn_entries) {
+		expn_entries = stats->index_tbl.expn_entries;
+	}
+	if (expn_entries > usable) {
+		stats->expn_overflow = expn_entries - usable;
+	}
+
+	IPADBG("rule table: used %d, expansion %d, max chain %d\n",
+				 stats->rule_tbl.used_entries, stats->rule_tbl.expn_entries,
+				 stats->rule_tbl.max_chain);
+	IPADBG("index table: used %d, expansion %d, max chain %d\n",
+				 stats->index_tbl.used_entries, stats->index_tbl.expn_entries,
+				 stats->index_tbl.max_chain);
+
+	free(rule_chain);
+	free(index_chain);
+	return 0;
+}
+
+int ipa_nati_recommend_tbl_size(const ipa_nat_ipv4_rule *clnt_rules,
+				uint16_t num_rules,
+				uint8_t max_chain,
+				uint16_t *table_entries,
+				uint16_t *expn_table_entries)
+{
+	ipa_nat_hash_stats stats;
+	uint32_t size, best_size = 0;
+	uint16_t base, expn, chain;
+	int ret;
+
+	*table_entries = 0;
+	*expn_table_entries = 0;
+
+	/* Bigger base tables mean shorter chains but every entry
+		 costs memory, keep the cheapest split that meets max_chain */
+	for (size = 2; size <= IPA_NAT_MAX_TBL_ENTRIES; size *= 2) {
+		base = (uint16_t)size;
+		ret = ipa_nati_analyze_hash(clnt_rules, num_rules, base, 0, &stats);
+		if (ret) {
+			return ret;
+		}
+
+		chain = stats.rule_tbl.max_chain;
+		if (stats.index_tbl.max_chain > chain) {
+			chain = stats.index_tbl.max_chain;
+		}
+		if (chain > max_chain) {
+			continue;
+		}
+
+		/* Entry 0 plus the collisions, the larger table decides */
+		expn = stats.rule_tbl.expn_entries;
+		if (stats.index_tbl.expn_entries > expn) {
+			expn = stats.index_tbl.expn_entries;
+		}
+		GetNearestEven(expn + 1, &expn);
+		if (expn > IPA_NAT_MAX_TBL_ENTRIES) {
+			continue;
+		}
+
+		if (0 == best_size || (uint32_t)(base + expn) < best_size) {
+			best_size = base + expn;
+			*table_entries = base;
+			*expn_table_entries = expn;
+		}
+	}
+
+	if (0 == best_size) {
+		IPADBG("no table size keeps chains within %d rules\n", max_chain);
+		return -EINVAL;
+	}
+
+	IPADBG("recommended table entries %d, expansion entries %d\n",
+				 *table_entries, *expn_table_entries);
+	return 0;
+}
+
 
 /* ========================================================
 						Debug functions
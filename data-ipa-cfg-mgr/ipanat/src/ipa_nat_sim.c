@@ -0,0 +1,297 @@
+/*
+Copyright (c) 2016, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of The Linux Foundation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*!
+	@file
+	ipa_nat_sim.c
+
+	@brief
+	Software backend of the nat driver. The tables live in
+	anonymous memory and the dma commands are applied in
+	process, the way the ipa driver applies them to the
+	hardware tables.
+*/
+
+#include "ipa_nat_drv.h"
+#include "ipa_nat_drvi.h"
+
+/* Descriptors handed out by the simulator, never passed to the system */
+#define IPA_NAT_SIM_IPA_FD  0x7ffe
+#define IPA_NAT_SIM_TBL_FD  0x7fff
+
+struct ipa_nat_sim {
+	uint8_t ipa_open;
+	uint8_t tbl_open;
+
+	/* size of the allocated nat memory, 0 if none */
+	size_t mem_size;
+	char *mem;
+	size_t mem_len;
+
+	uint8_t tbl_valid[IPA_NAT_MAX_IP4_TBLS];
+	struct ipa_ioc_v4_nat_init tbl[IPA_NAT_MAX_IP4_TBLS];
+};
+
+static struct ipa_nat_sim nat_sim;
+
+static int ipa_nat_sim_open(const char *name, int flags)
+{
+	(void)flags;
+
+	if (!strcmp(name, IPA_DEV_NAME)) {
+		nat_sim.ipa_open = 1;
+		return IPA_NAT_SIM_IPA_FD;
+	}
+
+	if (!strcmp(name, NAT_DEV_FULL_NAME) && nat_sim.mem_size) {
+		nat_sim.tbl_open = 1;
+		return IPA_NAT_SIM_TBL_FD;
+	}
+
+	errno = ENOENT;
+	return -1;
+}
+
+static int ipa_nat_sim_close(int fd)
+{
+	if (IPA_NAT_SIM_IPA_FD == fd && nat_sim.ipa_open) {
+		nat_sim.ipa_open = 0;
+		return 0;
+	}
+
+	if (IPA_NAT_SIM_TBL_FD == fd && nat_sim.tbl_open) {
+		nat_sim.tbl_open = 0;
+		return 0;
+	}
+
+	errno = EBADF;
+	return -1;
+}
+
+static void *ipa_nat_sim_mmap(void *addr, size_t len, int prot, int flags,
+				int fd, off_t offset)
+{
+	(void)addr;
+	(void)flags;
+
+	if (IPA_NAT_SIM_TBL_FD != fd || !nat_sim.tbl_open ||
+			0 != offset || NULL != nat_sim.mem) {
+		errno = EINVAL;
+		return MAP_FAILED;
+	}
+
+	nat_sim.mem = mmap(NULL, len, prot,
+										 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (MAP_FAILED == nat_sim.mem) {
+		nat_sim.mem = NULL;
+		return MAP_FAILED;
+	}
+	nat_sim.mem_len = len;
+
+	return nat_sim.mem;
+}
+
+static int ipa_nat_sim_munmap(void *addr, size_t len)
+{
+	(void)len;
+
+	if (NULL == nat_sim.mem || addr != nat_sim.mem) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	munmap(nat_sim.mem, nat_sim.mem_len);
+	nat_sim.mem = NULL;
+	nat_sim.mem_len = 0;
+
+	return 0;
+}
+
+/**
+ * ipa_nat_sim_init_tbl() - IPA_IOC_V4_INIT_NAT
+ * @cmd: [in] table layout
+ *
+ * Returns: 0 on success, negative on failure
+ */
+static int ipa_nat_sim_init_tbl(const struct ipa_ioc_v4_nat_init *cmd)
+{
+	uint32_t tbl_end;
+
+	if (cmd->tbl_index >= IPA_NAT_MAX_IP4_TBLS || NULL == nat_sim.mem) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	/* The index expansion table is the last one */
+	tbl_end = cmd->index_expn_offset +
+		(cmd->expn_table_entries * IPA_NAT_INDEX_TABLE_ENTRY_SIZE);
+	if (tbl_end > nat_sim.mem_len) {
+		IPAERR("tables end at %d, past the %d bytes mapped\n",
+					 tbl_end, (int)nat_sim.mem_len);
+		errno = EINVAL;
+		return -1;
+	}
+
+	memcpy(&nat_sim.tbl[cmd->tbl_index], cmd, sizeof(*cmd));
+	nat_sim.tbl_valid[cmd->tbl_index] = 1;
+
+	return 0;
+}
+
+/**
+ * ipa_nat_sim_dma_addr() - table memory a dma entry writes to
+ * @dma: [in] one entry of a dma command
+ *
+ * Returns: address of the 16 bits to write, NULL if out of range
+ */
+static uint16_t *ipa_nat_sim_dma_addr(const struct ipa_ioc_nat_dma_one *dma)
+{
+	const struct ipa_ioc_v4_nat_init *tbl;
+	uint32_t offset;
+
+	if (dma->table_index >= IPA_NAT_MAX_IP4_TBLS ||
+			!nat_sim.tbl_valid[dma->table_index]) {
+		return NULL;
+	}
+	tbl = &nat_sim.tbl[dma->table_index];
+
+	switch (dma->base_addr) {
+	case IPA_NAT_BASE_TBL:
+		offset = tbl->ipv4_rules_offset;
+		break;
+	case IPA_NAT_EXPN_TBL:
+		offset = tbl->expn_rules_offset;
+		break;
+	case IPA_NAT_INDX_TBL:
+		offset = tbl->index_offset;
+		break;
+	case IPA_NAT_INDEX_EXPN_TBL:
+		offset = tbl->index_expn_offset;
+		break;
+	default:
+		return NULL;
+	}
+
+	offset += dma->offset;
+	if (offset + sizeof(uint16_t) > nat_sim.mem_len || (offset % 2)) {
+		return NULL;
+	}
+
+	return (uint16_t *)(nat_sim.mem + offset);
+}
+
+/**
+ * ipa_nat_sim_dma() - IPA_IOC_NAT_DMA
+ * @cmd: [in] dma command
+ *
+ * Like the ipa driver, the whole command is rejected when any
+ * of its entries is invalid, otherwise the entries are written
+ * in order
+ *
+ * Returns: 0 on success, negative on failure
+ */
+static int ipa_nat_sim_dma(const struct ipa_ioc_nat_dma_cmd *cmd)
+{
+	int cnt;
+
+	for (cnt = 0; cnt < cmd->entries; cnt++) {
+		if (NULL == ipa_nat_sim_dma_addr(&cmd->dma[cnt])) {
+			IPAERR("invalid dma entry %d: table %d base %d offset %d\n",
+						 cnt, cmd->dma[cnt].table_index,
+						 cmd->dma[cnt].base_addr, cmd->dma[cnt].offset);
+			errno = EINVAL;
+			return -1;
+		}
+	}
+
+	for (cnt = 0; cnt < cmd->entries; cnt++) {
+		*ipa_nat_sim_dma_addr(&cmd->dma[cnt]) = cmd->dma[cnt].data;
+	}
+
+	return 0;
+}
+
+static int ipa_nat_sim_ioctl(int fd, unsigned long req, void *arg)
+{
+	struct ipa_ioc_nat_alloc_mem *mem;
+	struct ipa_ioc_v4_nat_del *del;
+
+	if (IPA_NAT_SIM_IPA_FD != fd || !nat_sim.ipa_open || NULL == arg) {
+		errno = EBADF;
+		return -1;
+	}
+
+	switch (req) {
+	case IPA_IOC_ALLOC_NAT_MEM:
+		mem = (struct ipa_ioc_nat_alloc_mem *)arg;
+		if (nat_sim.mem_size) {
+			errno = EPERM;
+			return -1;
+		}
+		nat_sim.mem_size = mem->size;
+		mem->offset = 0;
+		return 0;
+
+	case IPA_IOC_V4_INIT_NAT:
+		return ipa_nat_sim_init_tbl((struct ipa_ioc_v4_nat_init *)arg);
+
+	case IPA_IOC_NAT_DMA:
+		return ipa_nat_sim_dma((struct ipa_ioc_nat_dma_cmd *)arg);
+
+	case IPA_IOC_V4_DEL_NAT:
+		del = (struct ipa_ioc_v4_nat_del *)arg;
+		if (del->table_index >= IPA_NAT_MAX_IP4_TBLS ||
+				!nat_sim.tbl_valid[del->table_index]) {
+			errno = EINVAL;
+			return -1;
+		}
+		nat_sim.tbl_valid[del->table_index] = 0;
+		/* the nat memory goes along with the table */
+		nat_sim.mem_size = 0;
+		return 0;
+
+#ifdef IPA_ON_R3PC
+	case IPA_IOC_GET_NAT_OFFSET:
+		*(uint32_t *)arg = 0;
+		return 0;
+#endif
+
+	default:
+		errno = ENOTTY;
+		return -1;
+	}
+}
+
+const struct ipa_nat_ops ipa_nat_sim_ops = {
+	.open_dev = ipa_nat_sim_open,
+	.close_dev = ipa_nat_sim_close,
+	.ioctl_dev = ipa_nat_sim_ioctl,
+	.mmap_dev = ipa_nat_sim_mmap,
+	.munmap_dev = ipa_nat_sim_munmap,
+};
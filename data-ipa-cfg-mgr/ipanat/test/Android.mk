@@ -38,6 +38,12 @@ LOCAL_SRC_FILES := ipa_nat_test000.c \
 		ipa_nat_test020.c \
 		ipa_nat_test021.c \
 		ipa_nat_test022.c \
+		ipa_nat_test023.c \
+		ipa_nat_test024.c \
+		ipa_nat_test025.c \
+		ipa_nat_test026.c \
+		ipa_nat_test027.c \
+		ipa_nat_test028.c \
 		main.c
 
 
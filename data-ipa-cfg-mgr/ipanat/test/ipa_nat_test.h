@@ -43,6 +43,9 @@
 /*============ Preconditions to run NAT Test cases =========*/
 #define IPA_NAT_TEST_PRE_COND_TE  20
 
+/*============ Hash analysis of recorded flows =========*/
+#define IPA_NAT_TEST_MAX_FLOWS  65535
+
 #define CHECK_ERR1(x, tbl_hdl) \
   if(ipa_nat_validate_ipv4_table(tbl_hdl)) { \
     if(sep) {\
@@ -78,6 +81,8 @@
 
 #define NAT_DUMP
 int ipa_nat_validate_ipv4_table(u32);
+u8 *ipa_nat_save_ipv4_table(u32, int *);
+int ipa_nat_hash_report(const char *, int);
 
 int ipa_nat_test000(int, u32, u8);
 int ipa_nat_test001(int, u32, u8);
@@ -102,3 +107,9 @@ int ipa_nat_test019(int, u32, u8);
 int ipa_nat_test020(int, u32, u8);
 int ipa_nat_test021(int, int);
 int ipa_nat_test022(int, u32, u8);
+int ipa_nat_test023(int, u32, u8);
+int ipa_nat_test024(int, u32, u8);
+int ipa_nat_test025(int, u32, u8);
+int ipa_nat_test026(int, int);
+int ipa_nat_test027(int, u32, u8);
+int ipa_nat_test028(int, u32, u8);
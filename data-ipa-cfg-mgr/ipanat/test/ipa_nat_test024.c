@@ -0,0 +1,314 @@
+/*
+ * Copyright (c) 2016, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *  * Neither the name of The Linux Foundation nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*=========================================================================*/
+/*!
+	@file
+	ipa_nat_test024.c
+
+	@brief
+	Verify the following scenario:
+	1. Add ipv4 table
+	2. add 4 ipv4 rules one by one, two of them collide
+	3. delete all the rules with one bulk call
+	4. Delete ipv4 table
+	5. On a larger table, add 120 rules one by one, some of them in
+	   the expansion tables, delete 80 of them one by one
+	6. delete the rest, add the 120 rules again and delete the same
+	   80 rules with one bulk call, spanning several dma commands
+	7. compare the handles left and the table with the ones of step 5
+	8. delete the rest with one bulk call, the table must be empty again
+*/
+/*=========================================================================*/
+
+#include "ipa_nat_test.h"
+#include "ipa_nat_drv.h"
+
+#include <stdlib.h>
+
+#define IPA_NAT_TEST024_RULES 4
+#define IPA_NAT_TEST024_BULK_RULES 120
+#define IPA_NAT_TEST024_BULK_ENTRIES 512
+
+/* Rules deleted first, heads, middles and tails of the chains */
+#define IPA_NAT_TEST024_DEL_FIRST(cnt) ((cnt) % 3 != 2)
+
+static void ipa_nat_test024_fill(ipa_nat_ipv4_rule *ipv4_rules, int num_rules)
+{
+	int cnt;
+
+	memset(ipv4_rules, 0, num_rules * sizeof(ipa_nat_ipv4_rule));
+
+	for (cnt = 0; cnt < num_rules; cnt++)
+	{
+		/* Every fourth rule repeats the one before, so the pair
+		   collides in both tables and spills into expansion */
+		if (cnt % 4 == 3)
+		{
+			ipv4_rules[cnt] = ipv4_rules[cnt - 1];
+			continue;
+		}
+
+		ipv4_rules[cnt].target_ip = 0xC1171600 + (cnt % 61); /* 193.23.22.x */
+		ipv4_rules[cnt].target_port = 1234 + (cnt % 7);
+		ipv4_rules[cnt].private_ip = 0xC2171600 + (cnt % 53); /* 194.23.22.x */
+		ipv4_rules[cnt].private_port = 5678 + cnt;
+		ipv4_rules[cnt].protocol = (cnt % 2) ? IPPROTO_UDP : IPPROTO_TCP;
+		ipv4_rules[cnt].public_port = 9050 + cnt;
+	}
+}
+
+static int ipa_nat_test024_add(u32 tbl_hdl,
+		const ipa_nat_ipv4_rule *ipv4_rules,
+		u32 *rule_hdls)
+{
+	int cnt;
+
+	for (cnt = 0; cnt < IPA_NAT_TEST024_BULK_RULES; cnt++)
+	{
+		if (ipa_nat_add_ipv4_rule(tbl_hdl, &ipv4_rules[cnt], &rule_hdls[cnt]))
+		{
+			IPAERR("unable to add rule %d\n", cnt);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/* Bulk deletes the rules picked by first, all of them must go */
+static int ipa_nat_test024_del(u32 tbl_hdl, const u32 *rule_hdls, int first)
+{
+	u32 del_hdls[IPA_NAT_TEST024_BULK_RULES];
+	int cnt, num = 0;
+
+	for (cnt = 0; cnt < IPA_NAT_TEST024_BULK_RULES; cnt++)
+	{
+		if (IPA_NAT_TEST024_DEL_FIRST(cnt) == first)
+		{
+			del_hdls[num++] = rule_hdls[cnt];
+		}
+	}
+
+	if (ipa_nat_del_ipv4_rules(tbl_hdl, del_hdls, num))
+	{
+		IPAERR("unable to delete %d rules in bulk\n", num);
+		return -1;
+	}
+
+	for (cnt = 0; cnt < num; cnt++)
+	{
+		if (del_hdls[cnt])
+		{
+			IPAERR("handle %d left after bulk delete\n", del_hdls[cnt]);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static int ipa_nat_test024_bulk(u32 tbl_hdl)
+{
+	int ret = -1, cnt, size;
+	u32 seq_hdls[IPA_NAT_TEST024_BULK_RULES];
+	u32 bulk_hdls[IPA_NAT_TEST024_BULK_RULES];
+	ipa_nat_ipv4_rule ipv4_rules[IPA_NAT_TEST024_BULK_RULES];
+	u8 *empty_tbl = NULL, *seq_tbl = NULL, *bulk_tbl = NULL;
+
+	ipa_nat_test024_fill(ipv4_rules, IPA_NAT_TEST024_BULK_RULES);
+
+	empty_tbl = ipa_nat_save_ipv4_table(tbl_hdl, &size);
+	if (empty_tbl == NULL)
+		goto done;
+
+	if (ipa_nat_test024_add(tbl_hdl, ipv4_rules, seq_hdls))
+		goto done;
+
+	for (cnt = 0; cnt < IPA_NAT_TEST024_BULK_RULES; cnt++)
+	{
+		if (IPA_NAT_TEST024_DEL_FIRST(cnt) &&
+				ipa_nat_del_ipv4_rule(tbl_hdl, seq_hdls[cnt]))
+		{
+			IPAERR("unable to delete rule %d\n", cnt);
+			goto done;
+		}
+	}
+
+	seq_tbl = ipa_nat_save_ipv4_table(tbl_hdl, &size);
+	if (seq_tbl == NULL)
+		goto done;
+
+	for (cnt = 0; cnt < IPA_NAT_TEST024_BULK_RULES; cnt++)
+	{
+		if (!IPA_NAT_TEST024_DEL_FIRST(cnt) &&
+				ipa_nat_del_ipv4_rule(tbl_hdl, seq_hdls[cnt]))
+		{
+			IPAERR("unable to delete rule %d\n", cnt);
+			goto done;
+		}
+	}
+
+	/* Same rules on the same empty table, so the same handles */
+	if (ipa_nat_test024_add(tbl_hdl, ipv4_rules, bulk_hdls))
+		goto done;
+
+	for (cnt = 0; cnt < IPA_NAT_TEST024_BULK_RULES; cnt++)
+	{
+		if (bulk_hdls[cnt] != seq_hdls[cnt])
+		{
+			IPAERR("rule %d: handle %d, handle %d the first time\n",
+				cnt, bulk_hdls[cnt], seq_hdls[cnt]);
+			goto done;
+		}
+	}
+
+	if (ipa_nat_test024_del(tbl_hdl, bulk_hdls, 1))
+		goto done;
+
+	if (ipa_nat_validate_ipv4_table(tbl_hdl))
+		goto done;
+
+	bulk_tbl = ipa_nat_save_ipv4_table(tbl_hdl, &size);
+	if (bulk_tbl == NULL || memcmp(bulk_tbl, seq_tbl, size))
+	{
+		IPAERR("bulk delete left a different table\n");
+		goto done;
+	}
+
+	/* The rules left must still be there under their handles */
+	if (ipa_nat_test024_del(tbl_hdl, bulk_hdls, 0))
+		goto done;
+
+	free(bulk_tbl);
+	bulk_tbl = ipa_nat_save_ipv4_table(tbl_hdl, &size);
+	if (bulk_tbl == NULL || memcmp(bulk_tbl, empty_tbl, size))
+	{
+		IPAERR("table not empty after deleting all the rules\n");
+		goto done;
+	}
+
+	ret = 0;
+
+done:
+	free(empty_tbl);
+	free(seq_tbl);
+	free(bulk_tbl);
+	return ret;
+}
+
+int ipa_nat_test024(int total_entries, u32 tbl_hdl, u8 sep)
+{
+	int ret, cnt;
+	u32 bulk_tbl_hdl;
+	u32 rule_hdls[IPA_NAT_TEST024_RULES];
+	ipa_nat_ipv4_rule ipv4_rules[IPA_NAT_TEST024_RULES];
+
+	u32 pub_ip_add = 0x011617c0;   /* "192.23.22.1" */
+
+	memset(ipv4_rules, 0, sizeof(ipv4_rules));
+
+	/* Rule 1 and 2 are same, so they collide */
+	for (cnt = 0; cnt < 2; cnt++)
+	{
+		ipv4_rules[cnt].target_ip = 0xC1171601; /* 193.23.22.1 */
+		ipv4_rules[cnt].target_port = 1234;
+		ipv4_rules[cnt].private_ip = 0xC2171601; /* 194.23.22.1 */
+		ipv4_rules[cnt].private_port = 5678;
+		ipv4_rules[cnt].protocol = IPPROTO_TCP;
+		ipv4_rules[cnt].public_port = 9050;
+	}
+
+	/* Rule 3 */
+	ipv4_rules[2].target_ip = 0xC1171602; /* 193.23.22.2 */
+	ipv4_rules[2].target_port = 1235;
+	ipv4_rules[2].private_ip = 0xC2171602; /* 194.23.22.2 */
+	ipv4_rules[2].private_port = 5679;
+	ipv4_rules[2].protocol = IPPROTO_UDP;
+	ipv4_rules[2].public_port = 9051;
+
+	/* Rule 4 */
+	ipv4_rules[3].target_ip = 0xC1171603; /* 193.23.22.3 */
+	ipv4_rules[3].target_port = 1236;
+	ipv4_rules[3].private_ip = 0xC2171603; /* 194.23.22.3 */
+	ipv4_rules[3].private_port = 5680;
+	ipv4_rules[3].protocol = IPPROTO_TCP;
+	ipv4_rules[3].public_port = 9052;
+
+	IPADBG("%s():\n",__FUNCTION__);
+
+	if(sep)
+	{
+		ret = ipa_nat_add_ipv4_tbl(pub_ip_add, total_entries, &tbl_hdl);
+		CHECK_ERR1(ret, tbl_hdl);
+	}
+
+	for (cnt = 0; cnt < IPA_NAT_TEST024_RULES; cnt++)
+	{
+		ret = ipa_nat_add_ipv4_rule(tbl_hdl, &ipv4_rules[cnt], &rule_hdls[cnt]);
+		CHECK_ERR1(ret, tbl_hdl);
+	}
+
+	ret = ipa_nat_del_ipv4_rules(tbl_hdl, rule_hdls, IPA_NAT_TEST024_RULES);
+	CHECK_ERR1(ret, tbl_hdl);
+
+	if(sep)
+	{
+		ret = ipa_nat_del_ipv4_tbl(tbl_hdl);
+		CHECK_ERR(ret);
+	}
+
+	/* The bulk rules need a table of their own, only one may exist */
+	if(!sep)
+	{
+		ret = ipa_nat_del_ipv4_tbl(tbl_hdl);
+		CHECK_ERR(ret);
+	}
+
+	ret = ipa_nat_add_ipv4_tbl(pub_ip_add, IPA_NAT_TEST024_BULK_ENTRIES,
+				&bulk_tbl_hdl);
+	CHECK_ERR(ret);
+
+	ret = ipa_nat_test024_bulk(bulk_tbl_hdl);
+	ipa_nat_del_ipv4_tbl(bulk_tbl_hdl);
+	CHECK_ERR(ret);
+
+	if(!sep)
+	{
+		ret = ipa_nat_add_ipv4_tbl(pub_ip_add, total_entries, &bulk_tbl_hdl);
+		CHECK_ERR(ret);
+		if (bulk_tbl_hdl != tbl_hdl)
+		{
+			IPAERR("table came back with handle %d\n", bulk_tbl_hdl);
+			return -1;
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,143 @@
+/*
+ * Copyright (c) 2016, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *  * Neither the name of The Linux Foundation nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*=========================================================================*/
+/*!
+	@file
+	ipa_nat_test025.c
+
+	@brief
+	Verify the following scenario:
+	1. Analyze the hash for 64 flows of 16 clients to one server:443
+	2. Check the chain histograms add up
+	3. Get the recommended table size for at most 8 rules per chain
+	4. Add ipv4 table of recommended size
+	5. add all the flows with one bulk call and delete them again
+	6. Delete ipv4 table
+*/
+/*=========================================================================*/
+
+#include "ipa_nat_test.h"
+#include "ipa_nat_drv.h"
+
+#define IPA_NAT_TEST025_RULES 64
+#define IPA_NAT_TEST025_MAX_CHAIN 8
+
+static int ipa_nat_test025_chk(const ipa_nat_chain_stats *chain, int rules)
+{
+	int cnt, used = 0;
+
+	for (cnt = 0; cnt < IPA_NAT_CHAIN_HIST_LEN; cnt++)
+	{
+		used += chain->chain_hist[cnt];
+	}
+
+	if (used != chain->used_entries ||
+			chain->used_entries + chain->expn_entries != rules)
+	{
+		IPAERR("used %d, expansion %d for %d rules\n",
+			chain->used_entries, chain->expn_entries, rules);
+		return -1;
+	}
+
+	return 0;
+}
+
+int ipa_nat_test025(int total_entries, u32 tbl_hdl, u8 sep)
+{
+	int ret, cnt;
+	u16 table_entries, expn_table_entries;
+	u32 rule_hdls[IPA_NAT_TEST025_RULES];
+	ipa_nat_ipv4_rule ipv4_rules[IPA_NAT_TEST025_RULES];
+	ipa_nat_hash_stats stats;
+
+	u32 pub_ip_add = 0x011617c0;   /* "192.23.22.1" */
+
+	memset(ipv4_rules, 0, sizeof(ipv4_rules));
+	for (cnt = 0; cnt < IPA_NAT_TEST025_RULES; cnt++)
+	{
+		ipv4_rules[cnt].target_ip = 0xC1171601; /* 193.23.22.1 */
+		ipv4_rules[cnt].target_port = 443;
+		ipv4_rules[cnt].private_ip = 0xC0A80102 + (cnt % 16); /* 192.168.1.x */
+		ipv4_rules[cnt].private_port = 40000 + cnt;
+		ipv4_rules[cnt].protocol = IPPROTO_TCP;
+		ipv4_rules[cnt].public_port = 9050 + cnt;
+	}
+
+	IPADBG("%s():\n",__FUNCTION__);
+
+	ret = ipa_nat_analyze_ipv4_hash(ipv4_rules, IPA_NAT_TEST025_RULES,
+						64, 16, &stats);
+	CHECK_ERR(ret);
+
+	ret = ipa_nat_test025_chk(&stats.rule_tbl, IPA_NAT_TEST025_RULES);
+	CHECK_ERR(ret);
+	ret = ipa_nat_test025_chk(&stats.index_tbl, IPA_NAT_TEST025_RULES);
+	CHECK_ERR(ret);
+
+	ret = ipa_nat_recommend_ipv4_tbl(ipv4_rules, IPA_NAT_TEST025_RULES,
+						IPA_NAT_TEST025_MAX_CHAIN,
+						&table_entries, &expn_table_entries);
+	CHECK_ERR(ret);
+	IPADBG("recommended table entries %d, expansion entries %d\n",
+		table_entries, expn_table_entries);
+
+	/* The recommended size has to hold up to its own analysis */
+	ret = ipa_nat_analyze_ipv4_hash(ipv4_rules, IPA_NAT_TEST025_RULES,
+						table_entries, expn_table_entries, &stats);
+	CHECK_ERR(ret);
+	if (stats.rule_tbl.max_chain > IPA_NAT_TEST025_MAX_CHAIN ||
+			stats.index_tbl.max_chain > IPA_NAT_TEST025_MAX_CHAIN ||
+			stats.expn_overflow)
+	{
+		IPAERR("recommended size does not fit the flows\n");
+		return -1;
+	}
+
+	/* Only one table at a time, the suite table is in use otherwise */
+	if(sep)
+	{
+		ret = ipa_nat_add_ipv4_tbl_sized(pub_ip_add, table_entries,
+						expn_table_entries, &tbl_hdl);
+		CHECK_ERR(ret);
+
+		ret = ipa_nat_add_ipv4_rules(tbl_hdl, ipv4_rules,
+						IPA_NAT_TEST025_RULES, rule_hdls);
+		CHECK_ERR1(ret, tbl_hdl);
+
+		ret = ipa_nat_del_ipv4_rules(tbl_hdl, rule_hdls,
+						IPA_NAT_TEST025_RULES);
+		CHECK_ERR1(ret, tbl_hdl);
+
+		ret = ipa_nat_del_ipv4_tbl(tbl_hdl);
+		CHECK_ERR(ret);
+	}
+
+	return 0;
+}
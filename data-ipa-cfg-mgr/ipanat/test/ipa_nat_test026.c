@@ -0,0 +1,241 @@
+/*
+ * Copyright (c) 2016, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *  * Neither the name of The Linux Foundation nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*=========================================================================*/
+/*!
+	@file
+	ipa_nat_test026.c
+
+	@brief
+	Timestamp query contention benchmark:
+	1. Add ipv4 table and fill half of it
+	2. Add and delete one more rule over and over for the given
+	   time, alone and then with a second thread querying the
+	   timestamps of all the other rules
+	3. Print the rates of both threads
+	4. Delete ipv4 table
+*/
+/*=========================================================================*/
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include "ipa_nat_test.h"
+#include "ipa_nat_drv.h"
+
+struct ipa_nat_test026_ctx {
+	u32 tbl_hdl;
+	u32 *rule_hdls;
+	int num_rules;
+	volatile int stop;
+	unsigned long ops;
+	int err;
+};
+
+static void ipa_nat_test026_rule(ipa_nat_ipv4_rule *rule, int cnt)
+{
+	memset(rule, 0, sizeof(*rule));
+	/* Only the ports vary so that the rules spread over the table */
+	rule->target_ip = 0xC1171601; /* 193.23.22.1 */
+	rule->target_port = 443;
+	rule->private_ip = 0xC0A80102; /* 192.168.1.2 */
+	rule->private_port = 30000 + cnt;
+	rule->protocol = IPPROTO_TCP;
+	rule->public_port = 10000 + cnt;
+}
+
+static void *ipa_nat_test026_writer(void *arg)
+{
+	struct ipa_nat_test026_ctx *ctx = (struct ipa_nat_test026_ctx *)arg;
+	ipa_nat_ipv4_rule rule;
+	u32 rule_hdl;
+
+	ipa_nat_test026_rule(&rule, ctx->num_rules);
+	while (!ctx->stop)
+	{
+		if (ipa_nat_add_ipv4_rule(ctx->tbl_hdl, &rule, &rule_hdl) ||
+				ipa_nat_del_ipv4_rule(ctx->tbl_hdl, rule_hdl))
+		{
+			ctx->err = 1;
+			break;
+		}
+		ctx->ops++;
+	}
+
+	return NULL;
+}
+
+static void *ipa_nat_test026_reader(void *arg)
+{
+	struct ipa_nat_test026_ctx *ctx = (struct ipa_nat_test026_ctx *)arg;
+	u32 time_stamp;
+	int cnt;
+
+	while (!ctx->stop)
+	{
+		for (cnt = 0; cnt < ctx->num_rules; cnt++)
+		{
+			if (ipa_nat_query_timestamp(ctx->tbl_hdl, ctx->rule_hdls[cnt],
+						&time_stamp))
+			{
+				ctx->err = 1;
+				return NULL;
+			}
+		}
+		ctx->ops += ctx->num_rules;
+	}
+
+	return NULL;
+}
+
+/* Runs the writer, and the reader if asked for, for secs seconds */
+static int ipa_nat_test026_run(struct ipa_nat_test026_ctx *writer,
+				struct ipa_nat_test026_ctx *reader, int secs)
+{
+	pthread_t writer_thread, reader_thread;
+
+	writer->stop = 0;
+	writer->ops = 0;
+	if (pthread_create(&writer_thread, NULL, ipa_nat_test026_writer, writer))
+	{
+		IPAERR("unable to start writer\n");
+		return -1;
+	}
+
+	if (reader)
+	{
+		reader->stop = 0;
+		reader->ops = 0;
+		if (pthread_create(&reader_thread, NULL, ipa_nat_test026_reader, reader))
+		{
+			IPAERR("unable to start reader\n");
+			reader = NULL;
+		}
+	}
+
+	sleep(secs);
+
+	writer->stop = 1;
+	pthread_join(writer_thread, NULL);
+	if (reader)
+	{
+		reader->stop = 1;
+		pthread_join(reader_thread, NULL);
+	}
+
+	return (writer->err || (reader && reader->err)) ? -1 : 0;
+}
+
+int ipa_nat_test026(int total_entries, int secs)
+{
+	int ret, cnt;
+	u32 tbl_hdl;
+	unsigned long alone;
+	ipa_nat_ipv4_rule *rules;
+	struct ipa_nat_test026_ctx writer, reader;
+
+	u32 pub_ip_add = 0x011617c0;   /* "192.23.22.1" */
+
+	IPADBG("%s():\n",__FUNCTION__);
+
+	if (secs <= 0 || total_entries < 4)
+	{
+		IPAERR("invalid parameters\n");
+		return -1;
+	}
+
+	memset(&writer, 0, sizeof(writer));
+	memset(&reader, 0, sizeof(reader));
+	reader.num_rules = total_entries / 2;
+	rules = (ipa_nat_ipv4_rule *)calloc(reader.num_rules, sizeof(ipa_nat_ipv4_rule));
+	reader.rule_hdls = (u32 *)calloc(reader.num_rules, sizeof(u32));
+	if (NULL == rules || NULL == reader.rule_hdls)
+	{
+		IPAERR("unable to allocate rules\n");
+		free(rules);
+		free(reader.rule_hdls);
+		return -1;
+	}
+
+	for (cnt = 0; cnt < reader.num_rules; cnt++)
+	{
+		ipa_nat_test026_rule(&rules[cnt], cnt);
+	}
+
+	ret = ipa_nat_add_ipv4_tbl(pub_ip_add, total_entries, &tbl_hdl);
+	if (ret)
+	{
+		IPAERR("unable to create table %d\n", ret);
+		free(rules);
+		free(reader.rule_hdls);
+		return -1;
+	}
+
+	ret = ipa_nat_add_ipv4_rules(tbl_hdl, rules, reader.num_rules,
+					reader.rule_hdls);
+	if (ret)
+	{
+		IPAERR("unable to fill table %d\n", ret);
+		goto done;
+	}
+
+	writer.tbl_hdl = tbl_hdl;
+	writer.num_rules = reader.num_rules;
+	reader.tbl_hdl = tbl_hdl;
+
+	ret = ipa_nat_test026_run(&writer, NULL, secs);
+	if (ret)
+	{
+		goto done;
+	}
+	alone = writer.ops;
+
+	ret = ipa_nat_test026_run(&writer, &reader, secs);
+	if (ret)
+	{
+		goto done;
+	}
+
+	printf("add+del alone: %lu/s\n", alone / secs);
+	printf("add+del with queries: %lu/s\n", writer.ops / secs);
+	printf("timestamp queries: %lu/s over %d rules\n",
+		reader.ops / secs, reader.num_rules);
+
+done:
+	if (ret)
+	{
+		IPAERR("benchmark failed\n");
+	}
+	ipa_nat_del_ipv4_rules(tbl_hdl, reader.rule_hdls, reader.num_rules);
+	ipa_nat_del_ipv4_tbl(tbl_hdl);
+	free(rules);
+	free(reader.rule_hdls);
+
+	return ret ? -1 : 0;
+}
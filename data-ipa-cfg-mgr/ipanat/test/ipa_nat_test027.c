@@ -0,0 +1,191 @@
+/*
+ * Copyright (c) 2016, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *  * Neither the name of The Linux Foundation nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*=========================================================================*/
+/*!
+	@file
+	ipa_nat_test027.c
+
+	@brief
+	Verify the following scenario:
+	1. Add ipv4 table
+	2. add 4 ipv4 rules, two of them collide
+	3. query all the timestamps with one bulk call
+	4. delete the first of the colliding rules and query again
+	5. Delete the rules and the ipv4 table
+*/
+/*=========================================================================*/
+
+#include <stdlib.h>
+
+#include "ipa_nat_test.h"
+#include "ipa_nat_drv.h"
+
+#define IPA_NAT_TEST027_RULES 4
+
+/* The table may hold rules of earlier tests, look for ours */
+static int ipa_nat_test027_find(const ipa_nat_ipv4_timestamp *time_stamps,
+		u16 num_entries, u32 rule_hdl)
+{
+	int cnt;
+
+	for (cnt = 0; cnt < num_entries; cnt++)
+	{
+		if (time_stamps[cnt].rule_hdl == rule_hdl)
+		{
+			return cnt;
+		}
+	}
+
+	return -1;
+}
+
+static int ipa_nat_test027_check(u32 tbl_hdl,
+		const u32 *rule_hdls,
+		const ipa_nat_ipv4_rule *ipv4_rules,
+		int first_rule)
+{
+	int ret = 0, cnt, found;
+	u16 num_entries;
+	ipa_nat_ipv4_timestamp *time_stamps;
+
+	time_stamps = malloc(IPA_NAT_TEST_MAX_FLOWS * sizeof(ipa_nat_ipv4_timestamp));
+	if (time_stamps == NULL)
+	{
+		IPAERR("unable to allocate memory\n");
+		return -1;
+	}
+
+	ret = ipa_nat_query_timestamps_bulk(tbl_hdl, time_stamps,
+				IPA_NAT_TEST_MAX_FLOWS, &num_entries);
+	if (ret)
+	{
+		IPAERR("%d\n", ret);
+		goto done;
+	}
+
+	for (cnt = 0; cnt < IPA_NAT_TEST027_RULES; cnt++)
+	{
+		found = ipa_nat_test027_find(time_stamps, num_entries, rule_hdls[cnt]);
+		if (cnt < first_rule)
+		{
+			if (found >= 0)
+			{
+				IPAERR("deleted rule handle %d in timestamps\n", rule_hdls[cnt]);
+				ret = -1;
+			}
+			continue;
+		}
+
+		if (found < 0 ||
+				time_stamps[found].protocol != ipv4_rules[cnt].protocol)
+		{
+			IPAERR("rule handle %d missing from timestamps\n", rule_hdls[cnt]);
+			ret = -1;
+		}
+	}
+
+done:
+	free(time_stamps);
+	return ret;
+}
+
+int ipa_nat_test027(int total_entries, u32 tbl_hdl, u8 sep)
+{
+	int ret, cnt;
+	u32 rule_hdls[IPA_NAT_TEST027_RULES];
+	ipa_nat_ipv4_rule ipv4_rules[IPA_NAT_TEST027_RULES];
+
+	u32 pub_ip_add = 0x011617c0;   /* "192.23.22.1" */
+
+	memset(ipv4_rules, 0, sizeof(ipv4_rules));
+
+	/* Rule 1 and 2 are same, so they collide */
+	for (cnt = 0; cnt < 2; cnt++)
+	{
+		ipv4_rules[cnt].target_ip = 0xC1171601; /* 193.23.22.1 */
+		ipv4_rules[cnt].target_port = 1234;
+		ipv4_rules[cnt].private_ip = 0xC2171601; /* 194.23.22.1 */
+		ipv4_rules[cnt].private_port = 5678;
+		ipv4_rules[cnt].protocol = IPPROTO_TCP;
+		ipv4_rules[cnt].public_port = 9050;
+	}
+
+	/* Rule 3 */
+	ipv4_rules[2].target_ip = 0xC1171602; /* 193.23.22.2 */
+	ipv4_rules[2].target_port = 1235;
+	ipv4_rules[2].private_ip = 0xC2171602; /* 194.23.22.2 */
+	ipv4_rules[2].private_port = 5679;
+	ipv4_rules[2].protocol = IPPROTO_UDP;
+	ipv4_rules[2].public_port = 9051;
+
+	/* Rule 4 */
+	ipv4_rules[3].target_ip = 0xC1171603; /* 193.23.22.3 */
+	ipv4_rules[3].target_port = 1236;
+	ipv4_rules[3].private_ip = 0xC2171603; /* 194.23.22.3 */
+	ipv4_rules[3].private_port = 5680;
+	ipv4_rules[3].protocol = IPPROTO_UDP;
+	ipv4_rules[3].public_port = 9052;
+
+	IPADBG("%s():\n",__FUNCTION__);
+
+	if(sep)
+	{
+		ret = ipa_nat_add_ipv4_tbl(pub_ip_add, total_entries, &tbl_hdl);
+		CHECK_ERR1(ret, tbl_hdl);
+	}
+
+	for (cnt = 0; cnt < IPA_NAT_TEST027_RULES; cnt++)
+	{
+		ret = ipa_nat_add_ipv4_rule(tbl_hdl, &ipv4_rules[cnt], &rule_hdls[cnt]);
+		CHECK_ERR1(ret, tbl_hdl);
+	}
+
+	ret = ipa_nat_test027_check(tbl_hdl, rule_hdls, ipv4_rules, 0);
+	CHECK_ERR1(ret, tbl_hdl);
+
+	/* The head entry stays behind until the next delete, it must
+		 not be reported */
+	ret = ipa_nat_del_ipv4_rule(tbl_hdl, rule_hdls[0]);
+	CHECK_ERR1(ret, tbl_hdl);
+
+	ret = ipa_nat_test027_check(tbl_hdl, rule_hdls, ipv4_rules, 1);
+	CHECK_ERR1(ret, tbl_hdl);
+
+	ret = ipa_nat_del_ipv4_rules(tbl_hdl, &rule_hdls[1], IPA_NAT_TEST027_RULES - 1);
+	CHECK_ERR1(ret, tbl_hdl);
+
+	if(sep)
+	{
+		ret = ipa_nat_del_ipv4_tbl(tbl_hdl);
+		CHECK_ERR(ret);
+	}
+
+	return 0;
+}
@@ -34,6 +34,7 @@
 #include <string.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <arpa/inet.h>
 
 #include "ipa_nat_drv.h"
 #include "ipa_nat_drvi.h"
@@ -299,6 +300,142 @@ int ipa_nat_validate_ipv4_table(u32 tbl_hdl)
 	return ret;
 }
 
+/* Copy of the table memory, to tell whether rules added or
+   deleted in different ways leave the same table behind */
+u8 *ipa_nat_save_ipv4_table(u32 tbl_hdl, int *size)
+{
+	u8 *buf;
+
+	if (IPA_NAT_INVALID_NAT_ENTRY == tbl_hdl ||
+			tbl_hdl > IPA_NAT_MAX_IP4_TBLS) {
+		IPAERR("invalid table handle passed \n");
+		return NULL;
+	}
+
+	*size = ipv4_nat_cache.ip4_tbl[tbl_hdl - 1].size;
+	buf = malloc(*size);
+	if (buf == NULL) {
+		IPAERR("unable to allocate memory\n");
+		return NULL;
+	}
+
+	memcpy(buf, ipv4_nat_cache.ip4_tbl[tbl_hdl - 1].ipv4_rules_addr, *size);
+	return buf;
+}
+
+static void print_chain_stats(const char *name,
+				const ipa_nat_chain_stats *chain)
+{
+	int cnt;
+
+	printf("%s: used entries %d, expansion entries %d, longest chain %d\n",
+		name, chain->used_entries, chain->expn_entries, chain->max_chain);
+	for (cnt = 0; cnt < IPA_NAT_CHAIN_HIST_LEN; cnt++)
+	{
+		if (chain->chain_hist[cnt])
+		{
+			printf("  chain %d%s: %d\n", cnt + 1,
+				(cnt == IPA_NAT_CHAIN_HIST_LEN - 1) ? "+" : "",
+				chain->chain_hist[cnt]);
+		}
+	}
+}
+
+/* Reads recorded flows, one per line:
+	 private_ip private_port target_ip target_port public_port protocol */
+int ipa_nat_hash_report(const char *flows, int total_entries)
+{
+	FILE *fp;
+	char line[256], priv_ip[16], trgt_ip[16];
+	unsigned int priv_port, trgt_port, pub_port, proto;
+	ipa_nat_ipv4_rule *rules;
+	ipa_nat_hash_stats stats;
+	u16 num_rules = 0, table_entries, expn_table_entries;
+	u8 max_chain;
+	int ret;
+
+	rules = (ipa_nat_ipv4_rule *)calloc(IPA_NAT_TEST_MAX_FLOWS,
+						sizeof(ipa_nat_ipv4_rule));
+	if (NULL == rules)
+	{
+		IPAERR("unable to allocate flows\n");
+		return -1;
+	}
+
+	fp = fopen(flows, "r");
+	if (NULL == fp)
+	{
+		IPAERR("unable to open %s\n", flows);
+		free(rules);
+		return -1;
+	}
+
+	while (num_rules < IPA_NAT_TEST_MAX_FLOWS &&
+				 fgets(line, sizeof(line), fp) != NULL)
+	{
+		if (sscanf(line, "%15s %u %15s %u %u %u", priv_ip, &priv_port,
+					trgt_ip, &trgt_port, &pub_port, &proto) != 6)
+		{
+			continue;
+		}
+
+		rules[num_rules].private_ip = ntohl(inet_addr(priv_ip));
+		rules[num_rules].private_port = priv_port;
+		rules[num_rules].target_ip = ntohl(inet_addr(trgt_ip));
+		rules[num_rules].target_port = trgt_port;
+		rules[num_rules].public_port = pub_port;
+		rules[num_rules].protocol = proto;
+		num_rules++;
+	}
+	fclose(fp);
+
+	if (0 == num_rules)
+	{
+		IPAERR("no flows in %s\n", flows);
+		free(rules);
+		return -1;
+	}
+
+	/* Sizes ipa_nat_add_ipv4_tbl() would use today */
+	ret = ipa_nati_get_tbl_size(total_entries, &table_entries,
+						&expn_table_entries);
+	if (!ret)
+	{
+		ret = ipa_nat_analyze_ipv4_hash(rules, num_rules, table_entries,
+						expn_table_entries, &stats);
+	}
+	if (ret)
+	{
+		IPAERR("unable to analyze %d entries\n", total_entries);
+		free(rules);
+		return -1;
+	}
+
+	printf("%d flows, table entries %d, expansion entries %d\n",
+		num_rules, table_entries, expn_table_entries);
+	print_chain_stats("rule table", &stats.rule_tbl);
+	print_chain_stats("index table", &stats.index_tbl);
+	printf("flows without expansion entry: %d\n", stats.expn_overflow);
+
+	/* Smallest tables for each chain length limit */
+	for (max_chain = 1; max_chain <= IPA_NAT_CHAIN_HIST_LEN; max_chain++)
+	{
+		if (ipa_nat_recommend_ipv4_tbl(rules, num_rules, max_chain,
+							&table_entries, &expn_table_entries))
+		{
+			printf("chains of at most %d: no table size\n", max_chain);
+			continue;
+		}
+
+		printf("chains of at most %d: table entries %d, expansion entries %d"
+			" (%d%% expansion)\n", max_chain, table_entries, expn_table_entries,
+			(expn_table_entries * 100) / (table_entries + expn_table_entries));
+	}
+
+	free(rules);
+	return 0;
+}
+
 int main(int argc, char* argv[])
 {
 	int exec = 0, pass = 0, ret;
@@ -310,6 +447,13 @@ int main(int argc, char* argv[])
 
 	IPADBG("ipa_nat_testing user space nat driver\n");
 
+	/* Run against the software tables on hosts without ipa */
+	if (getenv("IPA_NAT_SIM") != NULL)
+	{
+		ret = ipa_nat_set_backend(IPA_NAT_BACKEND_SIM);
+		CHECK_ERR(ret);
+	}
+
 	if (argc == 4)
 	{
 		if (!strncmp(argv[1], "reg", 3))
@@ -324,6 +468,14 @@ int main(int argc, char* argv[])
 			nt = atoi(argv[2]);
 			total_entries = atoi(argv[3]);
 		}
+		else if (!strncmp(argv[1], "hash", 4))
+		{
+			return ipa_nat_hash_report(argv[2], atoi(argv[3]));
+		}
+		else if (!strncmp(argv[1], "tsbench", 7))
+		{
+			return ipa_nat_test026(atoi(argv[2]), atoi(argv[3]));
+		}
 	}
 	else if (argc == 3)
 	{
@@ -626,6 +778,61 @@ int main(int argc, char* argv[])
 				IPAERR("ipa_nat_test0%d Fail\n", exec);
 			}
 			exec++;
+			IPADBG("\n\nExecuting ipa_nat_test0%d\n", exec);
+			ret = ipa_nat_test023(total_entries, tbl_hdl, sep);
+			if (!ret)
+			{
+				pass++;
+			}
+			else
+			{
+				IPAERR("ipa_nat_test0%d Fail\n", exec);
+			}
+			exec++;
+			IPADBG("\n\nExecuting ipa_nat_test0%d\n", exec);
+			ret = ipa_nat_test024(total_entries, tbl_hdl, sep);
+			if (!ret)
+			{
+				pass++;
+			}
+			else
+			{
+				IPAERR("ipa_nat_test0%d Fail\n", exec);
+			}
+			exec++;
+			IPADBG("\n\nExecuting ipa_nat_test0%d\n", exec);
+			ret = ipa_nat_test025(total_entries, tbl_hdl, sep);
+			if (!ret)
+			{
+				pass++;
+			}
+			else
+			{
+				IPAERR("ipa_nat_test0%d Fail\n", exec);
+			}
+			exec++;
+			IPADBG("\n\nExecuting ipa_nat_test0%d\n", exec);
+			ret = ipa_nat_test027(total_entries, tbl_hdl, sep);
+			if (!ret)
+			{
+				pass++;
+			}
+			else
+			{
+				IPAERR("ipa_nat_test0%d Fail\n", exec);
+			}
+			exec++;
+			IPADBG("\n\nExecuting ipa_nat_test0%d\n", exec);
+			ret = ipa_nat_test028(total_entries, tbl_hdl, sep);
+			if (!ret)
+			{
+				pass++;
+			}
+			else
+			{
+				IPAERR("ipa_nat_test0%d Fail\n", exec);
+			}
+			exec++;
 		}
 
 		if (!sep)